@@ -13,10 +13,20 @@ setup(
     packages=['RPIO', 'RPIO.PWM'],
     ext_modules=[
             Extension('RPIO._GPIO', ['source/c_gpio/py_gpio.c',
-                'source/c_gpio/c_gpio.c', 'source/c_gpio/cpuinfo.c'],
+                'source/c_gpio/c_gpio.c', 'source/c_gpio/cpuinfo.c',
+                'source/c_gpio/systimer.c', 'source/c_gpio/stats.c',
+                'source/c_gpio/trace.c', 'source/c_gpio/c_events.c',
+                'source/c_gpio/counter.c', 'source/c_gpio/protocol.c',
+                'source/c_gpio/record.c', 'source/c_gpio/capture.c',
+                'source/c_gpio/rt.c', 'source/c_gpio/timed.c'],
                 extra_compile_args=["-Wno-error=declaration-after-statement"]),
             Extension('RPIO.PWM._PWM', ['source/c_pwm/pwm.c',
-                'source/c_pwm/pwm_py.c'],
+                'source/c_pwm/pwm_py.c', 'source/c_pwm/dma.c',
+                'source/c_pwm/led.c', 'source/c_pwm/shift.c',
+                'source/c_pwm/stepper.c',
+                'source/c_gpio/systimer.c',
+                'source/c_gpio/stats.c', 'source/c_gpio/trace.c'],
+                include_dirs=['source/c_gpio'],
                 extra_compile_args=["-Wno-error=declaration-after-statement"])],
     scripts=["source/scripts/rpio", "source/scripts/rpio-curses"],
 
@@ -29,9 +29,9 @@ of down to 1µs, multiple DMA channels, multiple GPIOs per channel, timing by
 PWM (default) or PCM and more. RPIO.PWM is BETA; feedback highly appreciated.
 
 You can directly access the low-level methods via PWM.init_channel(), etc. as
-well as several helpers such as the PWM.Servo class. For more information take
-a look at pythonhosted.org/RPIO as well as the source code at
-https://github.com/metachris/RPIO/blob/master/source/c_pwm
+well as several helpers such as the PWM.Servo, PWM.LedStrips and PWM.ShiftOut
+classes. For more information take a look at pythonhosted.org/RPIO as well as
+the source code at https://github.com/metachris/RPIO/blob/master/source/c_pwm
 
 Example of using `PWM.Servo`:
 
@@ -69,6 +69,9 @@ LOG_LEVEL_ERRORS = _PWM.LOG_LEVEL_ERRORS
 SUBCYCLE_TIME_US_DEFAULT = _PWM.SUBCYCLE_TIME_US_DEFAULT
 PULSE_WIDTH_INCREMENT_GRANULARITY_US_DEFAULT = \
         _PWM.PULSE_WIDTH_INCREMENT_GRANULARITY_US_DEFAULT
+LED_PERIOD_NS = _PWM.LED_PERIOD_NS
+SHIFT_PERIOD_NS = _PWM.SHIFT_PERIOD_NS
+STEPPER_TICK_NS = _PWM.STEPPER_TICK_NS
 VERSION = _PWM.VERSION
 
 
@@ -107,6 +110,14 @@ def clear_channel_gpio(channel, gpio):
     return _PWM.clear_channel_gpio(channel, gpio)
 
 
+def free_channel(channel):
+    """
+    Stops a channel and releases its DMA memory. The channel can be
+    initialized again afterwards.
+    """
+    return _PWM.free_channel(channel)
+
+
 def add_channel_pulse(dma_channel, gpio, start, width):
     """
     Add a pulse for a specific GPIO to a dma channel subcycle. `start` and
@@ -218,3 +229,212 @@ class Servo:
     def stop_servo(self, gpio):
         """ Stops servo activity for this gpio """
         clear_channel_gpio(self._dma_channel, gpio)
+
+
+class LedStrips(object):
+    """
+    Drives WS2812 (NeoPixel) or SK6812 LED strips, one per gpio, all in
+    parallel by one DMA channel. Each bit of a LED takes three periods of
+    the PWM or PCM pacer (416ns each by default); the CPU only encodes the
+    frames. Frames are double-buffered: `show()` returns as soon as the
+    frame is committed, and the strips change to it after the current frame.
+
+    Pixels are bytes (or any buffer) with the LEDs of the first strip, then
+    those of the next, each LED in RGB (RGBW) order. `order` is the order in
+    which the strips expect the bytes ("GRB" for WS2812, "GRBW" for SK6812
+    RGBW).
+
+    Example:
+
+        strips = RPIO.PWM.LedStrips([18, 23], 60)
+
+        # The first strip red, the second blue
+        strips.show(b"\\xff\\x00\\x00" * 60 + b"\\x00\\x00\\xff" * 60)
+        strips.wait()
+        strips.close()
+
+    The DMA channel (default 13) must not be used by PWM channels, and the
+    pacer must either be unused or run at the same period (PWM.setup()
+    defaults to DELAY_VIA_PWM, the strips to DELAY_VIA_PCM).
+    """
+    def __init__(self, gpios, leds, dma_channel=13, order="GRB", \
+            delay_hw=DELAY_VIA_PCM, period_ns=LED_PERIOD_NS):
+        self.gpios = list(gpios)
+        self.leds = leds
+        self.order = order
+        self._dma_channel = dma_channel
+        _PWM.led_open(dma_channel, self.gpios, leds, order, delay_hw,
+                period_ns)
+
+    def frame_bytes(self):
+        """ Returns the size of the pixels of a frame """
+        return len(self.gpios) * self.leds * len(self.order)
+
+    def show(self, pixels):
+        """
+        Outputs a frame after the current one. Waits while the previous
+        frame is still being output.
+        """
+        _PWM.led_show(self._dma_channel, pixels)
+
+    def wait(self, timeout=None):
+        """
+        Waits until all frames were output (at most `timeout` seconds).
+        Returns False on timeout.
+        """
+        timeout_ms = -1 if timeout is None else int(timeout * 1000)
+        return _PWM.led_wait(self._dma_channel, timeout_ms)
+
+    def frames(self):
+        """ Returns the number of frames which have been started """
+        return _PWM.led_frames(self._dma_channel)
+
+    def close(self):
+        """ Stops the strips, sets their gpios low and frees the channel """
+        _PWM.led_close(self._dma_channel)
+
+
+class ShiftOut(object):
+    """
+    Clocks bytes out of one or more data gpios which share a clock gpio, eg.
+    into chains of 74HC595 shift registers or SPI-like displays (SPI mode
+    0: data changes while the clock is low and is sampled on its rising
+    edge). After each frame, the optional latch gpio is pulsed. The
+    waveform is generated by a DMA channel at 2 pacer periods per bit (416ns
+    each by default, a 1.2MHz clock); the CPU only encodes the frames.
+
+    A frame has `nbytes` per data line: the bytes of the first line, then
+    those of the next. The first byte is shifted out first, by default most
+    significant bit first. Like `LedStrips`, frames are double-buffered.
+
+    Example:
+
+        # Two chains of 3 74HC595 each, sharing clock (11) and latch (8)
+        shift = RPIO.PWM.ShiftOut(11, [10, 9], 3, latch=8)
+        shift.write(b"\\x01\\x02\\x03\\x04\\x05\\x06")
+        shift.wait()
+        shift.close()
+    """
+    def __init__(self, clock, data, nbytes, latch=None, dma_channel=12, \
+            lsb_first=False, delay_hw=DELAY_VIA_PCM, \
+            period_ns=SHIFT_PERIOD_NS):
+        if isinstance(data, int):
+            data = [data]
+        self.clock = clock
+        self.data = list(data)
+        self.latch = latch
+        self.nbytes = nbytes
+        self._dma_channel = dma_channel
+        flags = _PWM.SHIFT_LSB_FIRST if lsb_first else 0
+        _PWM.shift_open(dma_channel, clock, -1 if latch is None else latch,
+                self.data, nbytes, flags, delay_hw, period_ns)
+
+    def frame_bytes(self):
+        """ Returns the size of the data of a frame """
+        return len(self.data) * self.nbytes
+
+    def write(self, data):
+        """
+        Outputs a frame after the current one. Waits while the previous
+        frame is still being output.
+        """
+        _PWM.shift_write(self._dma_channel, data)
+
+    def wait(self, timeout=None):
+        """
+        Waits until all frames were output (at most `timeout` seconds).
+        Returns False on timeout.
+        """
+        timeout_ms = -1 if timeout is None else int(timeout * 1000)
+        return _PWM.shift_wait(self._dma_channel, timeout_ms)
+
+    def frames(self):
+        """ Returns the number of frames which have been started """
+        return _PWM.shift_frames(self._dma_channel)
+
+    def close(self):
+        """ Stops the output, sets the gpios low and frees the channel """
+        _PWM.shift_close(self._dma_channel)
+
+
+class Steppers(object):
+    """
+    Drives step/direction stepper drivers (A4988, DRV8825, ...) on up to 8
+    axes. A move gives each axis a number of steps (the sign is the
+    direction), a maximum velocity (steps/s) and acceleration (steps/s^2),
+    and optionally a maximum jerk (steps/s^3) for S-curve instead of
+    trapezoidal velocity. All axes of a move start together and come to
+    rest; the next move starts when all have stopped.
+
+    A thread compiles the moves into step timing with a resolution of
+    `tick_ns` (2us by default, for at most 250000 steps/s), which a DMA
+    channel outputs while the next moves are compiled. The pacer must run
+    at the period of other users of `delay_hw`, eg. tick_ns=10000 with
+    PWM.setup()'s default 10us granularity on DELAY_VIA_PWM.
+
+    Example:
+
+        # Axes with step gpios 17 and 27, direction gpios 22 and 23
+        steppers = RPIO.PWM.Steppers([17, 27], [22, 23])
+        steppers.move([1600, -800], 4000, 20000)
+        steppers.move(3200, 8000, 40000, jerk=400000)
+        steppers.wait()
+        print(steppers.position())
+        steppers.close()
+    """
+    def __init__(self, step_gpios, dir_gpios=None, dma_channel=11, \
+            delay_hw=DELAY_VIA_PWM, tick_ns=STEPPER_TICK_NS):
+        if isinstance(step_gpios, int):
+            step_gpios = [step_gpios]
+        if isinstance(dir_gpios, int):
+            dir_gpios = [dir_gpios]
+        self.step_gpios = list(step_gpios)
+        self.dir_gpios = list(dir_gpios) if dir_gpios is not None else \
+                [None] * len(self.step_gpios)
+        self._dma_channel = dma_channel
+        _PWM.stepper_open(dma_channel, self.step_gpios,
+                [-1 if gpio is None else gpio for gpio in self.dir_gpios],
+                delay_hw, tick_ns)
+
+    def _per_axis(self, value):
+        if not isinstance(value, (list, tuple)):
+            return [value] * len(self.step_gpios)
+        if len(value) != len(self.step_gpios):
+            raise ValueError("one value per axis is needed (%d axes)" % \
+                    len(self.step_gpios))
+        return list(value)
+
+    def move(self, steps, max_velocity, acceleration, jerk=0):
+        """
+        Queues a move. Each argument is either a list with a value per axis
+        or one value for all axes. Waits while 64 moves are queued.
+        """
+        moves = zip(self._per_axis(steps), self._per_axis(max_velocity),
+                self._per_axis(acceleration), self._per_axis(jerk))
+        _PWM.stepper_move(self._dma_channel, list(moves))
+
+    def wait(self, timeout=None):
+        """
+        Waits until all moves were output (at most `timeout` seconds).
+        Returns False on timeout.
+        """
+        timeout_ms = -1 if timeout is None else int(timeout * 1000)
+        return _PWM.stepper_wait(self._dma_channel, timeout_ms)
+
+    def position(self):
+        """
+        Returns the positions of the axes (in steps from where they were
+        opened), from the progress of the DMA.
+        """
+        return _PWM.stepper_position(self._dma_channel)
+
+    def stop(self):
+        """
+        Stops all axes at once (without deceleration) and drops the queued
+        moves; position() keeps where they stopped.
+        """
+        _PWM.stepper_stop(self._dma_channel)
+
+    def close(self):
+        """ Stops the axes, sets the gpios low and frees the channel """
+        _PWM.stepper_close(self._dma_channel)
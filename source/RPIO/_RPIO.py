@@ -25,12 +25,14 @@
 #
 import socket
 import select
-import os.path
+import errno
+import stat
+import os
 import time
 import atexit
 
 from logging import debug, info, warn, error
-from threading import Thread
+from threading import Thread, Lock
 from functools import partial
 from itertools import chain
 
@@ -38,12 +40,25 @@ import RPIO
 import RPIO._GPIO as _GPIO
 
 # Internals
-_SYS_GPIO_ROOT = '/sys/class/gpio/'
 _TCP_SOCKET_HOST = "0.0.0.0"
+_DATAGRAM_BATCH = 32  # datagrams per proto_datagrams() (PROTO_DGRAMS)
 GPIO_FUNCTIONS = {0: "OUTPUT", 1: "INPUT", 4: "ALT0", 6:"ALT2", 7: "-"}
 
 _PULL_UPDN = ("PUD_OFF", "PUD_DOWN", "PUD_UP")
 
+# Runtime statistics (see RPIO.stats()); 0 if compiled with RPIO_NO_STATS
+_STATS = _GPIO.STATS_ENABLED
+
+# Trace recorder, switched by RPIO.trace_start() and trace_stop(): trace
+# events cost a call into C each, so they are only made while it is on
+_tracing = False
+
+
+def set_tracing(enabled):
+    """ Switches the trace events of interrupt and TCP dispatch """
+    global _tracing
+    _tracing = bool(enabled and _GPIO.TRACE_ENABLED)
+
 
 def _threaded_callback(callback, *args):
     """
@@ -55,6 +70,34 @@ def _threaded_callback(callback, *args):
     t.start()
 
 
+def _interrupt_args(gpio_id, callback, edge='both',
+        pull_up_down=_GPIO.PUD_OFF, threaded_callback=False,
+        debounce_timeout_ms=None, glitch_filter_us=None, integrator_us=None):
+    """
+    Normalizes one entry of `Interruptor.add_interrupt_callbacks(..)`. The
+    debounce arguments become one (filter, width_us) of the C event engine,
+    or None.
+    """
+    filters = [f for f in (
+            ("holdoff", debounce_timeout_ms and debounce_timeout_ms * 1000),
+            ("stable", glitch_filter_us),
+            ("integrator", integrator_us)) if f[1]]
+    if len(filters) > 1:
+        raise AttributeError("Only one of debounce_timeout_ms, "
+                "glitch_filter_us and integrator_us can be used.")
+    return (_GPIO.channel_to_gpio(gpio_id), callback, edge, pull_up_down,
+            threaded_callback, filters[0] if filters else None)
+
+
+def _set_protocol_pwm_handler():
+    """ Lets the PWM commands of the binary protocol use RPIO.PWM """
+    try:
+        from RPIO.PWM import _PWM
+    except ImportError:
+        return
+    _GPIO.proto_set_pwm_handler(_PWM.proto_pwm_handler())
+
+
 def exit_handler():
     """ Auto-cleanup on exit """
     RPIO.stop_waiting_for_interrupts()
@@ -73,47 +116,111 @@ class Interruptor:
     # Interrupt callback maps
     _map_fileno_to_file = {}
     _map_fileno_to_gpioid = {}
-    _map_fileno_to_options = {}
     _map_gpioid_to_fileno = {}
+    _map_gpioid_to_options = {}
     _map_gpioid_to_callbacks = {}
+    _map_listener_to_callback = {}  # { listener id: (gpio_id, cb) }
+
+    # Event engine fd (gpiochip backend), registered once in our epoll
+    _events_fileno = None
+
+    # Whether edges are recorded (see record_start)
+    _recording = False
+
+    # Timed schedules (see timed_submit): the executor fd in our epoll,
+    # callbacks of the pending schedules and results waiting to be fetched
+    _timed_fileno = None
+    _timed_callbacks = {}  # { id: cb }
+    _timed_results = {}  # { id: (id, status, start_us, late_us, reads) }
+    _timed_lock = Lock()
 
     # Keep track of created kernel interfaces for later cleanup
     _gpio_kernel_interfaces_created = []
 
-    # TCP socket stuff
+    # TCP and unix socket stuff (cb None: binary protocol, see protocol.h)
     _tcp_client_sockets = {}  # { fileno: (socket, cb) }
     _tcp_server_sockets = {}  # { fileno: (socket, cb) }
+    _udp_sockets = {}  # { fileno: (socket, cb) }
+
+    # gpios with edges pushed to protocol clients (see _update_subscriptions)
+    _subscribed_gpios = set()
 
     # Whether to continue the epoll loop or quit at next chance. You
     # can manually set this to False to stop `wait_for_interrupts()`.
     _is_waiting_for_interrupts = False
 
-    def add_tcp_callback(self, port, callback, threaded_callback=False):
+    def add_tcp_callback(self, port, callback=None, threaded_callback=False):
         """
         Adds a unix socket server callback, which will be invoked when values
         arrive from a connected socket client. The callback must accept two
         parameters, eg. ``def callback(socket, msg)``.
-        """
-        if not callback:
-            raise AttributeError("No callback")
 
+        Without a callback, the server speaks RPIO's framed binary protocol
+        (see `RPIO.protocol`), which is parsed and executed in C.
+        """
         serversocket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
         serversocket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
         serversocket.bind((_TCP_SOCKET_HOST, port))
-        serversocket.listen(1)
+        self._add_socket_server(serversocket, callback, threaded_callback)
+        debug("Socket server started at port %s and callback added." % port)
+
+    def add_unix_callback(self, path, callback=None, threaded_callback=False,
+            seqpacket=False):
+        """
+        Same as `add_tcp_callback(..)` for clients on this machine, on a unix
+        domain socket at `path` (replacing a stale socket file). With
+        `seqpacket`, every client message arrives in one piece.
+        """
+        if os.path.exists(path) and stat.S_ISSOCK(os.stat(path).st_mode):
+            os.unlink(path)
+        serversocket = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET \
+                if seqpacket else socket.SOCK_STREAM)
+        serversocket.bind(path)
+        self._add_socket_server(serversocket, callback, threaded_callback)
+        debug("Socket server started at %s and callback added." % path)
+
+    def add_udp_callback(self, port, callback=None, threaded_callback=False):
+        """
+        Adds a UDP socket callback, which will be invoked for every datagram
+        with three parameters, eg. ``def callback(socket, msg, address)``.
+
+        Without a callback, every datagram holds requests of RPIO's binary
+        protocol, which are received in batches and executed in C; their
+        responses are sent back to the sender.
+        """
+        udpsocket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        udpsocket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        udpsocket.bind((_TCP_SOCKET_HOST, port))
+        udpsocket.setblocking(0)
+        self._epoll.register(udpsocket.fileno(), select.EPOLLIN)
+
+        cb = callback
+        if callback is None:
+            _set_protocol_pwm_handler()
+        elif threaded_callback:
+            cb = partial(_threaded_callback, callback)
+        self._udp_sockets[udpsocket.fileno()] = (udpsocket, cb)
+        debug("UDP socket bound to port %s and callback added." % port)
+
+    def _add_socket_server(self, serversocket, callback, threaded_callback):
+        """ Listens on a bound stream or seqpacket socket in our epoll """
+        serversocket.listen(socket.SOMAXCONN)
         serversocket.setblocking(0)
         self._epoll.register(serversocket.fileno(), select.EPOLLIN)
 
         # Prepare the callback (wrap in Thread if needed)
-        cb = callback if not threaded_callback else \
-                partial(_threaded_callback, callback)
+        cb = callback
+        if callback is None:
+            _set_protocol_pwm_handler()
+        elif threaded_callback:
+            cb = partial(_threaded_callback, callback)
 
         self._tcp_server_sockets[serversocket.fileno()] = (serversocket, cb)
-        debug("Socket server started at port %s and callback added." % port)
 
     def add_interrupt_callback(self, gpio_id, callback, edge='both',
             pull_up_down=_GPIO.PUD_OFF, threaded_callback=False,
-            debounce_timeout_ms=None):
+            debounce_timeout_ms=None, glitch_filter_us=None,
+            integrator_us=None):
         """
         Add a callback to be executed when the value on 'gpio_id' changes to
         the edge specified via the 'edge' parameter (default='both').
@@ -123,103 +230,192 @@ class Interruptor:
 
         If `threaded_callback` is True, the callback will be started
         inside a Thread.
-        """
-        gpio_id = _GPIO.channel_to_gpio(gpio_id)
-        debug("Adding callback for GPIO %s" % gpio_id)
-        if not edge in ["falling", "rising", "both", "none"]:
-            raise AttributeError("'%s' is not a valid edge." % edge)
 
-        if not pull_up_down in [_GPIO.PUD_UP, _GPIO.PUD_DOWN, _GPIO.PUD_OFF]:
-            raise AttributeError("'%s' is not a valid pull_up_down." % edge)
+        One input filter can be set per callback, which runs in the C event
+        engine: `debounce_timeout_ms` reports an edge at once and the settled
+        level after the timeout, `glitch_filter_us` reports a level once it
+        was stable that long and `integrator_us` integrates the level over
+        that time. Callbacks of one gpio can use different edges and
+        filters; they share the gpio's single fd.
+        """
+        self.add_interrupt_callbacks([(gpio_id, callback, edge, pull_up_down,
+                threaded_callback, debounce_timeout_ms, glitch_filter_us,
+                integrator_us)])
 
-        # Make sure the gpio_id is valid
-        if not gpio_id in set(chain(RPIO.GPIO_LIST_R1, RPIO.GPIO_LIST_R2, \
-                              RPIO.GPIO_LIST_R3)):
-            raise AttributeError("GPIO %s is not a valid gpio-id." % gpio_id)
+    def add_interrupt_callbacks(self, callbacks):
+        """
+        Adds a list of (gpio_id, callback[, edge[, pull_up_down[,
+        threaded_callback[, debounce_timeout_ms[, glitch_filter_us[,
+        integrator_us]]]]]]) tuples (same arguments as
+        `add_interrupt_callback`). All gpios are set up together: one
+        batched pin setup, and one sysfs pass which exports the missing
+        gpios and reuses already exported ones (or, with the gpiochip
+        backend, one line request for all gpios).
+
+        A gpio whose callbacks use different edges or input filters is
+        handled by the C event engine: the pin is armed once, and every edge
+        is read once and demultiplexed to the callbacks there.
+        """
+        entries = [_interrupt_args(*args) for args in callbacks]
+        valid_gpios = set(chain(RPIO.GPIO_LIST_R1, RPIO.GPIO_LIST_R2, \
+                RPIO.GPIO_LIST_R3))
+
+        # Validate everything before touching any pin
+        for gpio_id, callback, edge, pull_up_down, _, _ in entries:
+            debug("Adding callback for GPIO %s" % gpio_id)
+            if not edge in ["falling", "rising", "both", "none"]:
+                raise AttributeError("'%s' is not a valid edge." % edge)
+
+            if not pull_up_down in [_GPIO.PUD_UP, _GPIO.PUD_DOWN, \
+                    _GPIO.PUD_OFF]:
+                raise AttributeError("'%s' is not a valid pull_up_down." % \
+                        pull_up_down)
+
+            # Make sure the gpio_id is valid
+            if not gpio_id in valid_gpios:
+                raise AttributeError("GPIO %s is not a valid gpio-id." % \
+                        gpio_id)
+
+        # Require INPUT pin setup; and set the correct PULL_UPDN (once per
+        # gpio, setup_pins refuses repeated gpios; the last callback's wins)
+        pulls = dict((gpio_id, pull_up_down) for \
+                gpio_id, _, _, pull_up_down, _, _ in entries)
+        RPIO.setup_pins([(gpio_id, RPIO.IN, pulls[gpio_id]) for \
+                gpio_id in sorted(pulls)])
+
+        # A gpio reads its own sysfs value file if all its callbacks use
+        # the same edge and no filter. Else (and with the gpiochip backend)
+        # it goes to the event engine, where each callback is a listener;
+        # gpios which read their own value file so far move there. So do
+        # gpios subscribed by protocol clients, whose edges the engine
+        # publishes in C.
+        gpiochip = _GPIO.interrupt_backend()[0] == "gpiochip"
+        published = set(gpio_id for gpio_id, callback, _, _, _, _ in entries \
+                if callback == self._publish)
+        kinds = {}
+        for gpio_id, _, edge, _, _, gpio_filter in entries:
+            kinds.setdefault(gpio_id, set()).add((edge, gpio_filter))
+        sysfs_gpios = []
+        engine_gpios = []
+        for gpio_id in sorted(kinds):
+            options = self._map_gpioid_to_options.get(gpio_id)
+            if options and options["engine"]:
+                continue
+            if options:
+                kinds[gpio_id].add((options["edge"], None))
+            if gpiochip or len(kinds[gpio_id]) > 1 or \
+                    [f for _, f in kinds[gpio_id] if f] or \
+                    gpio_id in published:
+                engine_gpios.append(gpio_id)
+            elif not options:
+                sysfs_gpios.append(gpio_id)
+
+        edges = dict((gpio_id, list(kinds[gpio_id])[0][0]) for gpio_id in \
+                sysfs_gpios)
+        self._add_sysfs_interfaces(sysfs_gpios, edges)
+        for gpio_id in sysfs_gpios:
+            self._map_gpioid_to_options[gpio_id] = {
+                    "edge": edges[gpio_id],
+                    "engine": False,
+                    "last_event": None
+                    }
+            self._map_gpioid_to_callbacks[gpio_id] = []
+
+        # Listeners for the callbacks of moved gpios and all new callbacks
+        # of engine gpios
+        listeners = []
+        for gpio_id in engine_gpios:
+            options = self._map_gpioid_to_options.get(gpio_id)
+            if options:
+                listeners.extend((gpio_id, cb, options["edge"], None) for \
+                        cb in self._map_gpioid_to_callbacks[gpio_id])
+        callbacks = []
+        for gpio_id, callback, edge, _, threaded_callback, gpio_filter in \
+                entries:
+            # Prepare the callback (wrap in Thread if needed)
+            cb = callback if not threaded_callback else \
+                    partial(_threaded_callback, callback)
+            callbacks.append((gpio_id, cb))
+            options = self._map_gpioid_to_options.get(gpio_id)
+            if gpio_id in engine_gpios or (options and options["engine"]):
+                listeners.append((gpio_id, cb, edge, gpio_filter))
+        self._add_engine_gpios(engine_gpios, listeners)
+
+        for gpio_id, cb in callbacks:
+            self._map_gpioid_to_callbacks[gpio_id].append(cb)
 
-        # Require INPUT pin setup; and set the correct PULL_UPDN
-        if RPIO.gpio_function(int(gpio_id)) == RPIO.IN:
-            RPIO.set_pullupdn(gpio_id, pull_up_down)
-        else:
-            debug("- changing gpio function from %s to INPUT" % \
-                    (GPIO_FUNCTIONS[RPIO.gpio_function(int(gpio_id))]))
-            RPIO.setup(gpio_id, RPIO.IN, pull_up_down)
+    def _add_sysfs_interfaces(self, gpios, edges):
+        """ Exports and configures the sysfs interfaces of new gpios """
+        configured = _GPIO.sysfs_setup([(gpio_id, edges[gpio_id]) for \
+                gpio_id in gpios])
 
-        # Prepare the callback (wrap in Thread if needed)
-        cb = callback if not threaded_callback else \
-                partial(_threaded_callback, callback)
-
-        # Prepare the /sys/class path of this gpio
-        path_gpio = "%sgpio%s/" % (_SYS_GPIO_ROOT, gpio_id)
-
-        # If initial callback for this GPIO then set everything up. Else make
-        # sure the edge detection is the same.
-        if gpio_id in self._map_gpioid_to_callbacks:
-            with open(path_gpio + "edge", "r") as f:
-                e = f.read().strip()
-                if e != edge:
-                    raise AttributeError(("Cannot add callback for gpio %s:"
-                            " edge detection '%s' not compatible with existing"
-                            " edge detection '%s'.") % (gpio_id, edge, e))
-
-            # Check whether edge is the same, else throw Exception
-            debug("- kernel interface already setup for GPIO %s" % gpio_id)
-            self._map_gpioid_to_callbacks[gpio_id].append(cb)
+        for gpio_id, (fd, val_initial, exported) in zip(gpios, configured):
+            if exported:
+                self._gpio_kernel_interfaces_created.append(gpio_id)
+            debug(("- kernel interface %s for GPIO %s (edge='%s', initial "
+                    "value %s)") % ("exported" if exported else "reused", \
+                    gpio_id, edges[gpio_id], val_initial))
 
-        else:
-            # If kernel interface already exists unexport first for clean setup
-            if os.path.exists(path_gpio):
-                if self._show_warnings:
-                    warn("Kernel interface for GPIO %s already exists." % \
-                            gpio_id)
-                debug("- unexporting kernel interface for GPIO %s" % gpio_id)
-                with open(_SYS_GPIO_ROOT + "unexport", "w") as f:
-                    f.write("%s" % gpio_id)
-                time.sleep(0.1)
-
-            # Export kernel interface /sys/class/gpio/gpioN
-            with open(_SYS_GPIO_ROOT + "export", "w") as f:
-                f.write("%s" % gpio_id)
-            self._gpio_kernel_interfaces_created.append(gpio_id)
-            debug("- kernel interface exported for GPIO %s" % gpio_id)
-
-            # Configure gpio as input
-            with open(path_gpio + "direction", "w") as f:
-                f.write("in")
-
-            # Configure gpio edge detection
-            with open(path_gpio + "edge", "w") as f:
-                f.write(edge)
-
-            debug(("- kernel interface configured for GPIO %s "
-                    "(edge='%s', pullupdn=%s)") % (gpio_id, edge, \
-                    _PULL_UPDN[pull_up_down]))
-
-            # Open the gpio value stream and read the initial value
-            f = open(path_gpio + "value", 'r')
-            val_initial = f.read().strip()
-            debug("- inital gpio value: %s" % val_initial)
+            # Wrap the gpio value stream (initial value already consumed)
+            f = os.fdopen(fd, 'r')
             f.seek(0)
 
-            # Add callback info to the mapping dictionaries
-            self._map_fileno_to_file[f.fileno()] = f
-            self._map_fileno_to_gpioid[f.fileno()] = gpio_id
-            self._map_fileno_to_options[f.fileno()] = {
-                    "debounce_timeout_s": debounce_timeout_ms / 1000.0 if \
-                            debounce_timeout_ms else 0,
-                    "interrupt_last": 0,
-                    "edge": edge
-                    }
-            self._map_gpioid_to_fileno[gpio_id] = f.fileno()
-            self._map_gpioid_to_callbacks[gpio_id] = [cb]
+            self._map_fileno_to_file[fd] = f
+            self._map_fileno_to_gpioid[fd] = gpio_id
+            self._map_gpioid_to_fileno[gpio_id] = fd
 
             # Add to epoll
-            self._epoll.register(f.fileno(), select.EPOLLPRI | select.EPOLLERR)
+            self._epoll.register(fd, select.EPOLLPRI | select.EPOLLERR)
 
-    def del_interrupt_callback(self, gpio_id):
-        """ Delete all interrupt callbacks from a certain gpio """
-        debug("- removing interrupts on gpio %s" % gpio_id)
-        gpio_id = _GPIO.channel_to_gpio(gpio_id)
+    def _add_engine_gpios(self, gpios, listeners):
+        """
+        Adds listeners, a list of (gpio_id, cb, edge, filter), and the new
+        gpios `gpios` to the C event engine, whose fd is registered in our
+        epoll. gpios which read their own value file so far move to the
+        engine once it has taken over.
+        """
+        if not listeners:
+            return
+        added = []
+        try:
+            # Listeners first, so new gpios are armed once for all of them
+            for gpio_id, cb, edge, gpio_filter in listeners:
+                listener = _GPIO.events_listen(gpio_id, edge, \
+                        *(gpio_filter or ()))
+                added.append((listener, gpio_id, cb))
+                if cb == self._publish:
+                    _GPIO.events_publish(listener)
+            if gpios:
+                _GPIO.events_add([(gpio_id, "none") for gpio_id in gpios])
+        except:
+            for listener, _, _ in added:
+                _GPIO.events_unlisten(listener)
+            raise
+
+        for gpio_id in gpios:
+            if gpio_id in self._map_gpioid_to_fileno:
+                self._close_value_file(gpio_id)
+            else:
+                self._map_gpioid_to_options[gpio_id] = {
+                        "edge": None,
+                        "last_event": None
+                        }
+                self._map_gpioid_to_callbacks[gpio_id] = []
+            self._map_gpioid_to_options[gpio_id]["engine"] = True
+        for listener, gpio_id, cb in added:
+            self._map_listener_to_callback[listener] = (gpio_id, cb)
+        if gpios:
+            debug("- event engine handles GPIOs %s" % gpios)
+        self._watch_event_engine()
+
+    def _watch_event_engine(self):
+        """ Registers the fd of the event engine in our epoll (once) """
+        if self._events_fileno is None:
+            self._events_fileno = _GPIO.events_fileno()
+            self._epoll.register(self._events_fileno, select.EPOLLIN)
+
+    def _close_value_file(self, gpio_id):
+        """ Stops reading the sysfs value file of a gpio """
         fileno = self._map_gpioid_to_fileno[gpio_id]
 
         # 1. Remove from epoll
@@ -231,45 +427,253 @@ class Interruptor:
         # 3. Remove from maps
         del self._map_fileno_to_file[fileno]
         del self._map_fileno_to_gpioid[fileno]
-        del self._map_fileno_to_options[fileno]
         del self._map_gpioid_to_fileno[gpio_id]
-        del self._map_gpioid_to_callbacks[gpio_id]
 
         # 4. Close file last in case of IOError
         f.close()
 
-    def _handle_interrupt(self, fileno, val):
-        """ Internally distributes interrupts to all attached callbacks """
-        val = int(val)
+    def del_interrupt_callback(self, gpio_id):
+        """ Delete all interrupt callbacks from a certain gpio """
+        debug("- removing interrupts on gpio %s" % gpio_id)
+        gpio_id = _GPIO.channel_to_gpio(gpio_id)
+        if self._map_gpioid_to_options[gpio_id]["engine"]:
+            # gpio of the event engine (which also drops its listeners)
+            _GPIO.events_remove(gpio_id)
+            for listener, (g, _) in list(self._map_listener_to_callback.items()):
+                if g == gpio_id:
+                    del self._map_listener_to_callback[listener]
+        else:
+            self._close_value_file(gpio_id)
+        del self._map_gpioid_to_options[gpio_id]
+        del self._map_gpioid_to_callbacks[gpio_id]
+
+    def last_event(self, gpio_id):
+        """
+        Returns (value, timestamp_ns, seqno) of the last interrupt on a gpio,
+        or None. Timestamp (CLOCK_MONOTONIC) and sequence number come from
+        the C event engine (gpiochip backend or input filter; taken by the
+        kernel with gpiochip), else they are None.
+        """
+        gpio_id = _GPIO.channel_to_gpio(gpio_id)
+        options = self._map_gpioid_to_options.get(gpio_id)
+        return options["last_event"] if options else None
+
+    def remove_interrupt_callback(self, gpio_id, callback):
+        """
+        Removes one callback (added without `threaded_callback`) from a gpio.
+        Edge detection stops when the last callback is removed.
+        """
+        gpio_id = _GPIO.channel_to_gpio(gpio_id)
+        callbacks = self._map_gpioid_to_callbacks.get(gpio_id, [])
+        if callback in callbacks:
+            callbacks.remove(callback)
+            for listener, entry in list(self._map_listener_to_callback.items()):
+                if entry == (gpio_id, callback):
+                    _GPIO.events_unlisten(listener)
+                    del self._map_listener_to_callback[listener]
+                    break
+        if not callbacks and gpio_id in self._map_gpioid_to_options:
+            self.del_interrupt_callback(gpio_id)
 
-        # Filter invalid edge values (sometimes 1 comes in when edge=falling)
-        edge = self._map_fileno_to_options[fileno]["edge"]
-        if (edge == 'rising' and val == 0) or (edge == 'falling' and val == 1):
+    def _handle_interrupt(self, gpio_id, val, timestamp_ns=None, seqno=None,
+            listener=None):
+        """
+        Internally distributes interrupts to all attached callbacks, or to
+        the callback of an event engine listener
+        """
+        val = int(val)
+        options = self._map_gpioid_to_options.get(gpio_id)
+        if options is None:
+            # A callback removed this gpio while the event was pending
             return
+        options["last_event"] = (val, timestamp_ns, seqno)
 
-        # If user activated debounce for this callback, check timing now
-        debounce = self._map_fileno_to_options[fileno]["debounce_timeout_s"]
-        if debounce:
-            t = time.time()
-            t_last = self._map_fileno_to_options[fileno]["interrupt_last"]
-            if t - t_last < debounce:
-                debug("- don't start interrupt callback due to debouncing")
+        if options["engine"]:
+            # Edge and filter were applied by the event engine
+            entry = self._map_listener_to_callback.get(listener)
+            callbacks = [entry[1]] if entry else []
+        else:
+            # Filter invalid edge values (sometimes 1 comes in when
+            # edge=falling)
+            edge = options["edge"]
+            if (edge == 'rising' and val == 0) or \
+                    (edge == 'falling' and val == 1):
+                if _STATS:
+                    _GPIO.stats_count(_GPIO.STAT_EVENTS_DROPPED)
                 return
-            self._map_fileno_to_options[fileno]["interrupt_last"] = t
+            callbacks = list(self._map_gpioid_to_callbacks[gpio_id])
 
         # Start the callback(s) now
-        gpio_id = self._map_fileno_to_gpioid[fileno]
-        if gpio_id in self._map_gpioid_to_callbacks:
-            for cb in self._map_gpioid_to_callbacks[gpio_id]:
-                cb(gpio_id, val)
+        for cb in callbacks:
+            if _tracing:
+                _GPIO.trace_event(_GPIO.TRACE_CALLBACK_BEGIN, gpio_id, val)
+            cb(gpio_id, val)
+            if _tracing:
+                _GPIO.trace_event(_GPIO.TRACE_CALLBACK_END, gpio_id)
 
     def close_tcp_client(self, fileno):
         debug("closing client socket fd %s" % fileno)
         self._epoll.unregister(fileno)
         socket, cb = self._tcp_client_sockets[fileno]
+        if cb is None:
+            _GPIO.proto_close(fileno)
+            self._update_subscriptions()
         socket.close()
         del self._tcp_client_sockets[fileno]
 
+    def _open_protocol_client(self, connection):
+        """ Serves the binary protocol on a new client connection """
+        if connection.family == socket.AF_INET:
+            connection.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        _GPIO.proto_open(connection.fileno())
+
+    def _handle_protocol(self, fileno, event):
+        """ Lets the C protocol handler serve a ready client connection """
+        try:
+            if event & (select.EPOLLIN | select.EPOLLHUP | select.EPOLLERR):
+                flags = _GPIO.proto_input(fileno)
+            else:
+                flags = _GPIO.proto_flush(fileno)
+        except (IOError, OSError):
+            self.close_tcp_client(fileno)
+            return
+
+        # Stop reading while responses back up, wait until writable
+        mask = 0
+        if flags & _GPIO.PROTO_WANT_READ:
+            mask |= select.EPOLLIN
+        if flags & _GPIO.PROTO_WANT_WRITE:
+            mask |= select.EPOLLOUT
+        self._epoll.modify(fileno, mask)
+        if flags & _GPIO.PROTO_SUBSCRIBED:
+            self._update_subscriptions()
+
+    def _handle_datagrams(self, fileno):
+        """ Handles the pending datagrams of a UDP socket """
+        udpsocket, cb = self._udp_sockets[fileno]
+        if cb is None:
+            # Batches of protocol requests, received with recvmmsg in C
+            while _GPIO.proto_datagrams(fileno) == _DATAGRAM_BATCH:
+                pass
+            return
+        for i in range(_DATAGRAM_BATCH):
+            try:
+                content, address = udpsocket.recvfrom(65536)
+            except socket.error as e:
+                if e.args[0] in (errno.EAGAIN, errno.EWOULDBLOCK):
+                    break
+                raise
+            cb(udpsocket, content, address)
+
+    def _update_subscriptions(self):
+        """
+        Watches the gpios subscribed by protocol clients (as interrupt
+        inputs) and pushes their edges to the clients
+        """
+        mask_bank0, mask_bank1 = _GPIO.proto_subscriptions()
+        mask = mask_bank0 | mask_bank1 << 32
+        gpios = set(gpio_id for gpio_id in chain(RPIO.GPIO_LIST_R1,
+                RPIO.GPIO_LIST_R2, RPIO.GPIO_LIST_R3) if mask >> gpio_id & 1)
+        for gpio_id in self._subscribed_gpios - gpios:
+            self.remove_interrupt_callback(gpio_id, self._publish)
+        try:
+            self.add_interrupt_callbacks([(gpio_id, self._publish) for \
+                    gpio_id in sorted(gpios - self._subscribed_gpios)])
+        except (AttributeError, IOError, OSError) as e:
+            warn("Cannot watch gpios subscribed by protocol clients: %s" % e)
+            gpios &= self._subscribed_gpios
+        self._subscribed_gpios = gpios
+
+    def _publish(self, gpio_id, val):
+        """
+        Interrupt callback of subscribed gpios. Its listeners publish their
+        edges to the protocol clients in C (see `_GPIO.events_publish`), so
+        it is never called.
+        """
+
+    def record_start(self, path):
+        """
+        Records all edges (of the event engine in C, and the sysfs interrupts
+        handled here) into a new file `path`, until `record_stop()`
+        """
+        _GPIO.record_start(path)
+        self._recording = True
+
+    def record_stop(self):
+        """ Finishes the recording; raises IOError if writing it failed """
+        self._recording = False
+        _GPIO.record_stop()
+
+    def replay(self, path, speed=1.0, start_ns=0, inject=True,
+            outputs=False):
+        """
+        Replays a recording in the background. Injected edges are dispatched
+        by `poll_interrupts()` like real ones.
+        """
+        if inject:
+            self._watch_event_engine()
+        _GPIO.replay_start(path, speed, start_ns, inject, outputs)
+
+    def timed_submit(self, ops, callback=None, start_us=0):
+        """
+        Queues a schedule in the executor thread and returns its id. Its
+        result is passed to `callback` by `poll_interrupts()`, or kept for
+        `timed_wait()` if there is no callback.
+        """
+        with self._timed_lock:
+            schedule_id = _GPIO.timed_submit(ops, start_us)
+            self._timed_callbacks[schedule_id] = callback
+            if self._timed_fileno is None:
+                self._timed_fileno = _GPIO.timed_fileno()
+                self._epoll.register(self._timed_fileno, select.EPOLLIN)
+        return schedule_id
+
+    def _collect_timed(self):
+        """ Fetches finished schedules and calls their callbacks """
+        with self._timed_lock:
+            finished = []
+            for result in _GPIO.timed_collect():
+                cb = self._timed_callbacks.pop(result[0], None)
+                if cb is None:
+                    self._timed_results[result[0]] = result
+                else:
+                    finished.append((cb, result))
+        for cb, result in finished:
+            cb(*result)
+
+    def timed_stop(self):
+        """
+        Stops the executor. Its fd is closed, so the results of the cancelled
+        schedules are passed on (or kept for `timed_wait()`) right away.
+        """
+        with self._timed_lock:
+            if self._timed_fileno is not None:
+                self._epoll.unregister(self._timed_fileno)
+                self._timed_fileno = None
+            _GPIO.timed_stop()
+        self._collect_timed()
+
+    def timed_wait(self, schedule_id, timeout=None):
+        """
+        Waits up to `timeout` seconds (None: forever) for the result of a
+        schedule without callback. Returns None on timeout.
+        """
+        if self._timed_fileno is None and \
+                schedule_id not in self._timed_results:
+            raise ValueError("no schedule was submitted")
+        if self._timed_callbacks.get(schedule_id) is not None:
+            raise ValueError("schedule %s has a callback" % schedule_id)
+        t_end = None if timeout is None else time.time() + timeout
+        while schedule_id not in self._timed_results:
+            wait = 0.05
+            if t_end is not None:
+                wait = min(wait, t_end - time.time())
+                if wait <= 0:
+                    return None
+            select.select([self._timed_fileno], [], [], wait)
+            self._collect_timed()
+        return self._timed_results.pop(schedule_id)
+
     def wait_for_interrupts(self, epoll_timeout=1):
         """
         Blocking loop to listen for GPIO interrupts and distribute them to
@@ -284,42 +688,108 @@ class Interruptor:
         """
         self._is_waiting_for_interrupts = True
         while self._is_waiting_for_interrupts:
-            events = self._epoll.poll(epoll_timeout)
-            for fileno, event in events:
-                debug("- epoll event on fd %s: %s" % (fileno, event))
-                if fileno in self._tcp_server_sockets:
-                    # New client connection to socket server
-                    serversocket, cb = self._tcp_server_sockets[fileno]
-                    connection, address = serversocket.accept()
-                    connection.setblocking(0)
-                    f = connection.fileno()
-                    self._epoll.register(f, select.EPOLLIN)
-                    self._tcp_client_sockets[f] = (connection, cb)
-
-                elif event & select.EPOLLIN:
-                    # Input from TCP socket
-                    socket, cb = self._tcp_client_sockets[fileno]
-                    content = socket.recv(1024)
-                    if not content or not content.strip():
-                        # No content means quitting
-                        self.close_tcp_client(fileno)
-                    else:
-                        sock, cb = self._tcp_client_sockets[fileno]
-                        cb(self._tcp_client_sockets[fileno][0], \
-                                content.strip())
-
-                elif event & select.EPOLLHUP:
-                    # TCP Socket Hangup
-                    self.close_tcp_client(fileno)
+            self.poll_interrupts(epoll_timeout)
+
+    def fileno(self):
+        """
+        Returns the epoll fd of all interrupt and TCP sockets. It becomes
+        readable when events are pending, so it can be added to other event
+        loops (see `RPIO.aio`), which then call `poll_interrupts(0)`.
+        """
+        return self._epoll.fileno()
 
-                elif event & select.EPOLLPRI:
-                    # GPIO interrupts
-                    f = self._map_fileno_to_file[fileno]
-                    # read() is workaround for not getting new values
-                    # with read(1)
-                    val = f.read().strip()
-                    f.seek(0)
-                    self._handle_interrupt(fileno, val)
+    def poll_interrupts(self, timeout=0):
+        """
+        Waits up to `timeout` seconds (0: don't block) and handles all
+        pending GPIO interrupts and TCP events in one batch. Returns the
+        number of handled epoll events.
+        """
+        events = self._epoll.poll(timeout)
+        for fileno, event in events:
+            debug("- epoll event on fd %s: %s" % (fileno, event))
+            if fileno == self._events_fileno:
+                # Batch of (filtered) events of the C event engine
+                for gpio_id, val, timestamp_ns, seqno, listener in \
+                        _GPIO.events_read():
+                    if _STATS:
+                        t0 = _GPIO.stats_clock()
+                    self._handle_interrupt(gpio_id, val, timestamp_ns, seqno,
+                            listener)
+                    if _STATS:
+                        _GPIO.stats_record(_GPIO.STAT_HANDLE_INTERRUPT, t0)
+                if self._subscribed_gpios:
+                    # Clients whose published edges backed up
+                    for f in _GPIO.proto_pending():
+                        self._handle_protocol(f, select.EPOLLOUT)
+
+            elif fileno == self._timed_fileno:
+                # Finished timed schedules
+                self._collect_timed()
+
+            elif fileno in self._tcp_server_sockets:
+                # New client connection to socket server
+                serversocket, cb = self._tcp_server_sockets[fileno]
+                connection, address = serversocket.accept()
+                connection.setblocking(0)
+                f = connection.fileno()
+                if cb is None:
+                    self._open_protocol_client(connection)
+                self._epoll.register(f, select.EPOLLIN)
+                self._tcp_client_sockets[f] = (connection, cb)
+
+            elif fileno in self._udp_sockets:
+                # Datagrams (several per wakeup)
+                self._handle_datagrams(fileno)
+
+            elif fileno in self._tcp_client_sockets and \
+                    self._tcp_client_sockets[fileno][1] is None:
+                # Requests of a protocol client (parsed and executed in C)
+                self._handle_protocol(fileno, event)
+
+            elif event & select.EPOLLIN:
+                # Input from TCP socket
+                socket, cb = self._tcp_client_sockets[fileno]
+                content = socket.recv(1024)
+                if not content or not content.strip():
+                    # No content means quitting
+                    self.close_tcp_client(fileno)
+                else:
+                    sock, cb = self._tcp_client_sockets[fileno]
+                    if _STATS:
+                        t0 = _GPIO.stats_clock()
+                    if _tracing:
+                        _GPIO.trace_event(_GPIO.TRACE_TCP_BEGIN, fileno)
+                    cb(self._tcp_client_sockets[fileno][0], \
+                            content.strip())
+                    if _tracing:
+                        _GPIO.trace_event(_GPIO.TRACE_TCP_END, fileno)
+                    if _STATS:
+                        _GPIO.stats_record(_GPIO.STAT_TCP_DISPATCH, t0)
+
+            elif event & select.EPOLLHUP:
+                # TCP Socket Hangup
+                self.close_tcp_client(fileno)
+
+            elif event & select.EPOLLPRI:
+                # GPIO interrupts (a callback may have removed this gpio)
+                if fileno not in self._map_fileno_to_file:
+                    continue
+                f = self._map_fileno_to_file[fileno]
+                # read() is workaround for not getting new values
+                # with read(1)
+                val = f.read().strip()
+                f.seek(0)
+                gpio_id = self._map_fileno_to_gpioid[fileno]
+                if self._recording:
+                    _GPIO.record_event(gpio_id, int(val))
+                if _tracing:
+                    _GPIO.trace_event(_GPIO.TRACE_INTERRUPT, gpio_id, int(val))
+                if _STATS:
+                    t0 = _GPIO.stats_clock()
+                self._handle_interrupt(gpio_id, val)
+                if _STATS:
+                    _GPIO.stats_record(_GPIO.STAT_HANDLE_INTERRUPT, t0)
+        return len(events)
 
     def stop_waiting_for_interrupts(self):
         """
@@ -334,30 +804,53 @@ class Interruptor:
         and deletes callback bindings. Should be used after using interrupts.
         """
         debug("Cleaning up interfaces...")
-        for gpio_id in self._gpio_kernel_interfaces_created:
-            # Close the value-file and remove interrupt bindings
+        # Close the value-files and remove interrupt bindings
+        for gpio_id in list(self._map_gpioid_to_options):
             self.del_interrupt_callback(gpio_id)
-
-            # Remove the kernel GPIO interface
+        _GPIO.replay_stop()
+        if self._timed_fileno is not None:
+            self._epoll.unregister(self._timed_fileno)
+            self._timed_fileno = None
+        _GPIO.timed_stop()
+        _GPIO.timed_collect()
+        self._timed_callbacks = {}
+        self._timed_results = {}
+        if self._events_fileno is not None:
+            self._epoll.unregister(self._events_fileno)
+            self._events_fileno = None
+            _GPIO.events_cleanup()
+        self._map_listener_to_callback = {}
+
+        # Remove the kernel GPIO interfaces
+        for gpio_id in self._gpio_kernel_interfaces_created:
             debug("- unexporting GPIO %s" % gpio_id)
-            with open(_SYS_GPIO_ROOT + "unexport", "w") as f:
-                f.write("%s" % gpio_id)
+            with open(_GPIO.sysfs_root() + "unexport", "w") as f:
+                f.write("%s\n" % gpio_id)
 
         # Reset list of created interfaces
         self._gpio_kernel_interfaces_created = []
+        self._subscribed_gpios = set()
 
     def cleanup_tcpsockets(self):
         """
-        Closes all TCP connections and then the socket servers
+        Closes all TCP and unix connections, then the socket servers and the
+        UDP sockets
         """
-        for fileno in self._tcp_client_sockets.keys():
+        for fileno in list(self._tcp_client_sockets.keys()):
             self.close_tcp_client(fileno)
         for fileno, items in self._tcp_server_sockets.items():
-            socket, cb = items
+            serversocket, cb = items
             debug("- _cleanup server socket connection (fd %s)" % fileno)
             self._epoll.unregister(fileno)
-            socket.close()
+            if serversocket.family == socket.AF_UNIX:
+                os.unlink(serversocket.getsockname())
+            serversocket.close()
         self._tcp_server_sockets = {}
+        for fileno, items in self._udp_sockets.items():
+            debug("- _cleanup udp socket (fd %s)" % fileno)
+            self._epoll.unregister(fileno)
+            items[0].close()
+        self._udp_sockets = {}
 
     def cleanup_interrupts(self):
         """
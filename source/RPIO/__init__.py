@@ -66,6 +66,10 @@ to the ``add_interrupt_callback(..)`` call:
 
     RPIO.add_interrupt_callback(7, do_something, debounce_timeout_ms=100)
 
+Noisy inputs can instead be filtered with ``glitch_filter_us`` (a level is
+reported once it was stable that long) or ``integrator_us``. All filters run
+in C, bounces never wake up Python.
+
 To stop the `wait_for_interrupts()` loop, call
 `RPIO.stop_waiting_for_interrupts()`. To remove all callbacks from a certain
 gpio pin, use `RPIO.del_interrupt_callback(gpio_id)`.
@@ -93,6 +97,9 @@ Besides the interrupt handling, you can use RPIO just as RPi.GPIO:
     # set up output channel with an initial state
     RPIO.setup(8, RPIO.OUT, initial=RPIO.LOW)
 
+    # set up many channels at once (batched register writes)
+    RPIO.setup_pins([(7, RPIO.IN, RPIO.PUD_UP), (8, RPIO.OUT)])
+
     # change to BOARD numbering schema
     RPIO.setmode(RPIO.BOARD)
 
@@ -111,9 +118,11 @@ Author: Chris Hager <chris@linuxuser.at>
 URL: https://github.com/metachris/RPIO
 License: LGPLv3+
 """
+import sys
+from logging import warn
 from threading import Thread
 import RPIO._GPIO as _GPIO
-from RPIO._RPIO import Interruptor
+from RPIO._RPIO import Interruptor, set_tracing as _set_tracing
 
 
 VERSION = "0.10.1"
@@ -135,6 +144,7 @@ PUD_DOWN = _GPIO.PUD_DOWN
 
 # Exposing methods from RPi.GPIO
 setup = _GPIO.setup
+setup_pins = _GPIO.setup_pins
 output = _GPIO.output
 input = _GPIO.input
 setmode = _GPIO.setmode
@@ -144,6 +154,34 @@ set_pullupdn = _GPIO.set_pullupdn
 gpio_function = _GPIO.gpio_function
 channel_to_gpio = _GPIO.channel_to_gpio
 
+# Blocking wait for one edge, in C without holding the GIL
+wait_for_edge = _GPIO.wait_for_edge
+
+# Edge counters and frequency meters, counted in a C thread (no callbacks)
+counter_start = _GPIO.counter_start
+counter_stop = _GPIO.counter_stop
+counter_read = _GPIO.counter_read
+
+# Decoders of captured level words (see capture)
+capture_edges = _GPIO.capture_edges
+capture_duty = _GPIO.capture_duty
+capture_frequency = _GPIO.capture_frequency
+
+# Real-time profile of RPIO's threads (see set_rt_profile)
+rt_profile = _GPIO.rt_profile
+
+# Operations of timed schedules (see timed_submit)
+TIMED_WRITE = _GPIO.TIMED_WRITE
+TIMED_WAIT = _GPIO.TIMED_WAIT
+TIMED_READ = _GPIO.TIMED_READ
+
+# System timer clock and calibrated delays
+SIMULATED = _GPIO.SIMULATED
+now_us = _GPIO.now_us
+delay_us = _GPIO.delay_us
+delay_ns = _GPIO.delay_ns
+sleep_us = _GPIO.sleep_us
+
 # BCM numbering mode by default
 _GPIO.setmode(BCM)
 
@@ -191,18 +229,46 @@ def version():
     return (VERSION, VERSION_GPIO)
 
 
-def add_tcp_callback(port, callback, threaded_callback=False):
+def add_tcp_callback(port, callback=None, threaded_callback=False):
     """
     Adds a unix socket server callback, which will be invoked when values
     arrive from a connected socket client. The callback must accept two
     parameters, eg. ``def callback(socket, msg)``.
+
+    Without a callback, clients speak RPIO's framed binary protocol
+    (`RPIO.protocol`): pipelined requests with sequence numbers, batches of
+    port reads, output masks and PWM widths, and subscriptions to edges. It
+    is parsed and executed in C, without a Python call per command.
     """
     _rpio.add_tcp_callback(port, callback, threaded_callback)
 
 
+def add_unix_callback(path, callback=None, threaded_callback=False, \
+        seqpacket=False):
+    """
+    Same as `add_tcp_callback(..)` on a unix domain socket at `path`, which
+    saves local clients the TCP stack. With `seqpacket` (SOCK_SEQPACKET),
+    every message of a client arrives in one piece.
+    """
+    _rpio.add_unix_callback(path, callback, threaded_callback, seqpacket)
+
+
+def add_udp_callback(port, callback=None, threaded_callback=False):
+    """
+    Adds a UDP socket callback, which will be invoked for every received
+    datagram. The callback must accept three parameters, eg. ``def
+    callback(socket, msg, address)``.
+
+    Without a callback, every datagram holds requests of RPIO's binary
+    protocol (`RPIO.protocol`), which are received in batches with recvmmsg
+    and executed in C. Their responses are sent back to the sender.
+    """
+    _rpio.add_udp_callback(port, callback, threaded_callback)
+
+
 def add_interrupt_callback(gpio_id, callback, edge='both', \
         pull_up_down=PUD_OFF, threaded_callback=False, \
-        debounce_timeout_ms=None):
+        debounce_timeout_ms=None, glitch_filter_us=None, integrator_us=None):
     """
     Add a callback to be executed when the value on 'gpio_id' changes to
     the edge specified via the 'edge' parameter (default='both').
@@ -214,10 +280,74 @@ def add_interrupt_callback(gpio_id, callback, edge='both', \
     inside a Thread.
 
     If debounce_timeout_ms is set, new interrupts will not be forwarded
-    until after the specified amount of milliseconds.
+    until after the specified amount of milliseconds. If the level changed
+    meanwhile, the settled level is forwarded then.
+
+    If glitch_filter_us is set, a level is only forwarded once it has been
+    stable for that many microseconds; shorter pulses are dropped. If
+    integrator_us is set, the level is integrated and a change is forwarded
+    when the integrator swung over completely (after integrator_us of a
+    clean signal, later on a noisy one). Only one filter can be used per
+    callback; all of them run in C (see `RPIO.stats()` for the number of
+    suppressed edges). Callbacks of one gpio can use different edges and
+    filters; the gpio is still armed once and each edge read once.
     """
     _rpio.add_interrupt_callback(gpio_id, callback, edge, pull_up_down, \
-            threaded_callback, debounce_timeout_ms)
+            threaded_callback, debounce_timeout_ms, glitch_filter_us, \
+            integrator_us)
+
+
+def add_interrupt_callbacks(callbacks):
+    """
+    Adds many interrupt callbacks at once, as a list of (gpio_id, callback[,
+    edge[, pull_up_down[, threaded_callback[, debounce_timeout_ms[,
+    glitch_filter_us[, integrator_us]]]]]]) tuples. This is much faster than single `add_interrupt_callback(..)`
+    calls: all gpios are exported and configured in one batched pass.
+
+        RPIO.add_interrupt_callbacks([(17, on_button), (18, on_sensor,
+                'rising', RPIO.PUD_UP)])
+    """
+    _rpio.add_interrupt_callbacks(callbacks)
+
+
+def set_interrupt_backend(backend, chip=None):
+    """
+    Selects how interrupts are received (before adding interrupt callbacks):
+
+    - 'sysfs' (default): one /sys/class/gpio/gpioN/value file per gpio
+    - 'gpiochip': one line request on the GPIO character device `chip`
+      (default: /dev/gpiochip0) for all gpios. The kernel buffers edges
+      with nanosecond timestamps and sequence numbers (see
+      `RPIO.last_interrupt(..)`), and all pending edges are read at once.
+
+    The environment variables RPIO_INTERRUPT_BACKEND and RPIO_GPIOCHIP set
+    the defaults.
+    """
+    _GPIO.set_interrupt_backend(backend, chip)
+
+
+def interrupt_backend():
+    """ Returns the interrupt backend and gpiochip as (backend, chip) """
+    return _GPIO.interrupt_backend()
+
+
+def last_interrupt(gpio_id):
+    """
+    Returns (value, timestamp_ns, seqno) of the last interrupt on `gpio_id`
+    (eg. from within its callback), or None. Timestamp (CLOCK_MONOTONIC)
+    and sequence number are taken by the kernel with the gpiochip backend,
+    and by the C event engine for filtered gpios; else they are None.
+    """
+    return _rpio.last_event(gpio_id)
+
+
+def set_sysfs_root(path):
+    """
+    Sets the root of the kernel's sysfs gpio interface (default:
+    /sys/class/gpio, or $RPIO_SYSFS_GPIO_ROOT). Useful for tests against a
+    fake tree.
+    """
+    _GPIO.set_sysfs_root(path)
 
 
 def del_interrupt_callback(gpio_id):
@@ -225,11 +355,29 @@ def del_interrupt_callback(gpio_id):
     _rpio.del_interrupt_callback(gpio_id)
 
 
+def remove_interrupt_callback(gpio_id, callback):
+    """
+    Removes one callback from a gpio (other callbacks stay active). Edge
+    detection stops when the last callback is removed.
+    """
+    _rpio.remove_interrupt_callback(gpio_id, callback)
+
+
 def close_tcp_client(fileno):
     """ Closes TCP connection to a client and removes client from epoll """
     _rpio.close_tcp_client(fileno)
 
 
+def _rt_wait_for_interrupts(epoll_timeout):
+    """ Interrupt thread: applies the real-time profile, then waits """
+    try:
+        _GPIO.rt_apply()
+    except IOError as e:
+        warn("Cannot apply the real-time profile to the interrupt thread: "
+                "%s" % e)
+    _rpio.wait_for_interrupts(epoll_timeout)
+
+
 def wait_for_interrupts(threaded=False, epoll_timeout=1):
     """
     Blocking loop to listen for GPIO interrupts and distribute them to
@@ -247,13 +395,28 @@ def wait_for_interrupts(threaded=False, epoll_timeout=1):
     `RPIO.stop_waiting_for_interrupts()`.
     """
     if threaded:
-        t = Thread(target=_rpio.wait_for_interrupts, args=(epoll_timeout,))
+        t = Thread(target=_rt_wait_for_interrupts, args=(epoll_timeout,))
         t.daemon = True
         t.start()
     else:
         _rpio.wait_for_interrupts(epoll_timeout)
 
 
+def poll_interrupts(timeout=0):
+    """
+    Handles all pending GPIO interrupts and TCP events (waiting up to
+    `timeout` seconds) and returns the number of handled events. Use it to
+    drive interrupts from your own event loop; `interrupts_fileno()` becomes
+    readable when events are pending. For asyncio see `RPIO.aio`.
+    """
+    return _rpio.poll_interrupts(timeout)
+
+
+def interrupts_fileno():
+    """ Returns the pollable fd of all interrupt and TCP sockets """
+    return _rpio.fileno()
+
+
 def stop_waiting_for_interrupts():
     """
     Ends the blocking `wait_for_interrupts()` loop the next time it can,
@@ -282,6 +445,223 @@ def cleanup():
     _GPIO.cleanup()
 
 
+def _stats_modules():
+    """ _GPIO, and _PWM if RPIO.PWM is in use (each keeps its own stats) """
+    modules = [_GPIO]
+    if "RPIO.PWM._PWM" in sys.modules:
+        modules.append(sys.modules["RPIO.PWM._PWM"])
+    return modules
+
+
+def stats():
+    """
+    Returns the runtime statistics of the GPIO, PWM and interrupt entry
+    points as a dict of `{name: {"calls", "total_ns", "max_ns",
+    "histogram"}}`. `histogram[i]` counts calls which took between 2**i and
+    2**(i+1) ns. `events_dropped`, `debounce_suppressed`, `rt_threads`,
+    `rt_errors`, `page_faults` and `stepper_underruns` are plain counters
+    (only `calls` is used).
+    Empty if RPIO was built with RPIO_NO_STATS.
+    """
+    result = {}
+    if not _GPIO.STATS_ENABLED:
+        return result
+    _GPIO.rt_update_stats()
+    for module in _stats_modules():
+        for name, entry in module.stats().items():
+            if name not in result:
+                result[name] = entry
+                continue
+            merged = result[name]
+            merged["calls"] += entry["calls"]
+            merged["total_ns"] += entry["total_ns"]
+            merged["max_ns"] = max(merged["max_ns"], entry["max_ns"])
+            merged["histogram"] = [a + b for a, b in \
+                    zip(merged["histogram"], entry["histogram"])]
+    return result
+
+
+def stats_reset():
+    """ Resets all runtime statistics """
+    for module in _stats_modules():
+        module.stats_reset()
+
+
+def trace_start():
+    """
+    Starts recording trace events (PWM channel edits, DMA starts and resets,
+    interrupts and callback dispatch) into per-thread binary ring buffers.
+    Use `trace_dump(path)` to save them, and `python -m RPIO.tracing` to
+    convert a dump into Chrome/Perfetto JSON.
+    """
+    _GPIO.trace_enable(1)
+    _set_tracing(True)
+
+
+def trace_stop():
+    """ Stops recording trace events (recorded events are kept) """
+    _GPIO.trace_enable(0)
+    _set_tracing(False)
+
+
+def trace_clear():
+    """ Drops all recorded trace events """
+    _GPIO.trace_clear()
+
+
+def trace_dump(path):
+    """ Writes all recorded trace events into the binary file `path` """
+    _GPIO.trace_dump(path)
+
+
+def trace_dump_on_signal(signum, path):
+    """
+    Writes the trace into `path` whenever the process receives `signum`
+    (eg. `signal.SIGUSR2`), eg. to look at a running controller with
+    `kill -USR2 <pid>`.
+    """
+    _GPIO.trace_dump_on_signal(signum, path)
+
+
+def set_rt_profile(policy='fifo', priority=50, cpu=None, lock_memory=True,
+        stack_kb=64):
+    """
+    Sets the real-time profile of the threads RPIO starts afterwards (the
+    thread of `wait_for_interrupts(threaded=True)`, edge counters and
+    replays):
+
+    - policy: 'fifo' or 'rr' with `priority` 1..99, or 'other' (default
+      scheduler)
+    - cpu: pin the threads to this CPU, eg. one isolated with `isolcpus=`
+    - lock_memory: lock all current and future memory of the process
+      (mlockall), so no page faults delay the threads
+    - stack_kb: stack pre-faulted by each thread when it starts
+
+    Needs root (or CAP_SYS_NICE and CAP_IPC_LOCK). Threads which fail to
+    apply the profile keep running normally; `RPIO.stats()` counts
+    `rt_threads`, `rt_errors` and the `page_faults` of the process.
+    `set_rt_profile('other', lock_memory=False)` resets the profile.
+    """
+    _GPIO.rt_configure(policy, priority, -1 if cpu is None else cpu,
+            lock_memory, stack_kb * 1024)
+
+
+def capture(channels, rate, n, buffer=None, bits=False, cpu=None):
+    """
+    Samples the levels of `channels` n times at `rate` samples per second
+    (0: as fast as possible) in a tight C loop with the GIL released, and
+    returns `(buffer, achieved_rate)`. `buffer` can be any writable buffer,
+    eg. a preallocated numpy array, and is filled without copies:
+
+    - n level words (uint32, 4-byte aligned): bit g is the level of BCM
+      gpio g, other bits are 0. Decode them with `RPIO.capture_edges(..)`,
+      `RPIO.capture_duty(..)` and `RPIO.capture_frequency(..)`.
+    - with bits=True, one row of (n + 7) // 8 bytes per channel (in the
+      order of `channels`): sample i is bit i % 8 of byte i // 8
+
+    Without `buffer`, a bytearray is allocated. `cpu` pins the sampling
+    loop to one CPU.
+    """
+    if buffer is None:
+        size = len(channels) * ((n + 7) // 8) if bits else n * 4
+        buffer = bytearray(size)
+    rate = _GPIO.capture(channels, rate, n, buffer, bits,
+            -1 if cpu is None else cpu)
+    return buffer, rate
+
+
+def record_start(path):
+    """
+    Records all interrupt edges (gpio, level and CLOCK_MONOTONIC timestamp)
+    into a new file `path` until `record_stop()`, at about 3 bytes per edge.
+    Edges are recorded before filters and callbacks, so a replay goes
+    through them again. Read recordings with `RPIO.recording.Recording`.
+    """
+    _rpio.record_start(path)
+
+
+def record_stop():
+    """ Finishes and closes the recording """
+    _rpio.record_stop()
+
+
+def replay(path, speed=1.0, start_ns=0, inject=True, outputs=False):
+    """
+    Replays a recording in a background thread, at `speed` times the
+    recorded pace (0: as fast as possible), from its first edge at or after
+    the timestamp `start_ns`:
+
+    - inject=True: the edges are fed into the interrupt handling, and reach
+      the filters and callbacks of their gpios like real edges (with new
+      timestamps) when interrupts are polled or waited for
+    - outputs=True: the recorded levels are driven on the pins, which must
+      be set up as outputs
+
+    Raises IOError if a replay is already running.
+    """
+    _rpio.replay(path, speed, start_ns, inject, outputs)
+
+
+def replay_stop():
+    """ Stops the replay """
+    _GPIO.replay_stop()
+
+
+def replay_running():
+    """ Returns True while a replay is running """
+    return bool(_GPIO.replay_running())
+
+
+def timed_start(cpu=None):
+    """
+    Starts the executor thread of timed schedules, pinned to `cpu` (None:
+    as the real-time profile says, see `set_rt_profile`). `timed_submit`
+    starts it on any CPU if it is not running.
+    """
+    _GPIO.timed_start(-1 if cpu is None else cpu)
+
+
+def timed_submit(schedule, callback=None, start_us=0):
+    """
+    Queues a schedule of timed operations on the pins of bank 0 (gpio 0-31)
+    and returns its id. Schedules run one after the other in a C thread,
+    which waits for each operation on the system timer (sleeping, then
+    spinning for the last 200us). `schedule` is a list of tuples:
+
+    - (time_us, RPIO.TIMED_WRITE, set_mask, clear_mask): set the gpios of
+      set_mask, then clear those of clear_mask, eg. `1 << 17`
+    - (time_us, RPIO.TIMED_WAIT): only wait
+    - (time_us, RPIO.TIMED_READ): read the levels of bank 0
+
+    time_us is relative to the start of the schedule, which is the
+    `RPIO.now_us()` time `start_us` (0: as soon as the executor takes it).
+    The pins must be set up as outputs beforehand.
+
+    When the schedule finishes, `callback(id, status, start_us, late_us,
+    reads)` is called by `poll_interrupts()` (or `wait_for_interrupts()`):
+    status is 0 or errno.ECANCELED if it was stopped, start_us its actual
+    start time, late_us the lateness of each executed operation against its
+    requested time and reads the level words of the TIMED_READs. Without
+    callback, fetch the same tuple with `timed_wait(id)`. `RPIO.stats()`
+    keeps a histogram of the lateness as `timed_lateness`.
+    """
+    return _rpio.timed_submit(schedule, callback, start_us)
+
+
+def timed_wait(schedule_id, timeout=None):
+    """
+    Waits up to `timeout` seconds (None: forever) for a schedule submitted
+    without callback and returns its `(id, status, start_us, late_us,
+    reads)`, or None on timeout.
+    """
+    return _rpio.timed_wait(schedule_id, timeout)
+
+
+def timed_stop():
+    """ Stops the executor and cancels the running and pending schedules """
+    _rpio.timed_stop()
+
+
 def setwarnings(enabled=True):
     """ Show warnings (either `True` or `False`) """
     _GPIO.setwarnings(enabled)
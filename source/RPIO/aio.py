@@ -0,0 +1,174 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+asyncio integration for GPIO interrupts and TCP callbacks (Python 3.5+).
+
+`attach()` registers RPIO's interrupt epoll fd with the asyncio event loop.
+Whenever it becomes readable, all pending GPIO interrupts and TCP events are
+handled in one batch, right inside the loop: no threads and no epoll
+timeout. Callbacks added with `RPIO.add_interrupt_callback(..)` and
+`RPIO.add_tcp_callback(..)` then run as part of the loop.
+
+Example:
+
+    import asyncio
+    from RPIO import aio
+
+    async def main():
+        edge = await aio.wait_for_edge(17, 'rising', timeout=10)
+        print("gpio %s is now %s" % (edge.gpio, edge.value))
+
+        async with aio.edges(4, 'both') as stream:
+            async for edge in stream:
+                print(edge)
+
+    asyncio.get_event_loop().run_until_complete(main())
+
+Do not use `RPIO.wait_for_interrupts()` at the same time, since both would
+handle the same events.
+"""
+import time
+import asyncio
+from collections import namedtuple, deque
+
+import RPIO
+
+# One edge: gpio, new value (0 or 1) and its time.monotonic() timestamp
+# (taken by the kernel with the gpiochip backend, else when it was handled)
+Edge = namedtuple("Edge", ["gpio", "value", "timestamp"])
+
+_loop = None
+
+
+def attach(loop=None):
+    """
+    Handles RPIO interrupts and TCP callbacks in the asyncio loop `loop`
+    (default: the current event loop). Called automatically by `edges()`
+    and `wait_for_edge()`.
+    """
+    global _loop
+    loop = loop or asyncio.get_event_loop()
+    if _loop is loop:
+        return
+    detach()
+    loop.add_reader(RPIO.interrupts_fileno(), RPIO.poll_interrupts, 0)
+    _loop = loop
+
+
+def detach():
+    """ Stops handling RPIO interrupts in the asyncio loop """
+    global _loop
+    if _loop is not None:
+        _loop.remove_reader(RPIO.interrupts_fileno())
+        _loop = None
+
+
+class edges(object):
+    """
+    Asynchronous iterator over the edges of a gpio. Edges are queued from
+    the moment the iterator is created; `pending()` returns (and removes)
+    all queued edges at once. Use it as (async) context manager, or call
+    `close()` to stop edge detection.
+
+        async with aio.edges(17, 'both') as stream:
+            async for edge in stream:
+                ...
+    """
+    def __init__(self, gpio, edge='both', pull_up_down=RPIO.PUD_OFF,
+            debounce_timeout_ms=None, glitch_filter_us=None,
+            integrator_us=None, loop=None):
+        attach(loop)
+        self.gpio = gpio
+        self._queue = deque()
+        self._waiter = None
+        self._closed = False
+        RPIO.add_interrupt_callback(gpio, self._on_edge, edge=edge,
+                pull_up_down=pull_up_down,
+                debounce_timeout_ms=debounce_timeout_ms,
+                glitch_filter_us=glitch_filter_us, integrator_us=integrator_us)
+
+    def _on_edge(self, gpio, value):
+        # Prefer the timestamp of the event engine (taken by the kernel with
+        # the gpiochip backend)
+        event = RPIO.last_interrupt(gpio)
+        timestamp = event[1] / 1e9 if event and event[1] else time.monotonic()
+        self._queue.append(Edge(gpio, value, timestamp))
+        if self._waiter is not None and not self._waiter.done():
+            self._waiter.set_result(None)
+
+    def pending(self):
+        """ Returns all queued edges without waiting """
+        edges = list(self._queue)
+        self._queue.clear()
+        return edges
+
+    async def get(self):
+        """ Waits for the next edge """
+        while not self._queue:
+            if self._closed:
+                raise StopAsyncIteration
+            self._waiter = _loop.create_future()
+            try:
+                await self._waiter
+            finally:
+                self._waiter = None
+        return self._queue.popleft()
+
+    def close(self):
+        """ Stops edge detection for this iterator """
+        if not self._closed:
+            self._closed = True
+            RPIO.remove_interrupt_callback(self.gpio, self._on_edge)
+            if self._waiter is not None and not self._waiter.done():
+                self._waiter.set_result(None)
+
+    def __aiter__(self):
+        return self
+
+    async def __anext__(self):
+        return await self.get()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    async def __aenter__(self):
+        return self
+
+    async def __aexit__(self, *exc):
+        self.close()
+
+
+async def wait_for_edge(gpio, edge='both', pull_up_down=RPIO.PUD_OFF,
+        timeout=None):
+    """
+    Waits for one edge on `gpio` and returns it as `Edge`. Raises
+    `asyncio.TimeoutError` after `timeout` seconds (default: no timeout).
+    """
+    with edges(gpio, edge, pull_up_down) as stream:
+        return await asyncio.wait_for(stream.get(), timeout)
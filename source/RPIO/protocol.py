@@ -0,0 +1,242 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Client of RPIO's framed binary protocol, which servers started with
+``RPIO.add_tcp_callback(port)``, ``RPIO.add_unix_callback(path)`` and
+``RPIO.add_udp_callback(port)`` (without a callback) speak:
+
+    from RPIO import protocol
+
+    client = protocol.Client("raspberrypi", 8080)
+    levels, = client.request(protocol.read_port(0))
+    client.request(protocol.write_mask(0, set_mask=1 << 17),
+            protocol.pwm_width(0, 18, 150))
+
+Every request carries a sequence number, and the server answers requests in
+order; `send(..)` returns without waiting, so any number of requests can be
+pipelined before `receive()`-ing their responses. One request can batch any
+number of commands. All integers are little-endian:
+
+    frame     u32 length (of the rest), body
+    request   u32 seqno, commands
+    response  u32 seqno, u8 status, results (u32 levels of each read_port)
+    event     u32 SEQNO_EVENT, u8 0, u32 dropped, records of u8 gpio,
+              u8 level, u64 timestamp_ns, u32 seqno
+
+After `subscribe(..)`, the server pushes event frames with the edges of the
+subscribed gpios; `receive()` queues them in `Client.events`. The edges are
+streamed from the server's C event engine in batches. If the client does not
+keep up, the server drops edges instead of buffering them without bound;
+`Client.dropped` is the number of edges dropped so far.
+
+`Client("/run/rpio.sock")` connects to a unix socket server, and
+`DatagramClient(host, port)` sends each request in one UDP datagram (of at
+most DGRAM_SIZE bytes), which is answered with one datagram. Datagram
+clients can't subscribe.
+"""
+import socket
+import struct
+
+READ_PORT = 0x01
+WRITE_MASK = 0x02
+PWM_WIDTH = 0x03
+SUBSCRIBE = 0x04
+
+OK = 0
+ECOMMAND = 1
+EINVAL = 2
+EIO = 3
+
+SEQNO_EVENT = 0xffffffff
+FRAME_MAX = 65536
+DGRAM_SIZE = 4096
+
+_EVENT = struct.Struct("<BBQI")
+
+
+class ProtocolError(Exception):
+    """ A request failed; `status` is ECOMMAND, EINVAL or EIO """
+    def __init__(self, seqno, status):
+        Exception.__init__(self, "request %s failed with status %s" % \
+                (seqno, status))
+        self.seqno = seqno
+        self.status = status
+
+
+def _frame(seqno, commands):
+    body = struct.pack("<I", seqno) + b"".join(commands)
+    if len(body) > FRAME_MAX:
+        raise ValueError("request too large")
+    return struct.pack("<I", len(body)) + body
+
+
+def _parse(body):
+    """ Returns (seqno, status, results) of a response """
+    seqno, status = struct.unpack("<IB", body[:5])
+    results = body[5:]
+    return seqno, status, list(struct.unpack("<%dI" % (len(results) // 4),
+            results))
+
+
+def read_port(bank=0):
+    """ Reads the levels of all gpios of a bank (0: gpio 0-31, 1: 32-53) """
+    return struct.pack("<BB", READ_PORT, bank)
+
+
+def write_mask(bank=0, set_mask=0, clear_mask=0):
+    """ Sets and clears the outputs of a bank in the two masks """
+    return struct.pack("<BBII", WRITE_MASK, bank, set_mask, clear_mask)
+
+
+def pwm_width(dma_channel, gpio, width):
+    """
+    Sets the pulse width of a gpio on an initialized RPIO.PWM channel (in
+    pulse width increments, from the start of the subcycle; 0 clears it)
+    """
+    return struct.pack("<BBBH", PWM_WIDTH, dma_channel, gpio, width)
+
+
+def subscribe(mask_bank0=0, mask_bank1=0):
+    """ Pushes the edges of these gpios to the client (0, 0: none) """
+    return struct.pack("<BII", SUBSCRIBE, mask_bank0, mask_bank1)
+
+
+class Client(object):
+    """
+    Blocking client connection over TCP, or to the unix socket at `host` if
+    no port is given (SOCK_SEQPACKET if `seqpacket`)
+    """
+    def __init__(self, host, port=None, seqpacket=False):
+        if port is None:
+            self.socket = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET \
+                    if seqpacket else socket.SOCK_STREAM)
+            self.socket.connect(host)
+        else:
+            self.socket = socket.create_connection((host, port))
+            self.socket.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.seqno = 0
+        self.events = []
+        self.dropped = 0
+        self._buffer = b""
+
+    def close(self):
+        self.socket.close()
+
+    def send(self, *commands):
+        """ Sends one request with these commands and returns its seqno """
+        self.seqno = (self.seqno + 1) % SEQNO_EVENT
+        self.socket.sendall(_frame(self.seqno, commands))
+        return self.seqno
+
+    def receive(self):
+        """
+        Returns the next response as (seqno, status, [levels]). Event
+        frames received in between are appended to `events` as (gpio,
+        level, timestamp_ns, seqno).
+        """
+        while True:
+            length, = struct.unpack("<I", self._read(4))
+            body = self._read(length)
+            if struct.unpack("<I", body[:4])[0] != SEQNO_EVENT:
+                return _parse(body)
+            self.dropped, = struct.unpack("<I", body[5:9])
+            self.events.extend(_EVENT.unpack(body[i:i + _EVENT.size]) for \
+                    i in range(9, len(body), _EVENT.size))
+
+    def request(self, *commands):
+        """
+        Sends a request and waits for its response. Returns the results of
+        its commands (the levels of each read_port), or raises
+        ProtocolError.
+        """
+        seqno = self.send(*commands)
+        while True:
+            response_seqno, status, results = self.receive()
+            if response_seqno == seqno:
+                break
+        if status != OK:
+            raise ProtocolError(seqno, status)
+        return results
+
+    def _read(self, size):
+        while len(self._buffer) < size:
+            data = self.socket.recv(65536)
+            if not data:
+                raise IOError("connection closed by the server")
+            self._buffer += data
+        data, self._buffer = self._buffer[:size], self._buffer[size:]
+        return data
+
+
+class DatagramClient(object):
+    """ Sends requests in UDP datagrams, which may get lost """
+    def __init__(self, host, port, timeout=1.0):
+        self.socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.socket.connect((host, port))
+        self.socket.settimeout(timeout)
+        self.seqno = 0
+
+    def close(self):
+        self.socket.close()
+
+    def send(self, *commands):
+        """
+        Sends one request with these commands and returns its seqno, without
+        waiting for the response (fire and forget)
+        """
+        self.seqno = (self.seqno + 1) % SEQNO_EVENT
+        frame = _frame(self.seqno, commands)
+        if len(frame) > DGRAM_SIZE:
+            raise ValueError("request too large for a datagram")
+        self.socket.send(frame)
+        return self.seqno
+
+    def receive(self):
+        """
+        Returns the responses of the next datagram as a list of (seqno,
+        status, [levels]). Raises socket.timeout if none arrives in time.
+        """
+        data = self.socket.recv(65536)
+        responses = []
+        while len(data) >= 4:
+            length, = struct.unpack("<I", data[:4])
+            responses.append(_parse(data[4:4 + length]))
+            data = data[4 + length:]
+        return responses
+
+    def request(self, *commands):
+        """
+        Sends a request and waits for its response (responses of earlier
+        requests are skipped). Returns the results of its commands, or
+        raises ProtocolError.
+        """
+        seqno = self.send(*commands)
+        while True:
+            for response_seqno, status, results in self.receive():
+                if response_seqno == seqno:
+                    if status != OK:
+                        raise ProtocolError(seqno, status)
+                    return results
@@ -0,0 +1,103 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Reads recordings of interrupt edges (written by `RPIO.record_start()` or
+librpio's rpio_record_start(), see record.h for the format) without
+loading them into memory (through the C reader of the replay), eg. to
+analyse them or to find a point to replay from:
+
+    rec = Recording("edges.rec")
+    for gpio, level, timestamp_ns, seqno in rec.events(start_ns=t0):
+        ...
+
+or print them as text:
+
+    $ python -m RPIO.recording edges.rec
+"""
+import sys
+import errno
+
+from RPIO import _GPIO
+
+# Edges read from C at once
+_BATCH = 4096
+
+
+class RecordingFormatError(Exception):
+    pass
+
+
+class Recording(object):
+    """
+    A memory-mapped recording. `len()` is its number of edges, `blocks` the
+    list of its data blocks as (offset, first timestamp_ns, edge count).
+    """
+    def __init__(self, fn):
+        self.fn = fn
+        try:
+            self._handle = _GPIO.recording_open(fn)
+        except (IOError, OSError) as e:
+            if e.errno == errno.EINVAL:
+                raise RecordingFormatError("%s: not an RPIO recording" % fn)
+            raise
+        self.blocks = _GPIO.recording_blocks(self._handle)
+
+    def __len__(self):
+        return sum(b[2] for b in self.blocks)
+
+    def events(self, start_ns=0, end_ns=None):
+        """
+        Yields (gpio, level, timestamp_ns, seqno) of the edges from the first
+        at or after `start_ns` up to before `end_ns`. seqno numbers the edges
+        of the recording.
+        """
+        seqno = _GPIO.recording_find(self._handle, start_ns)
+        while True:
+            batch = _GPIO.recording_read(self._handle, seqno, _BATCH)
+            if not batch:
+                return
+            for event in batch:
+                if end_ns is not None and event[2] >= end_ns:
+                    return
+                yield event
+            seqno = batch[-1][3] + 1
+
+    def close(self):
+        _GPIO.recording_close(self._handle)
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write("usage: python -m RPIO.recording <recording>\n")
+        sys.exit(1)
+    rec = Recording(sys.argv[1])
+    for gpio, level, timestamp_ns, seqno in rec.events():
+        sys.stdout.write("%d %d %d\n" % (timestamp_ns, gpio, level))
+    rec.close()
+
+
+if __name__ == '__main__':
+    main()
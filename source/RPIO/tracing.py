@@ -0,0 +1,139 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Reads binary trace dumps (written by `RPIO.trace_dump()`, on a signal or by
+librpio) and converts them into the Chrome trace event format, which can be
+opened in chrome://tracing or https://ui.perfetto.dev:
+
+    $ python -m RPIO.tracing rpio.trace rpio.json
+
+Interrupts, PWM edits and DMA starts/resets are instant events, callbacks
+and TCP dispatch are shown as slices on the thread which ran them.
+"""
+import sys
+import json
+import struct
+
+MAGIC = b"RPIOTRC\0"
+VERSION = 1
+
+_HEADER = struct.Struct("=8sII")
+_RECORD = struct.Struct("=QIHHIIII")
+
+# Same values as `enum trace_type` in trace.h
+PWM_INIT_CHANNEL = 1
+PWM_FREE_CHANNEL = 2
+PWM_ADD_PULSE = 3
+PWM_CLEAR_GPIO = 4
+PWM_CLEAR_CHANNEL = 5
+DMA_START = 6
+DMA_RESET = 7
+INTERRUPT = 8
+CALLBACK_BEGIN = 9
+CALLBACK_END = 10
+TCP_BEGIN = 11
+TCP_END = 12
+PWM_SET_PULSES = 13
+
+# type: (name, category, phase, names of arg0..arg3)
+_EVENTS = {
+    PWM_INIT_CHANNEL: ("init_channel", "pwm", "i", ("channel", "subcycle_us")),
+    PWM_FREE_CHANNEL: ("free_channel", "pwm", "i", ("channel",)),
+    PWM_ADD_PULSE: ("add_channel_pulse", "pwm", "i",
+            ("channel", "gpio", "width_start", "width")),
+    PWM_CLEAR_GPIO: ("clear_channel_gpio", "pwm", "i", ("channel", "gpio")),
+    PWM_CLEAR_CHANNEL: ("clear_channel", "pwm", "i", ("channel",)),
+    DMA_START: ("dma_start", "dma", "i", ("channel",)),
+    DMA_RESET: ("dma_reset", "dma", "i", ("channel",)),
+    INTERRUPT: ("interrupt", "gpio", "i", ("gpio", "level")),
+    CALLBACK_BEGIN: ("callback", "gpio", "B", ("gpio", "level")),
+    CALLBACK_END: ("callback", "gpio", "E", ("gpio",)),
+    TCP_BEGIN: ("tcp_callback", "tcp", "B", ("fileno",)),
+    TCP_END: ("tcp_callback", "tcp", "E", ("fileno",)),
+    PWM_SET_PULSES: ("set_channel_pulses", "pwm", "i",
+            ("channel", "mask", "pulses")),
+}
+
+
+class TraceFormatError(Exception):
+    pass
+
+
+def read_trace(fn):
+    """
+    Returns all records of a dump as a list of
+    `(timestamp_ns, tid, type, (arg0, arg1, arg2, arg3))`, sorted by time.
+    """
+    with open(fn, "rb") as f:
+        data = f.read()
+    if len(data) < _HEADER.size:
+        raise TraceFormatError("%s: file too short" % fn)
+    magic, version, record_size = _HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION or record_size != _RECORD.size:
+        raise TraceFormatError("%s: not an RPIO trace (version %s)" % \
+                (fn, VERSION))
+
+    records = []
+    for offset in range(_HEADER.size, len(data) - _RECORD.size + 1,
+            _RECORD.size):
+        ts, tid, type_, arg0, arg1, arg2, arg3, _ = \
+                _RECORD.unpack_from(data, offset)
+        records.append((ts, tid, type_, (arg0, arg1, arg2, arg3)))
+    records.sort()
+    return records
+
+
+def to_chrome(records, pid=1):
+    """ Converts records into a Chrome trace event dict """
+    events = []
+    for ts, tid, type_, args in records:
+        if type_ not in _EVENTS:
+            continue
+        name, category, phase, arg_names = _EVENTS[type_]
+        event = {"name": name, "cat": category, "ph": phase,
+                "ts": ts / 1000.0, "pid": pid, "tid": tid,
+                "args": dict(zip(arg_names, args))}
+        if phase == "i":
+            event["s"] = "t"
+        events.append(event)
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def convert(fn_in, fn_out):
+    """ Converts the binary dump `fn_in` into the Chrome JSON `fn_out` """
+    with open(fn_out, "w") as f:
+        json.dump(to_chrome(read_trace(fn_in)), f)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write("usage: python -m RPIO.tracing <dump> <out.json>\n")
+        sys.exit(1)
+    convert(sys.argv[1], sys.argv[2])
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,386 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * bench.c measures the C hot paths of RPIO and writes the results as JSON:
+ *
+ *   - output_gpio / input_gpio (ns per call)
+ *   - init_channel, add_channel_pulse and clear_channel_gpio for several
+ *     subcycle times and pulse-width increment granularities
+ *   - interrupt latency (output -> epoll wakeup), if two pins are wired
+ *     together and passed with --loopback OUT:IN
+ *
+ * The pulse-width granularity can only be set once per process, so every
+ * granularity is measured in a forked child which sends its results back
+ * through a pipe.
+ *
+ * Run with RPIO_SIMULATE=1 to measure against the simulated register backend
+ * (interrupt latency is skipped there). All times are taken with
+ * CLOCK_MONOTONIC, which keeps running in simulation.
+ *
+ * Usage: bench [-o results.json] [-n iterations] [-g gpio] [--loopback OUT:IN]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include "c_gpio.h"
+#include "c_events.h"
+#include "systimer.h"
+#include "pwm.h"
+
+#define VERSION "0.10.1"
+
+#define MAX_RESULTS  128
+#define RUNS         5      // repetitions of every measurement
+#define PWM_REPEATS  200    // add/clear calls per subcycle setting
+#define IRQ_SAMPLES  200
+
+static const int granularities_us[] = { 1, 5, 10 };
+static const int subcycles_us[] = { 3000, 10000, 20000, 100000 };
+
+#define ARRAY_SIZE(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+// One measurement. Plain data, so children can write it into a pipe.
+struct result {
+    char name[48];
+    char params[64];   // JSON object members, eg. "\"subcycle_us\": 20000"
+    long iterations;
+    double mean_ns;
+    double min_ns;
+    double max_ns;
+};
+
+static struct result results[MAX_RESULTS];
+static int num_results = 0;
+
+static uint64_t
+clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct result *
+add_result(const char *name, long iterations)
+{
+    struct result *r;
+
+    if (num_results == MAX_RESULTS) {
+        fprintf(stderr, "bench: too many results\n");
+        exit(EXIT_FAILURE);
+    }
+    r = &results[num_results++];
+    memset(r, 0, sizeof(*r));
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->iterations = iterations;
+    r->min_ns = 1e18;
+    return r;
+}
+
+// Adds one sample (ns for one operation) to a result
+static void
+sample(struct result *r, double ns, int n)
+{
+    r->mean_ns += (ns - r->mean_ns) / n;
+    if (ns < r->min_ns)
+        r->min_ns = ns;
+    if (ns > r->max_ns)
+        r->max_ns = ns;
+}
+
+// Tight loops: mean of RUNS batches, min/max are batch means
+static void
+bench_gpio(int gpio, long iterations)
+{
+    struct result *r;
+    uint64_t t0;
+    long i;
+    int run;
+    volatile int sink = 0;
+
+    setup_gpio(gpio, OUTPUT, PUD_OFF);
+
+    r = add_result("c.output_gpio", iterations);
+    snprintf(r->params, sizeof(r->params), "\"gpio\": %d", gpio);
+    for (run = 1; run <= RUNS; run++) {
+        t0 = clock_ns();
+        for (i = 0; i < iterations; i++)
+            output_gpio(gpio, i & 1);
+        sample(r, (double)(clock_ns() - t0) / iterations, run);
+    }
+
+    r = add_result("c.input_gpio", iterations);
+    snprintf(r->params, sizeof(r->params), "\"gpio\": %d", gpio);
+    for (run = 1; run <= RUNS; run++) {
+        t0 = clock_ns();
+        for (i = 0; i < iterations; i++)
+            sink += input_gpio(gpio);
+        sample(r, (double)(clock_ns() - t0) / iterations, run);
+    }
+
+    r = add_result("c.output_gpio_mask", iterations);
+    snprintf(r->params, sizeof(r->params), "\"gpio\": %d", gpio);
+    for (run = 1; run <= RUNS; run++) {
+        t0 = clock_ns();
+        for (i = 0; i < iterations; i++) {
+            if (i & 1)
+                output_gpio_mask(0, 1 << gpio, 0);
+            else
+                output_gpio_mask(0, 0, 1 << gpio);
+        }
+        sample(r, (double)(clock_ns() - t0) / iterations, run);
+    }
+    output_gpio(gpio, 0);
+}
+
+static void
+pwm_fail(const char *what)
+{
+    fprintf(stderr, "bench: %s failed: %s", what, get_error_message());
+    exit(EXIT_FAILURE);
+}
+
+// Runs in a child process (granularity is fixed per process)
+static void
+bench_pwm(int gpio, int granularity_us)
+{
+    struct result *r_init, *r_add, *r_clear;
+    uint64_t t0;
+    int i, run, width, subcycle_us, channel = 0;
+
+    set_softfatal(1);
+    set_loglevel(LOG_LEVEL_ERRORS);
+    if (pwm_setup(granularity_us, DELAY_VIA_PWM) == EXIT_FAILURE)
+        pwm_fail("pwm_setup");
+
+    for (i = 0; i < ARRAY_SIZE(subcycles_us); i++) {
+        subcycle_us = subcycles_us[i];
+
+        r_init = add_result("c.pwm.init_channel", RUNS);
+        snprintf(r_init->params, sizeof(r_init->params),
+                "\"subcycle_us\": %d, \"granularity_us\": %d", subcycle_us, granularity_us);
+        for (run = 1; run <= RUNS; run++) {
+            t0 = clock_ns();
+            if (init_channel(channel, subcycle_us) == EXIT_FAILURE)
+                pwm_fail("init_channel");
+            sample(r_init, clock_ns() - t0, run);
+            if (run < RUNS && free_channel(channel) == EXIT_FAILURE)
+                pwm_fail("free_channel");
+        }
+
+        // Pulses over a tenth of the subcycle
+        width = subcycle_us / granularity_us / 10;
+        r_add = add_result("c.pwm.add_channel_pulse", PWM_REPEATS);
+        r_clear = add_result("c.pwm.clear_channel_gpio", PWM_REPEATS);
+        snprintf(r_add->params, sizeof(r_add->params),
+                "\"subcycle_us\": %d, \"granularity_us\": %d", subcycle_us, granularity_us);
+        memcpy(r_clear->params, r_add->params, sizeof(r_add->params));
+        for (run = 1; run <= PWM_REPEATS; run++) {
+            t0 = clock_ns();
+            if (add_channel_pulse(channel, gpio, 0, width) == EXIT_FAILURE)
+                pwm_fail("add_channel_pulse");
+            sample(r_add, clock_ns() - t0, run);
+
+            t0 = clock_ns();
+            if (clear_channel_gpio(channel, gpio) == EXIT_FAILURE)
+                pwm_fail("clear_channel_gpio");
+            sample(r_clear, clock_ns() - t0, run);
+        }
+        if (free_channel(channel) == EXIT_FAILURE)
+            pwm_fail("free_channel");
+    }
+    pwm_shutdown();
+}
+
+static void
+bench_pwm_granularities(int gpio)
+{
+    int fds[2], g, status, n;
+    pid_t pid;
+    struct result r;
+
+    for (g = 0; g < ARRAY_SIZE(granularities_us); g++) {
+        if (pipe(fds) == -1) {
+            perror("bench: pipe");
+            exit(EXIT_FAILURE);
+        }
+        fflush(NULL);
+        pid = fork();
+        if (pid == -1) {
+            perror("bench: fork");
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            num_results = 0;
+            bench_pwm(gpio, granularities_us[g]);
+            for (n = 0; n < num_results; n++)
+                if (write(fds[1], &results[n], sizeof(results[n])) != sizeof(results[n]))
+                    _exit(EXIT_FAILURE);
+            _exit(EXIT_SUCCESS);
+        }
+
+        close(fds[1]);
+        while (read(fds[0], &r, sizeof(r)) == sizeof(r))
+            *add_result(r.name, r.iterations) = r;
+        close(fds[0]);
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            fprintf(stderr, "bench: pwm benchmark with granularity %dus failed\n", granularities_us[g]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Time from writing the output pin until epoll hands out the event of the
+// (wired) input pin, and until the kernel timestamped it.
+static void
+bench_interrupts(int gpio_out, int gpio_in)
+{
+    struct result *r_wake, *r_stamp;
+    struct gpio_event event;
+    uint64_t t0, t1;
+    int i, n = 0;
+
+    setup_gpio(gpio_out, OUTPUT, PUD_OFF);
+    output_gpio(gpio_out, 0);
+    if (events_setup() == -1 || events_add_gpio(gpio_in, EDGE_BOTH) == -1) {
+        perror("bench: cannot set up interrupts");
+        exit(EXIT_FAILURE);
+    }
+
+    r_wake = add_result("c.interrupt.wakeup_latency", IRQ_SAMPLES);
+    r_stamp = add_result("c.interrupt.timestamp_latency", IRQ_SAMPLES);
+    snprintf(r_wake->params, sizeof(r_wake->params), "\"gpio_out\": %d, \"gpio_in\": %d", gpio_out, gpio_in);
+    memcpy(r_stamp->params, r_wake->params, sizeof(r_wake->params));
+    for (i = 1; i <= IRQ_SAMPLES; i++) {
+        sleep_us(1000);
+        t0 = clock_ns();
+        output_gpio(gpio_out, i & 1);
+        if (events_read(&event, 1, 1000) != 1) {
+            fprintf(stderr, "bench: no interrupt on gpio %d; are gpio %d and %d connected?\n",
+                    gpio_in, gpio_out, gpio_in);
+            exit(EXIT_FAILURE);
+        }
+        t1 = clock_ns();
+        n++;
+        sample(r_wake, t1 - t0, n);
+        sample(r_stamp, event.timestamp_ns > t0 ? event.timestamp_ns - t0 : 0, n);
+    }
+    events_cleanup();
+    output_gpio(gpio_out, 0);
+}
+
+static void
+write_json(FILE *f, const char *loopback)
+{
+    int i;
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"suite\": \"c\",\n");
+    fprintf(f, "  \"version\": \"%s\",\n", VERSION);
+    fprintf(f, "  \"backend\": \"%s\",\n", simulation_enabled() ? "simulated" : "hardware");
+    fprintf(f, "  \"timestamp\": %ld,\n", (long)time(NULL));
+    if (loopback)
+        fprintf(f, "  \"skipped\": [],\n");
+    else
+        fprintf(f, "  \"skipped\": [\"c.interrupt\"],\n");
+    fprintf(f, "  \"results\": [\n");
+    for (i = 0; i < num_results; i++) {
+        fprintf(f, "    {\"name\": \"%s\", \"params\": {%s}, \"iterations\": %ld, "
+                "\"mean_ns\": %.1f, \"min_ns\": %.1f, \"max_ns\": %.1f}%s\n",
+                results[i].name, results[i].params, results[i].iterations,
+                results[i].mean_ns, results[i].min_ns, results[i].max_ns,
+                i < num_results - 1 ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "usage: bench [-o results.json] [-n iterations] [-g gpio] [--loopback OUT:IN]\n");
+    exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+    static struct option long_options[] = {
+        {"loopback", required_argument, NULL, 'l'},
+        {NULL, 0, NULL, 0}
+    };
+    char *output = NULL, *loopback = NULL;
+    long iterations = 1000000;
+    int c, gpio = 17, gpio_out = -1, gpio_in = -1;
+    FILE *f = stdout;
+
+    while ((c = getopt_long(argc, argv, "o:n:g:", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'o': output = optarg; break;
+        case 'n': iterations = atol(optarg); break;
+        case 'g': gpio = atoi(optarg); break;
+        case 'l':
+            loopback = optarg;
+            if (sscanf(optarg, "%d:%d", &gpio_out, &gpio_in) != 2)
+                usage();
+            break;
+        default: usage();
+        }
+    }
+    if (iterations < 1 || gpio < 0 || gpio > 31)
+        usage();
+    if (loopback && simulation_enabled()) {
+        fprintf(stderr, "bench: no interrupts in simulation, ignoring --loopback\n");
+        loopback = NULL;
+    }
+
+    if (setup() != SETUP_OK) {
+        fprintf(stderr, "bench: cannot map the gpio registers (try running as root or with RPIO_SIMULATE=1)\n");
+        return EXIT_FAILURE;
+    }
+    systimer_setup();
+
+    bench_gpio(gpio, iterations);
+    bench_pwm_granularities(gpio);
+    if (loopback)
+        bench_interrupts(gpio_out, gpio_in);
+    setup_gpio(gpio, INPUT, PUD_OFF);
+    cleanup();
+
+    if (output && (f = fopen(output, "w")) == NULL) {
+        perror("bench: cannot open output file");
+        return EXIT_FAILURE;
+    }
+    write_json(f, loopback);
+    if (f != stdout)
+        fclose(f);
+    return EXIT_SUCCESS;
+}
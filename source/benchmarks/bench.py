@@ -0,0 +1,263 @@
+#!/usr/bin/env python
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Measures the Python hot paths of RPIO (RPIO.output/input, RPIO.PWM channel
+methods and interrupt-to-callback latency) and writes the results as JSON,
+in the same format as the C benchmark (bench.c).
+
+Run with RPIO_SIMULATE=1 to measure against the simulated register backend.
+Interrupt latency needs two wired pins (--loopback OUT:IN) and real hardware.
+
+Compare two result files (eg. of two releases) with
+
+    $ python bench.py --compare old.json new.json
+
+which lists the change of every measurement and exits with 1 if any of them
+got slower by more than --threshold percent.
+"""
+import sys
+import json
+import time
+import threading
+from optparse import OptionParser
+
+# Best clock available (perf_counter is Python 3.3+)
+clock = getattr(time, "perf_counter", time.time)
+
+RUNS = 5
+PWM_REPEATS = 200
+IRQ_SAMPLES = 200
+SUBCYCLES_US = [3000, 10000, 20000, 100000]
+
+
+class Result(object):
+    """ Running mean/min/max of one measurement, in ns per operation """
+    def __init__(self, name, iterations, **params):
+        self.name = name
+        self.iterations = iterations
+        self.params = params
+        self.n = 0
+        self.mean_ns = 0.0
+        self.min_ns = None
+        self.max_ns = None
+
+    def sample(self, ns):
+        self.n += 1
+        self.mean_ns += (ns - self.mean_ns) / self.n
+        self.min_ns = ns if self.min_ns is None else min(self.min_ns, ns)
+        self.max_ns = ns if self.max_ns is None else max(self.max_ns, ns)
+
+    def as_dict(self):
+        return {"name": self.name, "params": self.params,
+                "iterations": self.iterations,
+                "mean_ns": round(self.mean_ns, 1),
+                "min_ns": round(self.min_ns, 1),
+                "max_ns": round(self.max_ns, 1)}
+
+
+def bench_gpio(RPIO, gpio, iterations):
+    results = []
+    RPIO.setup(gpio, RPIO.OUT)
+
+    r = Result("py.output", iterations, gpio=gpio)
+    output = RPIO.output
+    for run in range(RUNS):
+        t0 = clock()
+        for i in range(iterations):
+            output(gpio, i & 1)
+        r.sample((clock() - t0) * 1e9 / iterations)
+    results.append(r)
+
+    r = Result("py.input", iterations, gpio=gpio)
+    input_ = RPIO.input
+    for run in range(RUNS):
+        t0 = clock()
+        for i in range(iterations):
+            input_(gpio)
+        r.sample((clock() - t0) * 1e9 / iterations)
+    results.append(r)
+
+    RPIO.output(gpio, False)
+    return results
+
+
+def bench_pwm(PWM, gpio, granularity_us):
+    results = []
+    PWM.set_loglevel(PWM.LOG_LEVEL_ERRORS)
+    PWM.setup(granularity_us)
+    channel = 0
+    for subcycle_us in SUBCYCLES_US:
+        r = Result("py.pwm.init_channel", RUNS, subcycle_us=subcycle_us,
+                granularity_us=granularity_us)
+        for run in range(RUNS):
+            t0 = clock()
+            PWM.init_channel(channel, subcycle_us)
+            r.sample((clock() - t0) * 1e9)
+            if run < RUNS - 1:
+                PWM.free_channel(channel)
+        results.append(r)
+
+        width = subcycle_us // granularity_us // 10
+        r_add = Result("py.pwm.add_channel_pulse", PWM_REPEATS,
+                subcycle_us=subcycle_us, granularity_us=granularity_us)
+        r_clear = Result("py.pwm.clear_channel_gpio", PWM_REPEATS,
+                subcycle_us=subcycle_us, granularity_us=granularity_us)
+        for run in range(PWM_REPEATS):
+            t0 = clock()
+            PWM.add_channel_pulse(channel, gpio, 0, width)
+            r_add.sample((clock() - t0) * 1e9)
+            t0 = clock()
+            PWM.clear_channel_gpio(channel, gpio)
+            r_clear.sample((clock() - t0) * 1e9)
+        results.extend([r_add, r_clear])
+        PWM.free_channel(channel)
+    PWM.cleanup()
+    return results
+
+
+def bench_interrupts(RPIO, gpio_out, gpio_in):
+    """ Time from RPIO.output(..) until the callback of the wired pin runs """
+    received = threading.Event()
+    stamp = [0]
+
+    def callback(gpio_id, value):
+        stamp[0] = clock()
+        received.set()
+
+    RPIO.setup(gpio_out, RPIO.OUT, initial=RPIO.LOW)
+    RPIO.add_interrupt_callback(gpio_in, callback, edge='both')
+    RPIO.wait_for_interrupts(threaded=True)
+    time.sleep(0.1)
+
+    r = Result("py.interrupt.callback_latency", IRQ_SAMPLES,
+            gpio_out=gpio_out, gpio_in=gpio_in)
+    for i in range(IRQ_SAMPLES):
+        time.sleep(0.001)
+        received.clear()
+        t0 = clock()
+        RPIO.output(gpio_out, (i + 1) & 1)
+        if not received.wait(1):
+            raise SystemExit("no interrupt on gpio %s; are gpio %s and %s "
+                    "connected?" % (gpio_in, gpio_out, gpio_in))
+        r.sample((stamp[0] - t0) * 1e9)
+    RPIO.stop_waiting_for_interrupts()
+    RPIO.del_interrupt_callback(gpio_in)
+    RPIO.output(gpio_out, False)
+    return [r]
+
+
+def run(options):
+    import RPIO
+    from RPIO import PWM
+
+    loopback = options.loopback
+    if loopback and RPIO.SIMULATED:
+        sys.stderr.write("bench: no interrupts in simulation, "
+                "ignoring --loopback\n")
+        loopback = None
+
+    RPIO.setwarnings(False)
+    results = bench_gpio(RPIO, options.gpio, options.iterations)
+    results += bench_pwm(PWM, options.gpio, options.granularity)
+    if loopback:
+        gpio_out, gpio_in = [int(g) for g in loopback.split(":")]
+        results += bench_interrupts(RPIO, gpio_out, gpio_in)
+    RPIO.cleanup()
+
+    return {
+        "suite": "py",
+        "version": RPIO.VERSION,
+        "python": "%s.%s.%s" % sys.version_info[:3],
+        "backend": "simulated" if RPIO.SIMULATED else "hardware",
+        "timestamp": int(time.time()),
+        "skipped": [] if loopback else ["py.interrupt"],
+        "results": [r.as_dict() for r in results],
+    }
+
+
+def result_key(result):
+    params = ",".join("%s=%s" % kv for kv in sorted(result["params"].items()))
+    return "%s(%s)" % (result["name"], params)
+
+
+def compare(fn_old, fn_new, threshold):
+    """ Prints the change of every measurement, returns the regressions """
+    with open(fn_old) as f:
+        old = dict((result_key(r), r) for r in json.load(f)["results"])
+    with open(fn_new) as f:
+        new = json.load(f)["results"]
+
+    regressions = []
+    for r in new:
+        key = result_key(r)
+        if key not in old:
+            print("%-70s %12.1f ns  (new)" % (key, r["mean_ns"]))
+            continue
+        before = old[key]["mean_ns"]
+        change = (r["mean_ns"] - before) * 100 / before if before else 0
+        flag = ""
+        if change > threshold:
+            flag = "  REGRESSION"
+            regressions.append(key)
+        print("%-70s %12.1f ns  %+7.1f%%%s" % (key, r["mean_ns"], change, flag))
+    return regressions
+
+
+def main():
+    parser = OptionParser(usage="%prog [options]\n"
+            "       %prog --compare old.json new.json")
+    parser.add_option("-o", "--output", help="write results to this file")
+    parser.add_option("-n", "--iterations", type="int", default=100000,
+            help="calls per run for output/input (default: 100000)")
+    parser.add_option("-g", "--gpio", type="int", default=17,
+            help="gpio used for output and PWM (default: 17)")
+    parser.add_option("--granularity", type="int", default=10,
+            help="PWM pulse-width increment granularity in us (default: 10)")
+    parser.add_option("--loopback", metavar="OUT:IN",
+            help="measure interrupt latency with these two wired gpios")
+    parser.add_option("--compare", action="store_true",
+            help="compare two result files")
+    parser.add_option("--threshold", type="float", default=10.0,
+            help="regression threshold in percent for --compare "
+            "(default: 10)")
+    options, args = parser.parse_args()
+
+    if options.compare:
+        if len(args) != 2:
+            parser.error("--compare needs two result files")
+        regressions = compare(args[0], args[1], options.threshold)
+        sys.exit(1 if regressions else 0)
+
+    output = json.dumps(run(options), indent=2, sort_keys=True)
+    if options.output:
+        with open(options.output, "w") as f:
+            f.write(output + "\n")
+    else:
+        print(output)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,1689 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * c_events.c is the GPIO event engine: it configures the kernel's sysfs GPIO
+ * interface for edge detection, waits for edges on all registered pins with a
+ * single epoll fd and delivers them as timestamped `struct gpio_event`s.
+ *
+ * The epoll fd returned by events_fileno() is itself pollable, so the engine
+ * can be embedded into other event loops (eg. RPIO's Python epoll loop).
+ *
+ * With the EVENTS_GPIOCHIP backend, the engine uses the GPIO character device
+ * (/dev/gpiochipN, v2 uAPI) instead of sysfs: all registered gpios share one
+ * line request, the kernel buffers their edges with nanosecond timestamps and
+ * sequence numbers, and one read() returns a whole batch of them. Line
+ * offsets are BCM gpio numbers (true for gpiochip0 of the Raspberry Pi).
+ *
+ * Every pin can have an input filter (events_set_filter), which runs on the
+ * raw edges inside the engine: bounces and glitches never leave events_read().
+ * Filtered pins are armed for both edges; pending filter decisions are due at
+ * a deadline, for which the engine keeps a timerfd in its epoll set.
+ *
+ * Several listeners (events_listen) can share a gpio, each with its own edge
+ * and filter: the pin is armed once for the edges of all of them, every raw
+ * edge is read once and demultiplexed to the listeners, whose events carry
+ * their id. The events of a listener with a sink (events_set_sink, eg. the
+ * subscriptions of protocol clients) are passed to the sink in one batch per
+ * events_read() call instead of being returned.
+ *
+ * Other threads can inject edges (events_inject, eg. a replayed recording):
+ * they are queued, and events_read() dispatches them like edges read from
+ * the pins (those of gpios the engine doesn't watch are returned as they
+ * are). All raw edges are passed to the recorder (see record.c).
+ *
+ * Functions return 0 (or a count) on success and -1 with errno set on error.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#ifndef RPIO_NO_GPIOCHIP
+#include <linux/gpio.h>
+#endif
+#include "c_gpio.h"
+#include "c_events.h"
+#include "record.h"
+#include "stats.h"
+#include "trace.h"
+#include "util.h"
+
+// How long to wait for udev to set up a freshly exported gpio (in ms)
+#define EXPORT_TIMEOUT_MS 1000
+
+// Maximum length of sysfs paths (the root is configurable)
+#define SYSFS_PATH_MAX 256
+
+// Maximum number of epoll events handled per events_read() call
+#define EPOLL_BATCH 64
+
+// The gpiochip backend needs the v2 uAPI (Linux 5.10+ headers)
+#ifdef GPIO_V2_GET_LINE_IOCTL
+#define GPIOCHIP_ENABLED 1
+#else
+#define GPIOCHIP_ENABLED 0
+#endif
+
+// Edges the kernel buffers per line request (its maximum)
+#define CHIP_EVENT_BUFFER 1024
+
+// epoll tokens of the gpiochip line request and of the filter timer (other
+// tokens are gpio numbers)
+#define REQUEST_TOKEN 0xffffffff
+#define TIMER_TOKEN   0xfffffffe
+#define INJECT_TOKEN  0xfffffffd
+
+// Injected edges waiting for events_read()
+#define INJECT_QUEUE 1024
+
+// Input filter (FILTER_NONE: raw edges are passed on)
+struct event_filter {
+    int type;
+    uint64_t width_ns;
+    int level;             // last level passed by the filter
+    int raw;               // last level seen on the pin
+    uint64_t raw_ns;       // time of that edge (integrator: integrated up to)
+    uint32_t raw_seqno;
+    uint64_t deadline_ns;  // next decision of the filter, 0 if none pending
+    uint64_t count_ns;     // integrator, 0..width_ns
+};
+
+struct event_pin {
+    int fd;        // open `value` file, -1 if not registered
+    int line;      // 1 if registered as line of the gpiochip request
+    int edge;
+    int exported;  // 1 if the engine exported this gpio (unexport on cleanup)
+    int listeners; // number of listeners on this gpio
+    int listen_edge;  // edges armed on behalf of the listeners
+    struct event_filter filter;
+};
+
+// A listener receives the edges of a gpio through its own edge mask and
+// filter, in events tagged with its id (see events_listen)
+struct event_listener {
+    int used;
+    int gpio;
+    int edge;
+    struct event_filter filter;
+    events_sink sink;      // receives the events instead of events_read()
+};
+
+static struct event_pin event_pins[GPIO_COUNT];
+static struct event_listener listeners[LISTENER_COUNT];
+static int epoll_fd = -1;
+static uint32_t event_seqno = 0;
+
+static int timer_fd = -1;
+static uint64_t timer_armed_ns = 0;
+
+static int inject_fd = -1;
+static struct gpio_event inject_queue[INJECT_QUEUE];
+static int inject_len = 0;
+static pthread_mutex_t inject_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int backend = -1;
+static char chip_path[SYSFS_PATH_MAX];
+static int request_fd = -1;
+static uint64_t request_lines = 0;  // gpio mask of the lines in request_fd
+
+// A blocking events_wait_edge() on lines of the engine's request polls that
+// request too; edges the engine reads first are handed over through tap_fd
+static pthread_mutex_t tap_lock = PTHREAD_MUTEX_INITIALIZER;
+static int tap_fd = -1;             // eventfd, -1 while nobody waits
+static uint64_t tap_mask = 0;       // gpios waited for
+static int tap_edge;
+static int tap_hit;
+static struct gpio_event tap_event;
+
+static const char *edge_names[] = {"none", "rising", "falling", "both"};
+
+const char *
+edge_to_str(int edge)
+{
+    if (edge < EDGE_NONE || edge > EDGE_BOTH)
+        return NULL;
+    return edge_names[edge];
+}
+
+// Returns the EDGE_* value for a sysfs edge name, or -1
+int
+str_to_edge(const char *str)
+{
+    int i;
+    for (i=EDGE_NONE; i<=EDGE_BOTH; i++) {
+        if (strcmp(str, edge_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Root of the sysfs GPIO interface, always with a trailing slash (leaves
+// room for "gpioN/attribute" in SYSFS_PATH_MAX)
+static char sysfs_root[SYSFS_PATH_MAX - 32];
+
+// Sets the root of the sysfs GPIO interface (eg. a fake tree for testing)
+int
+events_set_sysfs_root(const char *root)
+{
+    size_t len = strlen(root);
+
+    if (len == 0 || len + 2 > sizeof(sysfs_root)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(sysfs_root, root, len + 1);
+    if (root[len - 1] != '/')
+        strcat(sysfs_root, "/");
+    return 0;
+}
+
+// Returns the sysfs GPIO root; defaults to $RPIO_SYSFS_GPIO_ROOT if set,
+// else SYSFS_GPIO_ROOT
+const char *
+events_sysfs_root(void)
+{
+    const char *env;
+
+    if (!sysfs_root[0]) {
+        env = getenv("RPIO_SYSFS_GPIO_ROOT");
+        if (!env || events_set_sysfs_root(env) < 0)
+            events_set_sysfs_root(SYSFS_GPIO_ROOT);
+    }
+    return sysfs_root;
+}
+
+// Builds the path of `file` in the root (gpio < 0) or in the gpio's directory
+static void
+sysfs_path(char *path, int gpio, const char *file)
+{
+    if (gpio < 0)
+        snprintf(path, SYSFS_PATH_MAX, "%s%s", events_sysfs_root(), file);
+    else
+        snprintf(path, SYSFS_PATH_MAX, "%sgpio%d/%s", events_sysfs_root(), gpio, file);
+}
+
+static int
+sysfs_write(const char *path, const char *value)
+{
+    int fd, len = strlen(value);
+
+    if ((fd = open(path, O_WRONLY|O_TRUNC)) < 0)
+        return -1;
+    if (write(fd, value, len) != len) {
+        close(fd);
+        return -1;
+    }
+    return close(fd);
+}
+
+// Reads an attribute into `buf` without the trailing newline
+static int
+sysfs_read(const char *path, char *buf, int size)
+{
+    int fd, n;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return -1;
+    n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    while (n > 0 && (buf[n-1] == '\n' || buf[n-1] == ' '))
+        n--;
+    buf[n] = '\0';
+    return 0;
+}
+
+// Writes an attribute of a gpio only if it does not have the value yet
+static int
+sysfs_update(int gpio, const char *file, const char *value)
+{
+    char path[SYSFS_PATH_MAX], current[16];
+
+    sysfs_path(path, gpio, file);
+    if (sysfs_read(path, current, sizeof(current)) == 0 && strcmp(current, value) == 0)
+        return 0;
+    return sysfs_write(path, value);
+}
+
+// Reads the level of an opened `value` file; returns 0 or 1, or -1 on error
+int
+events_read_level(int fd)
+{
+    char buf[2];
+
+    if (lseek(fd, 0, SEEK_SET) < 0 || read(fd, buf, sizeof(buf)) < 1)
+        return -1;
+    return buf[0] == '1';
+}
+
+// Configures `count` gpios as inputs with edge detection in one batch: all
+// missing gpios are exported through one open `export` file, the new nodes
+// are then awaited together (polling, no fixed sleeps), and `direction` and
+// `edge` are only written if they differ, so already exported gpios are
+// reused as they are. Opens every `value` file and consumes its initial
+// state. On error, all value files opened so far are closed again and the
+// gpios exported by this call are unexported.
+int
+events_sysfs_setup(struct sysfs_pin *pins, int count)
+{
+    char path[SYSFS_PATH_MAX], value[16];
+    struct stat st;
+    int i, fd = -1, len, pending = 0, waited, opened = 0, err;
+
+    for (i=0; i<count; i++) {
+        if (pins[i].gpio < 0 || pins[i].gpio >= GPIO_COUNT ||
+                pins[i].edge < EDGE_NONE || pins[i].edge > EDGE_BOTH) {
+            errno = EINVAL;
+            return -1;
+        }
+        pins[i].fd = -1;
+        pins[i].exported = 0;
+    }
+
+    for (i=0; i<count; i++) {
+        sysfs_path(path, pins[i].gpio, "direction");
+        if (stat(path, &st) == 0)
+            continue;
+        if (fd < 0) {
+            sysfs_path(path, -1, "export");
+            if ((fd = open(path, O_WRONLY|O_CLOEXEC)) < 0)
+                goto error;
+        }
+        len = snprintf(value, sizeof(value), "%d\n", pins[i].gpio);
+        if (write(fd, value, len) != len) {
+            err = errno;
+            close(fd);
+            errno = err;
+            goto error;
+        }
+        pins[i].exported = 1;
+        pending++;
+    }
+    if (fd >= 0)
+        close(fd);
+
+    // udev may need a moment to fix up permissions of the new nodes
+    for (waited=0; pending && waited<EXPORT_TIMEOUT_MS; waited++) {
+        pending = 0;
+        for (i=0; i<count; i++) {
+            sysfs_path(path, pins[i].gpio, "direction");
+            if (pins[i].exported && access(path, W_OK) < 0)
+                pending++;
+        }
+        if (pending)
+            usleep(1000);
+    }
+
+    for (opened=0; opened<count; opened++) {
+        if (sysfs_update(pins[opened].gpio, "direction", "in") < 0 ||
+                sysfs_update(pins[opened].gpio, "edge", edge_to_str(pins[opened].edge)) < 0)
+            goto error;
+
+        sysfs_path(path, pins[opened].gpio, "value");
+        if ((fd = open(path, O_RDONLY|O_NONBLOCK|O_CLOEXEC)) < 0)
+            goto error;
+
+        // Consume the initial state, else poll reports it right away
+        if ((pins[opened].level = events_read_level(fd)) < 0) {
+            close(fd);
+            goto error;
+        }
+        pins[opened].fd = fd;
+    }
+    return 0;
+
+error:
+    err = errno;
+    for (i=0; i<opened; i++) {
+        close(pins[i].fd);
+        pins[i].fd = -1;
+    }
+    for (i=0; i<count; i++) {
+        if (pins[i].exported) {
+            events_sysfs_unexport(pins[i].gpio);
+            pins[i].exported = 0;
+        }
+    }
+    errno = err;
+    return -1;
+}
+
+// Removes the sysfs interface of a gpio
+int
+events_sysfs_unexport(int gpio)
+{
+    char path[SYSFS_PATH_MAX], value[16];
+
+    sysfs_path(path, -1, "unexport");
+    snprintf(value, sizeof(value), "%d\n", gpio);
+    return sysfs_write(path, value);
+}
+
+// Returns the backend: EVENTS_SYSFS, or EVENTS_GPIOCHIP (default if
+// $RPIO_INTERRUPT_BACKEND is "gpiochip"; the chip defaults to $RPIO_GPIOCHIP
+// or GPIOCHIP_DEFAULT)
+int
+events_backend(void)
+{
+    const char *env;
+
+    if (backend < 0) {
+        env = getenv("RPIO_INTERRUPT_BACKEND");
+        if (!env || events_set_backend(str_to_backend(env), getenv("RPIO_GPIOCHIP")) < 0)
+            events_set_backend(EVENTS_SYSFS, NULL);
+    }
+    return backend;
+}
+
+const char *
+events_chip(void)
+{
+    events_backend();
+    return chip_path;
+}
+
+// Switches the backend (chip: gpiochip device or NULL for the default). Only
+// possible while no gpio is registered.
+int
+events_set_backend(int new_backend, const char *chip)
+{
+    int i;
+
+    if (new_backend != EVENTS_SYSFS && new_backend != EVENTS_GPIOCHIP) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (new_backend == EVENTS_GPIOCHIP && !GPIOCHIP_ENABLED) {
+        errno = ENOSYS;
+        return -1;
+    }
+    if (chip && (!chip[0] || strlen(chip) >= sizeof(chip_path))) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i=0; i<GPIO_COUNT; i++) {
+        if (epoll_fd >= 0 && (event_pins[i].fd >= 0 || event_pins[i].line)) {
+            errno = EBUSY;
+            return -1;
+        }
+    }
+    backend = new_backend;
+    strcpy(chip_path, chip ? chip : GPIOCHIP_DEFAULT);
+    return 0;
+}
+
+static const char *filter_names[] = {"none", "stable", "holdoff", "integrator"};
+
+const char *
+filter_to_str(int filter)
+{
+    if (filter < FILTER_NONE || filter > FILTER_INTEGRATOR)
+        return NULL;
+    return filter_names[filter];
+}
+
+// Returns the FILTER_* value for a filter name, or -1
+int
+str_to_filter(const char *str)
+{
+    int i;
+    for (i=FILTER_NONE; i<=FILTER_INTEGRATOR; i++) {
+        if (strcmp(str, filter_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static const char *backend_names[] = {"sysfs", "gpiochip"};
+
+const char *
+backend_to_str(int id)
+{
+    if (id < EVENTS_SYSFS || id > EVENTS_GPIOCHIP)
+        return NULL;
+    return backend_names[id];
+}
+
+// Returns the EVENTS_* value for a backend name, or -1
+int
+str_to_backend(const char *str)
+{
+    int i;
+    for (i=EVENTS_SYSFS; i<=EVENTS_GPIOCHIP; i++) {
+        if (strcmp(str, backend_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Filters see both edges; the configured edge is applied to their output
+static int
+armed_edge(int gpio)
+{
+    struct event_pin *pin = &event_pins[gpio];
+
+    return pin->filter.type ? EDGE_BOTH : pin->edge | pin->listen_edge;
+}
+
+// Updates the edges armed for the listeners of a gpio: their own edges, or
+// both if one of them has a filter
+static void
+update_listen_edge(int gpio)
+{
+    int i, edge = EDGE_NONE, left = event_pins[gpio].listeners;
+
+    for (i=0; i<LISTENER_COUNT && left; i++) {
+        if (listeners[i].used && listeners[i].gpio == gpio) {
+            edge |= listeners[i].filter.type ? EDGE_BOTH : listeners[i].edge;
+            left--;
+        }
+    }
+    event_pins[gpio].listen_edge = edge;
+}
+
+#if GPIOCHIP_ENABLED
+static uint64_t
+edge_to_flags(int edge)
+{
+    uint64_t flags = GPIO_V2_LINE_FLAG_INPUT;
+
+    if (edge & EDGE_RISING)
+        flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+    if (edge & EDGE_FALLING)
+        flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    return flags;
+}
+
+// Configures `count` lines as inputs with edge detection. Lines with other
+// edges than the first get a flags attribute per edge kind.
+static void
+chip_line_config(struct gpio_v2_line_config *config, const int *edges, int count)
+{
+    struct gpio_v2_line_config_attribute *attr;
+    uint64_t mask;
+    int i, edge;
+
+    memset(config, 0, sizeof(*config));
+    config->flags = edge_to_flags(edges[0]);
+    for (edge=EDGE_NONE; edge<=EDGE_BOTH; edge++) {
+        mask = 0;
+        for (i=0; i<count; i++) {
+            if (edges[i] == edge && edge != edges[0])
+                mask |= 1ULL << i;
+        }
+        if (!mask)
+            continue;
+        attr = &config->attrs[config->num_attrs++];
+        attr->attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+        attr->attr.flags = edge_to_flags(edge);
+        attr->mask = mask;
+    }
+}
+
+// Requests `count` lines as inputs with edge detection in one line request.
+// Returns the (non-blocking) request fd, or -1.
+static int
+chip_request_lines(const int *gpios, const int *edges, int count)
+{
+    struct gpio_v2_line_request req;
+    int i, chip_fd, err;
+
+    memset(&req, 0, sizeof(req));
+    for (i=0; i<count; i++)
+        req.offsets[i] = gpios[i];
+    req.num_lines = count;
+    req.event_buffer_size = CHIP_EVENT_BUFFER;
+    strncpy(req.consumer, "RPIO", sizeof(req.consumer) - 1);
+    chip_line_config(&req.config, edges, count);
+
+    if ((chip_fd = open(chip_path, O_RDONLY|O_CLOEXEC)) < 0)
+        return -1;
+    if (ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+        err = errno;
+        close(chip_fd);
+        errno = err;
+        return -1;
+    }
+    close(chip_fd);
+    fcntl(req.fd, F_SETFL, fcntl(req.fd, F_GETFL) | O_NONBLOCK);
+    return req.fd;
+}
+
+// Reads up to `max_events` buffered line events from a request fd
+static int
+chip_read_events(int fd, struct gpio_event *events, int max_events)
+{
+    struct gpio_v2_line_event buf[EPOLL_BATCH];
+    int i, n;
+
+    if (max_events > EPOLL_BATCH)
+        max_events = EPOLL_BATCH;
+    if ((n = read(fd, buf, max_events * sizeof(buf[0]))) < 0)
+        return errno == EAGAIN ? 0 : -1;
+
+    n /= sizeof(buf[0]);
+    for (i=0; i<n; i++) {
+        events[i].timestamp_ns = buf[i].timestamp_ns;
+        events[i].seqno = buf[i].seqno;
+        events[i].gpio = buf[i].offset;
+        events[i].level = buf[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+        events[i].edge = events[i].level ? EDGE_RISING : EDGE_FALLING;
+        events[i].listener = LISTENER_NONE;
+        TRACE_AT(buf[i].timestamp_ns, TRACE_INTERRUPT, buf[i].offset, events[i].level, 0, 0);
+    }
+    return n;
+}
+
+// Hands the first of `n` edges matching a waiting events_wait_edge() over
+// to it (see chip_wait_edge)
+static void
+chip_tap(const struct gpio_event *raw, int n)
+{
+    uint64_t one = 1;
+    int i;
+
+    if (!__atomic_load_n(&tap_mask, __ATOMIC_ACQUIRE))
+        return;
+    pthread_mutex_lock(&tap_lock);
+    for (i=0; i<n && tap_fd >= 0 && !tap_hit; i++) {
+        if (((tap_mask >> raw[i].gpio) & 1) && (raw[i].edge & tap_edge)) {
+            tap_event = raw[i];
+            tap_hit = 1;
+            if (write(tap_fd, &one, sizeof(one)) < 0)
+                tap_hit = 0;
+        }
+    }
+    pthread_mutex_unlock(&tap_lock);
+}
+
+// Makes the engine's line request cover all registered lines with their
+// armed edges: reconfigures it in place while the set of lines is the same,
+// replaces it otherwise
+static int
+chip_update_request(void)
+{
+    struct gpio_v2_line_config config;
+    struct epoll_event ev;
+    int gpios[GPIO_COUNT], edges[GPIO_COUNT];
+    uint64_t lines = 0;
+    int i, fd = -1, count = 0;
+
+    for (i=0; i<GPIO_COUNT; i++) {
+        if (event_pins[i].line) {
+            gpios[count] = i;
+            edges[count++] = armed_edge(i);
+            lines |= 1ULL << i;
+        }
+    }
+    if (count && request_fd >= 0 && lines == request_lines) {
+        chip_line_config(&config, edges, count);
+        return ioctl(request_fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0 ? -1 : 0;
+    }
+    if (count && (fd = chip_request_lines(gpios, edges, count)) < 0)
+        return -1;
+
+    if (request_fd >= 0) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, request_fd, NULL);
+        close(request_fd);
+    }
+    request_fd = fd;
+    request_lines = lines;
+    if (fd >= 0) {
+        ev.events = EPOLLIN;
+        ev.data.u32 = REQUEST_TOKEN;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+// Reads the level of a line of the engine's request; returns 0 or 1, or -1
+static int
+chip_line_level(int gpio)
+{
+    struct gpio_v2_line_values values;
+    int i, index = 0;
+
+    // Lines are requested in ascending order
+    for (i=0; i<gpio; i++)
+        index += event_pins[i].line;
+    values.mask = 1ULL << index;
+    values.bits = 0;
+    if (ioctl(request_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0)
+        return -1;
+    return (values.bits >> index) & 1;
+}
+
+// events_wait_edge() for the gpiochip backend. Lines the engine holds are
+// served from the engine's request (which must have their edges armed, or
+// EBUSY): edges read from it are passed on to the engine through
+// events_inject(), and those the engine reads first come in through the tap.
+// Only one call at a time can wait on such lines (EBUSY). Other lines get a
+// line request of their own.
+static int
+chip_wait_edge(const int *gpios, int count, int edge, int timeout_ms,
+        struct gpio_event *event)
+{
+    struct pollfd fds[3];
+    struct gpio_event buf[EPOLL_BATCH];
+    int own[GPIO_COUNT], edges[GPIO_COUNT];
+    uint64_t held = 0, deadline = 0, now, value;
+    int i, j, n, nown = 0, nfds = 0, tap_i = -1, engine_fd = request_fd, result = -1, err;
+
+    for (i=0; i<count; i++) {
+        if (!event_pins[gpios[i]].line) {
+            own[nown] = gpios[i];
+            edges[nown++] = edge;
+        } else if ((armed_edge(gpios[i]) & edge) != edge) {
+            errno = EBUSY;
+            return -1;
+        } else {
+            held |= 1ULL << gpios[i];
+        }
+    }
+    if (nown) {
+        if ((fds[0].fd = chip_request_lines(own, edges, nown)) < 0)
+            return -1;
+        fds[nfds++].events = POLLIN;
+    }
+    if (held) {
+        pthread_mutex_lock(&tap_lock);
+        if (tap_fd >= 0) {
+            errno = EBUSY;
+        } else if ((tap_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC)) >= 0) {
+            tap_edge = edge;
+            tap_hit = 0;
+            __atomic_store_n(&tap_mask, held, __ATOMIC_RELEASE);
+        }
+        fds[nfds].fd = tap_fd;
+        pthread_mutex_unlock(&tap_lock);
+        if (fds[nfds].fd < 0) {
+            held = 0;
+            goto out;
+        }
+        fds[tap_i = nfds++].events = POLLIN;
+        fds[nfds].fd = engine_fd;
+        fds[nfds++].events = POLLIN;
+    }
+
+    if (timeout_ms > 0)
+        deadline = monotonic_ns() + (uint64_t)timeout_ms * 1000000;
+    for (;;) {
+        if ((n = poll(fds, nfds, timeout_ms)) <= 0) {
+            result = n;
+            goto out;
+        }
+
+        for (i=0; i<nfds; i++) {
+            if (!(fds[i].revents & POLLIN))
+                continue;
+            if (held && i == tap_i + 1) {
+                if ((n = chip_read_events(engine_fd, buf, EPOLL_BATCH)) < 0)
+                    goto out;
+                for (j=0; j<n && result < 1; j++) {
+                    if (((held >> buf[j].gpio) & 1) && (buf[j].edge & edge)) {
+                        *event = buf[j];
+                        result = 1;
+                    }
+                }
+                if (n && events_inject(buf, n) < n)
+                    STATS_INC(STAT_EVENTS_DROPPED);
+            } else if (held && i == tap_i) {
+                pthread_mutex_lock(&tap_lock);
+                if (read(tap_fd, &value, sizeof(value)) > 0 && tap_hit) {
+                    *event = tap_event;
+                    result = 1;
+                }
+                pthread_mutex_unlock(&tap_lock);
+            } else {
+                // The kernel only queues the requested edges, no need to filter
+                if ((n = chip_read_events(fds[i].fd, event, 1)) < 0)
+                    goto out;
+                if (n)
+                    result = 1;
+            }
+            if (result == 1)
+                goto out;
+        }
+
+        // Nothing for us (eg. read by someone else meanwhile): poll again
+        if (timeout_ms > 0) {
+            now = monotonic_ns();
+            if (now >= deadline) {
+                result = 0;
+                goto out;
+            }
+            timeout_ms = (deadline - now + 999999) / 1000000;
+        }
+    }
+
+out:
+    err = errno;
+    if (nown)
+        close(fds[0].fd);
+    if (held) {
+        pthread_mutex_lock(&tap_lock);
+        __atomic_store_n(&tap_mask, 0, __ATOMIC_RELEASE);
+        close(tap_fd);
+        tap_fd = -1;
+        pthread_mutex_unlock(&tap_lock);
+    }
+    errno = err;
+    return result;
+}
+#else
+static int chip_read_events(int fd, struct gpio_event *events, int max_events) { errno = ENOSYS; return -1; }
+static int chip_update_request(void) { errno = ENOSYS; return -1; }
+static void chip_tap(const struct gpio_event *raw, int n) { }
+static int chip_line_level(int gpio) { errno = ENOSYS; return -1; }
+static int chip_wait_edge(const int *gpios, int count, int edge, int timeout_ms,
+        struct gpio_event *event) { errno = ENOSYS; return -1; }
+#endif
+
+// Requests `count` lines of the gpiochip with edge detection, independent of
+// the engine (eg. for edge counters). Returns the non-blocking request fd.
+int
+events_request_lines(const int *gpios, const int *edges, int count)
+{
+#if GPIOCHIP_ENABLED
+    events_backend();
+    return chip_request_lines(gpios, edges, count);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// Reads up to `max_events` buffered edges from a request fd (0 if none)
+int
+events_read_lines(int fd, struct gpio_event *events, int max_events)
+{
+    return chip_read_events(fd, events, max_events);
+}
+
+// Starts a filter at `level`, with nothing pending
+static void
+filter_reset(struct event_filter *f, int level)
+{
+    f->level = f->raw = level;
+    f->raw_ns = monotonic_ns();
+    f->raw_seqno = 0;
+    f->deadline_ns = 0;
+    f->count_ns = level ? f->width_ns : 0;
+}
+
+// Starts the filters of a gpio and of its listeners at `level`
+static void
+filters_reset(int gpio, int level)
+{
+    int i, left = event_pins[gpio].listeners;
+
+    filter_reset(&event_pins[gpio].filter, level);
+    for (i=0; i<LISTENER_COUNT && left; i++) {
+        if (listeners[i].used && listeners[i].gpio == gpio) {
+            filter_reset(&listeners[i].filter, level);
+            left--;
+        }
+    }
+}
+
+// The filter passes a transition to `level`; returns 1 if `event` was written
+// (the transition matches `edge`), else 0
+static int
+filter_emit(struct event_filter *f, int edge, int level, uint64_t timestamp_ns,
+        uint32_t seqno, struct gpio_event *event)
+{
+    f->level = level;
+    if (!(edge & (level ? EDGE_RISING : EDGE_FALLING)))
+        return 0;
+    event->timestamp_ns = timestamp_ns;
+    event->seqno = seqno;
+    event->level = level;
+    event->edge = level ? EDGE_RISING : EDGE_FALLING;
+    return 1;
+}
+
+// Makes the pending decision of a filter if it is due at `now`
+static int
+filter_expire(struct event_filter *f, int edge, uint64_t now,
+        struct gpio_event *event)
+{
+    uint64_t due = f->deadline_ns;
+
+    if (!due || due > now)
+        return 0;
+    f->deadline_ns = 0;
+
+    switch (f->type) {
+    case FILTER_STABLE:
+        // The level held for width_ns since its last edge
+        return filter_emit(f, edge, f->raw, f->raw_ns, f->raw_seqno, event);
+    case FILTER_HOLDOFF:
+        if (f->raw == f->level)
+            return 0;
+        // The level changed during the hold-off: settle, and hold off again
+        f->deadline_ns = due + f->width_ns;
+        return filter_emit(f, edge, f->raw, f->raw_ns, f->raw_seqno, event);
+    case FILTER_INTEGRATOR:
+        // The integrator saturated at `due`
+        f->count_ns = f->raw ? f->width_ns : 0;
+        f->raw_ns = due;
+        return filter_emit(f, edge, f->raw, due, f->raw_seqno, event);
+    }
+    return 0;
+}
+
+// Runs a raw edge through a filter; returns the number of events written
+// (at most 1)
+static int
+filter_event(struct event_filter *f, int edge, const struct gpio_event *raw,
+        struct gpio_event *event)
+{
+    uint64_t ts = raw->timestamp_ns, dt;
+    int n;
+
+    if (!f->type)
+        return filter_emit(f, edge, raw->level, ts, raw->seqno, event);
+
+    // A decision due before this edge comes first
+    n = filter_expire(f, edge, ts, event);
+    event += n;
+
+    switch (f->type) {
+    case FILTER_STABLE:
+        // Every edge restarts the window; an edge back to the reported
+        // level cancels the pending transition
+        if (f->deadline_ns)
+            STATS_INC(STAT_DEBOUNCE_SUPPRESSED);
+        f->deadline_ns = 0;
+        if (raw->level != f->level)
+            f->deadline_ns = ts + f->width_ns;
+        else
+            STATS_INC(STAT_DEBOUNCE_SUPPRESSED);
+        break;
+
+    case FILTER_HOLDOFF:
+        if (!f->deadline_ns && raw->level != f->level) {
+            f->raw = raw->level;
+            f->raw_ns = ts;
+            f->raw_seqno = raw->seqno;
+            f->deadline_ns = ts + f->width_ns;
+            return n + filter_emit(f, edge, raw->level, ts, raw->seqno, event);
+        }
+        STATS_INC(STAT_DEBOUNCE_SUPPRESSED);
+        break;
+
+    case FILTER_INTEGRATOR:
+        // Integrate the previous level up to this edge (without saturating,
+        // else filter_expire() would have decided)
+        dt = ts > f->raw_ns ? ts - f->raw_ns : 0;
+        if (f->raw)
+            f->count_ns = f->count_ns + dt < f->width_ns ? f->count_ns + dt : f->width_ns;
+        else
+            f->count_ns = f->count_ns > dt ? f->count_ns - dt : 0;
+        if (f->deadline_ns)
+            STATS_INC(STAT_DEBOUNCE_SUPPRESSED);
+        f->deadline_ns = 0;
+        if (raw->level != f->level)
+            f->deadline_ns = ts + (raw->level ? f->width_ns - f->count_ns : f->count_ns);
+        else
+            STATS_INC(STAT_DEBOUNCE_SUPPRESSED);
+        break;
+    }
+    f->raw = raw->level;
+    f->raw_ns = ts;
+    f->raw_seqno = raw->seqno;
+    return n;
+}
+
+// Tags the event just written by a filter with its gpio and listener
+static int
+tag_event(struct gpio_event *event, int n, int gpio, uint32_t listener)
+{
+    if (n) {
+        event->gpio = gpio;
+        event->listener = listener;
+    }
+    return n;
+}
+
+// Runs a raw edge through the filter of its pin and those of the pin's
+// listeners (one read of the pin serves all of them); returns the number of
+// events written (at most 1 + listeners)
+static int
+dispatch_edge(const struct gpio_event *raw, struct gpio_event *events)
+{
+    struct event_pin *pin = &event_pins[raw->gpio];
+    int i, count, left = pin->listeners;
+
+    count = tag_event(events, filter_event(&pin->filter, pin->edge, raw, events),
+            raw->gpio, LISTENER_NONE);
+    for (i=0; i<LISTENER_COUNT && left; i++) {
+        if (!listeners[i].used || listeners[i].gpio != raw->gpio)
+            continue;
+        left--;
+        count += tag_event(events + count, filter_event(&listeners[i].filter,
+                listeners[i].edge, raw, events + count), raw->gpio, i);
+    }
+    return count;
+}
+
+// Passes the events of listeners with a sink to their sinks (a batch per
+// run of events of the same sink), and returns the number of other events,
+// which are kept in order at the start of `events`
+static int
+dispatch_sinks(struct gpio_event *events, int count)
+{
+    struct gpio_event sunk[EPOLL_BATCH];
+    events_sink sink = NULL, next;
+    int i, kept = 0, n = 0;
+
+    for (i=0; i<count; i++) {
+        next = events[i].listener == LISTENER_NONE ? NULL :
+                listeners[events[i].listener].sink;
+        if (!next) {
+            events[kept++] = events[i];
+            continue;
+        }
+        if (n && next != sink) {
+            sink(sunk, n);
+            n = 0;
+        }
+        sink = next;
+        sunk[n++] = events[i];
+    }
+    if (n)
+        sink(sunk, n);
+    return kept;
+}
+
+// Makes all filter decisions due at `now`, writing up to max_events events
+// (decisions which don't fit stay pending)
+static int
+dispatch_expired(uint64_t now, struct gpio_event *events, int max_events)
+{
+    struct event_filter *f;
+    int i, count = 0;
+
+    for (i=0; i<GPIO_COUNT && count<max_events; i++) {
+        f = &event_pins[i].filter;
+        if (f->deadline_ns)
+            count += tag_event(events + count, filter_expire(f,
+                    event_pins[i].edge, now, events + count), i, LISTENER_NONE);
+    }
+    for (i=0; i<LISTENER_COUNT && count<max_events; i++) {
+        f = &listeners[i].filter;
+        if (listeners[i].used && f->deadline_ns)
+            count += tag_event(events + count, filter_expire(f,
+                    listeners[i].edge, now, events + count), listeners[i].gpio, i);
+    }
+    return count;
+}
+
+// Arms the timer for the earliest pending filter decision (or disarms it)
+static void
+filter_arm_timer(void)
+{
+    struct itimerspec its;
+    uint64_t next = 0, due;
+    int i;
+
+    for (i=0; i<GPIO_COUNT; i++) {
+        due = event_pins[i].filter.deadline_ns;
+        if (due && (!next || due < next))
+            next = due;
+    }
+    for (i=0; i<LISTENER_COUNT; i++) {
+        due = listeners[i].used ? listeners[i].filter.deadline_ns : 0;
+        if (due && (!next || due < next))
+            next = due;
+    }
+    if (next == timer_armed_ns)
+        return;
+
+    // An it_value of zero disarms, a past deadline fires at once
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = next / 1000000000;
+    its.it_value.tv_nsec = next % 1000000000;
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0)
+        timer_armed_ns = next;
+}
+
+// Creates the epoll fd (and the filter timer in it). Can be called multiple
+// times.
+int
+events_setup(void)
+{
+    struct epoll_event ev;
+    int i, err;
+
+    if (epoll_fd >= 0)
+        return 0;
+    if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        return -1;
+    if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) < 0)
+        goto error;
+    ev.events = EPOLLIN;
+    ev.data.u32 = TIMER_TOKEN;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) < 0)
+        goto error;
+    if ((inject_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC)) < 0)
+        goto error;
+    ev.data.u32 = INJECT_TOKEN;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inject_fd, &ev) < 0)
+        goto error;
+    timer_armed_ns = 0;
+    for (i=0; i<GPIO_COUNT; i++)
+        event_pins[i].fd = -1;
+    return 0;
+
+error:
+    err = errno;
+    if (timer_fd >= 0)
+        close(timer_fd);
+    if (inject_fd >= 0)
+        close(inject_fd);
+    close(epoll_fd);
+    timer_fd = inject_fd = epoll_fd = -1;
+    errno = err;
+    return -1;
+}
+
+int
+events_fileno(void)
+{
+    return epoll_fd;
+}
+
+// Starts edge detection on `count` gpios in one batch. With the sysfs backend
+// the gpios are exported if needed; with the gpiochip backend the engine's
+// line request is replaced by one which includes them.
+int
+events_add_gpios(const int *gpios, const int *edges, int count)
+{
+    struct sysfs_pin pins[GPIO_COUNT];
+    struct epoll_event ev;
+    int i, err;
+
+    if (count < 0 || count > GPIO_COUNT) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i=0; i<count; i++) {
+        if (gpios[i] < 0 || gpios[i] >= GPIO_COUNT || edges[i] < EDGE_NONE || edges[i] > EDGE_BOTH) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    if (events_setup() < 0)
+        return -1;
+    for (i=0; i<count; i++) {
+        if (event_pins[gpios[i]].fd >= 0 || event_pins[gpios[i]].line) {
+            errno = EEXIST;
+            return -1;
+        }
+    }
+
+    if (events_backend() == EVENTS_GPIOCHIP) {
+        for (i=0; i<count; i++) {
+            event_pins[gpios[i]].line = 1;
+            event_pins[gpios[i]].edge = edges[i];
+        }
+        if (chip_update_request() < 0) {
+            err = errno;
+            for (i=0; i<count; i++)
+                event_pins[gpios[i]].line = 0;
+            errno = err;
+            return -1;
+        }
+        for (i=0; i<count; i++) {
+            if (armed_edge(gpios[i]) == EDGE_BOTH)
+                filters_reset(gpios[i], chip_line_level(gpios[i]) == 1);
+        }
+        return 0;
+    }
+
+    for (i=0; i<count; i++) {
+        pins[i].gpio = gpios[i];
+        event_pins[gpios[i]].edge = edges[i];
+        pins[i].edge = armed_edge(gpios[i]);
+    }
+    if (events_sysfs_setup(pins, count) < 0)
+        return -1;
+
+    for (i=0; i<count; i++) {
+        if (pins[i].exported)
+            event_pins[gpios[i]].exported = 1;
+        ev.events = EPOLLPRI | EPOLLERR;
+        ev.data.u32 = gpios[i];
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pins[i].fd, &ev) < 0) {
+            err = errno;
+            while (i < count)
+                close(pins[i++].fd);
+            errno = err;
+            return -1;
+        }
+        event_pins[gpios[i]].fd = pins[i].fd;
+        filters_reset(gpios[i], pins[i].level);
+    }
+    return 0;
+}
+
+// Starts edge detection on a gpio
+int
+events_add_gpio(int gpio, int edge)
+{
+    return events_add_gpios(&gpio, &edge, 1);
+}
+
+// Returns 1 if the engine watches a gpio (its value file or line), else 0
+int
+events_watched(int gpio)
+{
+    return gpio >= 0 && gpio < GPIO_COUNT && epoll_fd >= 0 &&
+            (event_pins[gpio].fd >= 0 || event_pins[gpio].line);
+}
+
+// Stops edge detection on a gpio and removes its filter and listeners (the
+// sysfs interface stays exported)
+int
+events_del_gpio(int gpio)
+{
+    int i;
+
+    if (gpio < 0 || gpio >= GPIO_COUNT || epoll_fd < 0 ||
+            (event_pins[gpio].fd < 0 && !event_pins[gpio].line)) {
+        errno = EINVAL;
+        return -1;
+    }
+    event_pins[gpio].filter.type = FILTER_NONE;
+    event_pins[gpio].filter.deadline_ns = 0;
+    for (i=0; i<LISTENER_COUNT && event_pins[gpio].listeners; i++) {
+        if (listeners[i].used && listeners[i].gpio == gpio) {
+            listeners[i].used = 0;
+            event_pins[gpio].listeners--;
+        }
+    }
+    event_pins[gpio].listen_edge = EDGE_NONE;
+    if (event_pins[gpio].line) {
+        event_pins[gpio].line = 0;
+        return chip_update_request();
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, event_pins[gpio].fd, NULL);
+    close(event_pins[gpio].fd);
+    event_pins[gpio].fd = -1;
+    return 0;
+}
+
+// Re-arms a registered gpio if its armed edge is no longer `armed`, and starts
+// `f` (if any) at the current level
+static int
+pin_rearm(int gpio, int armed, struct event_filter *f)
+{
+    struct event_pin *pin = &event_pins[gpio];
+    int level;
+
+    if (pin->fd >= 0) {
+        if (armed_edge(gpio) != armed &&
+                sysfs_update(gpio, "edge", edge_to_str(armed_edge(gpio))) < 0)
+            return -1;
+        level = f ? events_read_level(pin->fd) : 0;
+    } else if (pin->line) {
+        if (armed_edge(gpio) != armed && chip_update_request() < 0)
+            return -1;
+        level = f ? chip_line_level(gpio) : 0;
+    } else {
+        return 0;
+    }
+    if (level < 0)
+        return -1;
+    if (f)
+        filter_reset(f, level);
+    return 0;
+}
+
+// Sets the input filter of a gpio, before or after adding it. width_us is
+// the time a level must be stable (FILTER_STABLE; shorter pulses are
+// dropped), the hold-off after a reported edge, at whose end the level is
+// reported again if it changed meanwhile (FILTER_HOLDOFF), or the time the
+// integrator needs to swing from one level to the other (FILTER_INTEGRATOR).
+int
+events_set_filter(int gpio, int filter, uint32_t width_us)
+{
+    struct event_pin *pin;
+    int armed;
+
+    if (gpio < 0 || gpio >= GPIO_COUNT || filter < FILTER_NONE ||
+            filter > FILTER_INTEGRATOR || (filter && !width_us)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (events_setup() < 0)
+        return -1;
+
+    pin = &event_pins[gpio];
+    armed = armed_edge(gpio);
+    pin->filter.type = filter;
+    pin->filter.width_ns = (uint64_t)width_us * 1000;
+    return pin_rearm(gpio, armed, &pin->filter);
+}
+
+// Adds a listener to a gpio, before or after adding the gpio: its edges are
+// run through the listener's own filter (as in events_set_filter) and those
+// matching `edge` are delivered as events tagged with the returned listener
+// id. The gpio is armed for the edges of all its listeners (both if one has
+// a filter), so listeners for different edges share its single fd (or
+// line). Returns -1 with errno ENOSPC if there are no free listeners.
+int
+events_listen(int gpio, int edge, int filter, uint32_t width_us)
+{
+    struct event_listener *l = NULL;
+    int i, armed, err;
+
+    if (gpio < 0 || gpio >= GPIO_COUNT || edge < EDGE_NONE || edge > EDGE_BOTH ||
+            filter < FILTER_NONE || filter > FILTER_INTEGRATOR ||
+            (filter && !width_us)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (events_setup() < 0)
+        return -1;
+    for (i=0; i<LISTENER_COUNT && !l; i++) {
+        if (!listeners[i].used)
+            l = &listeners[i];
+    }
+    if (!l || event_pins[gpio].listeners >= LISTENERS_PER_PIN) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    armed = armed_edge(gpio);
+    memset(l, 0, sizeof(*l));
+    l->used = 1;
+    l->gpio = gpio;
+    l->edge = edge;
+    l->filter.type = filter;
+    l->filter.width_ns = (uint64_t)width_us * 1000;
+    event_pins[gpio].listeners++;
+    update_listen_edge(gpio);
+    if (pin_rearm(gpio, armed, &l->filter) < 0) {
+        err = errno;
+        l->used = 0;
+        event_pins[gpio].listeners--;
+        update_listen_edge(gpio);
+        errno = err;
+        return -1;
+    }
+    return l - listeners;
+}
+
+// Removes a listener (the gpio goes back to its own edge once it has none)
+int
+events_unlisten(int id)
+{
+    int gpio, armed;
+
+    if (id < 0 || id >= LISTENER_COUNT || !listeners[id].used) {
+        errno = EINVAL;
+        return -1;
+    }
+    gpio = listeners[id].gpio;
+    armed = armed_edge(gpio);
+    listeners[id].used = 0;
+    event_pins[gpio].listeners--;
+    update_listen_edge(gpio);
+    return pin_rearm(gpio, armed, NULL);
+}
+
+// Queues edges (gpio, level and timestamp_ns are used) for the next
+// events_read(), from any thread. Returns the number of queued edges, which
+// is less than `count` while the queue is full. The engine must be set up.
+int
+events_inject(const struct gpio_event *events, int count)
+{
+    uint64_t one = 1;
+    int i, n, err = 0;
+
+    pthread_mutex_lock(&inject_lock);
+    if (inject_fd < 0) {
+        // Not set up (or cleaned up meanwhile)
+        pthread_mutex_unlock(&inject_lock);
+        errno = EBADF;
+        return -1;
+    }
+    n = INJECT_QUEUE - inject_len < count ? INJECT_QUEUE - inject_len : count;
+    for (i=0; i<n; i++) {
+        inject_queue[inject_len] = events[i];
+        inject_queue[inject_len].gpio = events[i].gpio % GPIO_COUNT;
+        inject_queue[inject_len].level = events[i].level ? 1 : 0;
+        inject_queue[inject_len].edge = events[i].level ? EDGE_RISING : EDGE_FALLING;
+        inject_queue[inject_len++].listener = LISTENER_NONE;
+    }
+    if (n && write(inject_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        err = errno;
+    pthread_mutex_unlock(&inject_lock);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return n;
+}
+
+// Moves up to max injected edges into `raw`. The eventfd stays readable
+// while more are queued.
+static int
+take_injected(struct gpio_event *raw, int max)
+{
+    uint64_t value;
+    int i, n;
+
+    pthread_mutex_lock(&inject_lock);
+    n = inject_len < max ? inject_len : max;
+    if (n == inject_len && read(inject_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        pthread_mutex_unlock(&inject_lock);
+        return -1;
+    }
+    for (i=0; i<n; i++) {
+        raw[i] = inject_queue[i];
+        raw[i].seqno = event_seqno++;
+    }
+    inject_len -= n;
+    memmove(inject_queue, inject_queue + n, inject_len * sizeof(*inject_queue));
+    pthread_mutex_unlock(&inject_lock);
+    return n;
+}
+
+// Passes the events of a listener to `sink` instead of returning them from
+// events_read() (NULL: return them again)
+int
+events_set_sink(int id, events_sink sink)
+{
+    if (id < 0 || id >= LISTENER_COUNT || !listeners[id].used) {
+        errno = EINVAL;
+        return -1;
+    }
+    listeners[id].sink = sink;
+    return 0;
+}
+
+// Waits up to timeout_ms (-1 = forever, 0 = don't block) for edges and
+// writes up to max_events into `events`. Returns the number of events. Raw
+// edges of filtered pins and events of listeners with a sink are consumed
+// silently; a blocking call keeps waiting
+// until its filters pass something (or the timeout is over). A raw edge can
+// yield one event for its pin and one per listener, so max_events must be
+// larger than the most listeners on a gpio.
+int
+events_read(struct gpio_event *events, int max_events, int timeout_ms)
+{
+    struct epoll_event evs[EPOLL_BATCH];
+    struct gpio_event raw[EPOLL_BATCH];
+    int i, n, m, gpio, level, nraw, budget, count = 0;
+    uint64_t now, deadline = 0, expired;
+
+    if (epoll_fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (max_events > EPOLL_BATCH)
+        max_events = EPOLL_BATCH;
+
+    // Read no more raw edges than there is room for their events
+    budget = 1;
+    for (gpio=0; gpio<GPIO_COUNT; gpio++) {
+        if (event_pins[gpio].listeners >= budget)
+            budget = event_pins[gpio].listeners + 1;
+    }
+    if ((budget = max_events / budget) < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (timeout_ms > 0)
+        deadline = monotonic_ns() + (uint64_t)timeout_ms * 1000000;
+
+    for (;;) {
+        do {
+            n = epoll_wait(epoll_fd, evs, budget, timeout_ms);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0)
+            return -1;
+
+        now = monotonic_ns();
+        nraw = 0;
+        for (i=0; i<n; i++) {
+            if (evs[i].data.u32 == TIMER_TOKEN) {
+                // Filter decisions are due (made below)
+                if (read(timer_fd, &expired, sizeof(expired)) > 0)
+                    timer_armed_ns = 0;
+                continue;
+            }
+            if (evs[i].data.u32 == INJECT_TOKEN) {
+                if ((m = take_injected(raw + nraw, budget - nraw)) > 0)
+                    nraw += m;
+                continue;
+            }
+            if (evs[i].data.u32 == REQUEST_TOKEN) {
+                // A whole batch of kernel-timestamped line events
+                if ((m = chip_read_events(request_fd, raw + nraw, budget - nraw)) > 0) {
+                    chip_tap(raw + nraw, m);
+                    nraw += m;
+                }
+                continue;
+            }
+
+            gpio = evs[i].data.u32;
+            if ((level = events_read_level(event_pins[gpio].fd)) < 0) {
+                STATS_INC(STAT_EVENTS_DROPPED);
+                continue;
+            }
+
+            // Filter invalid edge values (sometimes 1 comes in when edge=falling)
+            if ((armed_edge(gpio) == EDGE_RISING && !level) ||
+                    (armed_edge(gpio) == EDGE_FALLING && level)) {
+                STATS_INC(STAT_EVENTS_DROPPED);
+                continue;
+            }
+
+            raw[nraw].timestamp_ns = now;
+            raw[nraw].seqno = event_seqno++;
+            raw[nraw].gpio = gpio;
+            raw[nraw].level = level;
+            raw[nraw].edge = level ? EDGE_RISING : EDGE_FALLING;
+            raw[nraw].listener = LISTENER_NONE;
+            TRACE_AT(now, TRACE_INTERRUPT, gpio, level, 0, 0);
+            nraw++;
+        }
+
+        record_events(raw, nraw);
+
+        // Every raw edge yields at most one event per filter
+        for (i=0; i<nraw; i++) {
+            if (event_pins[raw[i].gpio].fd < 0 && !event_pins[raw[i].gpio].line)
+                events[count++] = raw[i];
+            else
+                count += dispatch_edge(&raw[i], events + count);
+        }
+        count += dispatch_expired(now, events + count, max_events - count);
+        filter_arm_timer();
+        count = dispatch_sinks(events, count);
+
+        if (count || timeout_ms == 0)
+            return count;
+        if (timeout_ms > 0) {
+            if (now >= deadline)
+                return 0;
+            timeout_ms = (deadline - now + 999999) / 1000000;
+        }
+    }
+}
+
+// Blocks until one of `gpios` sees an edge of the given kind, independent of
+// the epoll engine (safe to call from several threads for different pins;
+// with the gpiochip backend, lines the engine holds are served from its
+// request, see chip_wait_edge). With sysfs, gpios the engine watches are
+// refused with EBUSY.
+// Writes the first edge to `event` and returns 1, returns 0 after timeout_ms
+// (-1 = forever) or -1 with errno set on error (EINTR if a signal arrived).
+int
+events_wait_edge(const int *gpios, int count, int edge, int timeout_ms,
+        struct gpio_event *event)
+{
+    struct sysfs_pin pins[GPIO_COUNT];
+    struct pollfd fds[GPIO_COUNT];
+    uint64_t deadline = 0, now;
+    int i, n, level, result = -1;
+
+    if (count < 1 || count > GPIO_COUNT || edge < EDGE_RISING || edge > EDGE_BOTH) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i=0; i<count; i++) {
+        if (gpios[i] < 0 || gpios[i] >= GPIO_COUNT) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    if (events_backend() == EVENTS_GPIOCHIP)
+        return chip_wait_edge(gpios, count, edge, timeout_ms, event);
+
+    for (i=0; i<count; i++) {
+        // Setting up the pin would rearm the `edge` the engine relies on
+        if (events_watched(gpios[i])) {
+            errno = EBUSY;
+            return -1;
+        }
+        pins[i].gpio = gpios[i];
+        pins[i].edge = edge;
+    }
+    if (events_sysfs_setup(pins, count) < 0)
+        return -1;
+    for (i=0; i<count; i++) {
+        if (pins[i].exported)
+            event_pins[gpios[i]].exported = 1;
+        fds[i].fd = pins[i].fd;
+        fds[i].events = POLLPRI | POLLERR;
+    }
+
+    if (timeout_ms > 0)
+        deadline = monotonic_ns() + (uint64_t)timeout_ms * 1000000;
+    for (;;) {
+        if ((n = poll(fds, count, timeout_ms)) < 0)
+            goto out;
+        if (n == 0) {
+            result = 0;
+            goto out;
+        }
+
+        now = monotonic_ns();
+        for (i=0; i<count; i++) {
+            if (!(fds[i].revents & (POLLPRI | POLLERR)))
+                continue;
+            if ((level = events_read_level(fds[i].fd)) < 0 ||
+                    (edge == EDGE_RISING && !level) ||
+                    (edge == EDGE_FALLING && level)) {
+                STATS_INC(STAT_EVENTS_DROPPED);
+                continue;
+            }
+            event->timestamp_ns = now;
+            event->seqno = 0;
+            event->gpio = gpios[i];
+            event->level = level;
+            event->edge = level ? EDGE_RISING : EDGE_FALLING;
+            event->listener = LISTENER_NONE;
+            TRACE_AT(now, TRACE_INTERRUPT, gpios[i], level, 0, 0);
+            result = 1;
+            goto out;
+        }
+
+        // Only invalid edges: keep waiting for the rest of the timeout
+        if (timeout_ms > 0) {
+            if (now >= deadline) {
+                result = 0;
+                goto out;
+            }
+            timeout_ms = (deadline - now + 999999) / 1000000;
+        }
+    }
+
+out:
+    n = errno;
+    for (i=0; i<count; i++)
+        close(fds[i].fd);
+    errno = n;
+    return result;
+}
+
+// Closes all value files and the line request, unexports the gpios exported
+// by the engine (and by events_wait_edge) and closes the epoll fd
+void
+events_cleanup(void)
+{
+    int i;
+
+    if (request_fd >= 0) {
+        close(request_fd);
+        request_fd = -1;
+    }
+    request_lines = 0;
+    for (i=0; i<GPIO_COUNT; i++) {
+        event_pins[i].line = 0;
+        event_pins[i].filter.type = FILTER_NONE;
+        event_pins[i].filter.deadline_ns = 0;
+        event_pins[i].listeners = 0;
+        event_pins[i].listen_edge = EDGE_NONE;
+        if (epoll_fd >= 0 && event_pins[i].fd >= 0)
+            events_del_gpio(i);
+        if (event_pins[i].exported) {
+            events_sysfs_unexport(i);
+            event_pins[i].exported = 0;
+        }
+    }
+    memset(listeners, 0, sizeof(listeners));
+    if (timer_fd >= 0) {
+        close(timer_fd);
+        timer_fd = -1;
+    }
+    pthread_mutex_lock(&inject_lock);
+    if (inject_fd >= 0) {
+        close(inject_fd);
+        inject_fd = -1;
+    }
+    inject_len = 0;
+    pthread_mutex_unlock(&inject_lock);
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+}
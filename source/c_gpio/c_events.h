@@ -0,0 +1,111 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ */
+#include <stdint.h>
+
+// Edge detection modes (same order as the sysfs `edge` values)
+#define EDGE_NONE    0
+#define EDGE_RISING  1
+#define EDGE_FALLING 2
+#define EDGE_BOTH    3
+
+// Interrupt backends: sysfs (one `value` file per gpio) or the GPIO character
+// device (one line request for all gpios, kernel timestamps)
+#define EVENTS_SYSFS    0
+#define EVENTS_GPIOCHIP 1
+
+#define GPIOCHIP_DEFAULT "/dev/gpiochip0"
+
+// Input filters of the event engine (see events_set_filter)
+#define FILTER_NONE       0
+#define FILTER_STABLE     1  // a level is reported once stable for width_us
+#define FILTER_HOLDOFF    2  // edges are reported at once, then held off
+#define FILTER_INTEGRATOR 3  // the level is integrated over width_us
+
+// Listeners of the event engine (see events_listen)
+#define LISTENER_COUNT    128
+#define LISTENERS_PER_PIN 16
+#define LISTENER_NONE     0xffffffff  // event of the pin itself
+
+// Default root of the sysfs GPIO interface (see events_set_sysfs_root)
+#define SYSFS_GPIO_ROOT "/sys/class/gpio/"
+
+// One gpio for events_sysfs_setup()
+struct sysfs_pin {
+    int gpio;
+    int edge;
+    int fd;        // out: open `value` file (non-blocking)
+    int level;     // out: initial level
+    int exported;  // out: 1 if this call exported the gpio
+};
+
+// One GPIO level change, as delivered by events_read()
+struct gpio_event {
+    uint64_t timestamp_ns;  // CLOCK_MONOTONIC (taken by the kernel on gpiochip)
+    uint32_t seqno;         // per-engine (sysfs) or per-request (gpiochip) number
+    uint16_t gpio;
+    uint8_t level;
+    uint8_t edge;           // EDGE_RISING or EDGE_FALLING
+    uint32_t listener;      // listener id, or LISTENER_NONE
+};
+
+// Receives the events of a listener (see events_set_sink)
+typedef int (*events_sink)(const struct gpio_event *events, int count);
+
+int events_setup(void);
+void events_cleanup(void);
+int events_fileno(void);
+
+int events_backend(void);
+int events_set_backend(int backend, const char *chip);
+const char *events_chip(void);
+
+int events_add_gpio(int gpio, int edge);
+int events_add_gpios(const int *gpios, const int *edges, int count);
+int events_del_gpio(int gpio);
+int events_watched(int gpio);
+int events_set_filter(int gpio, int filter, uint32_t width_us);
+int events_listen(int gpio, int edge, int filter, uint32_t width_us);
+int events_unlisten(int id);
+int events_set_sink(int id, events_sink sink);
+int events_inject(const struct gpio_event *events, int count);
+int events_read(struct gpio_event *events, int max_events, int timeout_ms);
+int events_wait_edge(const int *gpios, int count, int edge, int timeout_ms,
+        struct gpio_event *event);
+
+const char *events_sysfs_root(void);
+int events_set_sysfs_root(const char *root);
+int events_sysfs_setup(struct sysfs_pin *pins, int count);
+int events_sysfs_unexport(int gpio);
+int events_read_level(int fd);
+
+int events_request_lines(const int *gpios, const int *edges, int count);
+int events_read_lines(int fd, struct gpio_event *events, int max_events);
+
+const char *edge_to_str(int edge);
+int str_to_edge(const char *str);
+const char *backend_to_str(int backend);
+int str_to_backend(const char *str);
+const char *filter_to_str(int filter);
+int str_to_filter(const char *str);
@@ -31,6 +31,7 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include "c_gpio.h"
+#include "systimer.h"
 
 #define BCM2708_PERI_BASE   0x20000000
 #define GPIO_BASE           (BCM2708_PERI_BASE + 0x200000)
@@ -51,16 +52,17 @@
 #define PAGE_SIZE  (4*1024)
 #define BLOCK_SIZE (4*1024)
 
+// 150 cycles at 250MHz, rounded up
+#define SHORT_WAIT_NS 1000
+
 static volatile uint32_t *gpio_map;
 
-// `short_wait` waits 150 cycles
+// `short_wait` waits at least 150 cycles of the GPIO clock (as demanded by
+// the datasheet for the pull-up/down sequence), using the calibrated delay
 void
 short_wait(void)
 {
-    int i;
-    for (i=0; i<150; i++) {
-        asm volatile("nop");
-    }
+    delay_ns(SHORT_WAIT_NS);
 }
 
 // `setup` is run when GPIO is imported in Python
@@ -70,6 +72,15 @@ setup(void)
     int mem_fd;
     uint8_t *gpio_mem;
 
+    systimer_setup();
+
+    // Simulated backend: registers are plain memory
+    if (simulation_enabled()) {
+        if ((gpio_map = calloc(1, BLOCK_SIZE)) == NULL)
+            return SETUP_MALLOC_FAIL;
+        return SETUP_OK;
+    }
+
     if ((mem_fd = open("/dev/mem", O_RDWR|O_SYNC) ) < 0)
         return SETUP_DEVMEM_FAIL;
 
@@ -87,13 +98,12 @@ setup(void)
     return SETUP_OK;
 }
 
-// Sets a pullup or -down resistor on a GPIO
+// Sets a pullup or -down resistor on all GPIOs in the two bank masks. The
+// GPPUDCLK registers take a bitmask per bank, so any number of pins with the
+// same pull mode cost one control sequence (and two waits).
 void
-set_pullupdn(int gpio, int pud)
+set_pullupdn_mask(int pud, uint32_t mask_bank0, uint32_t mask_bank1)
 {
-    int clk_offset = OFFSET_PULLUPDNCLK + (gpio/32);
-    int shift = (gpio%32);
-
     if (pud == PUD_DOWN)
        *(gpio_map+OFFSET_PULLUPDN) = (*(gpio_map+OFFSET_PULLUPDN) & ~3) | PUD_DOWN;
     else if (pud == PUD_UP)
@@ -102,10 +112,26 @@ set_pullupdn(int gpio, int pud)
        *(gpio_map+OFFSET_PULLUPDN) &= ~3;
 
     short_wait();
-    *(gpio_map+clk_offset) = 1 << shift;
+    if (mask_bank0)
+        *(gpio_map+OFFSET_PULLUPDNCLK) = mask_bank0;
+    if (mask_bank1)
+        *(gpio_map+OFFSET_PULLUPDNCLK+1) = mask_bank1;
     short_wait();
     *(gpio_map+OFFSET_PULLUPDN) &= ~3;
-    *(gpio_map+clk_offset) = 0;
+    if (mask_bank0)
+        *(gpio_map+OFFSET_PULLUPDNCLK) = 0;
+    if (mask_bank1)
+        *(gpio_map+OFFSET_PULLUPDNCLK+1) = 0;
+}
+
+// Sets a pullup or -down resistor on a GPIO
+void
+set_pullupdn(int gpio, int pud)
+{
+    if (gpio < 32)
+        set_pullupdn_mask(pud, 1U << gpio, 0);
+    else
+        set_pullupdn_mask(pud, 0, 1U << (gpio%32));
 }
 
 // Sets a GPIO to either output or input (input can have an optional pullup
@@ -123,6 +149,44 @@ setup_gpio(int gpio, int direction, int pud)
         *(gpio_map+offset) = (*(gpio_map+offset) & ~(7<<shift));
 }
 
+// Sets up a list of GPIOs in one sequence. Pins are grouped by pull mode
+// (one GPPUD/GPPUDCLK sequence per mode for both banks) and by FSEL register
+// (one read-modify-write per register), instead of paying for both per pin.
+// Returns -1 without touching a register if a GPIO is listed twice.
+int
+setup_pins(const struct pin_setup *pins, int count)
+{
+    uint32_t fsel_clear[FSEL_REGISTERS] = {0};
+    uint32_t fsel_set[FSEL_REGISTERS] = {0};
+    uint32_t pud_mask[3][2] = {{0, 0}, {0, 0}, {0, 0}};
+    uint64_t seen = 0;
+    int i, offset, shift;
+
+    for (i=0; i<count; i++) {
+        if (seen & (1ULL << pins[i].gpio))
+            return -1;
+        seen |= 1ULL << pins[i].gpio;
+        offset = pins[i].gpio / 10;
+        shift = (pins[i].gpio % 10) * 3;
+        fsel_clear[offset] |= 7 << shift;
+        if (pins[i].direction == OUTPUT)
+            fsel_set[offset] |= 1 << shift;
+        pud_mask[pins[i].pud][pins[i].gpio / 32] |= 1U << (pins[i].gpio % 32);
+    }
+
+    // Pull resistors first, as in setup_gpio()
+    for (i=PUD_OFF; i<=PUD_UP; i++) {
+        if (pud_mask[i][0] || pud_mask[i][1])
+            set_pullupdn_mask(i, pud_mask[i][0], pud_mask[i][1]);
+    }
+
+    for (i=0; i<FSEL_REGISTERS; i++) {
+        if (fsel_clear[i])
+            *(gpio_map+OFFSET_FSEL+i) = (*(gpio_map+OFFSET_FSEL+i) & ~fsel_clear[i]) | fsel_set[i];
+    }
+    return 0;
+}
+
 // Returns the function of a GPIO: 0=input, 1=output, 4=alt0
 // Contribution by Eric Ptak <trouch@trouch.com>
 int
@@ -148,6 +212,32 @@ output_gpio(int gpio, int value)
     *(gpio_map+offset) = 1 << gpio % 32;
 }
 
+// Returns the mapped GPIO register block (for callers that precompute
+// register offsets and masks, eg. the C++ wrapper)
+volatile uint32_t *
+gpio_registers(void)
+{
+    return gpio_map;
+}
+
+// Sets and clears all GPIOs in the masks of one bank (0: gpio 0..31,
+// 1: gpio 32..53) with at most two register writes
+void
+output_gpio_mask(int bank, uint32_t set_mask, uint32_t clear_mask)
+{
+    if (set_mask)
+        *(gpio_map+OFFSET_SET+bank) = set_mask;
+    if (clear_mask)
+        *(gpio_map+OFFSET_CLR+bank) = clear_mask;
+}
+
+// Returns the levels of all GPIOs of one bank
+uint32_t
+input_gpio_bank(int bank)
+{
+    return *(gpio_map+OFFSET_PINLEVEL+bank);
+}
+
 // Returns the value of a GPIO input (1 or 0)
 int
 input_gpio(int gpio)
@@ -163,5 +253,9 @@ void
 cleanup(void)
 {
     // fixme - set all gpios back to input
-    munmap((void *)gpio_map, BLOCK_SIZE);
+    if (simulation_enabled())
+        free((void *)gpio_map);
+    else
+        munmap((void *)gpio_map, BLOCK_SIZE);
+    systimer_cleanup();
 }
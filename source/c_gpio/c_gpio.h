@@ -22,13 +22,27 @@
  *
  *     http://pythonhosted.org/RPIO
  */
+#include <stdint.h>
+
+// One entry per GPIO for setup_pins()
+struct pin_setup {
+    int gpio;
+    int direction;
+    int pud;
+};
+
 int setup(void);
 void setup_gpio(int gpio, int direction, int pud);
+int setup_pins(const struct pin_setup *pins, int count);
 void output_gpio(int gpio, int value);
 int input_gpio(int gpio);
+void output_gpio_mask(int bank, uint32_t set_mask, uint32_t clear_mask);
+uint32_t input_gpio_bank(int bank);
+volatile uint32_t *gpio_registers(void);
 void cleanup(void);
 int gpio_function(int gpio);
 void set_pullupdn(int gpio, int pud);
+void set_pullupdn_mask(int pud, uint32_t mask_bank0, uint32_t mask_bank1);
 
 #define SETUP_OK          0
 #define SETUP_DEVMEM_FAIL 1
@@ -45,3 +59,7 @@ void set_pullupdn(int gpio, int pud);
 #define PUD_OFF  0
 #define PUD_DOWN 1
 #define PUD_UP   2
+
+// 54 GPIOs in 6 function select registers (10 GPIOs each)
+#define GPIO_COUNT     54
+#define FSEL_REGISTERS 6
@@ -0,0 +1,223 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * capture.c samples GPLEV0 in a tight loop, paced by the system timer (every
+ * interval_ns, or as fast as possible), optionally pinned to one CPU. Only
+ * the gpios' bits are kept; in CAPTURE_BITS format 32 samples are collected
+ * before they are transposed into the per-gpio rows, so the sampling loop
+ * itself stays a register read and a store.
+ *
+ * The decoders walk captured words with one XOR per sample and skip runs
+ * without changes of the gpio.
+ *
+ * With RPIO_SIMULATE the virtual clock advances by interval_ns per sample.
+ */
+#define _GNU_SOURCE
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include "c_gpio.h"
+#include "c_events.h"
+#include "systimer.h"
+#include "capture.h"
+#include "rt.h"
+
+#define GPLEV0 13  // 0x0034 / 4
+
+// Returns the size of the buffer for n samples of `count` gpios
+size_t
+capture_size(size_t n, int count, int format)
+{
+    if (format == CAPTURE_BITS)
+        return (size_t)count * ((n + 7) / 8);
+    return n * sizeof(uint32_t);
+}
+
+static void
+wait_until(uint64_t due_ns, int simulated)
+{
+    uint64_t now;
+
+    while ((now = now_us() * 1000) < due_ns)
+        if (simulated)
+            delay_ns(due_ns - now);
+}
+
+static void
+sample_words(volatile uint32_t *lev, uint32_t *out, size_t n, uint32_t mask,
+        uint64_t start_ns, uint32_t interval_ns, int simulated)
+{
+    size_t i;
+
+    if (!interval_ns) {
+        for (i=0; i<n; i++)
+            out[i] = *lev & mask;
+        return;
+    }
+    for (i=0; i<n; i++) {
+        wait_until(start_ns + i * (uint64_t)interval_ns, simulated);
+        out[i] = *lev & mask;
+    }
+}
+
+// Transposes up to 32 level words into bits of the gpio rows
+static void
+store_bits(uint8_t *out, size_t row, size_t first, const uint32_t *words,
+        int n, const int *gpios, int count)
+{
+    uint32_t bits;
+    int i, k;
+
+    for (k=0; k<count; k++) {
+        bits = 0;
+        for (i=0; i<n; i++)
+            bits |= ((words[i] >> gpios[k]) & 1) << i;
+        for (i=0; i<n; i+=8)
+            out[k * row + (first + i) / 8] = bits >> i;
+    }
+}
+
+// Samples `count` gpios (0..31) n times, every interval_ns (0: as fast as
+// possible), into `out` (capture_size() bytes, 4-byte aligned for
+// CAPTURE_WORDS). `cpu` >= 0 pins the calling thread to that CPU for the
+// capture. Returns 0 and the time from the first to the last sample in
+// elapsed_ns.
+int
+capture_levels(void *out, size_t n, const int *gpios, int count,
+        uint32_t interval_ns, int format, int cpu, uint64_t *elapsed_ns)
+{
+    volatile uint32_t *lev;
+    uint32_t chunk[32], mask = 0;
+    uint64_t start_ns;
+    cpu_set_t old, set;
+    size_t i, row;
+    int k, pinned = 0, simulated = simulation_enabled();
+
+    for (k=0; k<count; k++) {
+        if (gpios[k] < 0 || gpios[k] > 31) {
+            errno = EINVAL;
+            return -1;
+        }
+        mask |= 1U << gpios[k];
+    }
+    if ((lev = gpio_registers()) == NULL || count < 1 ||
+            (format != CAPTURE_WORDS && format != CAPTURE_BITS)) {
+        errno = EINVAL;
+        return -1;
+    }
+    lev += GPLEV0;
+
+    if (cpu >= 0) {
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_getaffinity(0, sizeof(old), &old) < 0 ||
+                sched_setaffinity(0, sizeof(set), &set) < 0)
+            return -1;
+        pinned = 1;
+    }
+
+    // No page faults while sampling
+    rt_prefault(out, capture_size(n, count, format));
+
+    start_ns = now_us() * 1000;
+    if (format == CAPTURE_WORDS) {
+        sample_words(lev, out, n, mask, start_ns, interval_ns, simulated);
+    } else {
+        row = (n + 7) / 8;
+        memset(out, 0, count * row);
+        for (i=0; i<n; i+=32) {
+            k = n - i < 32 ? n - i : 32;
+            sample_words(lev, chunk, k, mask, start_ns + i * (uint64_t)interval_ns, interval_ns, simulated);
+            store_bits(out, row, i, chunk, k, gpios, count);
+        }
+    }
+    *elapsed_ns = n > 1 ? now_us() * 1000 - start_ns : 0;
+    if (simulated && n > 1)
+        *elapsed_ns = (n - 1) * (uint64_t)interval_ns;
+
+    if (pinned)
+        sched_setaffinity(0, sizeof(old), &old);
+    return 0;
+}
+
+// Writes the sample indices of the `edge` edges (EDGE_RISING, EDGE_FALLING
+// or EDGE_BOTH) of a gpio into `indices` (up to max) and returns their
+// number. Index i means the level changed between sample i - 1 and i.
+size_t
+capture_edges(const uint32_t *words, size_t n, int gpio, int edge,
+        uint32_t *indices, size_t max)
+{
+    uint32_t mask = 1U << gpio, prev;
+    size_t i, found = 0;
+    int rising;
+
+    if (!n)
+        return 0;
+    prev = words[0] & mask;
+    for (i=1; i<n; i++) {
+        if (!((words[i] ^ prev) & mask))
+            continue;
+        prev = words[i] & mask;
+        rising = prev != 0;
+        if ((rising && (edge & EDGE_RISING)) || (!rising && (edge & EDGE_FALLING))) {
+            if (found < max)
+                indices[found] = i;
+            found++;
+        }
+    }
+    return found;
+}
+
+// Counts the high samples and the edges of a gpio
+void
+capture_stats(const uint32_t *words, size_t n, int gpio,
+        struct capture_stats *stats)
+{
+    uint32_t mask = 1U << gpio, prev;
+    size_t i, run = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    if (!n)
+        return;
+    prev = words[0] & mask;
+    for (i=1; i<n; i++) {
+        if (!((words[i] ^ prev) & mask))
+            continue;
+        // Level changed at i: the samples since `run` had level prev
+        if (prev)
+            stats->high += i - run;
+        run = i;
+        prev = words[i] & mask;
+        if (prev) {
+            if (!stats->rising++)
+                stats->first_rising = i;
+            stats->last_rising = i;
+        } else {
+            stats->falling++;
+        }
+    }
+    if (prev)
+        stats->high += n - run;
+}
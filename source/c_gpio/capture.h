@@ -0,0 +1,58 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * capture.c samples the levels of several gpios (bank 0) at a fixed rate
+ * into a caller supplied buffer, and decodes edges, duty cycle and frequency
+ * of a gpio from captured level words.
+ */
+#ifndef RPIO_CAPTURE_H
+#define RPIO_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Buffer formats of capture_levels()
+#define CAPTURE_WORDS 0  // one uint32_t per sample: GPLEV0 masked to the gpios
+#define CAPTURE_BITS  1  // one row of (n + 7) / 8 bytes per gpio, sample i in
+                         // bit i % 8 of byte i / 8
+
+// Summary of one gpio in captured level words (see capture_stats)
+struct capture_stats {
+    uint64_t high;          // samples at level 1
+    uint64_t rising;
+    uint64_t falling;
+    uint64_t first_rising;  // sample index of the first and last rising edge
+    uint64_t last_rising;
+};
+
+size_t capture_size(size_t n, int count, int format);
+int capture_levels(void *out, size_t n, const int *gpios, int count,
+        uint32_t interval_ns, int format, int cpu, uint64_t *elapsed_ns);
+size_t capture_edges(const uint32_t *words, size_t n, int gpio, int edge,
+        uint32_t *indices, size_t max);
+void capture_stats(const uint32_t *words, size_t n, int gpio,
+        struct capture_stats *stats);
+
+#endif
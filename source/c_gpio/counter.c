@@ -0,0 +1,393 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * counter.c counts the edges of gpios without waking up the caller: one
+ * background thread waits for the edges of all counted gpios (sysfs `value`
+ * files, or one gpiochip line request per gpio with the gpiochip backend)
+ * and only updates counters. Readers take a snapshot with counter_read().
+ *
+ * The frequency is measured over a sliding window, which is split into
+ * COUNTER_BUCKETS buckets: the counts of all buckets divided by the time
+ * they cover (the oldest bucket is dropped as the window moves on).
+ *
+ * Functions return 0 on success and -1 with errno set on error.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "c_gpio.h"
+#include "c_events.h"
+#include "counter.h"
+#include "rt.h"
+#include "util.h"
+
+// epoll token of the wake-up eventfd (other tokens are gpio numbers)
+#define WAKE_TOKEN 0xffffffff
+
+// Edges read per gpiochip read() and epoll events per epoll_wait()
+#define COUNTER_BATCH 64
+
+struct edge_counter {
+    int fd;               // value file or line request, -1 if not counting
+    int line;             // 1 if fd is a gpiochip line request
+    int edge;
+    int exported;         // 1 if counter_start() exported the gpio
+    int starting;         // 1 while counter_start() sets the gpio up
+    uint64_t rising;
+    uint64_t falling;
+    uint64_t last_ns;
+    uint64_t period_ns;
+    uint64_t period_start_ns;  // last edge of the kind periods are measured on
+    uint64_t started_ns;  // start of the measurement (or last reset)
+    uint64_t bucket_ns;
+    uint64_t bucket;      // current bucket (timestamp / bucket_ns)
+    uint32_t buckets[COUNTER_BUCKETS];
+};
+
+static struct edge_counter counters[GPIO_COUNT];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t thread;
+static int epoll_fd = -1;
+static int wake_fd = -1;
+
+// Moves the window on to `now`, clearing the buckets it left behind
+static void
+counter_advance(struct edge_counter *c, uint64_t now)
+{
+    uint64_t bucket = now / c->bucket_ns;
+
+    if (bucket <= c->bucket)
+        return;
+    if (bucket - c->bucket >= COUNTER_BUCKETS) {
+        memset(c->buckets, 0, sizeof(c->buckets));
+        c->bucket = bucket;
+        return;
+    }
+    while (c->bucket < bucket)
+        c->buckets[++c->bucket % COUNTER_BUCKETS] = 0;
+}
+
+static void
+counter_add(struct edge_counter *c, int level, uint64_t timestamp_ns)
+{
+    if (!(c->edge & (level ? EDGE_RISING : EDGE_FALLING)))
+        return;
+    if (level)
+        c->rising++;
+    else
+        c->falling++;
+    c->last_ns = timestamp_ns;
+
+    // With EDGE_BOTH, a signal period spans two edges: measure rising to rising
+    if (c->edge != EDGE_BOTH || level) {
+        if (c->period_start_ns && timestamp_ns > c->period_start_ns)
+            c->period_ns = timestamp_ns - c->period_start_ns;
+        c->period_start_ns = timestamp_ns;
+    }
+    counter_advance(c, timestamp_ns);
+    c->buckets[c->bucket % COUNTER_BUCKETS]++;
+}
+
+static void
+counter_clear(struct edge_counter *c, uint64_t now)
+{
+    c->rising = c->falling = 0;
+    c->started_ns = now;
+    c->bucket = now / c->bucket_ns;
+    memset(c->buckets, 0, sizeof(c->buckets));
+}
+
+// Reads the pending edges of one counted gpio
+static void
+counter_update(int gpio, uint64_t now)
+{
+    struct edge_counter *c = &counters[gpio];
+    struct gpio_event events[COUNTER_BATCH];
+    int i, n, level;
+
+    if (c->line) {
+        while ((n = events_read_lines(c->fd, events, COUNTER_BATCH)) > 0) {
+            for (i=0; i<n; i++)
+                counter_add(c, events[i].level, events[i].timestamp_ns);
+            if (n < COUNTER_BATCH)
+                break;
+        }
+    } else if ((level = events_read_level(c->fd)) >= 0) {
+        counter_add(c, level, now);
+    }
+}
+
+static void *
+counter_thread(void *arg)
+{
+    struct epoll_event evs[COUNTER_BATCH];
+    uint64_t now;
+    int i, n;
+
+    rt_apply();
+    for (;;) {
+        if ((n = epoll_wait(epoll_fd, evs, COUNTER_BATCH, -1)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return NULL;
+        }
+
+        now = monotonic_ns();
+        pthread_mutex_lock(&lock);
+        for (i=0; i<n; i++) {
+            if (evs[i].data.u32 == WAKE_TOKEN) {
+                // counter_cleanup() wants the thread to end
+                pthread_mutex_unlock(&lock);
+                return NULL;
+            }
+            // A counter stopped while its edge was pending has fd -1
+            if (counters[evs[i].data.u32].fd >= 0)
+                counter_update(evs[i].data.u32, now);
+        }
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+// Creates the epoll fd and starts the thread, which does not take signals
+static int
+counter_setup(void)
+{
+    struct epoll_event ev;
+    sigset_t all, old;
+    int i, err;
+
+    if (epoll_fd >= 0)
+        return 0;
+    if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        return -1;
+    if ((wake_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC)) < 0)
+        goto error;
+    ev.events = EPOLLIN;
+    ev.data.u32 = WAKE_TOKEN;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) < 0)
+        goto error;
+    for (i=0; i<GPIO_COUNT; i++)
+        counters[i].fd = -1;
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    err = pthread_create(&thread, NULL, counter_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err) {
+        errno = err;
+        goto error;
+    }
+    return 0;
+
+error:
+    err = errno;
+    if (wake_fd >= 0)
+        close(wake_fd);
+    close(epoll_fd);
+    wake_fd = epoll_fd = -1;
+    errno = err;
+    return -1;
+}
+
+// Starts counting `edge` edges (EDGE_RISING, EDGE_FALLING or EDGE_BOTH) of a
+// gpio, which is exported or requested as input with edge detection. The
+// frequency is measured over the last window_ms. Gpios the event engine
+// watches are refused with EBUSY.
+int
+counter_start(int gpio, int edge, uint32_t window_ms)
+{
+    struct sysfs_pin pin;
+    struct edge_counter *c;
+    struct epoll_event ev;
+    int line = 0, err;
+
+    if (gpio < 0 || gpio >= GPIO_COUNT || edge < EDGE_RISING || edge > EDGE_BOTH ||
+            window_ms < 1 || window_ms > COUNTER_WINDOW_MS_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&lock);
+    c = &counters[gpio];
+    if (counter_setup() < 0) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+    if (c->fd >= 0 || c->starting || events_watched(gpio)) {
+        pthread_mutex_unlock(&lock);
+        errno = c->fd >= 0 || c->starting ? EEXIST : EBUSY;
+        return -1;
+    }
+    c->starting = 1;
+    pthread_mutex_unlock(&lock);
+
+    // The setup may wait up to a second for udev: not under the lock
+    pin.exported = 0;
+    if (events_backend() == EVENTS_GPIOCHIP) {
+        if ((pin.fd = events_request_lines(&gpio, &edge, 1)) < 0)
+            goto error;
+        line = 1;
+        ev.events = EPOLLIN;
+    } else {
+        pin.gpio = gpio;
+        pin.edge = edge;
+        if (events_sysfs_setup(&pin, 1) < 0)
+            goto error;
+        ev.events = EPOLLPRI | EPOLLERR;
+    }
+
+    pthread_mutex_lock(&lock);
+    ev.data.u32 = gpio;
+    if (counter_setup() < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pin.fd, &ev) < 0) {
+        err = errno;
+        c->starting = 0;
+        pthread_mutex_unlock(&lock);
+        close(pin.fd);
+        if (pin.exported)
+            events_sysfs_unexport(gpio);
+        errno = err;
+        return -1;
+    }
+    memset(c, 0, sizeof(*c));
+    c->fd = pin.fd;
+    c->line = line;
+    c->exported = pin.exported;
+    c->edge = edge;
+    c->bucket_ns = (uint64_t)window_ms * 1000000 / COUNTER_BUCKETS;
+    counter_clear(c, monotonic_ns());
+    pthread_mutex_unlock(&lock);
+    return 0;
+
+error:
+    err = errno;
+    pthread_mutex_lock(&lock);
+    c->starting = 0;
+    pthread_mutex_unlock(&lock);
+    errno = err;
+    return -1;
+}
+
+static void
+counter_close(int gpio)
+{
+    struct edge_counter *c = &counters[gpio];
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    if (c->exported)
+        events_sysfs_unexport(gpio);
+    c->exported = 0;
+}
+
+// Stops counting a gpio (and unexports it if counter_start exported it)
+int
+counter_stop(int gpio)
+{
+    pthread_mutex_lock(&lock);
+    if (gpio < 0 || gpio >= GPIO_COUNT || epoll_fd < 0 || counters[gpio].fd < 0) {
+        pthread_mutex_unlock(&lock);
+        errno = EINVAL;
+        return -1;
+    }
+    counter_close(gpio);
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+// Writes a snapshot of a counter to `count`, and restarts counting and the
+// frequency window if `reset` is set (no edge is lost in between)
+int
+counter_read(int gpio, struct edge_count *count, int reset)
+{
+    struct edge_counter *c;
+    uint64_t now, span, sum = 0;
+    int i;
+
+    pthread_mutex_lock(&lock);
+    if (gpio < 0 || gpio >= GPIO_COUNT || epoll_fd < 0 || counters[gpio].fd < 0) {
+        pthread_mutex_unlock(&lock);
+        errno = EINVAL;
+        return -1;
+    }
+    c = &counters[gpio];
+    now = monotonic_ns();
+    counter_advance(c, now);
+    for (i=0; i<COUNTER_BUCKETS; i++)
+        sum += c->buckets[i];
+
+    // All but the current bucket are complete; the window may not be full yet
+    span = (COUNTER_BUCKETS - 1) * c->bucket_ns + now % c->bucket_ns;
+    if (now - c->started_ns < span)
+        span = now - c->started_ns;
+
+    count->rising = c->rising;
+    count->falling = c->falling;
+    count->last_ns = c->last_ns;
+    count->period_ns = c->period_ns;
+    count->frequency_hz = span ? sum * 1e9 / span : 0;
+    if (c->edge == EDGE_BOTH)
+        count->frequency_hz /= 2;
+    if (reset)
+        counter_clear(c, now);
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+// Stops the thread and all counters
+void
+counter_cleanup(void)
+{
+    uint64_t value = 1;
+    int i;
+
+    pthread_mutex_lock(&lock);
+    if (epoll_fd < 0) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    if (write(wake_fd, &value, sizeof(value)) != sizeof(value)) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+
+    pthread_mutex_lock(&lock);
+    for (i=0; i<GPIO_COUNT; i++) {
+        if (counters[i].fd >= 0)
+            counter_close(i);
+    }
+    close(wake_fd);
+    close(epoll_fd);
+    wake_fd = epoll_fd = -1;
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,56 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * counter.c counts the edges of gpios in a background thread, without any
+ * per-edge callback: for tachometers, flow meters and other pulse inputs
+ * which only need counts, rates and periods.
+ */
+#ifndef RPIO_COUNTER_H
+#define RPIO_COUNTER_H
+
+#include <stdint.h>
+
+// Frequency window resolution: the window is split into this many buckets
+#define COUNTER_BUCKETS 32
+
+#define COUNTER_WINDOW_MS_MAX 600000
+
+// Snapshot of one counter (see counter_read). Period and frequency are those
+// of the signal: with EDGE_BOTH, the period is measured between rising edges
+// and the frequency is half the counted edges per second.
+struct edge_count {
+    uint64_t rising;        // counted rising edges
+    uint64_t falling;       // counted falling edges
+    uint64_t last_ns;       // CLOCK_MONOTONIC time of the last counted edge
+    uint64_t period_ns;     // time between the last two edges of one kind
+    double frequency_hz;    // signal periods per second over the window
+};
+
+int counter_start(int gpio, int edge, uint32_t window_ms);
+int counter_stop(int gpio);
+int counter_read(int gpio, struct edge_count *count, int reset);
+void counter_cleanup(void);
+
+#endif
@@ -0,0 +1,612 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * protocol.c parses and executes the requests of RPIO's binary protocol (see
+ * protocol.h) in C: a connection's input is read in large chunks, all
+ * complete frames in it are executed, and their responses are sent in one
+ * go. The caller (eg. RPIO's Python epoll loop) only accepts connections
+ * and calls proto_input() or proto_flush() when a socket is ready.
+ *
+ * Every connection has an input buffer of one maximum frame and a bounded
+ * output buffer. Requests are only executed while their largest possible
+ * response fits into the output buffer, so a client which does not read
+ * its responses stops being read (PROTO_WANT_READ is cleared) instead of
+ * growing the buffer.
+ *
+ * Edges of subscribed gpios are queued per connection, in a bounded queue
+ * of PROTO_EVENT_QUEUE records: when it is full, further edges are dropped
+ * and counted. Whenever the previous event frame is out, all queued edges
+ * become the next one, which is written together with the pending responses
+ * in one gathered write. The event engine passes the edges of the subscribed
+ * gpios to proto_publish() directly (see events_set_sink), so streaming them
+ * takes no call into the caller per edge.
+ *
+ * Datagram sockets (UDP) are stateless: proto_datagrams() receives a batch
+ * of datagrams with one recvmmsg() call, executes the requests in each of
+ * them and sends every datagram's responses back to its sender in one
+ * sendmmsg() call. Subscriptions need a connection.
+ *
+ * Functions return 0 (or flags) on success and -1 with errno set on error.
+ */
+#define _GNU_SOURCE  // recvmmsg, sendmmsg
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "c_gpio.h"
+#include "c_events.h"
+#include "protocol.h"
+#include "util.h"
+
+// Reads per proto_input() call, so one busy client can't starve the others
+#define PROTO_READS 4
+
+#define PROTO_IN_SIZE (4 + PROTO_FRAME_MAX)
+
+// Largest response to one request: header, and 4 bytes of result per 2-byte
+// PROTO_READ_PORT command
+#define PROTO_RESPONSE_MAX (9 + 2 * PROTO_FRAME_MAX)
+
+#define PROTO_OUT_SIZE (2 * PROTO_RESPONSE_MAX)
+
+// Queued edges per connection
+#define PROTO_EVENT_QUEUE 4096
+
+// Datagrams per proto_datagrams() call. Responses to a datagram (of at most
+// PROTO_DGRAM_SIZE bytes) are less than twice its size (see execute()).
+#define PROTO_DGRAMS 32
+
+struct proto_conn {
+    int fd;                // -1 if unused
+    uint8_t *in;
+    size_t in_len;
+    uint8_t *out;
+    size_t out_len;
+    uint32_t subscribed[2];
+    uint8_t *events;       // queued event records
+    size_t events_len;
+    size_t frame_len;      // records in the event frame being sent
+    size_t frame_sent;     // bytes of it (header included) sent so far
+    uint8_t header[PROTO_EVENT_HEADER];
+    uint32_t dropped;      // edges dropped since the connection was opened
+    int write_known;       // the caller knows about the pending output
+};
+
+static struct proto_conn conns[PROTO_CONNS];
+static int conns_used = 0;
+static proto_pwm_handler pwm_handler = NULL;
+
+// Datagram buffers, allocated on first use
+static uint8_t *dgram_in = NULL;
+static uint8_t *dgram_out = NULL;
+
+static struct proto_conn *
+find_conn(int fd)
+{
+    int i;
+
+    for (i=0; i<conns_used; i++) {
+        if (conns[i].fd == fd && fd >= 0)
+            return &conns[i];
+    }
+    errno = EBADF;
+    return NULL;
+}
+
+// Executes one request and writes its response (at most 9 + 2 * len bytes)
+// to `response`. Returns the end of the response. Sets *subscribed if the
+// request changed the subscriptions of connection `c` (NULL for datagrams,
+// which can't subscribe).
+static uint8_t *
+execute(struct proto_conn *c, const uint8_t *body, uint32_t len,
+        uint8_t *response, int *subscribed)
+{
+    uint8_t *result = response + 9;
+    const uint8_t *cmd = body + 4, *end = body + len;
+    int status = PROTO_OK;
+
+    while (cmd < end && status == PROTO_OK) {
+        switch (cmd[0]) {
+        case PROTO_READ_PORT:
+            if (end - cmd < 2)
+                status = PROTO_ECOMMAND;
+            else if (cmd[1] > 1)
+                status = PROTO_EINVAL;
+            else
+                result = put_le32(result, input_gpio_bank(cmd[1]));
+            cmd += 2;
+            break;
+
+        case PROTO_WRITE_MASK:
+            if (end - cmd < 10)
+                status = PROTO_ECOMMAND;
+            else if (cmd[1] > 1)
+                status = PROTO_EINVAL;
+            else
+                output_gpio_mask(cmd[1], get_le32(cmd + 2), get_le32(cmd + 6));
+            cmd += 10;
+            break;
+
+        case PROTO_PWM_WIDTH:
+            if (end - cmd < 5)
+                status = PROTO_ECOMMAND;
+            else if (cmd[2] > 31)
+                status = PROTO_EINVAL;
+            else if (!pwm_handler || pwm_handler(cmd[1], cmd[2], cmd[3] | cmd[4] << 8) < 0)
+                status = PROTO_EIO;
+            cmd += 5;
+            break;
+
+        case PROTO_SUBSCRIBE:
+            if (end - cmd < 9) {
+                status = PROTO_ECOMMAND;
+            } else if (!c) {
+                status = PROTO_EINVAL;
+            } else {
+                c->subscribed[0] = get_le32(cmd + 1);
+                c->subscribed[1] = get_le32(cmd + 5) & ((1 << (GPIO_COUNT - 32)) - 1);
+                *subscribed = 1;
+            }
+            cmd += 9;
+            break;
+
+        default:
+            status = PROTO_ECOMMAND;
+        }
+    }
+
+    put_le32(response, result - response - 4);
+    put_le32(response + 4, get_le32(body));
+    response[8] = status;
+    return result;
+}
+
+// Executes all complete requests in the input buffer while their responses
+// fit. Returns -1 with errno EPROTO on a malformed frame.
+static int
+process(struct proto_conn *c, int *subscribed)
+{
+    size_t off = 0;
+    uint32_t len;
+
+    while (c->in_len - off >= 4 && c->out_len <= PROTO_OUT_SIZE - PROTO_RESPONSE_MAX) {
+        len = get_le32(c->in + off);
+        if (len < 4 || len > PROTO_FRAME_MAX) {
+            errno = EPROTO;
+            return -1;
+        }
+        if (c->in_len - off - 4 < len)
+            break;
+        c->out_len = execute(c, c->in + off + 4, len, c->out + c->out_len,
+                subscribed) - c->out;
+        off += 4 + len;
+    }
+    c->in_len -= off;
+    memmove(c->in, c->in + off, c->in_len);
+    return 0;
+}
+
+// Queues all pending edges as the next event frame, once the previous one
+// is out
+static void
+seal_events(struct proto_conn *c)
+{
+    if (c->frame_len || !c->events_len)
+        return;
+    c->frame_len = c->events_len;
+    c->frame_sent = 0;
+    put_le32(c->header, PROTO_EVENT_HEADER - 4 + c->frame_len);
+    put_le32(c->header + 4, PROTO_SEQNO_EVENT);
+    c->header[8] = PROTO_OK;
+    put_le32(c->header + 9, c->dropped);
+}
+
+// Takes the first n sent bytes off the event frame, returns the rest
+static size_t
+frame_sent(struct proto_conn *c, size_t n)
+{
+    size_t left = c->frame_len ? PROTO_EVENT_HEADER + c->frame_len - c->frame_sent : 0;
+
+    if (n < left) {
+        c->frame_sent += n;
+        return 0;
+    }
+    if (left) {
+        c->events_len -= c->frame_len;
+        memmove(c->events, c->events + c->frame_len, c->events_len);
+        c->frame_len = c->frame_sent = 0;
+    }
+    return n - left;
+}
+
+// Takes the first n sent bytes off the responses, returns the rest
+static size_t
+out_sent(struct proto_conn *c, size_t n)
+{
+    size_t taken = n < c->out_len ? n : c->out_len;
+
+    c->out_len -= taken;
+    memmove(c->out, c->out + taken, c->out_len);
+    return n - taken;
+}
+
+// Sends as much of the pending responses and event frame as the socket
+// takes, gathered into one sendmsg() per try (a writev() which doesn't raise
+// SIGPIPE). A partly sent frame goes first, so frames never interleave.
+static int
+send_output(struct proto_conn *c)
+{
+    struct iovec iov[3];
+    struct msghdr msg;
+    size_t offset;
+    ssize_t n;
+    int count, frame_first;
+
+    for (;;) {
+        seal_events(c);
+        if (!c->out_len && !c->frame_len)
+            return 0;
+
+        frame_first = c->frame_sent > 0;
+        count = 0;
+        if (c->out_len && !frame_first) {
+            iov[count].iov_base = c->out;
+            iov[count++].iov_len = c->out_len;
+        }
+        if (c->frame_len) {
+            if (c->frame_sent < PROTO_EVENT_HEADER) {
+                iov[count].iov_base = c->header + c->frame_sent;
+                iov[count++].iov_len = PROTO_EVENT_HEADER - c->frame_sent;
+            }
+            offset = c->frame_sent > PROTO_EVENT_HEADER ? c->frame_sent - PROTO_EVENT_HEADER : 0;
+            iov[count].iov_base = c->events + offset;
+            iov[count++].iov_len = c->frame_len - offset;
+        }
+        if (c->out_len && frame_first) {
+            iov[count].iov_base = c->out;
+            iov[count++].iov_len = c->out_len;
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        n = sendmsg(c->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        if (frame_first)
+            out_sent(c, frame_sent(c, n));
+        else
+            frame_sent(c, out_sent(c, n));
+    }
+}
+
+static int
+flags(struct proto_conn *c, int subscribed)
+{
+    int result = subscribed ? PROTO_SUBSCRIBED : 0;
+
+    if (c->out_len <= PROTO_OUT_SIZE - PROTO_RESPONSE_MAX)
+        result |= PROTO_WANT_READ;
+    if (c->out_len || c->events_len)
+        result |= PROTO_WANT_WRITE;
+    c->write_known = (result & PROTO_WANT_WRITE) != 0;
+    return result;
+}
+
+// Registers a connected stream socket (the caller keeps owning the fd)
+int
+proto_open(int fd)
+{
+    struct proto_conn *c = NULL;
+    int i;
+
+    for (i=0; i<conns_used && !c; i++) {
+        if (conns[i].fd < 0)
+            c = &conns[i];
+    }
+    if (!c && conns_used < PROTO_CONNS)
+        c = &conns[conns_used++];
+    if (!c) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    if ((c->in = malloc(PROTO_IN_SIZE)) == NULL ||
+            (c->out = malloc(PROTO_OUT_SIZE)) == NULL ||
+            (c->events = malloc(PROTO_EVENT_QUEUE * PROTO_EVENT_SIZE)) == NULL) {
+        free(c->in);
+        free(c->out);
+        errno = ENOMEM;
+        return -1;
+    }
+    c->fd = fd;
+    return 0;
+}
+
+// Forgets a connection (without closing its fd)
+int
+proto_close(int fd)
+{
+    struct proto_conn *c;
+
+    if ((c = find_conn(fd)) == NULL)
+        return -1;
+    free(c->in);
+    free(c->out);
+    free(c->events);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    return 0;
+}
+
+// Reads the available input of a connection, executes all complete
+// requests and sends their responses. Returns PROTO_WANT_* and
+// PROTO_SUBSCRIBED flags, or -1 (ECONNRESET once the peer closed the
+// connection, EPROTO on a malformed frame).
+int
+proto_input(int fd)
+{
+    struct proto_conn *c;
+    int i, subscribed = 0;
+    ssize_t n;
+
+    if ((c = find_conn(fd)) == NULL)
+        return -1;
+
+    for (i=0; i<PROTO_READS; i++) {
+        if (process(c, &subscribed) < 0)
+            return -1;
+        if (c->in_len == PROTO_IN_SIZE ||
+                c->out_len > PROTO_OUT_SIZE - PROTO_RESPONSE_MAX)
+            break;
+        n = recv(fd, c->in + c->in_len, PROTO_IN_SIZE - c->in_len, MSG_DONTWAIT);
+        if (n == 0) {
+            // Answer what is complete, then report the closed connection
+            process(c, &subscribed);
+            send_output(c);
+            errno = ECONNRESET;
+            return -1;
+        }
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return -1;
+        }
+        c->in_len += n;
+    }
+    if (process(c, &subscribed) < 0 || send_output(c) < 0)
+        return -1;
+    return flags(c, subscribed);
+}
+
+// Sends pending output of a writable connection, and executes buffered
+// requests which were waiting for room in the output buffer. Returns the
+// same flags as proto_input().
+int
+proto_flush(int fd)
+{
+    struct proto_conn *c;
+    int subscribed = 0;
+
+    if ((c = find_conn(fd)) == NULL)
+        return -1;
+    if (send_output(c) < 0 || process(c, &subscribed) < 0 || send_output(c) < 0)
+        return -1;
+    return flags(c, subscribed);
+}
+
+// Executes the complete requests of a datagram and returns the size of the
+// responses. A truncated or malformed frame ends the datagram.
+static size_t
+execute_datagram(const uint8_t *in, size_t in_len, uint8_t *out)
+{
+    uint8_t *p = out;
+    size_t off = 0;
+    uint32_t len;
+    int subscribed = 0;
+
+    while (in_len - off >= 8) {
+        len = get_le32(in + off);
+        if (len < 4 || len > in_len - off - 4)
+            break;
+        p = execute(NULL, in + off + 4, len, p, &subscribed);
+        off += 4 + len;
+    }
+    return p - out;
+}
+
+// Receives up to PROTO_DGRAMS pending datagrams of a non-blocking datagram
+// socket in one batch, executes their requests and sends the responses of
+// each datagram to its sender (datagrams of unbound unix sockets are not
+// answered). Returns the number of datagrams, or -1.
+int
+proto_datagrams(int fd)
+{
+    struct mmsghdr in_msgs[PROTO_DGRAMS], out_msgs[PROTO_DGRAMS];
+    struct iovec in_iov[PROTO_DGRAMS], out_iov[PROTO_DGRAMS];
+    struct sockaddr_storage addrs[PROTO_DGRAMS];
+    int i, count, replies = 0, sent;
+
+    if (!dgram_in) {
+        dgram_in = malloc(PROTO_DGRAMS * PROTO_DGRAM_SIZE);
+        dgram_out = malloc(PROTO_DGRAMS * 2 * PROTO_DGRAM_SIZE);
+        if (!dgram_in || !dgram_out) {
+            free(dgram_in);
+            free(dgram_out);
+            dgram_in = dgram_out = NULL;
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    memset(in_msgs, 0, sizeof(in_msgs));
+    for (i=0; i<PROTO_DGRAMS; i++) {
+        in_iov[i].iov_base = dgram_in + i * PROTO_DGRAM_SIZE;
+        in_iov[i].iov_len = PROTO_DGRAM_SIZE;
+        in_msgs[i].msg_hdr.msg_iov = &in_iov[i];
+        in_msgs[i].msg_hdr.msg_iovlen = 1;
+        in_msgs[i].msg_hdr.msg_name = &addrs[i];
+        in_msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+    }
+    do {
+        count = recvmmsg(fd, in_msgs, PROTO_DGRAMS, MSG_DONTWAIT, NULL);
+    } while (count < 0 && errno == EINTR);
+    if (count < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+
+    memset(out_msgs, 0, sizeof(out_msgs));
+    for (i=0; i<count; i++) {
+        out_iov[replies].iov_base = dgram_out + i * 2 * PROTO_DGRAM_SIZE;
+        out_iov[replies].iov_len = execute_datagram(in_iov[i].iov_base,
+                in_msgs[i].msg_len, out_iov[replies].iov_base);
+        if (!out_iov[replies].iov_len ||
+                in_msgs[i].msg_hdr.msg_namelen <= sizeof(sa_family_t))
+            continue;
+        out_msgs[replies].msg_hdr.msg_iov = &out_iov[replies];
+        out_msgs[replies].msg_hdr.msg_iovlen = 1;
+        out_msgs[replies].msg_hdr.msg_name = &addrs[i];
+        out_msgs[replies].msg_hdr.msg_namelen = in_msgs[i].msg_hdr.msg_namelen;
+        replies++;
+    }
+
+    // A failed reply (eg. a full send buffer) only drops that response
+    for (i=0; i<replies; i += sent > 0 ? sent : 1) {
+        sent = sendmmsg(fd, out_msgs + i, replies - i, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            sent = 0;
+    }
+    return count;
+}
+
+// Queues edges for all connections which subscribed to their gpios (edges
+// which don't fit into a connection's queue are dropped and counted) and
+// sends what the sockets take. A timestamp of 0 is replaced by the current
+// time. Returns the number of connections with output left, which then wait
+// until they are writable (see proto_pending).
+int
+proto_publish(const struct gpio_event *events, int count)
+{
+    struct proto_conn *c;
+    uint8_t *p;
+    uint64_t now = 0;
+    int i, k, queued, backlog = 0;
+
+    for (i=0; i<conns_used; i++) {
+        c = &conns[i];
+        if (c->fd < 0 || !(c->subscribed[0] | c->subscribed[1]))
+            continue;
+
+        queued = 0;
+        for (k=0; k<count; k++) {
+            if (!(c->subscribed[events[k].gpio / 32] & (1U << events[k].gpio % 32)))
+                continue;
+            if (c->events_len == PROTO_EVENT_QUEUE * PROTO_EVENT_SIZE) {
+                c->dropped++;
+                continue;
+            }
+            if (!events[k].timestamp_ns && !now)
+                now = monotonic_ns();
+            p = c->events + c->events_len;
+            *p++ = events[k].gpio;
+            *p++ = events[k].level;
+            p = put_le64(p, events[k].timestamp_ns ? events[k].timestamp_ns : now);
+            put_le32(p, events[k].seqno);
+            c->events_len += PROTO_EVENT_SIZE;
+            queued = 1;
+        }
+        if (queued)
+            send_output(c);
+        if (c->out_len || c->events_len)
+            backlog++;
+    }
+    return backlog;
+}
+
+// Writes the fds of up to `max` connections with output left which the
+// caller has not been told about (by proto_input/proto_flush flags) into
+// `fds`, and returns their number. The caller then waits until they are
+// writable and calls proto_flush().
+int
+proto_pending(int *fds, int max)
+{
+    struct proto_conn *c;
+    int i, count = 0;
+
+    for (i=0; i<conns_used && count<max; i++) {
+        c = &conns[i];
+        if (c->fd >= 0 && !c->write_known && (c->out_len || c->events_len)) {
+            c->write_known = 1;
+            fds[count++] = c->fd;
+        }
+    }
+    return count;
+}
+
+// Returns the union of the subscriptions of all connections
+void
+proto_subscriptions(uint32_t *mask_bank0, uint32_t *mask_bank1)
+{
+    int i;
+
+    *mask_bank0 = *mask_bank1 = 0;
+    for (i=0; i<conns_used; i++) {
+        if (conns[i].fd >= 0) {
+            *mask_bank0 |= conns[i].subscribed[0];
+            *mask_bank1 |= conns[i].subscribed[1];
+        }
+    }
+}
+
+void
+proto_set_pwm_handler(proto_pwm_handler handler)
+{
+    pwm_handler = handler;
+}
+
+// Forgets all connections
+void
+proto_cleanup(void)
+{
+    int i;
+
+    for (i=0; i<conns_used; i++) {
+        if (conns[i].fd >= 0)
+            proto_close(conns[i].fd);
+    }
+    conns_used = 0;
+    free(dgram_in);
+    free(dgram_out);
+    dgram_in = dgram_out = NULL;
+}
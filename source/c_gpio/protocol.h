@@ -0,0 +1,104 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * protocol.c implements RPIO's framed binary control protocol, which remote
+ * controllers speak over TCP, unix stream and seqpacket sockets, and UDP (see
+ * RPIO.add_tcp_callback, add_unix_callback and add_udp_callback). All
+ * integers are little-endian.
+ *
+ * A frame is a u32 length (of the rest of the frame, at most
+ * PROTO_FRAME_MAX) and a body. A request body is a u32 sequence number and
+ * any number of commands back to back; the server answers every request,
+ * in order, with a response of the same sequence number, a u8 status and the
+ * results of the commands. Clients can pipeline requests without waiting for
+ * their responses.
+ *
+ *   PROTO_READ_PORT   u8 bank                      -> u32 levels
+ *   PROTO_WRITE_MASK  u8 bank, u32 set, u32 clear
+ *   PROTO_PWM_WIDTH   u8 dma_channel, u8 gpio, u16 width (0 clears the gpio)
+ *   PROTO_SUBSCRIBE   u32 mask_bank0, u32 mask_bank1
+ *
+ * Commands run in order. The first failing command ends the request with its
+ * status; the results of the commands before it are kept. Edges of
+ * subscribed gpios are pushed in event frames: sequence number
+ * PROTO_SEQNO_EVENT, status 0, u32 dropped (the number of edges dropped so far
+ * because the client did not keep up) and one or more records of u8 gpio, u8
+ * level, u64 timestamp_ns and u32 seqno.
+ *
+ * A seqpacket message or a datagram holds one or more complete frames; a
+ * datagram is answered with one datagram of all their responses and can be
+ * at most PROTO_DGRAM_SIZE bytes. Datagram clients can't subscribe
+ * (PROTO_EINVAL).
+ */
+#ifndef RPIO_PROTOCOL_H
+#define RPIO_PROTOCOL_H
+
+#include <stdint.h>
+
+struct gpio_event;
+
+#define PROTO_CONNS 64  // connections served at once
+#define PROTO_FRAME_MAX 65536
+#define PROTO_DGRAM_SIZE 4096
+
+// Commands
+#define PROTO_READ_PORT  0x01
+#define PROTO_WRITE_MASK 0x02
+#define PROTO_PWM_WIDTH  0x03
+#define PROTO_SUBSCRIBE  0x04
+
+// Response status
+#define PROTO_OK       0
+#define PROTO_ECOMMAND 1  // unknown or truncated command
+#define PROTO_EINVAL   2  // invalid argument
+#define PROTO_EIO      3  // the operation failed (eg. PWM channel not set up)
+
+#define PROTO_SEQNO_EVENT 0xffffffff
+
+// Size of the header of an event frame (length included), and of a record
+#define PROTO_EVENT_HEADER 13
+#define PROTO_EVENT_SIZE 14
+
+// proto_input() and proto_flush() flags
+#define PROTO_WANT_READ  1  // the connection accepts input
+#define PROTO_WANT_WRITE 2  // output is pending (wait until writable)
+#define PROTO_SUBSCRIBED 4  // subscriptions changed (see proto_subscriptions)
+
+// Sets the pulse width (in pulse increments) of a gpio on a DMA channel, 0
+// clears it. Returns 0 or -1. Provided by the PWM code (if linked).
+typedef int (*proto_pwm_handler)(int channel, int gpio, int width);
+
+int proto_open(int fd);
+int proto_close(int fd);
+int proto_input(int fd);
+int proto_flush(int fd);
+int proto_datagrams(int fd);
+int proto_publish(const struct gpio_event *events, int count);
+int proto_pending(int *fds, int max);
+void proto_subscriptions(uint32_t *mask_bank0, uint32_t *mask_bank1);
+void proto_set_pwm_handler(proto_pwm_handler handler);
+void proto_cleanup(void);
+
+#endif
@@ -26,8 +26,23 @@
  * interact with the gpio-related C methods. 
  */
 #include "Python.h"
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
 #include "c_gpio.h"
+#include "c_events.h"
+#include "counter.h"
+#include "capture.h"
+#include "protocol.h"
+#include "record.h"
+#include "rt.h"
+#include "timed.h"
 #include "cpuinfo.h"
+#include "systimer.h"
+#include "stats.h"
+#include "py_stats.h"
+#include "py_trace.h"
 
 // All these will get exposed via the Python module
 static PyObject *WrongDirectionException;
@@ -82,10 +97,16 @@ static int gpio_direction[54];
 #define BCM          11
 static int gpio_mode = MODE_UNKNOWN;
 
-// Read /proc/cpuinfo once and keep the info at hand for further requests
+// Read /proc/cpuinfo once and keep the info at hand for further requests.
+// The simulated backend pretends to be a B+ (revision 3 pin layout).
 static void
 cache_rpi_revision(void)
 {
+    if (simulation_enabled()) {
+        strcpy(revision_hex, "0010");
+        revision_int = 3;
+        return;
+    }
     revision_int = get_cpuinfo_revision(revision_hex);
 }
 
@@ -141,14 +162,35 @@ module_setup(void)
 static PyObject*
 py_cleanup(PyObject *self, PyObject *args)
 {
-    int i;
-    for (i=0; i<54; i++) {
+    struct pin_setup pins[GPIO_COUNT];
+    int i, count = 0;
+
+    // No timed operations on the pins after they were reset
+    Py_BEGIN_ALLOW_THREADS
+    timed_stop();
+    Py_END_ALLOW_THREADS
+
+    for (i=0; i<GPIO_COUNT; i++) {
         if (gpio_direction[i] != -1) {
             // printf("GPIO %d --> INPUT\n", i);
-            setup_gpio(i, INPUT, PUD_OFF);
+            pins[count].gpio = i;
+            pins[count].direction = INPUT;
+            pins[count].pud = PUD_OFF;
+            count++;
             gpio_direction[i] = -1;
         }
     }
+    if (count)
+        setup_pins(pins, count);
+
+    // Stop replaying and recording before the event engine goes away
+    replay_stop();
+    if (record_active())
+        record_stop();
+
+    // Unexport the sysfs interfaces created by wait_for_edge() and counters
+    events_cleanup();
+    counter_cleanup();
 
     Py_INCREF(Py_None);
     return Py_None;
@@ -215,6 +257,7 @@ py_setup_channel(PyObject *self, PyObject *args, PyObject *kwargs)
     int initial = -1;
     static char *kwlist[] = {"channel", "direction", "pull_up_down", "initial", NULL};
     int func;
+    STATS_TIMER(t0);
 
     if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|ii", kwlist, &channel, &direction, &pud, &initial))
         return NULL;
@@ -250,9 +293,95 @@ py_setup_channel(PyObject *self, PyObject *args, PyObject *kwargs)
     }
     setup_gpio(gpio, direction, pud);
     gpio_direction[gpio] = direction;
+    STATS_RECORD(STAT_PY_SETUP_CHANNEL, t0);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function setup_pins([(channel, direction[, pull_up_down[, initial]]), ...])
+// Configures all pins in one batched register sequence (see setup_pins in c_gpio.c)
+static PyObject*
+py_setup_pins(PyObject *self, PyObject *args)
+{
+    PyObject *list, *seq, *item;
+    struct pin_setup pins[GPIO_COUNT];
+    int initial[GPIO_COUNT];
+    int i, count, gpio, channel, direction, pud, init, func;
+    uint64_t seen = 0;
+
+    if (!PyArg_ParseTuple(args, "O", &list))
+        return NULL;
+
+    if ((seq = PySequence_Fast(list, "setup_pins() expects a list of (channel, direction[, pull_up_down[, initial]]) tuples")) == NULL)
+        return NULL;
+
+    count = PySequence_Fast_GET_SIZE(seq);
+    if (count > GPIO_COUNT) {
+        Py_DECREF(seq);
+        PyErr_SetString(InvalidChannelException, "Too many channels passed to setup_pins()");
+        return NULL;
+    }
+
+    // Validate everything before touching any register
+    for (i=0; i<count; i++) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        pud = PUD_OFF;
+        init = -1;
+        if (!PyArg_ParseTuple(item, "ii|ii", &channel, &direction, &pud, &init))
+            goto error;
+
+        if (direction != INPUT && direction != OUTPUT) {
+            PyErr_SetString(InvalidDirectionException, "An invalid direction was passed to setup_pins()");
+            goto error;
+        }
+
+        if (direction == OUTPUT)
+            pud = PUD_OFF;
+
+        if (pud != PUD_OFF && pud != PUD_DOWN && pud != PUD_UP) {
+            PyErr_SetString(InvalidPullException, "Invalid value for pull_up_down - should be either PUD_OFF, PUD_UP or PUD_DOWN");
+            goto error;
+        }
+
+        if ((gpio = channel_to_gpio(channel)) < 0)
+            goto error;
+        if (seen & (1ULL << gpio)) {
+            PyErr_SetString(InvalidChannelException, "A channel was passed to setup_pins() more than once");
+            goto error;
+        }
+        seen |= 1ULL << gpio;
+
+        func = gpio_function(gpio);
+        if (gpio_warnings &&
+             ((func != 0 && func != 1) ||
+             (gpio_direction[gpio] == -1 && func == 1)))
+        {
+            if (PyErr_WarnEx(NULL, "This channel is already in use, continuing anyway.  Use RPIO.setwarnings(False) to disable warnings.", 1) == -1)
+                goto error;
+        }
+
+        pins[i].gpio = gpio;
+        pins[i].direction = direction;
+        pins[i].pud = pud;
+        initial[i] = direction == OUTPUT ? init : -1;
+    }
+    Py_DECREF(seq);
+
+    for (i=0; i<count; i++) {
+        if (initial[i] == LOW || initial[i] == HIGH)
+            output_gpio(pins[i].gpio, initial[i]);
+    }
+    setup_pins(pins, count);
+    for (i=0; i<count; i++)
+        gpio_direction[pins[i].gpio] = pins[i].direction;
 
     Py_INCREF(Py_None);
     return Py_None;
+
+error:
+    Py_DECREF(seq);
+    return NULL;
 }
 
 // python function output(channel, value)
@@ -260,6 +389,7 @@ static PyObject*
 py_output_gpio(PyObject *self, PyObject *args)
 {
     int gpio, channel, value;
+    STATS_TIMER(t0);
 
     if (!PyArg_ParseTuple(args, "ii", &channel, &value))
         return NULL;
@@ -274,6 +404,7 @@ py_output_gpio(PyObject *self, PyObject *args)
 
 //    printf("Output GPIO %d value %d\n", gpio, value);
     output_gpio(gpio, value);
+    STATS_RECORD(STAT_PY_OUTPUT_GPIO, t0);
 
     Py_INCREF(Py_None);
     return Py_None;
@@ -324,7 +455,8 @@ py_set_pullupdn(PyObject *self, PyObject *args, PyObject *kwargs)
 static PyObject*
 py_input_gpio(PyObject *self, PyObject *args)
 {
-    int gpio, channel;
+    int gpio, channel, value;
+    STATS_TIMER(t0);
 
     if (!PyArg_ParseTuple(args, "i", &channel))
         return NULL;
@@ -333,7 +465,9 @@ py_input_gpio(PyObject *self, PyObject *args)
           return NULL;
 
     //    printf("Input GPIO %d\n", gpio);
-    if (input_gpio(gpio))
+    value = input_gpio(gpio);
+    STATS_RECORD(STAT_PY_INPUT_GPIO, t0);
+    if (value)
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
@@ -425,127 +559,1582 @@ py_channel_to_gpio(PyObject *self, PyObject *args)
     return func;
 }
 
-PyMethodDef rpi_gpio_methods[] = {
-    {"setup", (PyCFunction)py_setup_channel, METH_VARARGS | METH_KEYWORDS, "Set up the GPIO channel, direction and (optional) pull/up down control\nchannel    - Either: RPi board pin number (not BCM GPIO 00..nn number).  Pins start from 1\n                or     : BCM GPIO number\ndirection - INPUT or OUTPUT\n[pull_up_down] - PUD_OFF (default), PUD_UP or PUD_DOWN\n[initial]        - Initial value for an output channel"},
-    {"cleanup", py_cleanup, METH_VARARGS, "Clean up by resetting all GPIO channels that have been used by this program\nto INPUT with no pullup/pulldown and no event detection"},
-    {"output", py_output_gpio, METH_VARARGS, "Output to a GPIO channel"},
-    {"input", py_input_gpio, METH_VARARGS, "Input from a GPIO channel"},
-    {"setmode", setmode, METH_VARARGS, "Set up numbering mode to use for channels.\nBOARD - Use Raspberry Pi board numbers\nBCM    - Use Broadcom GPIO 00..nn numbers"},
-    {"setwarnings", py_setwarnings, METH_VARARGS, "Enable or disable warning messages"},
+// python function t = now_us()
+static PyObject*
+py_now_us(PyObject *self, PyObject *args)
+{
+    return PyLong_FromUnsignedLongLong(now_us());
+}
 
-    // New methods in RPIO
-    {"forceoutput", py_forceoutput_gpio, METH_VARARGS, "Force output to a GPIO channel, ignoring whether it has been set up before."},
-    {"forceinput", py_forceinput_gpio, METH_VARARGS, "Force read input from a GPIO channel, ignoring whether it was set up before."},
-    {"set_pullupdn", (PyCFunction)py_set_pullupdn, METH_VARARGS | METH_KEYWORDS, "Set pullup or -down resistor on a GPIO channel."},
-    {"gpio_function", py_gpio_function, METH_VARARGS, "Return the current GPIO function (IN, OUT, ALT0)"},
-    {"channel_to_gpio", py_channel_to_gpio, METH_VARARGS, "Return BCM or BOARD id of channel (depending on current setmode)"},
-    {NULL, NULL, 0, NULL}
-};
+// python function delay_us(us) (busy-wait)
+static PyObject*
+py_delay_us(PyObject *self, PyObject *args)
+{
+    unsigned int us;
 
-#if PY_MAJOR_VERSION > 2
-static struct PyModuleDef rpigpiomodule = {
-    PyModuleDef_HEAD_INIT,
-    "_GPIO", /* name of module */
-    NULL,         /* module documentation, may be NULL */
-    -1,            /* size of per-interpreter state of the module,
-                        or -1 if the module keeps state in global variables. */
-    rpi_gpio_methods
-};
-#endif
+    if (!PyArg_ParseTuple(args, "I", &us))
+        return NULL;
 
-#if PY_MAJOR_VERSION > 2
-PyMODINIT_FUNC PyInit__GPIO(void)
-#else
-PyMODINIT_FUNC init_GPIO(void)
-#endif
+    delay_us(us);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function delay_ns(ns) (busy-wait)
+static PyObject*
+py_delay_ns(PyObject *self, PyObject *args)
 {
-    PyObject *module = NULL;
+    unsigned int ns;
 
-#if PY_MAJOR_VERSION > 2
-    if ((module = PyModule_Create(&rpigpiomodule)) == NULL)
-        goto exit;
-#else
-    if ((module = Py_InitModule("_GPIO", rpi_gpio_methods)) == NULL)
-        goto exit;
-#endif
+    if (!PyArg_ParseTuple(args, "I", &ns))
+        return NULL;
 
-    WrongDirectionException = PyErr_NewException("RPIO.Exceptions.WrongDirectionException", NULL, NULL);
-    PyModule_AddObject(module, "WrongDirectionException", WrongDirectionException);
+    delay_ns(ns);
 
-    InvalidModeException = PyErr_NewException("RPIO.Exceptions.InvalidModeException", NULL, NULL);
-    PyModule_AddObject(module, "InvalidModeException", InvalidModeException);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
 
-    InvalidDirectionException = PyErr_NewException("RPIO.Exceptions.InvalidDirectionException", NULL, NULL);
-    PyModule_AddObject(module, "InvalidDirectionException", InvalidDirectionException);
+// python function sleep_us(us) (sleep, then spin; releases the GIL)
+static PyObject*
+py_sleep_us(PyObject *self, PyObject *args)
+{
+    unsigned int us;
 
-    InvalidChannelException = PyErr_NewException("RPIO.Exceptions.InvalidChannelException", NULL, NULL);
-    PyModule_AddObject(module, "InvalidChannelException", InvalidChannelException);
+    if (!PyArg_ParseTuple(args, "I", &us))
+        return NULL;
 
-    InvalidPullException = PyErr_NewException("RPIO.Exceptions.InvalidPullException", NULL, NULL);
-    PyModule_AddObject(module, "InvalidPullException", InvalidPullException);
+    Py_BEGIN_ALLOW_THREADS
+    sleep_us(us);
+    Py_END_ALLOW_THREADS
 
-    ModeNotSetException = PyErr_NewException("RPIO.Exceptions.ModeNotSetException", NULL, NULL);
-    PyModule_AddObject(module, "ModeNotSetException", ModeNotSetException);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
 
-    high = Py_BuildValue("i", HIGH);
-    PyModule_AddObject(module, "HIGH", high);
+// python function (channel, level, timestamp) = wait_for_edge(channel, edge='both', timeout=None, pull_up_down=PUD_OFF)
+// `channel` can be a single channel or a list of channels. Waits in C with
+// the GIL released; returns None on timeout.
+static PyObject*
+py_wait_for_edge(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *channels, *seq, *timeout_obj = Py_None;
+    int chan[GPIO_COUNT], gpios[GPIO_COUNT];
+    int i, count, edge, pud = PUD_OFF, timeout_ms = -1, result, err;
+    const char *edge_str = "both";
+    static char *kwlist[] = {"channel", "edge", "timeout", "pull_up_down", NULL};
+    struct gpio_event event;
+    struct timespec ts;
+    double timeout, deadline = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|sOi", kwlist, &channels, &edge_str, &timeout_obj, &pud))
+        return NULL;
 
-    low = Py_BuildValue("i", LOW);
-    PyModule_AddObject(module, "LOW", low);
+    if ((edge = str_to_edge(edge_str)) < EDGE_RISING) {
+        PyErr_SetString(PyExc_ValueError, "edge must be 'rising', 'falling' or 'both'");
+        return NULL;
+    }
 
-    output = Py_BuildValue("i", OUTPUT);
-    PyModule_AddObject(module, "OUT", output);
+    if (pud != PUD_OFF && pud != PUD_DOWN && pud != PUD_UP) {
+        PyErr_SetString(InvalidPullException, "Invalid value for pull_up_down - should be either PUD_OFF, PUD_UP or PUD_DOWN");
+        return NULL;
+    }
 
-    input = Py_BuildValue("i", INPUT);
-    PyModule_AddObject(module, "IN", input);
+    if (timeout_obj != Py_None) {
+        timeout = PyFloat_AsDouble(timeout_obj);
+        if (timeout == -1 && PyErr_Occurred())
+            return NULL;
+        timeout_ms = timeout < 0 ? 0 : (int)(timeout * 1000 + 0.5);
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        deadline = ts.tv_sec + ts.tv_nsec / 1e9 + timeout;
+    }
 
-    alt0 = Py_BuildValue("i", ALT0);
-    PyModule_AddObject(module, "ALT0", alt0);
+    if (PySequence_Check(channels)) {
+        if ((seq = PySequence_Fast(channels, "wait_for_edge() expects a channel or a list of channels")) == NULL)
+            return NULL;
+        count = PySequence_Fast_GET_SIZE(seq);
+        if (count < 1 || count > GPIO_COUNT) {
+            Py_DECREF(seq);
+            PyErr_Format(InvalidChannelException, "wait_for_edge() needs between 1 and %d channels", GPIO_COUNT);
+            return NULL;
+        }
+        for (i=0; i<count; i++) {
+            chan[i] = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+            if (chan[i] == -1 && PyErr_Occurred()) {
+                Py_DECREF(seq);
+                return NULL;
+            }
+        }
+        Py_DECREF(seq);
+    } else {
+        count = 1;
+        chan[0] = PyLong_AsLong(channels);
+        if (chan[0] == -1 && PyErr_Occurred())
+            return NULL;
+    }
 
-    board = Py_BuildValue("i", BOARD);
-    PyModule_AddObject(module, "BOARD", board);
+    for (i=0; i<count; i++) {
+        if ((gpios[i] = channel_to_gpio(chan[i])) < 0)
+            return NULL;
+        setup_gpio(gpios[i], INPUT, pud);
+        gpio_direction[gpios[i]] = INPUT;
+    }
 
-    bcm = Py_BuildValue("i", BCM);
-    PyModule_AddObject(module, "BCM", bcm);
+    for (;;) {
+        Py_BEGIN_ALLOW_THREADS
+        result = events_wait_edge(gpios, count, edge, timeout_ms, &event);
+        err = errno;
+        Py_END_ALLOW_THREADS
+
+        if (result >= 0 || err != EINTR)
+            break;
+
+        // Give KeyboardInterrupt & co a chance, then wait for the remainder
+        if (PyErr_CheckSignals() < 0)
+            return NULL;
+        if (timeout_ms > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            timeout = deadline - (ts.tv_sec + ts.tv_nsec / 1e9);
+            timeout_ms = timeout < 0 ? 0 : (int)(timeout * 1000 + 0.5);
+        }
+    }
 
-    pud_off = Py_BuildValue("i", PUD_OFF);
-    PyModule_AddObject(module, "PUD_OFF", pud_off);
+    if (result < 0) {
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+    if (result == 0) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
 
-    pud_up = Py_BuildValue("i", PUD_UP);
-    PyModule_AddObject(module, "PUD_UP", pud_up);
+    for (i=0; i<count && gpios[i] != event.gpio; i++)
+        ;
+    return Py_BuildValue("(iid)", chan[i], event.level, event.timestamp_ns / 1e9);
+}
 
-    pud_down = Py_BuildValue("i", PUD_DOWN);
-    PyModule_AddObject(module, "PUD_DOWN", pud_down);
+// python function counter_start(channel, edge='rising', window_ms=1000, pull_up_down=PUD_OFF)
+// Counts edges of a channel in a background thread (see counter.c)
+static PyObject*
+py_counter_start(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    int channel, gpio, edge, window_ms = 1000, pud = PUD_OFF, ret, err;
+    const char *edge_str = "rising";
+    static char *kwlist[] = {"channel", "edge", "window_ms", "pull_up_down", NULL};
 
-    // detect board revision and set up accordingly
-    cache_rpi_revision();
-    switch (revision_int) {
-    case 1:
-        pin_to_gpio = &pin_to_gpio_rev1;
-        gpio_to_pin = &gpio_to_pin_rev1;
-        break;
-    case 2:
-        pin_to_gpio = &pin_to_gpio_rev2;
-        gpio_to_pin = &gpio_to_pin_rev2;
-        break;
-    case 3:
-        pin_to_gpio = &pin_to_gpio_rev3;
-        gpio_to_pin = &gpio_to_pin_rev3;
-        break;
-    default:
-        PyErr_SetString(PyExc_SystemError, "This module can only be run on a Raspberry Pi!");
-#if PY_MAJOR_VERSION > 2
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|sii", kwlist, &channel, &edge_str, &window_ms, &pud))
+        return NULL;
+
+    if ((edge = str_to_edge(edge_str)) < EDGE_RISING) {
+        PyErr_SetString(PyExc_ValueError, "edge must be 'rising', 'falling' or 'both'");
         return NULL;
-#else
-        return;
-#endif
     }
+    if (window_ms < 1 || window_ms > COUNTER_WINDOW_MS_MAX) {
+        PyErr_Format(PyExc_ValueError, "window_ms must be between 1 and %d", COUNTER_WINDOW_MS_MAX);
+        return NULL;
+    }
+    if (pud != PUD_OFF && pud != PUD_DOWN && pud != PUD_UP) {
+        PyErr_SetString(InvalidPullException, "Invalid value for pull_up_down - should be either PUD_OFF, PUD_UP or PUD_DOWN");
+        return NULL;
+    }
+    if ((gpio = channel_to_gpio(channel)) < 0)
+        return NULL;
+    setup_gpio(gpio, INPUT, pud);
+    gpio_direction[gpio] = INPUT;
 
-    rpi_revision = Py_BuildValue("i", revision_int);
-    PyModule_AddObject(module, "RPI_REVISION", rpi_revision);
+    Py_BEGIN_ALLOW_THREADS
+    ret = counter_start(gpio, edge, window_ms);
+    err = errno;
+    Py_END_ALLOW_THREADS
 
-    rpi_revision_hex = Py_BuildValue("s", revision_hex);
-    PyModule_AddObject(module, "RPI_REVISION_HEX", rpi_revision_hex);
+    if (ret < 0) {
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function counter_stop(channel)
+static PyObject*
+py_counter_stop(PyObject *self, PyObject *args)
+{
+    int channel, gpio;
+
+    if (!PyArg_ParseTuple(args, "i", &channel))
+        return NULL;
+    if ((gpio = channel_to_gpio(channel)) < 0)
+        return NULL;
+
+    if (counter_stop(gpio) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function (rising, falling, frequency, period) = counter_read(channel, reset=False)
+static PyObject*
+py_counter_read(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    struct edge_count count;
+    int channel, gpio, reset = 0;
+    static char *kwlist[] = {"channel", "reset", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|i", kwlist, &channel, &reset))
+        return NULL;
+    if ((gpio = channel_to_gpio(channel)) < 0)
+        return NULL;
+
+    if (counter_read(gpio, &count, reset) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    return Py_BuildValue("(KKdd)", (unsigned PY_LONG_LONG)count.rising,
+            (unsigned PY_LONG_LONG)count.falling, count.frequency_hz,
+            count.period_ns / 1e9);
+}
+
+// Converts a list of channels into BCM gpios; returns their number or -1
+static int
+channels_to_gpios(PyObject *channels, int *gpios)
+{
+    PyObject *seq;
+    int i, count, channel;
+
+    if ((seq = PySequence_Fast(channels, "expected a list of channels")) == NULL)
+        return -1;
+    count = PySequence_Fast_GET_SIZE(seq);
+    if (count < 1 || count > 32) {
+        Py_DECREF(seq);
+        PyErr_SetString(InvalidChannelException, "needs between 1 and 32 channels");
+        return -1;
+    }
+    for (i=0; i<count; i++) {
+        channel = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+        if ((channel == -1 && PyErr_Occurred()) || (gpios[i] = channel_to_gpio(channel)) < 0) {
+            Py_DECREF(seq);
+            return -1;
+        }
+    }
+    Py_DECREF(seq);
+    return count;
+}
+
+// python function rate = capture(channels, rate, n, buffer, bits=False, cpu=-1)
+// Samples the levels of channels n times at `rate` Hz (0: as fast as
+// possible) into a writable buffer (with the GIL released), and returns the
+// achieved rate (0.0 if unknown)
+static PyObject*
+py_capture(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *channels, *buffer;
+    Py_buffer view;
+    Py_ssize_t n;
+    double rate;
+    uint64_t elapsed_ns;
+    uint32_t interval_ns = 0;
+    int gpios[32], count, bits = 0, cpu = -1, format, ret, err;
+    static char *kwlist[] = {"channels", "rate", "n", "buffer", "bits", "cpu", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OdnO|ii", kwlist, &channels, &rate, &n, &buffer, &bits, &cpu))
+        return NULL;
+    if (rate < 0 || n < 0 || (rate > 0 && rate < 0.25)) {
+        PyErr_SetString(PyExc_ValueError, "rate must be 0 or at least 0.25, and n not negative");
+        return NULL;
+    }
+    if (rate > 0)
+        interval_ns = (uint32_t)(1e9 / rate + 0.5);
+    if ((count = channels_to_gpios(channels, gpios)) < 0)
+        return NULL;
+
+    format = bits ? CAPTURE_BITS : CAPTURE_WORDS;
+    if (PyObject_GetBuffer(buffer, &view, PyBUF_WRITABLE) < 0)
+        return NULL;
+    if ((size_t)view.len < capture_size(n, count, format) ||
+            (format == CAPTURE_WORDS && ((uintptr_t)view.buf & 3))) {
+        PyBuffer_Release(&view);
+        PyErr_Format(PyExc_ValueError, "buffer must be a %saligned, writable buffer of at least %lu bytes",
+                format == CAPTURE_WORDS ? "4-byte " : "", (unsigned long)capture_size(n, count, format));
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = capture_levels(view.buf, n, gpios, count, interval_ns, format, cpu, &elapsed_ns);
+    err = errno;
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&view);
+    if (ret < 0) {
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+    return Py_BuildValue("d", elapsed_ns ? (n - 1) * 1e9 / elapsed_ns : 0.0);
+}
+
+// Gets captured level words from a buffer; returns the gpio or -1
+static int
+capture_words(PyObject *buffer, int channel, Py_buffer *view)
+{
+    int gpio;
+
+    if ((gpio = channel_to_gpio(channel)) < 0)
+        return -1;
+    if (PyObject_GetBuffer(buffer, view, PyBUF_SIMPLE) < 0)
+        return -1;
+    if ((uintptr_t)view->buf & 3) {
+        PyBuffer_Release(view);
+        PyErr_SetString(PyExc_ValueError, "buffer must be 4-byte aligned");
+        return -1;
+    }
+    return gpio;
+}
+
+// python function [index, ..] = capture_edges(buffer, channel, edge='both')
+// Sample indices of the edges of a channel in captured level words
+static PyObject*
+py_capture_edges(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *buffer, *list, *item;
+    Py_buffer view;
+    uint32_t *indices;
+    size_t n, count, i;
+    int channel, gpio, edge;
+    const char *edge_str = "both";
+    static char *kwlist[] = {"buffer", "channel", "edge", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|s", kwlist, &buffer, &channel, &edge_str))
+        return NULL;
+    if ((edge = str_to_edge(edge_str)) < EDGE_RISING) {
+        PyErr_SetString(PyExc_ValueError, "edge must be 'rising', 'falling' or 'both'");
+        return NULL;
+    }
+    if ((gpio = capture_words(buffer, channel, &view)) < 0)
+        return NULL;
+
+    n = view.len / sizeof(uint32_t);
+    Py_BEGIN_ALLOW_THREADS
+    count = capture_edges(view.buf, n, gpio, edge, NULL, 0);
+    Py_END_ALLOW_THREADS
+    if ((indices = malloc((count ? count : 1) * sizeof(uint32_t))) == NULL) {
+        PyBuffer_Release(&view);
+        return PyErr_NoMemory();
+    }
+    capture_edges(view.buf, n, gpio, edge, indices, count);
+    PyBuffer_Release(&view);
+
+    if ((list = PyList_New(count)) == NULL) {
+        free(indices);
+        return NULL;
+    }
+    for (i=0; i<count; i++) {
+        if ((item = Py_BuildValue("I", indices[i])) == NULL) {
+            free(indices);
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    free(indices);
+    return list;
+}
+
+// python function duty = capture_duty(buffer, channel)
+// Share of the captured level words in which a channel is high
+static PyObject*
+py_capture_duty(PyObject *self, PyObject *args)
+{
+    PyObject *buffer;
+    Py_buffer view;
+    struct capture_stats stats;
+    size_t n;
+    int channel, gpio;
+
+    if (!PyArg_ParseTuple(args, "Oi", &buffer, &channel))
+        return NULL;
+    if ((gpio = capture_words(buffer, channel, &view)) < 0)
+        return NULL;
+
+    n = view.len / sizeof(uint32_t);
+    capture_stats(view.buf, n, gpio, &stats);
+    PyBuffer_Release(&view);
+    return Py_BuildValue("d", n ? (double)stats.high / n : 0.0);
+}
+
+// python function frequency = capture_frequency(buffer, channel, rate)
+// Frequency of a channel in captured level words sampled at `rate` Hz,
+// from its first to its last rising edge (0.0 with less than two)
+static PyObject*
+py_capture_frequency(PyObject *self, PyObject *args)
+{
+    PyObject *buffer;
+    Py_buffer view;
+    struct capture_stats stats;
+    double rate;
+    int channel, gpio;
+
+    if (!PyArg_ParseTuple(args, "Oid", &buffer, &channel, &rate))
+        return NULL;
+    if ((gpio = capture_words(buffer, channel, &view)) < 0)
+        return NULL;
+
+    capture_stats(view.buf, view.len / sizeof(uint32_t), gpio, &stats);
+    PyBuffer_Release(&view);
+    if (stats.rising < 2)
+        return Py_BuildValue("d", 0.0);
+    return Py_BuildValue("d", (stats.rising - 1) * rate / (stats.last_rising - stats.first_rising));
+}
+
+// python function [(fd, level, exported), ...] = sysfs_setup([(gpio, edge), ...])
+// Batched sysfs export and edge configuration of BCM gpios for RPIO's
+// interrupt handling (see events_sysfs_setup in c_events.c)
+static PyObject*
+py_sysfs_setup(PyObject *self, PyObject *args)
+{
+    PyObject *list, *seq, *result;
+    struct sysfs_pin pins[GPIO_COUNT];
+    const char *edge_str;
+    int i, count, ret, err;
+
+    if (!PyArg_ParseTuple(args, "O", &list))
+        return NULL;
+
+    if ((seq = PySequence_Fast(list, "sysfs_setup() expects a list of (gpio, edge) tuples")) == NULL)
+        return NULL;
+
+    count = PySequence_Fast_GET_SIZE(seq);
+    if (count > GPIO_COUNT) {
+        Py_DECREF(seq);
+        PyErr_SetString(InvalidChannelException, "Too many gpios passed to sysfs_setup()");
+        return NULL;
+    }
+    for (i=0; i<count; i++) {
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, i), "is", &pins[i].gpio, &edge_str)) {
+            Py_DECREF(seq);
+            return NULL;
+        }
+        if ((pins[i].edge = str_to_edge(edge_str)) < 0) {
+            Py_DECREF(seq);
+            PyErr_Format(PyExc_ValueError, "'%s' is not a valid edge", edge_str);
+            return NULL;
+        }
+    }
+    Py_DECREF(seq);
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = events_sysfs_setup(pins, count);
+    err = errno;
+    Py_END_ALLOW_THREADS
+
+    if (ret < 0) {
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    if ((result = PyList_New(count)) == NULL)
+        goto error;
+    for (i=0; i<count; i++) {
+        PyObject *item = Py_BuildValue("(iii)", pins[i].fd, pins[i].level, pins[i].exported);
+        if (item == NULL) {
+            Py_DECREF(result);
+            goto error;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+    return result;
+
+error:
+    for (i=0; i<count; i++)
+        close(pins[i].fd);
+    return NULL;
+}
+
+// python function (backend, chip) = interrupt_backend()
+static PyObject*
+py_interrupt_backend(PyObject *self, PyObject *args)
+{
+    return Py_BuildValue("(ss)", backend_to_str(events_backend()), events_chip());
+}
+
+// python function set_interrupt_backend(backend, chip=None)
+static PyObject*
+py_set_interrupt_backend(PyObject *self, PyObject *args)
+{
+    const char *name, *chip = NULL;
+    int id;
+
+    if (!PyArg_ParseTuple(args, "s|z", &name, &chip))
+        return NULL;
+
+    if ((id = str_to_backend(name)) < 0) {
+        PyErr_SetString(PyExc_ValueError, "backend must be 'sysfs' or 'gpiochip'");
+        return NULL;
+    }
+    if (events_set_backend(id, chip) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function events_add([(gpio, edge), ...])
+// Registers BCM gpios with the event engine in one batch
+static PyObject*
+py_events_add(PyObject *self, PyObject *args)
+{
+    PyObject *list, *seq;
+    int gpios[GPIO_COUNT], edges[GPIO_COUNT];
+    const char *edge_str;
+    int i, count, ret, err;
+
+    if (!PyArg_ParseTuple(args, "O", &list))
+        return NULL;
+
+    if ((seq = PySequence_Fast(list, "events_add() expects a list of (gpio, edge) tuples")) == NULL)
+        return NULL;
+
+    count = PySequence_Fast_GET_SIZE(seq);
+    if (count > GPIO_COUNT) {
+        Py_DECREF(seq);
+        PyErr_SetString(InvalidChannelException, "Too many gpios passed to events_add()");
+        return NULL;
+    }
+    for (i=0; i<count; i++) {
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, i), "is", &gpios[i], &edge_str)) {
+            Py_DECREF(seq);
+            return NULL;
+        }
+        if ((edges[i] = str_to_edge(edge_str)) < 0) {
+            Py_DECREF(seq);
+            PyErr_Format(PyExc_ValueError, "'%s' is not a valid edge", edge_str);
+            return NULL;
+        }
+    }
+    Py_DECREF(seq);
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = events_add_gpios(gpios, edges, count);
+    err = errno;
+    Py_END_ALLOW_THREADS
+
+    if (ret < 0) {
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function events_remove(gpio)
+static PyObject*
+py_events_remove(PyObject *self, PyObject *args)
+{
+    int gpio;
+
+    if (!PyArg_ParseTuple(args, "i", &gpio))
+        return NULL;
+
+    if (events_del_gpio(gpio) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function events_set_filter(gpio, filter, width_us=0)
+// filter is 'none', 'stable', 'holdoff' or 'integrator'
+static PyObject*
+py_events_set_filter(PyObject *self, PyObject *args)
+{
+    const char *name;
+    unsigned int width_us = 0;
+    int gpio, filter;
+
+    if (!PyArg_ParseTuple(args, "is|I", &gpio, &name, &width_us))
+        return NULL;
+
+    if ((filter = str_to_filter(name)) < 0) {
+        PyErr_Format(PyExc_ValueError, "'%s' is not a valid filter", name);
+        return NULL;
+    }
+    if (filter != FILTER_NONE && width_us == 0) {
+        PyErr_SetString(PyExc_ValueError, "width_us must be > 0");
+        return NULL;
+    }
+    if (events_set_filter(gpio, filter, width_us) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function id = events_listen(gpio, edge, filter='none', width_us=0)
+// Adds a listener with its own edge and filter to a gpio of the engine
+static PyObject*
+py_events_listen(PyObject *self, PyObject *args)
+{
+    const char *edge_name, *filter_name = "none";
+    unsigned int width_us = 0;
+    int gpio, edge, filter, id;
+
+    if (!PyArg_ParseTuple(args, "is|sI", &gpio, &edge_name, &filter_name, &width_us))
+        return NULL;
+
+    if ((edge = str_to_edge(edge_name)) < 0) {
+        PyErr_Format(PyExc_ValueError, "'%s' is not a valid edge", edge_name);
+        return NULL;
+    }
+    if ((filter = str_to_filter(filter_name)) < 0) {
+        PyErr_Format(PyExc_ValueError, "'%s' is not a valid filter", filter_name);
+        return NULL;
+    }
+    if (filter != FILTER_NONE && width_us == 0) {
+        PyErr_SetString(PyExc_ValueError, "width_us must be > 0");
+        return NULL;
+    }
+    if ((id = events_listen(gpio, edge, filter, width_us)) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+    return Py_BuildValue("i", id);
+}
+
+// python function events_unlisten(id)
+static PyObject*
+py_events_unlisten(PyObject *self, PyObject *args)
+{
+    int id;
+
+    if (!PyArg_ParseTuple(args, "i", &id))
+        return NULL;
+    if (events_unlisten(id) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function events_publish(id)
+// Publishes the events of a listener to the subscribed protocol connections
+// (in C), instead of returning them from events_read
+static PyObject*
+py_events_publish(PyObject *self, PyObject *args)
+{
+    int id;
+
+    if (!PyArg_ParseTuple(args, "i", &id))
+        return NULL;
+    if (events_set_sink(id, proto_publish) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function fd = events_fileno()
+static PyObject*
+py_events_fileno(PyObject *self, PyObject *args)
+{
+    if (events_setup() < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+    return Py_BuildValue("i", events_fileno());
+}
+
+// python function [(gpio, level, timestamp_ns, seqno, listener), ...] = events_read(max_events=64)
+// Returns the pending events of the engine without blocking (listener is
+// None for events of the gpio itself)
+static PyObject*
+py_events_read(PyObject *self, PyObject *args)
+{
+    struct gpio_event events[64];
+    PyObject *result, *item;
+    int i, n, max_events = 64;
+
+    if (!PyArg_ParseTuple(args, "|i", &max_events))
+        return NULL;
+
+    if (max_events < 1 || max_events > 64)
+        max_events = 64;
+    if ((n = events_read(events, max_events, 0)) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    if ((result = PyList_New(n)) == NULL)
+        return NULL;
+    for (i=0; i<n; i++) {
+        if (events[i].listener == LISTENER_NONE)
+            item = Py_BuildValue("(iiKIO)", events[i].gpio, events[i].level,
+                    (unsigned PY_LONG_LONG)events[i].timestamp_ns, events[i].seqno, Py_None);
+        else
+            item = Py_BuildValue("(iiKII)", events[i].gpio, events[i].level,
+                    (unsigned PY_LONG_LONG)events[i].timestamp_ns, events[i].seqno,
+                    events[i].listener);
+        if (item == NULL) {
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+    return result;
+}
+
+// python function events_cleanup()
+static PyObject*
+py_events_cleanup(PyObject *self, PyObject *args)
+{
+    events_cleanup();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function proto_open(fd)
+// Serves RPIO's binary protocol on a connected stream socket
+static PyObject*
+py_proto_open(PyObject *self, PyObject *args)
+{
+    int fd;
+
+    if (!PyArg_ParseTuple(args, "i", &fd))
+        return NULL;
+    if (proto_open(fd) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function proto_close(fd)
+static PyObject*
+py_proto_close(PyObject *self, PyObject *args)
+{
+    int fd;
+
+    if (!PyArg_ParseTuple(args, "i", &fd))
+        return NULL;
+    if (proto_close(fd) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function flags = proto_input(fd)
+// Reads and executes the pending requests of a connection
+static PyObject*
+py_proto_input(PyObject *self, PyObject *args)
+{
+    int fd, flags;
+
+    if (!PyArg_ParseTuple(args, "i", &fd))
+        return NULL;
+    if ((flags = proto_input(fd)) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+    return Py_BuildValue("i", flags);
+}
+
+// python function flags = proto_flush(fd)
+// Sends the pending output of a writable connection
+static PyObject*
+py_proto_flush(PyObject *self, PyObject *args)
+{
+    int fd, flags;
+
+    if (!PyArg_ParseTuple(args, "i", &fd))
+        return NULL;
+    if ((flags = proto_flush(fd)) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+    return Py_BuildValue("i", flags);
+}
+
+// python function count = proto_datagrams(fd)
+// Executes a batch of pending datagrams of a datagram socket
+static PyObject*
+py_proto_datagrams(PyObject *self, PyObject *args)
+{
+    int fd, count;
+
+    if (!PyArg_ParseTuple(args, "i", &fd))
+        return NULL;
+    if ((count = proto_datagrams(fd)) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+    return Py_BuildValue("i", count);
+}
+
+// python function proto_publish(gpio, level, timestamp_ns=0, seqno=0)
+static PyObject*
+py_proto_publish(PyObject *self, PyObject *args)
+{
+    struct gpio_event event;
+    unsigned PY_LONG_LONG timestamp_ns = 0;
+    unsigned int seqno = 0;
+    int gpio, level;
+
+    if (!PyArg_ParseTuple(args, "ii|KI", &gpio, &level, &timestamp_ns, &seqno))
+        return NULL;
+    if (gpio < 0 || gpio >= GPIO_COUNT) {
+        PyErr_SetString(InvalidChannelException, "The gpio number is invalid");
+        return NULL;
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.gpio = gpio;
+    event.level = level ? 1 : 0;
+    event.edge = level ? EDGE_RISING : EDGE_FALLING;
+    event.timestamp_ns = timestamp_ns;
+    event.seqno = seqno;
+    event.listener = LISTENER_NONE;
+    proto_publish(&event, 1);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function [fd, ..] = proto_pending()
+// Protocol connections whose published edges backed up (wait until writable)
+static PyObject*
+py_proto_pending(PyObject *self, PyObject *args)
+{
+    int fds[PROTO_CONNS], i, count;
+    PyObject *list, *item;
+
+    count = proto_pending(fds, PROTO_CONNS);
+    if ((list = PyList_New(count)) == NULL)
+        return NULL;
+    for (i=0; i<count; i++) {
+        if ((item = Py_BuildValue("i", fds[i])) == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    return list;
+}
+
+// python function rt_configure(policy='fifo', priority=50, cpu=-1, lock_memory=True, stack_bytes=RT_STACK_BYTES)
+// Sets the real-time profile which RPIO's threads apply when they start
+static PyObject*
+py_rt_configure(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    struct rt_profile profile;
+    const char *policy = "fifo";
+    Py_ssize_t stack_bytes = RT_STACK_BYTES;
+    static char *kwlist[] = {"policy", "priority", "cpu", "lock_memory", "stack_bytes", NULL};
+
+    profile.priority = 50;
+    profile.cpu = -1;
+    profile.lock_memory = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|siiin", kwlist, &policy, &profile.priority, &profile.cpu, &profile.lock_memory, &stack_bytes))
+        return NULL;
+
+    if (strcmp(policy, "fifo") == 0)
+        profile.policy = SCHED_FIFO;
+    else if (strcmp(policy, "rr") == 0)
+        profile.policy = SCHED_RR;
+    else if (strcmp(policy, "other") == 0)
+        profile.policy = SCHED_OTHER;
+    else {
+        PyErr_SetString(PyExc_ValueError, "policy must be 'fifo', 'rr' or 'other'");
+        return NULL;
+    }
+    if (stack_bytes < 0 || stack_bytes > 8 * 1024 * 1024) {
+        PyErr_SetString(PyExc_ValueError, "stack_bytes must be between 0 and 8MB");
+        return NULL;
+    }
+    profile.stack_bytes = stack_bytes;
+
+    if (rt_configure(&profile) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function rt_apply()
+// Applies the real-time profile to the calling thread
+static PyObject*
+py_rt_apply(PyObject *self, PyObject *args)
+{
+    if (rt_apply() < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function (policy, priority, cpu, lock_memory, stack_bytes) = rt_profile()
+// Returns None if no profile is configured
+static PyObject*
+py_rt_profile(PyObject *self, PyObject *args)
+{
+    struct rt_profile profile;
+    const char *policy;
+
+    if (!rt_get_profile(&profile)) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    policy = profile.policy == SCHED_FIFO ? "fifo" : profile.policy == SCHED_RR ? "rr" : "other";
+    return Py_BuildValue("(siiin)", policy, profile.priority, profile.cpu,
+            profile.lock_memory, (Py_ssize_t)profile.stack_bytes);
+}
+
+// python function rt_update_stats()
+// Adds the page faults since the last call to the page_faults counter
+static PyObject*
+py_rt_update_stats(PyObject *self, PyObject *args)
+{
+    rt_update_stats();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function record_start(path)
+// Records the raw edges of the event engine (and those passed to
+// record_event) into a new file (see record.h)
+static PyObject*
+py_record_start(PyObject *self, PyObject *args)
+{
+    const char *path;
+
+    if (!PyArg_ParseTuple(args, "s", &path))
+        return NULL;
+    if (record_start(path) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function record_stop()
+static PyObject*
+py_record_stop(PyObject *self, PyObject *args)
+{
+    int ret, err;
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = record_stop();
+    err = errno;
+    Py_END_ALLOW_THREADS
+
+    if (ret < 0) {
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function record_event(gpio, level, timestamp_ns=0)
+// Records an edge of a BCM gpio which RPIO handled outside of the event
+// engine (sysfs interrupts); timestamp 0 is now
+static PyObject*
+py_record_event(PyObject *self, PyObject *args)
+{
+    struct gpio_event event;
+    struct timespec ts;
+    unsigned PY_LONG_LONG timestamp_ns = 0;
+    int gpio, level;
+
+    if (!PyArg_ParseTuple(args, "ii|K", &gpio, &level, &timestamp_ns))
+        return NULL;
+    if (gpio < 0 || gpio >= GPIO_COUNT) {
+        PyErr_SetString(PyExc_ValueError, "invalid gpio");
+        return NULL;
+    }
+    if (!timestamp_ns) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        timestamp_ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+    memset(&event, 0, sizeof(event));
+    event.gpio = gpio;
+    event.level = level ? 1 : 0;
+    event.timestamp_ns = timestamp_ns;
+    record_events(&event, 1);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// Recordings opened for reading are capsules of a struct record_reader
+#define RECORDING_CAPSULE "RPIO.recording"
+
+static void
+recording_destroy(PyObject *capsule)
+{
+    struct record_reader *reader = PyCapsule_GetPointer(capsule, RECORDING_CAPSULE);
+
+    if (reader) {
+        record_reader_close(reader);
+        free(reader);
+    }
+}
+
+static struct record_reader *
+recording_get(PyObject *capsule)
+{
+    struct record_reader *reader = PyCapsule_GetPointer(capsule, RECORDING_CAPSULE);
+
+    if (reader && !reader->map) {
+        PyErr_SetString(PyExc_ValueError, "recording is closed");
+        return NULL;
+    }
+    return reader;
+}
+
+// python function handle = recording_open(path)
+// Maps a recording for reading (see record_reader_open)
+static PyObject*
+py_recording_open(PyObject *self, PyObject *args)
+{
+    struct record_reader *reader;
+    const char *path;
+    PyObject *capsule;
+
+    if (!PyArg_ParseTuple(args, "s", &path))
+        return NULL;
+    if ((reader = malloc(sizeof(*reader))) == NULL)
+        return PyErr_NoMemory();
+    if (record_reader_open(reader, path) < 0) {
+        free(reader);
+        return PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+    }
+    if ((capsule = PyCapsule_New(reader, RECORDING_CAPSULE, recording_destroy)) == NULL) {
+        record_reader_close(reader);
+        free(reader);
+    }
+    return capsule;
+}
+
+// python function recording_close(handle)
+static PyObject*
+py_recording_close(PyObject *self, PyObject *args)
+{
+    struct record_reader *reader;
+    PyObject *capsule;
+
+    if (!PyArg_ParseTuple(args, "O", &capsule))
+        return NULL;
+    if ((reader = PyCapsule_GetPointer(capsule, RECORDING_CAPSULE)) == NULL)
+        return NULL;
+    record_reader_close(reader);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function [(offset, first_ns, count), ...] = recording_blocks(handle)
+static PyObject*
+py_recording_blocks(PyObject *self, PyObject *args)
+{
+    struct record_reader *reader;
+    PyObject *capsule, *list, *item;
+    int i;
+
+    if (!PyArg_ParseTuple(args, "O", &capsule))
+        return NULL;
+    if ((reader = recording_get(capsule)) == NULL)
+        return NULL;
+    if ((list = PyList_New(reader->block_count)) == NULL)
+        return NULL;
+    for (i=0; i<reader->block_count; i++) {
+        item = Py_BuildValue("(KKI)", (unsigned PY_LONG_LONG)reader->blocks[i].offset,
+                (unsigned PY_LONG_LONG)reader->blocks[i].first_ns, reader->blocks[i].count);
+        if (item == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    return list;
+}
+
+// python function seqno = recording_find(handle, timestamp_ns)
+// Number of the first event at or after timestamp_ns
+static PyObject*
+py_recording_find(PyObject *self, PyObject *args)
+{
+    struct record_reader *reader;
+    unsigned PY_LONG_LONG timestamp_ns;
+    PyObject *capsule;
+
+    if (!PyArg_ParseTuple(args, "OK", &capsule, &timestamp_ns))
+        return NULL;
+    if ((reader = recording_get(capsule)) == NULL)
+        return NULL;
+    record_reader_seek(reader, timestamp_ns);
+    return PyLong_FromUnsignedLongLong(reader->event);
+}
+
+// python function [(gpio, level, timestamp_ns, seqno), ...] = recording_read(handle, seqno, max_events)
+// Reads up to max_events from the event number seqno on
+static PyObject*
+py_recording_read(PyObject *self, PyObject *args)
+{
+    struct record_reader *reader;
+    struct gpio_event event;
+    unsigned PY_LONG_LONG seqno;
+    PyObject *capsule, *list, *item;
+    int i, max_events;
+
+    if (!PyArg_ParseTuple(args, "OKi", &capsule, &seqno, &max_events))
+        return NULL;
+    if ((reader = recording_get(capsule)) == NULL)
+        return NULL;
+    if ((list = PyList_New(0)) == NULL)
+        return NULL;
+    record_reader_goto(reader, seqno);
+    for (i=0; i<max_events && record_reader_next(reader, &event); i++) {
+        item = Py_BuildValue("(iiKK)", event.gpio, event.level,
+                (unsigned PY_LONG_LONG)event.timestamp_ns, (unsigned PY_LONG_LONG)event.seqno);
+        if (item == NULL || PyList_Append(list, item) < 0) {
+            Py_XDECREF(item);
+            Py_DECREF(list);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    return list;
+}
+
+// python function replay_start(path, speed=1.0, start_ns=0, inject=True, outputs=False)
+// Replays a recording in a background thread (see replay_start in record.c)
+static PyObject*
+py_replay_start(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    const char *path;
+    double speed = 1.0;
+    unsigned PY_LONG_LONG start_ns = 0;
+    int inject = 1, outputs = 0, ret, err;
+    static char *kwlist[] = {"path", "speed", "start_ns", "inject", "outputs", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|dKii", kwlist, &path, &speed, &start_ns, &inject, &outputs))
+        return NULL;
+    if (speed < 0) {
+        PyErr_SetString(PyExc_ValueError, "speed must not be negative");
+        return NULL;
+    }
+    if (!inject && !outputs) {
+        PyErr_SetString(PyExc_ValueError, "nothing to replay into (inject and outputs are False)");
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    ret = replay_start(path, speed, start_ns, (inject ? REPLAY_INJECT : 0) | (outputs ? REPLAY_OUTPUT : 0));
+    err = errno;
+    Py_END_ALLOW_THREADS
+
+    if (ret < 0) {
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function replay_stop()
+static PyObject*
+py_replay_stop(PyObject *self, PyObject *args)
+{
+    Py_BEGIN_ALLOW_THREADS
+    replay_stop();
+    Py_END_ALLOW_THREADS
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function running = replay_running()
+static PyObject*
+py_replay_running(PyObject *self, PyObject *args)
+{
+    return Py_BuildValue("i", replay_running());
+}
+
+// python function timed_start(cpu=-1)
+// Starts the executor thread of timed schedules (see timed.c)
+static PyObject*
+py_timed_start(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    int cpu = -1;
+    static char *kwlist[] = {"cpu", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", kwlist, &cpu))
+        return NULL;
+    if (timed_start(cpu) < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function timed_stop()
+static PyObject*
+py_timed_stop(PyObject *self, PyObject *args)
+{
+    Py_BEGIN_ALLOW_THREADS
+    timed_stop();
+    Py_END_ALLOW_THREADS
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function id = timed_submit(ops, start_us=0)
+// ops is a sequence of (time_us, TIMED_WRITE, set_mask, clear_mask),
+// (time_us, TIMED_WAIT) and (time_us, TIMED_READ) tuples
+static PyObject*
+py_timed_submit(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *ops, *seq, *item;
+    struct timed_op *buf;
+    unsigned PY_LONG_LONG start_us = 0;
+    PY_LONG_LONG time_us;
+    unsigned int type, set_mask, clear_mask;
+    Py_ssize_t i, count;
+    int id;
+    static char *kwlist[] = {"ops", "start_us", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|K", kwlist, &ops, &start_us))
+        return NULL;
+    if ((seq = PySequence_Fast(ops, "ops must be a sequence")) == NULL)
+        return NULL;
+    count = PySequence_Fast_GET_SIZE(seq);
+    if (count == 0 || count > TIMED_OPS_MAX) {
+        Py_DECREF(seq);
+        PyErr_Format(PyExc_ValueError, "a schedule has 1..%d operations", TIMED_OPS_MAX);
+        return NULL;
+    }
+    if ((buf = malloc(count * sizeof(*buf))) == NULL) {
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+
+    for (i=0; i<count; i++) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        set_mask = clear_mask = 0;
+        if (!PyTuple_Check(item) || !PyArg_ParseTuple(item, "LI|II", &time_us, &type, &set_mask, &clear_mask)) {
+            PyErr_Clear();
+            PyErr_Format(PyExc_ValueError, "operation %d is not a (time_us, type[, set_mask, clear_mask]) tuple", (int)i);
+            goto fail;
+        }
+        if (time_us < 0 || type < TIMED_WRITE || type > TIMED_READ) {
+            PyErr_Format(PyExc_ValueError, "operation %d has a negative time or an unknown type", (int)i);
+            goto fail;
+        }
+        buf[i].time_us = time_us;
+        buf[i].type = type;
+        buf[i].set_mask = set_mask;
+        buf[i].clear_mask = clear_mask;
+    }
+    Py_DECREF(seq);
+
+    id = timed_submit(buf, count, start_us);
+    free(buf);
+    if (id < 0)
+        return PyErr_SetFromErrno(PyExc_IOError);
+    return Py_BuildValue("i", id);
+
+fail:
+    Py_DECREF(seq);
+    free(buf);
+    return NULL;
+}
+
+// python function fd = timed_fileno()
+static PyObject*
+py_timed_fileno(PyObject *self, PyObject *args)
+{
+    return Py_BuildValue("i", timed_fileno());
+}
+
+// python function [(id, status, start_us, late_us, reads), ...] = timed_collect()
+static PyObject*
+py_timed_collect(PyObject *self, PyObject *args)
+{
+    struct timed_result result;
+    PyObject *list, *late, *reads, *item;
+    uint32_t i;
+
+    if ((list = PyList_New(0)) == NULL)
+        return NULL;
+    while (timed_collect(&result)) {
+        late = PyList_New(result.count);
+        reads = PyList_New(result.read_count);
+        for (i=0; late && i<result.count; i++)
+            PyList_SET_ITEM(late, i, Py_BuildValue("i", result.late_us[i]));
+        for (i=0; reads && i<result.read_count; i++)
+            PyList_SET_ITEM(reads, i, Py_BuildValue("I", result.reads[i]));
+        item = (late && reads) ? Py_BuildValue("(IiKOO)", result.id, result.status, (unsigned PY_LONG_LONG)result.start_us, late, reads) : NULL;
+        Py_XDECREF(late);
+        Py_XDECREF(reads);
+        timed_result_free(&result);
+        if (item == NULL || PyList_Append(list, item) < 0) {
+            Py_XDECREF(item);
+            Py_DECREF(list);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    return list;
+}
+
+// python function (mask_bank0, mask_bank1) = proto_subscriptions()
+static PyObject*
+py_proto_subscriptions(PyObject *self, PyObject *args)
+{
+    uint32_t mask_bank0, mask_bank1;
+
+    proto_subscriptions(&mask_bank0, &mask_bank1);
+    return Py_BuildValue("(II)", mask_bank0, mask_bank1);
+}
+
+// python function proto_set_pwm_handler(address)
+// Address of a proto_pwm_handler (see RPIO.PWM._PWM.proto_pwm_handler()), or 0
+static PyObject*
+py_proto_set_pwm_handler(PyObject *self, PyObject *args)
+{
+    PyObject *address;
+    void *handler;
+
+    if (!PyArg_ParseTuple(args, "O", &address))
+        return NULL;
+    if ((handler = PyLong_AsVoidPtr(address)) == NULL && PyErr_Occurred())
+        return NULL;
+    proto_set_pwm_handler((proto_pwm_handler)handler);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function proto_cleanup()
+static PyObject*
+py_proto_cleanup(PyObject *self, PyObject *args)
+{
+    proto_cleanup();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function path = sysfs_root()
+static PyObject*
+py_sysfs_root(PyObject *self, PyObject *args)
+{
+    return Py_BuildValue("s", events_sysfs_root());
+}
+
+// python function set_sysfs_root(path)
+static PyObject*
+py_set_sysfs_root(PyObject *self, PyObject *args)
+{
+    const char *root;
+
+    if (!PyArg_ParseTuple(args, "s", &root))
+        return NULL;
+
+    if (events_set_sysfs_root(root) < 0) {
+        PyErr_SetString(PyExc_ValueError, "Invalid sysfs root");
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+PyMethodDef rpi_gpio_methods[] = {
+    {"setup", (PyCFunction)py_setup_channel, METH_VARARGS | METH_KEYWORDS, "Set up the GPIO channel, direction and (optional) pull/up down control\nchannel    - Either: RPi board pin number (not BCM GPIO 00..nn number).  Pins start from 1\n                or     : BCM GPIO number\ndirection - INPUT or OUTPUT\n[pull_up_down] - PUD_OFF (default), PUD_UP or PUD_DOWN\n[initial]        - Initial value for an output channel"},
+    {"setup_pins", py_setup_pins, METH_VARARGS, "Set up a list of GPIO channels in one batched sequence\npins - list of (channel, direction[, pull_up_down[, initial]]) tuples"},
+    {"wait_for_edge", (PyCFunction)py_wait_for_edge, METH_VARARGS | METH_KEYWORDS, "Block (with the GIL released) until an edge occurs on a channel\nchannel   - channel number or list of channel numbers\n[edge]    - 'rising', 'falling' or 'both' (default)\n[timeout] - in seconds, None (default) waits forever\n[pull_up_down] - PUD_OFF (default), PUD_UP or PUD_DOWN\nReturns (channel, level, timestamp) of the first edge, or None on timeout"},
+    {"counter_start", (PyCFunction)py_counter_start, METH_VARARGS | METH_KEYWORDS, "Count the edges of a channel in C, without callbacks\nchannel     - channel number\n[edge]      - 'rising' (default), 'falling' or 'both'\n[window_ms] - window of the frequency measurement (default: 1000)\n[pull_up_down] - PUD_OFF (default), PUD_UP or PUD_DOWN"},
+    {"counter_stop", py_counter_stop, METH_VARARGS, "Stop counting the edges of a channel"},
+    {"counter_read", (PyCFunction)py_counter_read, METH_VARARGS | METH_KEYWORDS, "Read the edge counter of a channel\nchannel - channel number\n[reset] - restart counting after reading (no edge is lost)\nReturns (rising, falling, frequency, period): the counted rising and falling edges,\nsignal periods per second over the window and the last period in seconds\n(with edge='both', periods run from rising edge to rising edge)"},
+    {"capture", (PyCFunction)py_capture, METH_VARARGS | METH_KEYWORDS, "Sample the levels of channels at a fixed rate into a buffer (with the GIL released)\nchannels - list of channels\nrate     - samples per second (0: as fast as possible)\nn        - number of samples\nbuffer   - writable buffer (eg. bytearray or numpy array) of n uint32 level words,\n           or with bits=True of one row of (n + 7) // 8 bytes per channel\n[cpu]    - pin the capture to this CPU\nReturns the achieved rate"},
+    {"capture_edges", (PyCFunction)py_capture_edges, METH_VARARGS | METH_KEYWORDS, "Return the sample indices of the edges of a channel in captured level words\n[edge] - 'rising', 'falling' or 'both' (default)"},
+    {"capture_duty", py_capture_duty, METH_VARARGS, "Return the share of captured level words in which a channel is high"},
+    {"capture_frequency", py_capture_frequency, METH_VARARGS, "Return the frequency of a channel in level words captured at `rate`"},
+    {"sysfs_setup", py_sysfs_setup, METH_VARARGS, "Export and configure a list of (gpio, edge) for interrupts in one batch\nReturns a list of (fd, level, exported)"},
+    {"interrupt_backend", py_interrupt_backend, METH_NOARGS, "Return the interrupt backend and gpiochip device as (backend, chip)"},
+    {"set_interrupt_backend", py_set_interrupt_backend, METH_VARARGS, "Select the interrupt backend ('sysfs' or 'gpiochip') and the gpiochip device"},
+    {"events_add", py_events_add, METH_VARARGS, "Add a list of (gpio, edge) to the event engine in one batch"},
+    {"events_remove", py_events_remove, METH_VARARGS, "Remove a gpio from the event engine"},
+    {"events_set_filter", py_events_set_filter, METH_VARARGS, "Set the input filter of a gpio in the event engine\ngpio     - BCM gpio number\nfilter   - 'none', 'stable', 'holdoff' or 'integrator'\nwidth_us - stable time, hold-off time or integration time"},
+    {"events_listen", py_events_listen, METH_VARARGS, "Add a listener to a gpio of the event engine and return its id\ngpio     - BCM gpio number\nedge     - 'rising', 'falling', 'both' or 'none'\n[filter] - 'none' (default), 'stable', 'holdoff' or 'integrator'\n[width_us] - stable time, hold-off time or integration time"},
+    {"events_unlisten", py_events_unlisten, METH_VARARGS, "Remove a listener from the event engine"},
+    {"events_publish", py_events_publish, METH_VARARGS, "Publish the events of a listener to the subscribed protocol connections instead of returning them"},
+    {"events_fileno", py_events_fileno, METH_NOARGS, "Return the pollable fd of the event engine"},
+    {"events_read", py_events_read, METH_VARARGS, "Return the pending events as list of (gpio, level, timestamp_ns, seqno, listener)"},
+    {"events_cleanup", py_events_cleanup, METH_NOARGS, "Remove all gpios from the event engine"},
+    {"proto_open", py_proto_open, METH_VARARGS, "Serve RPIO's binary protocol on a connected, non-blocking stream socket fd"},
+    {"proto_close", py_proto_close, METH_VARARGS, "Stop serving the binary protocol on a socket fd (does not close it)"},
+    {"proto_input", py_proto_input, METH_VARARGS, "Read and execute the pending requests of a protocol connection\nReturns PROTO_WANT_READ, PROTO_WANT_WRITE and PROTO_SUBSCRIBED flags"},
+    {"proto_flush", py_proto_flush, METH_VARARGS, "Send the pending output of a writable protocol connection\nReturns the same flags as proto_input"},
+    {"proto_datagrams", py_proto_datagrams, METH_VARARGS, "Execute the requests of a batch of pending datagrams on a datagram socket fd\nReturns the number of datagrams (0: none pending)"},
+    {"proto_publish", py_proto_publish, METH_VARARGS, "Push an edge (gpio, level[, timestamp_ns[, seqno]]) to the subscribed protocol connections"},
+    {"proto_pending", py_proto_pending, METH_NOARGS, "Return the fds of protocol connections whose published edges wait for the socket to become writable"},
+    {"rt_configure", (PyCFunction)py_rt_configure, METH_VARARGS | METH_KEYWORDS, "Set the real-time profile of RPIO's threads\n[policy]      - 'fifo' (default), 'rr' or 'other'\n[priority]    - 1..99 (default: 50)\n[cpu]         - pin the threads to this CPU (default: -1, any)\n[lock_memory] - lock all current and future memory (default: True)\n[stack_bytes] - stack to pre-fault in each thread"},
+    {"rt_apply", py_rt_apply, METH_NOARGS, "Apply the real-time profile to the calling thread"},
+    {"rt_profile", py_rt_profile, METH_NOARGS, "Return (policy, priority, cpu, lock_memory, stack_bytes) of the real-time profile, or None"},
+    {"rt_update_stats", py_rt_update_stats, METH_NOARGS, "Add the page faults since the last call to the page_faults statistics counter"},
+    {"record_start", py_record_start, METH_VARARGS, "Record the raw edges of the event engine into a new file\npath - file name"},
+    {"record_stop", py_record_stop, METH_NOARGS, "Finish and close the recording"},
+    {"record_event", py_record_event, METH_VARARGS, "Record an edge handled outside of the event engine\ngpio - BCM gpio\nlevel - 0 or 1\n[timestamp_ns] - CLOCK_MONOTONIC timestamp (default: now)"},
+    {"recording_open", py_recording_open, METH_VARARGS, "Map a recording for reading\npath - file name"},
+    {"recording_close", py_recording_close, METH_VARARGS, "Unmap a recording"},
+    {"recording_blocks", py_recording_blocks, METH_VARARGS, "Return the data blocks of a recording as (offset, first timestamp_ns, edge count)"},
+    {"recording_find", py_recording_find, METH_VARARGS, "Return the number of the first edge at or after a timestamp"},
+    {"recording_read", py_recording_read, METH_VARARGS, "Read edges as (gpio, level, timestamp_ns, seqno)\nhandle - of recording_open\nseqno - number of the first edge\nmax_events - most edges to return"},
+    {"replay_start", (PyCFunction)py_replay_start, METH_VARARGS | METH_KEYWORDS, "Replay a recording in a background thread\npath - file name\n[speed] - pace relative to the recording (default: 1.0; 0: as fast as possible)\n[start_ns] - start at the first edge at or after this timestamp\n[inject] - feed the edges into the event engine (default: True)\n[outputs] - drive the recorded levels on the pins (default: False)"},
+    {"replay_stop", py_replay_stop, METH_NOARGS, "Stop the replay"},
+    {"replay_running", py_replay_running, METH_NOARGS, "Return 1 while a replay is running"},
+    {"timed_start", (PyCFunction)py_timed_start, METH_VARARGS | METH_KEYWORDS, "Start the executor thread of timed schedules\n[cpu] - pin it to this CPU (default: -1, as the real-time profile says)"},
+    {"timed_stop", py_timed_stop, METH_NOARGS, "Stop the executor; the running and pending schedules are cancelled"},
+    {"timed_submit", (PyCFunction)py_timed_submit, METH_VARARGS | METH_KEYWORDS, "Queue a schedule of timed operations and return its id\nops - sequence of (time_us, TIMED_WRITE, set_mask, clear_mask), (time_us, TIMED_WAIT) and (time_us, TIMED_READ)\n[start_us] - now_us() time to start at (default: 0, when the executor takes it)"},
+    {"timed_fileno", py_timed_fileno, METH_NOARGS, "Return an fd which is readable while results of schedules are pending (-1 before the executor was started)"},
+    {"timed_collect", py_timed_collect, METH_NOARGS, "Return the finished schedules as a list of (id, status, start_us, late_us, reads)"},
+    {"proto_subscriptions", py_proto_subscriptions, METH_NOARGS, "Return the gpios subscribed by protocol connections as (mask_bank0, mask_bank1)"},
+    {"proto_set_pwm_handler", py_proto_set_pwm_handler, METH_VARARGS, "Set the address of the C function which executes PWM commands of the protocol"},
+    {"proto_cleanup", py_proto_cleanup, METH_NOARGS, "Forget all protocol connections"},
+    {"sysfs_root", py_sysfs_root, METH_NOARGS, "Return the root of the sysfs GPIO interface"},
+    {"set_sysfs_root", py_set_sysfs_root, METH_VARARGS, "Set the root of the sysfs GPIO interface (eg. a fake tree for testing)"},
+    {"cleanup", py_cleanup, METH_VARARGS, "Clean up by resetting all GPIO channels that have been used by this program\nto INPUT with no pullup/pulldown and no event detection"},
+    {"output", py_output_gpio, METH_VARARGS, "Output to a GPIO channel"},
+    {"input", py_input_gpio, METH_VARARGS, "Input from a GPIO channel"},
+    {"setmode", setmode, METH_VARARGS, "Set up numbering mode to use for channels.\nBOARD - Use Raspberry Pi board numbers\nBCM    - Use Broadcom GPIO 00..nn numbers"},
+    {"setwarnings", py_setwarnings, METH_VARARGS, "Enable or disable warning messages"},
+
+    // New methods in RPIO
+    {"forceoutput", py_forceoutput_gpio, METH_VARARGS, "Force output to a GPIO channel, ignoring whether it has been set up before."},
+    {"forceinput", py_forceinput_gpio, METH_VARARGS, "Force read input from a GPIO channel, ignoring whether it was set up before."},
+    {"set_pullupdn", (PyCFunction)py_set_pullupdn, METH_VARARGS | METH_KEYWORDS, "Set pullup or -down resistor on a GPIO channel."},
+    {"gpio_function", py_gpio_function, METH_VARARGS, "Return the current GPIO function (IN, OUT, ALT0)"},
+    {"channel_to_gpio", py_channel_to_gpio, METH_VARARGS, "Return BCM or BOARD id of channel (depending on current setmode)"},
+    {"now_us", py_now_us, METH_NOARGS, "Return the system timer value in microseconds"},
+    {"delay_us", py_delay_us, METH_VARARGS, "Busy-wait for the specified number of microseconds"},
+    {"delay_ns", py_delay_ns, METH_VARARGS, "Busy-wait for the specified number of nanoseconds (calibrated spin loop)"},
+    {"sleep_us", py_sleep_us, METH_VARARGS, "Sleep for the specified number of microseconds, spinning for the last part"},
+    PY_STATS_METHODS,
+    PY_TRACE_METHODS,
+    {NULL, NULL, 0, NULL}
+};
+
+#if PY_MAJOR_VERSION > 2
+static struct PyModuleDef rpigpiomodule = {
+    PyModuleDef_HEAD_INIT,
+    "_GPIO", /* name of module */
+    NULL,         /* module documentation, may be NULL */
+    -1,            /* size of per-interpreter state of the module,
+                        or -1 if the module keeps state in global variables. */
+    rpi_gpio_methods
+};
+#endif
+
+#if PY_MAJOR_VERSION > 2
+PyMODINIT_FUNC PyInit__GPIO(void)
+#else
+PyMODINIT_FUNC init_GPIO(void)
+#endif
+{
+    PyObject *module = NULL;
+
+#if PY_MAJOR_VERSION > 2
+    if ((module = PyModule_Create(&rpigpiomodule)) == NULL)
+        goto exit;
+#else
+    if ((module = Py_InitModule("_GPIO", rpi_gpio_methods)) == NULL)
+        goto exit;
+#endif
+
+    WrongDirectionException = PyErr_NewException("RPIO.Exceptions.WrongDirectionException", NULL, NULL);
+    PyModule_AddObject(module, "WrongDirectionException", WrongDirectionException);
+
+    InvalidModeException = PyErr_NewException("RPIO.Exceptions.InvalidModeException", NULL, NULL);
+    PyModule_AddObject(module, "InvalidModeException", InvalidModeException);
+
+    InvalidDirectionException = PyErr_NewException("RPIO.Exceptions.InvalidDirectionException", NULL, NULL);
+    PyModule_AddObject(module, "InvalidDirectionException", InvalidDirectionException);
+
+    InvalidChannelException = PyErr_NewException("RPIO.Exceptions.InvalidChannelException", NULL, NULL);
+    PyModule_AddObject(module, "InvalidChannelException", InvalidChannelException);
+
+    InvalidPullException = PyErr_NewException("RPIO.Exceptions.InvalidPullException", NULL, NULL);
+    PyModule_AddObject(module, "InvalidPullException", InvalidPullException);
+
+    ModeNotSetException = PyErr_NewException("RPIO.Exceptions.ModeNotSetException", NULL, NULL);
+    PyModule_AddObject(module, "ModeNotSetException", ModeNotSetException);
+
+    high = Py_BuildValue("i", HIGH);
+    PyModule_AddObject(module, "HIGH", high);
+
+    low = Py_BuildValue("i", LOW);
+    PyModule_AddObject(module, "LOW", low);
+
+    output = Py_BuildValue("i", OUTPUT);
+    PyModule_AddObject(module, "OUT", output);
+
+    input = Py_BuildValue("i", INPUT);
+    PyModule_AddObject(module, "IN", input);
+
+    alt0 = Py_BuildValue("i", ALT0);
+    PyModule_AddObject(module, "ALT0", alt0);
+
+    board = Py_BuildValue("i", BOARD);
+    PyModule_AddObject(module, "BOARD", board);
+
+    bcm = Py_BuildValue("i", BCM);
+    PyModule_AddObject(module, "BCM", bcm);
+
+    pud_off = Py_BuildValue("i", PUD_OFF);
+    PyModule_AddObject(module, "PUD_OFF", pud_off);
+
+    pud_up = Py_BuildValue("i", PUD_UP);
+    PyModule_AddObject(module, "PUD_UP", pud_up);
+
+    pud_down = Py_BuildValue("i", PUD_DOWN);
+    PyModule_AddObject(module, "PUD_DOWN", pud_down);
+
+    // detect board revision and set up accordingly
+    cache_rpi_revision();
+    switch (revision_int) {
+    case 1:
+        pin_to_gpio = &pin_to_gpio_rev1;
+        gpio_to_pin = &gpio_to_pin_rev1;
+        break;
+    case 2:
+        pin_to_gpio = &pin_to_gpio_rev2;
+        gpio_to_pin = &gpio_to_pin_rev2;
+        break;
+    case 3:
+        pin_to_gpio = &pin_to_gpio_rev3;
+        gpio_to_pin = &gpio_to_pin_rev3;
+        break;
+    default:
+        PyErr_SetString(PyExc_SystemError, "This module can only be run on a Raspberry Pi!");
+#if PY_MAJOR_VERSION > 2
+        return NULL;
+#else
+        return;
+#endif
+    }
+
+    rpi_revision = Py_BuildValue("i", revision_int);
+    PyModule_AddObject(module, "RPI_REVISION", rpi_revision);
+
+    rpi_revision_hex = Py_BuildValue("s", revision_hex);
+    PyModule_AddObject(module, "RPI_REVISION_HEX", rpi_revision_hex);
+
+    PyModule_AddObject(module, "SIMULATED", Py_BuildValue("i", simulation_enabled()));
+    PyModule_AddObject(module, "PROTO_WANT_READ", Py_BuildValue("i", PROTO_WANT_READ));
+    PyModule_AddObject(module, "PROTO_WANT_WRITE", Py_BuildValue("i", PROTO_WANT_WRITE));
+    PyModule_AddObject(module, "PROTO_SUBSCRIBED", Py_BuildValue("i", PROTO_SUBSCRIBED));
+    PyModule_AddObject(module, "TIMED_WRITE", Py_BuildValue("i", TIMED_WRITE));
+    PyModule_AddObject(module, "TIMED_WAIT", Py_BuildValue("i", TIMED_WAIT));
+    PyModule_AddObject(module, "TIMED_READ", Py_BuildValue("i", TIMED_READ));
+    py_stats_add_constants(module);
+    py_trace_add_constants(module);
+    py_trace_export_state(module);
 
     version = Py_BuildValue("s", "0.10.1/0.4.2a");
     PyModule_AddObject(module, "VERSION_GPIO", version);
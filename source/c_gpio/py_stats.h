@@ -0,0 +1,133 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * py_stats.h contains the Python bindings of stats.c. It is included by both
+ * extension modules (_GPIO and _PWM), each of which has its own copy of the
+ * statistics; RPIO.stats() merges them.
+ */
+#include "Python.h"
+#include "stats.h"
+
+// python function stats() -> {name: {"calls", "total_ns", "max_ns", "histogram"}}
+static PyObject*
+py_stats(PyObject *self, PyObject *args)
+{
+    struct stats_entry entry;
+    PyObject *result, *item, *histogram;
+    int id, i;
+
+    if ((result = PyDict_New()) == NULL)
+        return NULL;
+    for (id=0; id<STATS_COUNT; id++) {
+        stats_get(id, &entry);
+        if ((histogram = PyList_New(STATS_BUCKETS)) == NULL)
+            goto error;
+        for (i=0; i<STATS_BUCKETS; i++)
+            PyList_SET_ITEM(histogram, i, PyLong_FromUnsignedLongLong(entry.buckets[i]));
+        item = Py_BuildValue("{s:K,s:K,s:K,s:N}",
+                "calls", (unsigned long long)entry.calls,
+                "total_ns", (unsigned long long)entry.total_ns,
+                "max_ns", (unsigned long long)entry.max_ns,
+                "histogram", histogram);
+        if (item == NULL)
+            goto error;
+        if (PyDict_SetItemString(result, stats_name(id), item) < 0) {
+            Py_DECREF(item);
+            goto error;
+        }
+        Py_DECREF(item);
+    }
+    return result;
+
+error:
+    Py_DECREF(result);
+    return NULL;
+}
+
+// python function stats_reset()
+static PyObject*
+py_stats_reset(PyObject *self, PyObject *args)
+{
+    stats_reset();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function stats_record(id, t0) (for entry points implemented in Python;
+// t0 is the stats_clock() value at the start of the call)
+static PyObject*
+py_stats_record(PyObject *self, PyObject *args)
+{
+    int id;
+    unsigned long long t0;
+
+    if (!PyArg_ParseTuple(args, "iK", &id, &t0))
+        return NULL;
+
+    STATS_RECORD(id, t0);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function stats_count(id)
+static PyObject*
+py_stats_count(PyObject *self, PyObject *args)
+{
+    int id;
+
+    if (!PyArg_ParseTuple(args, "i", &id))
+        return NULL;
+
+    STATS_INC(id);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function ns = stats_clock() (start time for stats_record)
+static PyObject*
+py_stats_clock(PyObject *self, PyObject *args)
+{
+    return PyLong_FromUnsignedLongLong(STATS_ENABLED ? stats_clock_ns() : 0);
+}
+
+#define PY_STATS_METHODS \
+    {"stats", py_stats, METH_NOARGS, "Return call counts and latency histograms of the instrumented functions"}, \
+    {"stats_reset", py_stats_reset, METH_NOARGS, "Reset all statistics"}, \
+    {"stats_clock", py_stats_clock, METH_NOARGS, "Return the statistics clock in ns (start time for stats_record)"}, \
+    {"stats_record", py_stats_record, METH_VARARGS, "Record a call of entry `id` which started at stats_clock() time `t0`"}, \
+    {"stats_count", py_stats_count, METH_VARARGS, "Increment the counter `id`"}
+
+static void
+py_stats_add_constants(PyObject *module)
+{
+    PyModule_AddObject(module, "STATS_ENABLED", Py_BuildValue("i", STATS_ENABLED));
+    PyModule_AddObject(module, "STAT_HANDLE_INTERRUPT", Py_BuildValue("i", STAT_HANDLE_INTERRUPT));
+    PyModule_AddObject(module, "STAT_TCP_DISPATCH", Py_BuildValue("i", STAT_TCP_DISPATCH));
+    PyModule_AddObject(module, "STAT_EVENTS_DROPPED", Py_BuildValue("i", STAT_EVENTS_DROPPED));
+    PyModule_AddObject(module, "STAT_DEBOUNCE_SUPPRESSED", Py_BuildValue("i", STAT_DEBOUNCE_SUPPRESSED));
+}
@@ -0,0 +1,152 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * py_trace.h contains the Python bindings of trace.c. _GPIO exports its trace
+ * state as a capsule, which _PWM imports with py_trace_share_state(), so both
+ * modules record into the same set of rings.
+ */
+#include "Python.h"
+#include "trace.h"
+
+#define TRACE_CAPSULE "RPIO._GPIO._trace_state"
+
+// python function trace_enable(enabled)
+static PyObject*
+py_trace_enable(PyObject *self, PyObject *args)
+{
+    int enabled;
+
+    if (!PyArg_ParseTuple(args, "i", &enabled))
+        return NULL;
+
+    trace_enable(enabled);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function trace_event(type, arg0[, arg1[, arg2[, arg3]]])
+static PyObject*
+py_trace_event(PyObject *self, PyObject *args)
+{
+    int type, arg0;
+    unsigned int arg1 = 0, arg2 = 0, arg3 = 0;
+
+    if (!PyArg_ParseTuple(args, "ii|III", &type, &arg0, &arg1, &arg2, &arg3))
+        return NULL;
+
+    TRACE(type, arg0, arg1, arg2, arg3);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function trace_clear()
+static PyObject*
+py_trace_clear(PyObject *self, PyObject *args)
+{
+    trace_clear();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function trace_dump(path)
+static PyObject*
+py_trace_dump(PyObject *self, PyObject *args)
+{
+    char *path;
+    int result;
+
+    if (!PyArg_ParseTuple(args, "s", &path))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = trace_dump(path);
+    Py_END_ALLOW_THREADS
+    if (result < 0)
+        return PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function trace_dump_on_signal(signum, path)
+static PyObject*
+py_trace_dump_on_signal(PyObject *self, PyObject *args)
+{
+    char *path;
+    int signum;
+
+    if (!PyArg_ParseTuple(args, "is", &signum, &path))
+        return NULL;
+
+    if (trace_dump_on_signal(signum, path) < 0)
+        return PyErr_SetFromErrno(PyExc_OSError);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+#define PY_TRACE_METHODS \
+    {"trace_enable", py_trace_enable, METH_VARARGS, "Start (1) or stop (0) recording trace events"}, \
+    {"trace_event", py_trace_event, METH_VARARGS, "Record a trace event (type, arg0[, arg1[, arg2[, arg3]]])"}, \
+    {"trace_clear", py_trace_clear, METH_NOARGS, "Drop all recorded trace events"}, \
+    {"trace_dump", py_trace_dump, METH_VARARGS, "Write all recorded trace events into a binary file"}, \
+    {"trace_dump_on_signal", py_trace_dump_on_signal, METH_VARARGS, "Write the trace into a file whenever the signal is received"}
+
+static void
+py_trace_add_constants(PyObject *module)
+{
+    PyModule_AddObject(module, "TRACE_ENABLED", Py_BuildValue("i", TRACE_ENABLED));
+    PyModule_AddObject(module, "TRACE_INTERRUPT", Py_BuildValue("i", TRACE_INTERRUPT));
+    PyModule_AddObject(module, "TRACE_CALLBACK_BEGIN", Py_BuildValue("i", TRACE_CALLBACK_BEGIN));
+    PyModule_AddObject(module, "TRACE_CALLBACK_END", Py_BuildValue("i", TRACE_CALLBACK_END));
+    PyModule_AddObject(module, "TRACE_TCP_BEGIN", Py_BuildValue("i", TRACE_TCP_BEGIN));
+    PyModule_AddObject(module, "TRACE_TCP_END", Py_BuildValue("i", TRACE_TCP_END));
+}
+
+// Exports this module's trace state (in _GPIO)
+static inline void
+py_trace_export_state(PyObject *module)
+{
+#if PY_VERSION_HEX >= 0x02070000
+    PyModule_AddObject(module, "_trace_state", PyCapsule_New(trace_get_state(), TRACE_CAPSULE, NULL));
+#endif
+}
+
+// Uses the trace state of _GPIO, if it can be imported (in _PWM)
+static inline void
+py_trace_share_state(void)
+{
+#if PY_VERSION_HEX >= 0x02070000
+    struct trace_state *state = PyCapsule_Import(TRACE_CAPSULE, 0);
+
+    if (state)
+        trace_set_state(state);
+    else
+        PyErr_Clear();
+#endif
+}
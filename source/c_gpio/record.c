@@ -0,0 +1,778 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * record.c writes recordings (see record.h) block by block: events are
+ * encoded into an in-memory block, which is appended to the file with one
+ * write() when it is full, a second after its first event, and on
+ * record_stop(). Readers map the file and locate the data blocks through the
+ * index blocks, so seeking by time is a binary search over the blocks and a
+ * scan of at most one block.
+ *
+ * The replayer reads a recording in a background thread and emits its
+ * edges at their original pace (scaled by a speed factor): into the event
+ * engine, where they reach filters, listeners and callbacks like real edges,
+ * and/or onto the output pins.
+ *
+ * Functions return 0 on success and -1 with errno set on error.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "c_gpio.h"
+#include "c_events.h"
+#include "record.h"
+#include "rt.h"
+#include "util.h"
+
+// Largest encoded event: a 10-byte timestamp delta and a 1-byte gpio/level
+#define RECORD_EVENT_MAX 11
+
+// A block is written at the latest a second after its first event: by the
+// next event, or else by the flusher thread (so a crashed recorder loses at
+// most that much)
+#define RECORD_BLOCK_NS 1000000000ULL
+
+// Longest sleep of the replayer between checks for replay_stop()
+#define REPLAY_POLL_NS 100000000ULL
+
+// Edges injected into the event engine at once
+#define REPLAY_BATCH 64
+
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+static int record_fd = -1;
+static volatile int recording = 0;
+static int record_errno = 0;          // first write error of the recording
+static uint64_t file_size = 0;
+
+static uint8_t block[RECORD_BLOCK_HEADER + RECORD_BLOCK_EVENTS * RECORD_EVENT_MAX];
+static size_t block_len = 0;          // payload bytes
+static uint32_t block_count = 0;
+static uint64_t block_first_ns = 0;
+static uint64_t block_last_ns = 0;
+static uint64_t block_started_ns = 0;  // CLOCK_MONOTONIC when the block got its first event
+
+static pthread_t flush_thread;
+static pthread_cond_t flush_cond;
+static int flush_started = 0;
+static int flush_stop = 0;
+
+static uint8_t index_block[RECORD_BLOCK_HEADER + RECORD_INDEX_BLOCKS * 16];
+static int index_count = 0;
+static uint64_t last_index = 0;       // offset of the last index block
+
+static pthread_t replay_thread;
+static struct record_reader replay_reader;
+static double replay_speed = 1.0;
+static int replay_flags = 0;
+static pthread_mutex_t replay_lock = PTHREAD_MUTEX_INITIALIZER;  // replay_start/stop
+static int replay_state = 0;          // 0: idle, 1: running, 2: stopping, 3: done
+
+static uint8_t *
+put_varint(uint8_t *p, uint64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = v | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+// Decodes a varint ending before `end`; returns NULL if it is truncated
+static const uint8_t *
+get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+    int shift = 0;
+
+    *v = 0;
+    while (p < end && shift < 64) {
+        *v |= (uint64_t)(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80))
+            return p;
+        shift += 7;
+    }
+    return NULL;
+}
+
+static int
+write_all(const uint8_t *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len) {
+        if ((n = write(record_fd, buf, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void
+put_block_header(uint8_t *p, uint32_t type, uint32_t size, uint32_t count, uint64_t time)
+{
+    p = put_le32(p, type);
+    p = put_le32(p, size);
+    p = put_le32(p, count);
+    p = put_le32(p, 0);
+    put_le64(p, time);
+}
+
+// Appends the pending index entries as an index block
+static int
+write_index(void)
+{
+    put_block_header(index_block, RECORD_INDEX, index_count * 16, index_count, last_index);
+    if (write_all(index_block, RECORD_BLOCK_HEADER + index_count * 16) < 0)
+        return -1;
+    last_index = file_size;
+    file_size += RECORD_BLOCK_HEADER + index_count * 16;
+    index_count = 0;
+    return 0;
+}
+
+// Appends the current data block (and an index block every
+// RECORD_INDEX_BLOCKS blocks)
+static int
+write_block(void)
+{
+    uint8_t *entry;
+
+    if (!block_count)
+        return 0;
+    put_block_header(block, RECORD_DATA, block_len, block_count, block_first_ns);
+    if (write_all(block, RECORD_BLOCK_HEADER + block_len) < 0)
+        return -1;
+
+    entry = index_block + RECORD_BLOCK_HEADER + index_count++ * 16;
+    put_le64(put_le64(entry, file_size), block_first_ns);
+    file_size += RECORD_BLOCK_HEADER + block_len;
+    block_len = block_count = 0;
+    if (index_count == RECORD_INDEX_BLOCKS)
+        return write_index();
+    return 0;
+}
+
+// Flusher thread: writes the data block once it is RECORD_BLOCK_NS old,
+// also if no event follows
+static void *
+flush_run(void *arg)
+{
+    struct timespec ts;
+    uint64_t due;
+
+    pthread_mutex_lock(&record_lock);
+    while (!flush_stop) {
+        due = (block_count ? block_started_ns : monotonic_ns()) + RECORD_BLOCK_NS;
+        ts.tv_sec = due / 1000000000;
+        ts.tv_nsec = due % 1000000000;
+        pthread_cond_timedwait(&flush_cond, &record_lock, &ts);
+        if (recording && block_count && monotonic_ns() - block_started_ns >= RECORD_BLOCK_NS &&
+                write_block() < 0) {
+            record_errno = errno;
+            recording = 0;
+        }
+    }
+    pthread_mutex_unlock(&record_lock);
+    return NULL;
+}
+
+static int
+flush_start(void)
+{
+    pthread_condattr_t attr;
+    sigset_t all, old;
+    int err;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&flush_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    flush_stop = 0;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    err = pthread_create(&flush_thread, NULL, flush_run, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err) {
+        pthread_cond_destroy(&flush_cond);
+        return err;
+    }
+    flush_started = 1;
+    return 0;
+}
+
+// Starts recording all raw edges of the event engine (and those passed to
+// record_events) into a new file at `path`
+int
+record_start(const char *path)
+{
+    uint8_t header[RECORD_FILE_HEADER];
+    int err;
+
+    pthread_mutex_lock(&record_lock);
+    if (record_fd >= 0) {
+        pthread_mutex_unlock(&record_lock);
+        errno = EBUSY;
+        return -1;
+    }
+    if ((record_fd = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_APPEND|O_CLOEXEC, 0644)) < 0) {
+        pthread_mutex_unlock(&record_lock);
+        return -1;
+    }
+    memcpy(header, RECORD_MAGIC, 8);
+    put_le32(put_le32(header + 8, RECORD_VERSION), 0);
+    if (write_all(header, RECORD_FILE_HEADER) < 0) {
+        err = errno;
+        close(record_fd);
+        record_fd = -1;
+        pthread_mutex_unlock(&record_lock);
+        errno = err;
+        return -1;
+    }
+    if ((err = flush_start()) != 0) {
+        close(record_fd);
+        record_fd = -1;
+        pthread_mutex_unlock(&record_lock);
+        errno = err;
+        return -1;
+    }
+    file_size = RECORD_FILE_HEADER;
+    block_len = block_count = 0;
+    index_count = 0;
+    last_index = 0;
+    record_errno = 0;
+    recording = 1;
+    pthread_mutex_unlock(&record_lock);
+    return 0;
+}
+
+// Writes the pending events, the last index block and the trailer, and
+// closes the recording. Returns -1 if any write of the recording failed.
+int
+record_stop(void)
+{
+    uint8_t trailer[16];
+    int err, joined;
+
+    pthread_mutex_lock(&record_lock);
+    if (record_fd < 0) {
+        pthread_mutex_unlock(&record_lock);
+        errno = EINVAL;
+        return -1;
+    }
+    recording = 0;
+
+    // The flusher waits for record_lock: join it without holding that
+    joined = flush_started;
+    flush_started = 0;
+    flush_stop = 1;
+    if (joined)
+        pthread_cond_signal(&flush_cond);
+    pthread_mutex_unlock(&record_lock);
+    if (joined) {
+        pthread_join(flush_thread, NULL);
+        pthread_cond_destroy(&flush_cond);
+    }
+    pthread_mutex_lock(&record_lock);
+    if (record_fd < 0) {
+        // Another record_stop() finished the recording meanwhile
+        pthread_mutex_unlock(&record_lock);
+        errno = EINVAL;
+        return -1;
+    }
+    // The trailer points at the index written last
+    if (!record_errno && (write_block() < 0 || write_index() < 0))
+        record_errno = errno;
+    if (!record_errno) {
+        put_le64(trailer, last_index);
+        memcpy(trailer + 8, RECORD_TRAILER, 8);
+        if (write_all(trailer, 16) < 0)
+            record_errno = errno;
+    }
+    if (close(record_fd) < 0 && !record_errno)
+        record_errno = errno;
+    record_fd = -1;
+    err = record_errno;
+    pthread_mutex_unlock(&record_lock);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int
+record_active(void)
+{
+    return recording;
+}
+
+// Appends events to the recording (if one is active). Their timestamps
+// should not decrease; a write error stops recording (see record_stop).
+void
+record_events(const struct gpio_event *events, int count)
+{
+    uint8_t *p;
+    int64_t delta;
+    int i;
+
+    if (!recording || count <= 0)
+        return;
+    pthread_mutex_lock(&record_lock);
+    for (i=0; i<count && recording; i++) {
+        if (block_count && events[i].timestamp_ns - block_first_ns >= RECORD_BLOCK_NS &&
+                events[i].timestamp_ns > block_first_ns && write_block() < 0)
+            goto error;
+        if (!block_count) {
+            block_first_ns = block_last_ns = events[i].timestamp_ns;
+            block_started_ns = monotonic_ns();
+        }
+
+        delta = (int64_t)(events[i].timestamp_ns - block_last_ns);
+        p = block + RECORD_BLOCK_HEADER + block_len;
+        p = put_varint(p, (uint64_t)(delta << 1) ^ (uint64_t)(delta >> 63));
+        p = put_varint(p, (uint64_t)events[i].gpio << 1 | (events[i].level ? 1 : 0));
+        block_len = p - block - RECORD_BLOCK_HEADER;
+        block_last_ns = events[i].timestamp_ns;
+        if (++block_count == RECORD_BLOCK_EVENTS && write_block() < 0)
+            goto error;
+    }
+    pthread_mutex_unlock(&record_lock);
+    return;
+
+error:
+    record_errno = errno;
+    recording = 0;
+    pthread_mutex_unlock(&record_lock);
+}
+
+// Returns 1 if a valid block header of `type` is at `offset`
+static int
+block_valid(const struct record_reader *r, uint64_t offset, uint32_t type)
+{
+    return offset >= RECORD_FILE_HEADER && offset + RECORD_BLOCK_HEADER <= r->size &&
+            get_le32(r->map + offset) == type &&
+            offset + RECORD_BLOCK_HEADER + get_le32(r->map + offset + 4) <= r->size;
+}
+
+static int
+add_block(struct record_reader *r, uint64_t offset, int *allocated)
+{
+    struct record_block *blocks;
+
+    if (!block_valid(r, offset, RECORD_DATA))
+        return 0;
+    if (r->block_count == *allocated) {
+        *allocated = *allocated ? *allocated * 2 : 256;
+        if ((blocks = realloc(r->blocks, *allocated * sizeof(*blocks))) == NULL)
+            return -1;
+        r->blocks = blocks;
+    }
+    r->blocks[r->block_count].offset = offset;
+    r->blocks[r->block_count].first_ns = get_le64(r->map + offset + 16);
+    r->blocks[r->block_count].count = get_le32(r->map + offset + 8);
+    r->block_count++;
+    return 0;
+}
+
+// Collects the data blocks through the chain of index blocks, which ends at
+// the trailer. Returns 0 if there is no (valid) trailer.
+static int
+read_index(struct record_reader *r, int *allocated)
+{
+    const uint8_t *p;
+    uint64_t offset, previous, entries = 0, blocks = 0;
+    uint32_t i;
+    int k;
+
+    if (r->size < RECORD_FILE_HEADER + 16 ||
+            memcmp(r->map + r->size - 8, RECORD_TRAILER, 8))
+        return 0;
+
+    // The chain runs backwards: count the entries, then fill from the end.
+    // Each link must point further back, so a corrupt chain cannot cycle.
+    for (offset = get_le64(r->map + r->size - 16); offset; offset = previous) {
+        if (!block_valid(r, offset, RECORD_INDEX) || entries > r->size ||
+                ++blocks > r->size / RECORD_BLOCK_HEADER)
+            return 0;
+        entries += get_le32(r->map + offset + 8);
+        if ((previous = get_le64(r->map + offset + 16)) >= offset)
+            return 0;
+    }
+    *allocated = entries;
+    if (entries && (r->blocks = calloc(entries, sizeof(*r->blocks))) == NULL)
+        return -1;
+    r->block_count = entries;
+    k = entries;
+    for (offset = get_le64(r->map + r->size - 16); offset;
+            offset = get_le64(r->map + offset + 16)) {
+        p = r->map + offset + RECORD_BLOCK_HEADER;
+        k -= get_le32(r->map + offset + 8);
+        for (i=0; i<get_le32(r->map + offset + 8); i++) {
+            r->blocks[k + i].offset = get_le64(p + i * 16);
+            if (!block_valid(r, r->blocks[k + i].offset, RECORD_DATA)) {
+                free(r->blocks);
+                r->blocks = NULL;
+                r->block_count = 0;
+                return 0;
+            }
+            r->blocks[k + i].first_ns = get_le64(p + i * 16 + 8);
+            r->blocks[k + i].count = get_le32(r->map + r->blocks[k + i].offset + 8);
+        }
+    }
+    return 1;
+}
+
+// Maps a recording and locates its data blocks
+int
+record_reader_open(struct record_reader *r, const char *path)
+{
+    struct stat st;
+    uint64_t offset, event = 0;
+    int fd, i, err, allocated = 0, found;
+
+    memset(r, 0, sizeof(*r));
+    if ((fd = open(path, O_RDONLY|O_CLOEXEC)) < 0)
+        return -1;
+    if (fstat(fd, &st) < 0) {
+        err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    r->size = st.st_size;
+    if (r->size < RECORD_FILE_HEADER) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    r->map = mmap(NULL, r->size, PROT_READ, MAP_SHARED, fd, 0);
+    err = errno;
+    close(fd);
+    if (r->map == MAP_FAILED) {
+        r->map = NULL;
+        errno = err;
+        return -1;
+    }
+    if (memcmp(r->map, RECORD_MAGIC, 8) || get_le32(r->map + 8) != RECORD_VERSION) {
+        record_reader_close(r);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ((found = read_index(r, &allocated)) < 0)
+        goto error;
+    for (offset = RECORD_FILE_HEADER; !found && offset + RECORD_BLOCK_HEADER <= r->size;
+            offset += RECORD_BLOCK_HEADER + get_le32(r->map + offset + 4)) {
+        if (add_block(r, offset, &allocated) < 0)
+            goto error;
+    }
+    for (i=0; i<r->block_count; i++) {
+        r->blocks[i].first_event = event;
+        event += r->blocks[i].count;
+    }
+    r->event_count = event;
+    r->block = -1;
+    return 0;
+
+error:
+    record_reader_close(r);
+    errno = ENOMEM;
+    return -1;
+}
+
+void
+record_reader_close(struct record_reader *r)
+{
+    if (r->map)
+        munmap((void *)r->map, r->size);
+    free(r->blocks);
+    memset(r, 0, sizeof(*r));
+}
+
+static void
+enter_block(struct record_reader *r, int block)
+{
+    r->block = block;
+    r->pos = r->blocks[block].offset + RECORD_BLOCK_HEADER;
+    r->left = r->blocks[block].count;
+    r->timestamp_ns = r->blocks[block].first_ns;
+    r->event = r->blocks[block].first_event;
+}
+
+// Reads the next event into `event` (its seqno is the number of the event in
+// the recording). Returns 1, or 0 at the end of the recording.
+int
+record_reader_next(struct record_reader *r, struct gpio_event *event)
+{
+    const uint8_t *p, *end;
+    uint64_t delta, value;
+
+    for (;;) {
+        while (!r->left) {
+            if (r->block + 1 >= r->block_count)
+                return 0;
+            enter_block(r, r->block + 1);
+        }
+        end = r->map + r->blocks[r->block].offset + RECORD_BLOCK_HEADER +
+                get_le32(r->map + r->blocks[r->block].offset + 4);
+        if ((p = get_varint(r->map + r->pos, end, &delta)) != NULL &&
+                (p = get_varint(p, end, &value)) != NULL && (value >> 1) < GPIO_COUNT)
+            break;
+        // Corrupt block: skip the rest of it
+        r->left = 0;
+    }
+    r->pos = p - r->map;
+    r->left--;
+    r->timestamp_ns += (delta >> 1) ^ -(delta & 1);
+
+    memset(event, 0, sizeof(*event));
+    event->timestamp_ns = r->timestamp_ns;
+    event->seqno = r->event++;
+    event->gpio = value >> 1;
+    event->level = value & 1;
+    event->edge = event->level ? EDGE_RISING : EDGE_FALLING;
+    event->listener = LISTENER_NONE;
+    return 1;
+}
+
+// Positions the reader at the first event at or after timestamp_ns
+int
+record_reader_seek(struct record_reader *r, uint64_t timestamp_ns)
+{
+    struct record_reader before;
+    struct gpio_event event;
+    int lo = 0, hi = r->block_count - 1, mid;
+
+    if (!r->block_count)
+        return 0;
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (r->blocks[mid].first_ns <= timestamp_ns)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    enter_block(r, lo);
+    for (;;) {
+        before = *r;
+        if (!record_reader_next(r, &event))
+            return 0;
+        if (event.timestamp_ns >= timestamp_ns) {
+            *r = before;
+            return 0;
+        }
+    }
+}
+
+// Positions the reader at the event number `event` (the end of the
+// recording if there are fewer)
+void
+record_reader_goto(struct record_reader *r, uint64_t event)
+{
+    struct gpio_event skipped;
+    int lo = 0, hi = r->block_count - 1, mid;
+
+    if (r->block >= 0 && r->event == event)
+        return;
+    if (!r->block_count || event >= r->event_count) {
+        r->block = r->block_count - 1;
+        r->left = 0;
+        r->event = r->event_count;
+        return;
+    }
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (r->blocks[mid].first_event <= event)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    enter_block(r, lo);
+    while (r->event < event && record_reader_next(r, &skipped))
+        ;
+}
+
+// Time at which the replay emits an event
+static uint64_t
+replay_due(uint64_t start_ns, uint64_t first_ns, const struct gpio_event *event)
+{
+    if (replay_speed <= 0 || event->timestamp_ns <= first_ns)
+        return start_ns;
+    return start_ns + (uint64_t)((event->timestamp_ns - first_ns) / replay_speed);
+}
+
+static void
+replay_inject(struct gpio_event *batch, int count)
+{
+    struct timespec pause = {0, 1000000};
+    int n;
+
+    while (count && __atomic_load_n(&replay_state, __ATOMIC_ACQUIRE) == 1) {
+        if ((n = events_inject(batch, count)) < 0) {
+            // The event engine was cleaned up
+            __atomic_store_n(&replay_state, 3, __ATOMIC_RELEASE);
+            return;
+        }
+        batch += n;
+        count -= n;
+        if (count)
+            nanosleep(&pause, NULL);  // the event engine's queue is full
+    }
+}
+
+static void *
+replay_run(void *arg)
+{
+    struct gpio_event event = {0}, batch[REPLAY_BATCH];
+    struct timespec ts;
+    uint64_t start_ns, first_ns, now, due;
+    int count = 0, more;
+
+    rt_apply();
+    start_ns = monotonic_ns();
+    more = record_reader_next(&replay_reader, &event);
+    first_ns = event.timestamp_ns;
+    while (more && __atomic_load_n(&replay_state, __ATOMIC_ACQUIRE) == 1) {
+        now = monotonic_ns();
+        due = replay_due(start_ns, first_ns, &event);
+        if (due > now) {
+            if (count) {
+                replay_inject(batch, count);
+                count = 0;
+                continue;
+            }
+            due = due - now > REPLAY_POLL_NS ? now + REPLAY_POLL_NS : due;
+            ts.tv_sec = due / 1000000000;
+            ts.tv_nsec = due % 1000000000;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            continue;
+        }
+
+        if (replay_flags & REPLAY_OUTPUT)
+            output_gpio(event.gpio, event.level);
+        if (replay_flags & REPLAY_INJECT) {
+            event.timestamp_ns = now;
+            batch[count++] = event;
+            if (count == REPLAY_BATCH) {
+                replay_inject(batch, count);
+                count = 0;
+            }
+        }
+        more = record_reader_next(&replay_reader, &event);
+    }
+    replay_inject(batch, count);
+    __atomic_store_n(&replay_state, 3, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Stops the replay thread (if any) and waits for it (replay_lock held)
+static void
+replay_join(void)
+{
+    int running = 1;
+
+    if (!__atomic_load_n(&replay_state, __ATOMIC_ACQUIRE))
+        return;
+    __atomic_compare_exchange_n(&replay_state, &running, 2, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    pthread_join(replay_thread, NULL);
+    record_reader_close(&replay_reader);
+    __atomic_store_n(&replay_state, 0, __ATOMIC_RELEASE);
+}
+
+// Replays a recording from its first event at or after start_ns (0: from
+// the beginning) in a background thread, at `speed` times the original
+// pace (0: as fast as possible). `flags` are REPLAY_INJECT and/or
+// REPLAY_OUTPUT.
+int
+replay_start(const char *path, double speed, uint64_t start_ns, int flags)
+{
+    sigset_t all, old;
+    int err, state;
+
+    if (speed < 0 || !(flags & (REPLAY_INJECT | REPLAY_OUTPUT))) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&replay_lock);
+    state = __atomic_load_n(&replay_state, __ATOMIC_ACQUIRE);
+    if (state == 1 || state == 2) {
+        pthread_mutex_unlock(&replay_lock);
+        errno = EBUSY;
+        return -1;
+    }
+    replay_join();
+    if (((flags & REPLAY_INJECT) && events_setup() < 0) ||
+            record_reader_open(&replay_reader, path) < 0) {
+        pthread_mutex_unlock(&replay_lock);
+        return -1;
+    }
+    if (start_ns)
+        record_reader_seek(&replay_reader, start_ns);
+    replay_speed = speed;
+    replay_flags = flags;
+    __atomic_store_n(&replay_state, 1, __ATOMIC_RELEASE);
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    err = pthread_create(&replay_thread, NULL, replay_run, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err) {
+        __atomic_store_n(&replay_state, 0, __ATOMIC_RELEASE);
+        record_reader_close(&replay_reader);
+        pthread_mutex_unlock(&replay_lock);
+        errno = err;
+        return -1;
+    }
+    pthread_mutex_unlock(&replay_lock);
+    return 0;
+}
+
+// Stops the replay (if any) and waits for its thread
+int
+replay_stop(void)
+{
+    pthread_mutex_lock(&replay_lock);
+    replay_join();
+    pthread_mutex_unlock(&replay_lock);
+    return 0;
+}
+
+// Returns 1 while a replay is running
+int
+replay_running(void)
+{
+    return __atomic_load_n(&replay_state, __ATOMIC_ACQUIRE) == 1;
+}
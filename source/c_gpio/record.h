@@ -0,0 +1,109 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * record.c records GPIO event streams to compact, append-only files, reads
+ * them back memory-mapped with seek by time, and replays them in real time.
+ * All integers are little-endian.
+ *
+ * A recording starts with a 16-byte file header (RECORD_MAGIC, u32 version,
+ * u32 reserved) followed by blocks. Every block has a 24-byte header: u32
+ * type, u32 size (of the payload), u32 count, u32 reserved and a u64 time.
+ *
+ *   RECORD_DATA   up to RECORD_BLOCK_EVENTS events; the time is the timestamp
+ *                 of the first one. Each event is a varint of the zigzag
+ *                 delta of its timestamp_ns to the previous event (the first
+ *                 to the block time) and a varint of gpio << 1 | level.
+ *   RECORD_INDEX  the (u64 offset, u64 first timestamp_ns) of the data blocks
+ *                 written since the previous index block, every
+ *                 RECORD_INDEX_BLOCKS data blocks and when the recording is
+ *                 closed; the time is the offset of the previous index block
+ *                 (0 if none).
+ *
+ * A closed recording ends with a trailer: u64 offset of the last index block
+ * and RECORD_TRAILER. Readers of a recording without trailer (eg. of a
+ * crashed recorder) walk the blocks instead.
+ */
+#ifndef RPIO_RECORD_H
+#define RPIO_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct gpio_event;
+
+#define RECORD_MAGIC "RPIOREC1"
+#define RECORD_TRAILER "RPIOEND"  // 8 bytes with the terminating zero
+#define RECORD_VERSION 1
+
+#define RECORD_DATA  1
+#define RECORD_INDEX 2
+
+#define RECORD_FILE_HEADER 16
+#define RECORD_BLOCK_HEADER 24
+#define RECORD_BLOCK_EVENTS 1024
+#define RECORD_INDEX_BLOCKS 64
+
+// replay_start() flags
+#define REPLAY_INJECT 1  // feed the edges into the event engine (events_inject)
+#define REPLAY_OUTPUT 2  // drive the recorded levels with output_gpio
+
+// A data block of a recording
+struct record_block {
+    uint64_t offset;
+    uint64_t first_ns;
+    uint64_t first_event;  // number of the block's first event
+    uint32_t count;
+};
+
+// Memory-mapped recording (see record_reader_open)
+struct record_reader {
+    const uint8_t *map;
+    size_t size;
+    struct record_block *blocks;
+    int block_count;
+    uint64_t event_count;
+    int block;             // current block
+    size_t pos;            // offset of the next event in the file
+    uint32_t left;         // events left in the current block
+    uint64_t timestamp_ns; // of the last event read
+    uint64_t event;        // number of the next event
+};
+
+int record_start(const char *path);
+int record_stop(void);
+int record_active(void);
+void record_events(const struct gpio_event *events, int count);
+
+int record_reader_open(struct record_reader *reader, const char *path);
+void record_reader_close(struct record_reader *reader);
+int record_reader_seek(struct record_reader *reader, uint64_t timestamp_ns);
+int record_reader_next(struct record_reader *reader, struct gpio_event *event);
+void record_reader_goto(struct record_reader *reader, uint64_t event);
+
+int replay_start(const char *path, double speed, uint64_t start_ns, int flags);
+int replay_stop(void);
+int replay_running(void);
+
+#endif
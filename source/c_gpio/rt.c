@@ -0,0 +1,169 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * rt.c applies the real-time profile of rt.h. Errors of rt_apply() (eg.
+ * EPERM without CAP_SYS_NICE) are counted as `rt_errors`, threads which run
+ * with the profile as `rt_threads`; rt_update_stats() adds the page faults of
+ * the process since the last update to `page_faults`, which stays at 0 once
+ * the memory is locked and the stacks are pre-faulted.
+ */
+#define _GNU_SOURCE
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "stats.h"
+#include "rt.h"
+
+static pthread_mutex_t rt_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rt_profile rt_profile = {SCHED_OTHER, 0, -1, 0, 0};
+static int configured = 0;
+#if STATS_ENABLED
+static uint64_t faults_seen = 0;
+#endif
+
+// Sets the profile of RPIO's threads, and locks the memory if requested.
+// Threads started afterwards apply it; a profile with SCHED_OTHER, no CPU
+// and no memory locking resets it (memory stays locked).
+int
+rt_configure(const struct rt_profile *profile)
+{
+    int min, max;
+
+    if (profile->policy != SCHED_OTHER) {
+        min = sched_get_priority_min(profile->policy);
+        max = sched_get_priority_max(profile->policy);
+        if (min < 0 || profile->priority < min || profile->priority > max) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    if (profile->cpu >= CPU_SETSIZE ||
+            (profile->cpu >= 0 && profile->cpu >= sysconf(_SC_NPROCESSORS_CONF))) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (profile->lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        return -1;
+
+    pthread_mutex_lock(&rt_lock);
+    rt_profile = *profile;
+    configured = profile->policy != SCHED_OTHER || profile->cpu >= 0 ||
+            profile->lock_memory;
+    pthread_mutex_unlock(&rt_lock);
+    return 0;
+}
+
+// Copies the profile; returns 1 if one is configured, else 0
+int
+rt_get_profile(struct rt_profile *profile)
+{
+    int ret;
+
+    pthread_mutex_lock(&rt_lock);
+    *profile = rt_profile;
+    ret = configured;
+    pthread_mutex_unlock(&rt_lock);
+    return ret;
+}
+
+// Touches the pages of `buf` (for writing), so the kernel maps them now
+// instead of on the first access
+void
+rt_prefault(void *buf, size_t len)
+{
+    volatile uint8_t *p = buf;
+    size_t page = sysconf(_SC_PAGESIZE), i;
+
+    for (i=0; i<len; i+=page)
+        p[i] = p[i];
+    if (len)
+        p[len - 1] = p[len - 1];
+}
+
+static void __attribute__((noinline))
+prefault_stack(size_t len)
+{
+    uint8_t stack[len];
+
+    memset(stack, 0, len);
+    __asm__ __volatile__("" : : "r"(stack) : "memory");
+}
+
+// Applies the profile to the calling thread. Returns 0 (also if no profile
+// is configured), or -1 if a part of it failed (the others are applied).
+int
+rt_apply(void)
+{
+    struct rt_profile profile;
+    struct sched_param param;
+    cpu_set_t set;
+    int ret, err = 0;
+
+    if (!rt_get_profile(&profile))
+        return 0;
+    if (profile.cpu >= 0) {
+        CPU_ZERO(&set);
+        CPU_SET(profile.cpu, &set);
+        err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    if (profile.policy != SCHED_OTHER) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = profile.priority;
+        if ((ret = pthread_setschedparam(pthread_self(), profile.policy, &param)) && !err)
+            err = ret;
+    }
+    if (profile.stack_bytes)
+        prefault_stack(profile.stack_bytes);
+
+    if (err) {
+        STATS_INC(STAT_RT_ERRORS);
+        errno = err;
+        return -1;
+    }
+    STATS_INC(STAT_RT_THREADS);
+    return 0;
+}
+
+// Adds the page faults (minor and major) of the process since the last call
+// to the `page_faults` counter
+void
+rt_update_stats(void)
+{
+#if STATS_ENABLED
+    struct rusage usage;
+    uint64_t faults, seen;
+
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+        return;
+    faults = usage.ru_minflt + usage.ru_majflt;
+    seen = __atomic_exchange_n(&faults_seen, faults, __ATOMIC_RELAXED);
+    if (seen && faults > seen)
+        stats_add(STAT_PAGE_FAULTS, faults - seen);
+#endif
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * rt.c keeps the real-time profile of RPIO's threads: scheduling policy and
+ * priority, CPU affinity, memory locking and the amount of stack to
+ * pre-fault. rt_configure() sets it for the process (and locks the memory
+ * at once); threads owned by RPIO call rt_apply() when they start.
+ */
+#ifndef RPIO_RT_H
+#define RPIO_RT_H
+
+#include <stddef.h>
+
+struct rt_profile {
+    int policy;          // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+    int priority;        // 1..99 with SCHED_FIFO and SCHED_RR
+    int cpu;             // CPU to pin the threads to, -1: any
+    int lock_memory;     // mlockall() current and future mappings
+    size_t stack_bytes;  // stack pre-faulted by rt_apply()
+};
+
+// Default stack pre-faulted by rt_apply()
+#define RT_STACK_BYTES (64 * 1024)
+
+int rt_configure(const struct rt_profile *profile);
+int rt_get_profile(struct rt_profile *profile);
+int rt_apply(void);
+void rt_prefault(void *buf, size_t len);
+void rt_update_stats(void);
+
+#endif
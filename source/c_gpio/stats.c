@@ -0,0 +1,132 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ */
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+static const char *stat_names[STATS_COUNT] = {
+    "py_output_gpio",
+    "py_input_gpio",
+    "py_setup_channel",
+    "init_channel",
+    "add_channel_pulse",
+    "clear_channel",
+    "clear_channel_gpio",
+    "handle_interrupt",
+    "tcp_dispatch",
+    "events_dropped",
+    "debounce_suppressed",
+    "rt_threads",
+    "rt_errors",
+    "page_faults",
+    "timed_lateness",
+    "led_encode",
+    "shift_encode",
+    "stepper_compile",
+    "stepper_underruns",
+};
+
+static struct stats_entry entries[STATS_COUNT];
+
+uint64_t
+stats_clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int
+bucket(uint64_t ns)
+{
+    int i = ns ? 63 - __builtin_clzll(ns) : 0;
+    return i < STATS_BUCKETS ? i : STATS_BUCKETS - 1;
+}
+
+// Adds one call which took `ns` nanoseconds
+void
+stats_record(int id, uint64_t ns)
+{
+    struct stats_entry *e;
+    uint64_t max;
+
+    if (id < 0 || id >= STATS_COUNT)
+        return;
+    e = &entries[id];
+    __atomic_fetch_add(&e->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&e->total_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&e->buckets[bucket(ns)], 1, __ATOMIC_RELAXED);
+    max = __atomic_load_n(&e->max_ns, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&e->max_ns, &max, ns, 1,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+// Increments a counter (no timing)
+void
+stats_count(int id)
+{
+    if (id >= 0 && id < STATS_COUNT)
+        __atomic_fetch_add(&entries[id].calls, 1, __ATOMIC_RELAXED);
+}
+
+// Adds `count` to a counter
+void
+stats_add(int id, uint64_t count)
+{
+    if (id >= 0 && id < STATS_COUNT)
+        __atomic_fetch_add(&entries[id].calls, count, __ATOMIC_RELAXED);
+}
+
+// Copies one entry. Returns 0, or -1 for an invalid id.
+int
+stats_get(int id, struct stats_entry *entry)
+{
+    int i;
+
+    if (id < 0 || id >= STATS_COUNT)
+        return -1;
+    entry->calls = __atomic_load_n(&entries[id].calls, __ATOMIC_RELAXED);
+    entry->total_ns = __atomic_load_n(&entries[id].total_ns, __ATOMIC_RELAXED);
+    entry->max_ns = __atomic_load_n(&entries[id].max_ns, __ATOMIC_RELAXED);
+    for (i=0; i<STATS_BUCKETS; i++)
+        entry->buckets[i] = __atomic_load_n(&entries[id].buckets[i], __ATOMIC_RELAXED);
+    return 0;
+}
+
+const char *
+stats_name(int id)
+{
+    if (id < 0 || id >= STATS_COUNT)
+        return NULL;
+    return stat_names[id];
+}
+
+void
+stats_reset(void)
+{
+    memset(entries, 0, sizeof(entries));
+}
@@ -0,0 +1,94 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * stats.c keeps per-function call counters and latency histograms for the
+ * GPIO, PWM and interrupt entry points, plus plain event counters. Updates
+ * are lock-free (atomic adds), so the statistics are always on. Compile with
+ * -DRPIO_NO_STATS to remove them completely.
+ *
+ * Histogram bucket i counts calls which took [2^i, 2^(i+1)) ns (bucket 0
+ * also counts 0ns, the last bucket everything above).
+ */
+#ifndef RPIO_STATS_H
+#define RPIO_STATS_H
+
+#include <stdint.h>
+
+// Entry points and counters. Keep in sync with stat_names in stats.c.
+enum stats_id {
+    STAT_PY_OUTPUT_GPIO,
+    STAT_PY_INPUT_GPIO,
+    STAT_PY_SETUP_CHANNEL,
+    STAT_INIT_CHANNEL,
+    STAT_ADD_CHANNEL_PULSE,
+    STAT_CLEAR_CHANNEL,
+    STAT_CLEAR_CHANNEL_GPIO,
+    STAT_HANDLE_INTERRUPT,
+    STAT_TCP_DISPATCH,
+    STAT_EVENTS_DROPPED,         // counter only
+    STAT_DEBOUNCE_SUPPRESSED,    // counter only
+    STAT_RT_THREADS,             // counter only (see rt.c)
+    STAT_RT_ERRORS,              // counter only
+    STAT_PAGE_FAULTS,            // counter only
+    STAT_TIMED_LATENESS,         // lateness of timed operations (see timed.c)
+    STAT_LED_ENCODE,             // frame encoding of LED strips (see led.c)
+    STAT_SHIFT_ENCODE,           // frame encoding of shift outputs (see shift.c)
+    STAT_STEPPER_COMPILE,        // compilation of a stepper segment (see stepper.c)
+    STAT_STEPPER_UNDERRUNS,      // counter only
+    STATS_COUNT
+};
+
+#define STATS_BUCKETS 32
+
+struct stats_entry {
+    uint64_t calls;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[STATS_BUCKETS];
+};
+
+uint64_t stats_clock_ns(void);
+void stats_record(int id, uint64_t ns);
+void stats_count(int id);
+void stats_add(int id, uint64_t count);
+int stats_get(int id, struct stats_entry *entry);
+const char *stats_name(int id);
+void stats_reset(void);
+
+// STATS_TIMER(t0) declares and starts a timer (use it with the declarations),
+// STATS_RECORD(id, t0) adds the elapsed time to the entry `id`.
+#ifndef RPIO_NO_STATS
+#define STATS_ENABLED 1
+#define STATS_TIMER(t) uint64_t t = stats_clock_ns()
+#define STATS_RECORD(id, t) stats_record(id, stats_clock_ns() - (t))
+#define STATS_INC(id) stats_count(id)
+#else
+#define STATS_ENABLED 0
+#define STATS_TIMER(t) uint64_t t __attribute__((unused)) = 0
+#define STATS_RECORD(id, t) do {} while (0)
+#define STATS_INC(id) do {} while (0)
+#endif
+
+#endif
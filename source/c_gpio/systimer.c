@@ -0,0 +1,219 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * systimer.c provides a microsecond clock and calibrated delays based on the
+ * BCM2835 free running system timer (ST_CLO/ST_CHI at 0x20003004).
+ *
+ * Reading the timer is a plain memory access (no syscall). If the timer cannot
+ * be mapped (no access to /dev/mem), CLOCK_MONOTONIC is used instead, which is
+ * served by the vDSO on current kernels.
+ *
+ * If the environment variable RPIO_SIMULATE is set, the clock is virtual: it
+ * starts at 0 and only advances when one of the delay functions is called (or
+ * via systimer_advance_us()), without ever sleeping or spinning.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "systimer.h"
+
+#define ST_BASE     0x20003000
+#define ST_LEN      0x1c
+#define ST_CLO      1  // 0x0004 / 4
+#define ST_CHI      2  // 0x0008 / 4
+
+// Loops used for calibrating the ns spin delay
+#define CALIBRATION_LOOPS 1000000
+
+static volatile uint32_t *st_map;
+static int simulated = -1;
+static uint64_t sim_clock_ns = 0;  // virtual clock, advanced from any thread
+
+// Number of spin loop iterations per microsecond (calibrated in systimer_setup)
+static uint32_t loops_per_us = 1000;
+
+// Returns 1 if RPIO should run against simulated registers and a virtual
+// clock instead of the real hardware (set with RPIO_SIMULATE=1)
+int
+simulation_enabled(void)
+{
+    char *env;
+
+    if (simulated == -1) {
+        env = getenv("RPIO_SIMULATE");
+        simulated = (env && *env && strcmp(env, "0")) ? 1 : 0;
+    }
+    return simulated;
+}
+
+static void
+spin(uint32_t loops)
+{
+    while (loops--)
+        asm volatile("nop");
+}
+
+static uint64_t
+monotonic_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Measures how many spin loops fit into one microsecond
+static void
+calibrate(void)
+{
+    struct timespec t0, t1;
+    uint64_t elapsed_ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    spin(CALIBRATION_LOOPS);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    elapsed_ns = (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000 + t1.tv_nsec - t0.tv_nsec;
+    if (elapsed_ns > 0)
+        loops_per_us = (uint64_t)CALIBRATION_LOOPS * 1000 / elapsed_ns;
+    if (loops_per_us == 0)
+        loops_per_us = 1;
+}
+
+// Maps the system timer and calibrates the spin delay. Returns SYSTIMER_OK, or
+// SYSTIMER_FALLBACK if the timer could not be mapped and CLOCK_MONOTONIC is
+// used instead.
+int
+systimer_setup(void)
+{
+    int mem_fd;
+    void *map;
+
+    if (simulation_enabled())
+        return SYSTIMER_OK;
+
+    if (st_map == NULL) {
+        if ((mem_fd = open("/dev/mem", O_RDONLY|O_SYNC)) >= 0) {
+            // ST_BASE is page aligned
+            map = mmap(NULL, ST_LEN, PROT_READ, MAP_SHARED, mem_fd, ST_BASE);
+            if (map != MAP_FAILED)
+                st_map = (volatile uint32_t *)map;
+            close(mem_fd);
+        }
+        calibrate();
+    }
+    return st_map ? SYSTIMER_OK : SYSTIMER_FALLBACK;
+}
+
+void
+systimer_cleanup(void)
+{
+    if (st_map)
+        munmap((void *)st_map, ST_LEN);
+    st_map = NULL;
+}
+
+// Returns the current time in microseconds. The system timer is 64 bit wide;
+// if CLO wraps between the two reads of CHI, CLO is read again.
+uint64_t
+now_us(void)
+{
+    uint32_t hi, lo;
+
+    if (simulated == 1)
+        return __atomic_load_n(&sim_clock_ns, __ATOMIC_RELAXED) / 1000;
+    if (st_map == NULL)
+        return monotonic_us();
+
+    hi = st_map[ST_CHI];
+    lo = st_map[ST_CLO];
+    if (st_map[ST_CHI] != hi) {
+        hi = st_map[ST_CHI];
+        lo = st_map[ST_CLO];
+    }
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Advances the virtual clock (simulation only)
+void
+systimer_advance_us(uint32_t us)
+{
+    __atomic_add_fetch(&sim_clock_ns, (uint64_t)us * 1000, __ATOMIC_RELAXED);
+}
+
+// Busy-waits for at least `ns` nanoseconds using the calibrated spin loop.
+// Meant for sub-microsecond delays, where the 1MHz system timer is too coarse.
+void
+delay_ns(uint32_t ns)
+{
+    if (simulated == 1) {
+        __atomic_add_fetch(&sim_clock_ns, ns, __ATOMIC_RELAXED);
+        return;
+    }
+    spin(((uint64_t)ns * loops_per_us + 999) / 1000);
+}
+
+// Busy-waits for at least `us` microseconds, polling the system timer
+void
+delay_us(uint32_t us)
+{
+    uint64_t start;
+
+    if (simulated == 1) {
+        __atomic_add_fetch(&sim_clock_ns, (uint64_t)us * 1000, __ATOMIC_RELAXED);
+        return;
+    }
+    start = now_us();
+    while (now_us() - start <= us)
+        ;
+}
+
+// Sleeps for `us` microseconds: the bulk of the delay is handed to the kernel,
+// the last SLEEP_SPIN_THRESHOLD_US are spent busy-waiting on the system timer
+// to compensate for the scheduler wake-up latency.
+void
+sleep_us(uint32_t us)
+{
+    uint64_t start, end;
+    struct timespec ts;
+
+    if (simulated == 1) {
+        __atomic_add_fetch(&sim_clock_ns, (uint64_t)us * 1000, __ATOMIC_RELAXED);
+        return;
+    }
+    start = now_us();
+    end = start + us;
+    if (us > SLEEP_SPIN_THRESHOLD_US) {
+        us -= SLEEP_SPIN_THRESHOLD_US;
+        ts.tv_sec = us / 1000000;
+        ts.tv_nsec = (us % 1000000) * 1000;
+        nanosleep(&ts, NULL);
+    }
+    while (now_us() < end)
+        ;
+}
@@ -0,0 +1,41 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ */
+#include <stdint.h>
+
+int systimer_setup(void);
+void systimer_cleanup(void);
+int simulation_enabled(void);
+
+uint64_t now_us(void);
+void delay_us(uint32_t us);
+void delay_ns(uint32_t ns);
+void sleep_us(uint32_t us);
+void systimer_advance_us(uint32_t us);
+
+#define SYSTIMER_OK        0
+#define SYSTIMER_FALLBACK  1
+
+// sleep_us() hands delays longer than this to the kernel and spins the rest
+#define SLEEP_SPIN_THRESHOLD_US 100
@@ -0,0 +1,390 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * timed.c runs the executor of timed.h. Submitted schedules are copied into
+ * a FIFO queue; the executor thread takes one at a time and waits for the
+ * time of each operation on the system timer: it sleeps in the kernel until
+ * TIMED_SPIN_US before the deadline and spins for the rest, so wake-up
+ * latency is not added to the operation. The thread applies the real-time
+ * profile (rt.c) and can be pinned to one CPU.
+ *
+ * Finished schedules are queued as results and signalled through an
+ * eventfd, which a poll loop can watch. Lateness is recorded in the
+ * `timed_lateness` statistics as well.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include "c_gpio.h"
+#include "systimer.h"
+#include "stats.h"
+#include "rt.h"
+#include "timed.h"
+
+// The executor spins on the system timer for the last TIMED_SPIN_US before
+// a deadline, and sleeps at most TIMED_SLEEP_MAX_US at once (to notice
+// timed_stop)
+#define TIMED_SPIN_US      200
+#define TIMED_SLEEP_MAX_US 100000
+
+struct schedule {
+    struct schedule *next;
+    struct timed_op *ops;
+    uint32_t count;
+    uint64_t start_us;
+    struct timed_result result;
+};
+
+// control_lock serializes starting and stopping the executor (it is held
+// while joining it), timed_lock guards the queues
+static pthread_mutex_t control_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t timed_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timed_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t thread;
+static int running = 0;
+static volatile int stopping = 0;
+static int done_fd = -1;
+static uint32_t next_id = 1;
+
+// Pending schedules and results, both FIFO
+static struct schedule *pending = NULL, **pending_tail = &pending;
+static struct schedule *done = NULL, **done_tail = &done;
+
+static void
+free_schedule(struct schedule *s)
+{
+    free(s->ops);
+    timed_result_free(&s->result);
+    free(s);
+}
+
+// Moves a finished schedule to the results and signals them
+static void
+finish(struct schedule *s, int status)
+{
+    uint64_t one = 1;
+
+    free(s->ops);
+    s->ops = NULL;
+    s->result.status = status;
+    pthread_mutex_lock(&timed_lock);
+    s->next = NULL;
+    *done_tail = s;
+    done_tail = &s->next;
+    if (done_fd >= 0 && write(done_fd, &one, sizeof(one)) < 0)
+        ;  // the counter can't overflow in practice
+    pthread_mutex_unlock(&timed_lock);
+}
+
+// Waits until now_us() >= deadline. Returns the time of the wake-up, or 0
+// if stopping.
+static uint64_t
+wait_until(uint64_t deadline)
+{
+    struct timespec ts;
+    uint64_t now, left;
+
+    for (;;) {
+        now = now_us();
+        if (now >= deadline)
+            return now;
+        if (stopping)
+            return 0;
+        left = deadline - now;
+        if (simulation_enabled()) {
+            systimer_advance_us(left);
+        } else if (left > TIMED_SPIN_US) {
+            left -= TIMED_SPIN_US;
+            if (left > TIMED_SLEEP_MAX_US)
+                left = TIMED_SLEEP_MAX_US;
+            ts.tv_sec = left / 1000000;
+            ts.tv_nsec = (left % 1000000) * 1000;
+            nanosleep(&ts, NULL);
+        } else {
+            while (now_us() < deadline)
+                ;
+        }
+    }
+}
+
+static void
+execute(struct schedule *s)
+{
+    struct timed_result *r = &s->result;
+    struct timed_op *op;
+    uint64_t start, due, now;
+    int64_t late;
+    uint32_t i;
+    STATS_TIMER(t0);
+
+    start = s->start_us ? s->start_us : now_us();
+    r->start_us = start;
+    for (i=0; i<s->count; i++) {
+        op = &s->ops[i];
+        due = start + op->time_us;
+        if ((now = wait_until(due)) == 0) {
+            finish(s, ECANCELED);
+            return;
+        }
+        switch (op->type) {
+        case TIMED_WRITE:
+            output_gpio_mask(0, op->set_mask, op->clear_mask);
+            break;
+        case TIMED_READ:
+            r->reads[r->read_count++] = input_gpio_bank(0);
+            break;
+        }
+        late = now - due;
+        r->late_us[r->count++] = late > INT32_MAX ? INT32_MAX : late;
+
+        // A timer started at the deadline measures the lateness
+        t0 = stats_clock_ns() - (uint64_t)late * 1000;
+        STATS_RECORD(STAT_TIMED_LATENESS, t0);
+    }
+    finish(s, 0);
+}
+
+static void *
+timed_thread(void *arg)
+{
+    struct schedule *s;
+    int cpu = (intptr_t)arg;
+    cpu_set_t set;
+
+    rt_apply();
+    if (cpu >= 0) {
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    for (;;) {
+        pthread_mutex_lock(&timed_lock);
+        while (!pending && !stopping)
+            pthread_cond_wait(&timed_cond, &timed_lock);
+        if (stopping) {
+            pthread_mutex_unlock(&timed_lock);
+            return NULL;
+        }
+        s = pending;
+        if ((pending = s->next) == NULL)
+            pending_tail = &pending;
+        pthread_mutex_unlock(&timed_lock);
+        execute(s);
+    }
+}
+
+// timed_start() with control_lock held
+static int
+start_locked(int cpu)
+{
+    sigset_t all, old;
+    uint64_t one = 1;
+    int err;
+
+    if (running)
+        return 0;
+    if (cpu >= CPU_SETSIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&timed_lock);
+    if (done_fd < 0) {
+        done_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        // Results of schedules stopped earlier may still be pending
+        if (done_fd >= 0 && done && write(done_fd, &one, sizeof(one)) < 0)
+            ;  // a fresh counter can't overflow
+    }
+    err = done_fd < 0 ? errno : 0;
+    pthread_mutex_unlock(&timed_lock);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    stopping = 0;
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    err = pthread_create(&thread, NULL, timed_thread, (void *)(intptr_t)cpu);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    running = 1;
+    return 0;
+}
+
+// Starts the executor thread, pinned to `cpu` (-1: as the real-time profile
+// says). Does nothing if it is running.
+int
+timed_start(int cpu)
+{
+    int ret;
+
+    pthread_mutex_lock(&control_lock);
+    ret = start_locked(cpu);
+    pthread_mutex_unlock(&control_lock);
+    return ret;
+}
+
+// Stops the executor. The current and all pending schedules are finished
+// with status ECANCELED; their results stay collectable, but the fd of
+// timed_fileno() is closed (the next start opens a new one).
+int
+timed_stop(void)
+{
+    struct schedule *s;
+
+    pthread_mutex_lock(&control_lock);
+    if (!running) {
+        pthread_mutex_unlock(&control_lock);
+        return 0;
+    }
+    pthread_mutex_lock(&timed_lock);
+    stopping = 1;
+    pthread_cond_signal(&timed_cond);
+    pthread_mutex_unlock(&timed_lock);
+    pthread_join(thread, NULL);
+    running = 0;
+
+    while ((s = pending) != NULL) {
+        pending = s->next;
+        finish(s, ECANCELED);
+    }
+    pending_tail = &pending;
+
+    pthread_mutex_lock(&timed_lock);
+    close(done_fd);
+    done_fd = -1;
+    pthread_mutex_unlock(&timed_lock);
+    pthread_mutex_unlock(&control_lock);
+    return 0;
+}
+
+// Queues a schedule, starting at the now_us() time start_us (0: when the
+// executor takes it). Returns its id (> 0), which its result carries.
+int
+timed_submit(const struct timed_op *ops, uint32_t count, uint64_t start_us)
+{
+    struct schedule *s;
+    uint32_t i, reads = 0;
+
+    if (count == 0 || count > TIMED_OPS_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i=0; i<count; i++) {
+        if (ops[i].type < TIMED_WRITE || ops[i].type > TIMED_READ) {
+            errno = EINVAL;
+            return -1;
+        }
+        reads += ops[i].type == TIMED_READ;
+    }
+
+    if ((s = calloc(1, sizeof(*s))) == NULL ||
+            (s->ops = malloc(count * sizeof(*ops))) == NULL ||
+            (s->result.late_us = malloc(count * sizeof(int32_t))) == NULL ||
+            (s->result.reads = malloc((reads ? reads : 1) * sizeof(uint32_t))) == NULL) {
+        if (s)
+            free_schedule(s);
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(s->ops, ops, count * sizeof(*ops));
+    s->count = count;
+    s->start_us = start_us;
+
+    // The executor can't be stopped between starting it and queueing
+    pthread_mutex_lock(&control_lock);
+    if (start_locked(-1) < 0) {
+        pthread_mutex_unlock(&control_lock);
+        free_schedule(s);
+        return -1;
+    }
+    pthread_mutex_lock(&timed_lock);
+    s->result.id = next_id++;
+    if (!next_id)
+        next_id = 1;
+    *pending_tail = s;
+    pending_tail = &s->next;
+    pthread_cond_signal(&timed_cond);
+    pthread_mutex_unlock(&timed_lock);
+    pthread_mutex_unlock(&control_lock);
+    return s->result.id;
+}
+
+// Returns an fd which is readable while results are pending (-1 while the
+// executor is not running)
+int
+timed_fileno(void)
+{
+    int fd;
+
+    pthread_mutex_lock(&timed_lock);
+    fd = done_fd;
+    pthread_mutex_unlock(&timed_lock);
+    return fd;
+}
+
+// Takes the oldest result. Returns 1, or 0 if none is pending. Free it with
+// timed_result_free().
+int
+timed_collect(struct timed_result *result)
+{
+    struct schedule *s;
+    uint64_t value;
+
+    pthread_mutex_lock(&timed_lock);
+    if ((s = done) == NULL) {
+        pthread_mutex_unlock(&timed_lock);
+        return 0;
+    }
+    if ((done = s->next) == NULL) {
+        done_tail = &done;
+        if (done_fd >= 0 && read(done_fd, &value, sizeof(value)) < 0)
+            ;  // EAGAIN: already reset
+    }
+    pthread_mutex_unlock(&timed_lock);
+
+    *result = s->result;
+    free(s);
+    return 1;
+}
+
+void
+timed_result_free(struct timed_result *result)
+{
+    free(result->late_us);
+    free(result->reads);
+    result->late_us = NULL;
+    result->reads = NULL;
+}
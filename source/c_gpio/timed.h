@@ -0,0 +1,68 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * timed.c executes schedules of timed GPIO operations (bank 0) on a
+ * dedicated thread: writes of set/clear masks, waits and reads of the pin
+ * levels, each at a time relative to the start of its schedule. The
+ * lateness of every operation against its requested time is reported with
+ * the results.
+ */
+#ifndef RPIO_TIMED_H
+#define RPIO_TIMED_H
+
+#include <stdint.h>
+
+#define TIMED_WRITE 1  // set set_mask, then clear clear_mask
+#define TIMED_WAIT  2  // only wait for time_us
+#define TIMED_READ  3  // read the levels into the results
+
+// Most operations of a schedule
+#define TIMED_OPS_MAX (1 << 20)
+
+struct timed_op {
+    uint64_t time_us;     // offset from the start of the schedule
+    uint32_t type;
+    uint32_t set_mask;    // TIMED_WRITE
+    uint32_t clear_mask;
+};
+
+struct timed_result {
+    uint32_t id;
+    int status;           // 0, or ECANCELED if stopped before it completed
+    uint64_t start_us;    // now_us() time the schedule started at
+    uint32_t count;       // executed operations
+    int32_t *late_us;     // per executed operation: actual - requested time
+    uint32_t read_count;
+    uint32_t *reads;      // levels of the TIMED_READ operations
+};
+
+int timed_start(int cpu);
+int timed_stop(void);
+int timed_submit(const struct timed_op *ops, uint32_t count, uint64_t start_us);
+int timed_fileno(void);
+int timed_collect(struct timed_result *result);
+void timed_result_free(struct timed_result *result);
+
+#endif
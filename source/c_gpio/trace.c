@@ -0,0 +1,252 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "trace.h"
+#include "util.h"
+
+struct trace_ring {
+    struct trace_ring *next;
+    uint32_t tid;
+    uint64_t head;  // number of records written (only the owner thread writes)
+    struct trace_record records[TRACE_RING_SIZE];
+};
+
+static struct trace_state local_state;
+struct trace_state *trace_state = &local_state;
+
+static __thread struct trace_ring *ring;
+
+// Frees the ring of a thread when it exits
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+// Path for dumps from the signal handler
+static char signal_dump_path[256];
+
+// The list lock is a spinlock: dumps from signal handlers must not block
+// on it, so they walk the list without it (see trace_dump)
+static void
+list_lock(void)
+{
+    while (__atomic_exchange_n(&trace_state->lock, 1, __ATOMIC_ACQUIRE))
+        sched_yield();
+}
+
+static void
+list_unlock(void)
+{
+    __atomic_store_n(&trace_state->lock, 0, __ATOMIC_RELEASE);
+}
+
+// Thread exit: unlinks the ring and frees it once no dump walks the list
+static void
+ring_destroy(void *arg)
+{
+    struct trace_ring *r = arg, **p;
+
+    list_lock();
+    for (p = &trace_state->rings; *p; p = &(*p)->next) {
+        if (*p == r) {
+            __atomic_store_n(p, r->next, __ATOMIC_SEQ_CST);
+            break;
+        }
+    }
+    list_unlock();
+    while (__atomic_load_n(&trace_state->dumping, __ATOMIC_SEQ_CST))
+        sched_yield();
+    free(r);
+}
+
+static void
+ring_key_create(void)
+{
+    pthread_key_create(&ring_key, ring_destroy);
+}
+
+// Allocates the ring of the calling thread and adds it to the list
+static struct trace_ring *
+ring_create(void)
+{
+    struct trace_ring *r;
+
+    pthread_once(&ring_key_once, ring_key_create);
+    if ((r = calloc(1, sizeof(*r))) == NULL)
+        return NULL;
+    r->tid = syscall(SYS_gettid);
+    list_lock();
+    r->next = trace_state->rings;
+    __atomic_store_n(&trace_state->rings, r, __ATOMIC_RELEASE);
+    list_unlock();
+    pthread_setspecific(ring_key, r);
+    return r;
+}
+
+void
+trace_enable(int enabled)
+{
+    __atomic_store_n(&trace_state->enabled, enabled, __ATOMIC_RELEASE);
+}
+
+void
+trace_event_at(uint64_t timestamp_ns, int type, int arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3)
+{
+    struct trace_record *rec;
+
+    if (ring == NULL && (ring = ring_create()) == NULL)
+        return;
+    rec = &ring->records[ring->head & (TRACE_RING_SIZE - 1)];
+    rec->timestamp_ns = timestamp_ns;
+    rec->tid = ring->tid;
+    rec->type = type;
+    rec->arg0 = arg0;
+    rec->arg1 = arg1;
+    rec->arg2 = arg2;
+    rec->arg3 = arg3;
+    rec->reserved = 0;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+void
+trace_event(int type, int arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3)
+{
+    trace_event_at(monotonic_ns(), type, arg0, arg1, arg2, arg3);
+}
+
+// Drops all records (rings stay allocated). Records written at the same time
+// may survive.
+void
+trace_clear(void)
+{
+    struct trace_ring *r;
+
+    list_lock();
+    for (r = trace_state->rings; r; r = r->next)
+        __atomic_store_n(&r->head, 0, __ATOMIC_RELEASE);
+    list_unlock();
+}
+
+static int
+write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(fd, p, len)) <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Writes all rings (oldest record first per ring) to `path`. Uses only
+// async-signal-safe calls. Returns 0 or -1 with errno set.
+int
+trace_dump(const char *path)
+{
+    struct trace_file_header header;
+    struct trace_ring *r;
+    uint64_t head, start, first;
+    int fd;
+
+    if ((fd = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644)) < 0)
+        return -1;
+    // Exiting threads free their rings only after this walk
+    __atomic_add_fetch(&trace_state->dumping, 1, __ATOMIC_SEQ_CST);
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(struct trace_record);
+    if (write_all(fd, &header, sizeof(header)) < 0)
+        goto error;
+
+    for (r = __atomic_load_n(&trace_state->rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        start = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        first = start & (TRACE_RING_SIZE - 1);
+        if (head - start == 0)
+            continue;
+        // The oldest records are at the end of the array if the ring wrapped
+        if (first + (head - start) > TRACE_RING_SIZE) {
+            if (write_all(fd, &r->records[first], (TRACE_RING_SIZE - first) * sizeof(struct trace_record)) < 0 ||
+                    write_all(fd, &r->records[0], (head & (TRACE_RING_SIZE - 1)) * sizeof(struct trace_record)) < 0)
+                goto error;
+        } else if (write_all(fd, &r->records[first], (head - start) * sizeof(struct trace_record)) < 0) {
+            goto error;
+        }
+    }
+    __atomic_sub_fetch(&trace_state->dumping, 1, __ATOMIC_SEQ_CST);
+    return close(fd);
+
+error:
+    __atomic_sub_fetch(&trace_state->dumping, 1, __ATOMIC_SEQ_CST);
+    close(fd);
+    return -1;
+}
+
+static void
+signal_dump(int signum)
+{
+    trace_dump(signal_dump_path);
+}
+
+// Dumps the trace to `path` whenever `signum` (eg. SIGUSR2) is received
+int
+trace_dump_on_signal(int signum, const char *path)
+{
+    struct sigaction sa;
+
+    if (strlen(path) >= sizeof(signal_dump_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(signal_dump_path, path);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = signal_dump;
+    sa.sa_flags = SA_RESTART;
+    return sigaction(signum, &sa, NULL);
+}
+
+struct trace_state *
+trace_get_state(void)
+{
+    return trace_state;
+}
+
+void
+trace_set_state(struct trace_state *state)
+{
+    trace_state = state;
+}
@@ -0,0 +1,121 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * trace.c is a binary trace recorder for PWM channel edits, DMA starts and
+ * resets, interrupt arrivals and callback dispatch. Every thread writes into
+ * its own ring of fixed size records (no locks, no formatting), so tracing
+ * can stay on in production. A thread's ring is freed with its records when
+ * the thread exits. Tracing is off until trace_enable(1); compile with
+ * -DRPIO_NO_TRACE to remove it completely.
+ *
+ * trace_dump() writes all rings into a file (header + raw records) and is
+ * async-signal-safe, so it can also run from a signal handler (see
+ * trace_dump_on_signal). `python -m RPIO.tracing` converts a dump into
+ * Chrome/Perfetto JSON.
+ */
+#ifndef RPIO_TRACE_H
+#define RPIO_TRACE_H
+
+#include <stdint.h>
+
+// Record types. args: see the comment of each type.
+enum trace_type {
+    TRACE_PWM_INIT_CHANNEL = 1,  // channel, subcycle_us
+    TRACE_PWM_FREE_CHANNEL,      // channel
+    TRACE_PWM_ADD_PULSE,         // channel, gpio, width_start, width
+    TRACE_PWM_CLEAR_GPIO,        // channel, gpio
+    TRACE_PWM_CLEAR_CHANNEL,     // channel
+    TRACE_DMA_START,             // channel
+    TRACE_DMA_RESET,             // channel
+    TRACE_INTERRUPT,             // gpio, level
+    TRACE_CALLBACK_BEGIN,        // gpio, level
+    TRACE_CALLBACK_END,          // gpio
+    TRACE_TCP_BEGIN,             // fileno
+    TRACE_TCP_END,               // fileno
+    TRACE_PWM_SET_PULSES,        // channel, gpio mask, number of pulses
+};
+
+// One record, 32 bytes
+struct trace_record {
+    uint64_t timestamp_ns;  // CLOCK_MONOTONIC
+    uint32_t tid;
+    uint16_t type;
+    uint16_t arg0;
+    uint32_t arg1;
+    uint32_t arg2;
+    uint32_t arg3;
+    uint32_t reserved;
+};
+
+// Dump file header, followed by the records
+#define TRACE_MAGIC   "RPIOTRC"
+#define TRACE_VERSION 1
+
+struct trace_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+// Records per thread ring (power of 2)
+#define TRACE_RING_SIZE 8192
+
+struct trace_ring;
+
+// Process wide state. Extension modules which each contain a copy of trace.c
+// share one state (see trace_set_state).
+struct trace_state {
+    int enabled;
+    struct trace_ring *rings;  // list of the rings of all live threads
+    int lock;                  // spinlock of adding and removing rings
+    int dumping;               // dumps walking the list
+};
+
+extern struct trace_state *trace_state;
+
+void trace_enable(int enabled);
+void trace_event(int type, int arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3);
+void trace_event_at(uint64_t timestamp_ns, int type, int arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3);
+void trace_clear(void);
+int trace_dump(const char *path);
+int trace_dump_on_signal(int signum, const char *path);
+struct trace_state *trace_get_state(void);
+void trace_set_state(struct trace_state *state);
+
+#ifndef RPIO_NO_TRACE
+#define TRACE_ENABLED 1
+#define TRACE(type, a0, a1, a2, a3) do { \
+        if (trace_state->enabled) trace_event(type, a0, a1, a2, a3); \
+    } while (0)
+#define TRACE_AT(ts, type, a0, a1, a2, a3) do { \
+        if (trace_state->enabled) trace_event_at(ts, type, a0, a1, a2, a3); \
+    } while (0)
+#else
+#define TRACE_ENABLED 0
+#define TRACE(type, a0, a1, a2, a3) do {} while (0)
+#define TRACE_AT(ts, type, a0, a1, a2, a3) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,875 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * dma.c holds the DMA infrastructure which pwm.c and the DMA output engines
+ * (led.c, shift.c, stepper.c) share.
+ *
+ *
+ * ENGINES
+ * -------
+ * An engine claims a DMA channel for itself (as pwm.c's init_channel does,
+ * so either one refuses a channel the other uses), allocates DMA memory with
+ * dma_mem_alloc() and writes its control blocks there: GPIO writes
+ * (dma_cb_copy to BUS_GPSET0/BUS_GPCLR0) alternating with delays
+ * (dma_cb_delay). Chains end with next = 0, so the channel stops once a
+ * chain is done (see dma_active); dma_start() starts the next one.
+ * pwm_shutdown() resets all claimed channels.
+ *
+ * Each engine begins with a struct dma_engine, which dma.c registers per
+ * channel: its callers find it locked with dma_engine_lock(), wait for it
+ * to get idle with dma_engine_wait(), and its close function unregisters it
+ * with dma_engine_close(), which returns once no caller waits on it anymore,
+ * and frees it with dma_engine_release().
+ *
+ *
+ * RINGS
+ * -----
+ * Engines which output a stream (frames, motion segments) split their
+ * memory into a ring of segments. The first control block of a segment is a
+ * marker which copies its sequence number into the status word. A segment
+ * is committed when it is written: it ends the chain, and is linked to the
+ * end of the last committed one, or the channel is started if it is idle.
+ * Once the status word is past a segment (or the channel stopped), the DMA
+ * is done with it and it can be written again (dma_ring_next).
+ *
+ *
+ * PACING
+ * ------
+ * Delays write to the FIFO of the PWM or PCM peripheral, which takes one
+ * word per period; its DREQ holds the DMA channel back until there is room.
+ * Each of both pacers runs at one period for all its users: pwm_setup
+ * reserves one for pulse_width_incr_us, engines acquire a pacer with the
+ * period they need (from PLLD at 500MHz: 2ns * divisor * range), and can
+ * share it with others which need the same period.
+ *
+ *
+ * SIMULATION
+ * ----------
+ * With RPIO_SIMULATE=1, dma_start() executes the chain at once: copies are
+ * done, delays advance the virtual clock, and GPIO writes can be recorded
+ * with their times (dma_sim_record), so the output of engines can be tested
+ * without a Raspberry Pi.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include "pwm.h"
+#include "dma.h"
+#include "systimer.h"
+#include "util.h"
+
+// Simulated bus addresses: one 64MB window per channel (as in pwm.c)
+#define SIM_BUS_BASE    0x40000000
+#define SIM_PAGES_MAX   (1 << 14)
+
+static pthread_mutex_t dma_lock = PTHREAD_MUTEX_INITIALIZER;
+static int is_dma_setup = 0;
+
+// Registers
+static volatile uint32_t *dma_reg;
+static volatile uint32_t *pwm_reg;
+static volatile uint32_t *pcm_reg;
+static volatile uint32_t *clk_reg;
+
+// Channels claimed by engines (bitfield, accessed atomically), and their
+// memory for the simulation
+static int claimed = 0;
+static struct dma_mem *channel_mem[DMA_CHANNELS];
+
+// Pacers (DELAY_VIA_PWM, DELAY_VIA_PCM) acquired by engines, and the one
+// reserved by pwm_setup (-1: none)
+static struct {
+    int users;
+    uint32_t period_ns;
+} pacers[2];
+static int pwm_pacer = -1;
+static uint32_t pwm_pacer_ns;
+
+// Engines per channel; engine_lock guards the array and is locked before
+// the lock of an engine
+static struct dma_engine *engines[DMA_CHANNELS];
+static pthread_mutex_t engine_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *engine_names[] = {"LED strips", "shift outputs", "steppers"};
+
+// Simulation
+static int sim_recording = 0;
+static uint64_t sim_time_ns = 0;
+static struct dma_sim_event *sim_events = NULL;
+static size_t sim_count = 0, sim_size = 0;
+
+// Peripherals memory mapping
+void *
+dma_map_peripheral(uint32_t base, uint32_t len)
+{
+    int fd;
+    void * vaddr;
+
+    if (simulation_enabled()) {
+        vaddr = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (vaddr == MAP_FAILED) {
+            pwm_fatal("rpio-pwm: Failed to allocate simulated peripheral: %m\n");
+            return NULL;
+        }
+        return vaddr;
+    }
+
+    fd = open("/dev/mem", O_RDWR);
+    if (fd < 0) {
+        pwm_fatal("rpio-pwm: Failed to open /dev/mem: %m\n");
+        return NULL;
+    }
+    vaddr = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, base);
+    if (vaddr == MAP_FAILED) {
+        pwm_fatal("rpio-pwm: Failed to map peripheral at 0x%08x: %m\n", base);
+        return NULL;
+    }
+    close(fd);
+
+    return vaddr;
+}
+
+// Maps the registers, starts the system timer and catches all signals which
+// would leave DMA running (once)
+int
+dma_setup(void)
+{
+    int result = EXIT_SUCCESS;
+
+    pthread_mutex_lock(&dma_lock);
+    if (!is_dma_setup) {
+        systimer_setup();
+        pwm_catch_signals();
+        dma_reg = dma_map_peripheral(DMA_BASE, PAGE_SIZE);
+        pwm_reg = dma_map_peripheral(PWM_BASE, PWM_LEN);
+        pcm_reg = dma_map_peripheral(PCM_BASE, PCM_LEN);
+        clk_reg = dma_map_peripheral(CLK_BASE, CLK_LEN);
+        if (dma_reg && pwm_reg && pcm_reg && clk_reg)
+            is_dma_setup = 1;
+        else
+            result = EXIT_FAILURE;
+    }
+    pthread_mutex_unlock(&dma_lock);
+    return result;
+}
+
+// Allocates `bytes` of zeroed, locked memory with known bus addresses for
+// the DMA channel `channel`
+int
+dma_mem_alloc(struct dma_mem *mem, int channel, size_t bytes)
+{
+    int fd, flags = MAP_SHARED|MAP_ANONYMOUS|MAP_NORESERVE|MAP_LOCKED;
+    uint32_t i;
+    uint64_t pfn;
+    off_t offset;
+
+    memset(mem, 0, sizeof(*mem));
+    mem->num_pages = (bytes + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    if (simulation_enabled()) {
+        if (mem->num_pages > SIM_PAGES_MAX)
+            return pwm_fatal("rpio-pwm: %u bytes of DMA memory exceed the simulated 64MB\n", (unsigned)bytes);
+        flags &= ~MAP_LOCKED;
+    }
+    mem->virtbase = mmap(NULL, mem->num_pages * PAGE_SIZE, PROT_READ|PROT_WRITE, flags, -1, 0);
+    if (mem->virtbase == MAP_FAILED) {
+        mem->virtbase = NULL;
+        return pwm_fatal("rpio-pwm: Failed to mmap physical pages: %m\n");
+    }
+    mem->page_map = malloc(mem->num_pages * sizeof(*mem->page_map));
+    if (mem->page_map == NULL) {
+        dma_mem_free(mem);
+        return pwm_fatal("rpio-pwm: Failed to malloc page_map: %m\n");
+    }
+
+    if (simulation_enabled()) {
+        for (i = 0; i < mem->num_pages; i++) {
+            mem->page_map[i].virtaddr = mem->virtbase + i * PAGE_SIZE;
+            mem->page_map[i].physaddr = SIM_BUS_BASE | (channel << 26) | (i << PAGE_SHIFT);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    fd = open("/proc/self/pagemap", O_RDONLY);
+    if (fd < 0) {
+        dma_mem_free(mem);
+        return pwm_fatal("rpio-pwm: Failed to open /proc/self/pagemap: %m\n");
+    }
+    offset = (off_t)((uintptr_t)mem->virtbase >> PAGE_SHIFT) * sizeof(pfn);
+    for (i = 0; i < mem->num_pages; i++) {
+        mem->page_map[i].virtaddr = mem->virtbase + i * PAGE_SIZE;
+        // Following line forces page to be allocated
+        mem->page_map[i].virtaddr[0] = 0;
+        if (pread(fd, &pfn, sizeof(pfn), offset + i * sizeof(pfn)) != sizeof(pfn) ||
+                ((pfn >> 55) & 0x1bf) != 0x10c) {
+            close(fd);
+            dma_mem_free(mem);
+            return pwm_fatal("rpio-pwm: Page %u of DMA memory not present\n", i);
+        }
+        mem->page_map[i].physaddr = (uint32_t)pfn << PAGE_SHIFT | 0x40000000;
+    }
+    close(fd);
+    return EXIT_SUCCESS;
+}
+
+void
+dma_mem_free(struct dma_mem *mem)
+{
+    if (mem->virtbase)
+        munmap(mem->virtbase, mem->num_pages * PAGE_SIZE);
+    free(mem->page_map);
+    memset(mem, 0, sizeof(*mem));
+}
+
+// Bus address of a location in DMA memory
+uint32_t
+dma_phys(const struct dma_mem *mem, const void *virt)
+{
+    uint32_t offset = (const uint8_t *)virt - mem->virtbase;
+    return mem->page_map[offset >> PAGE_SHIFT].physaddr + (offset % PAGE_SIZE);
+}
+
+// Reserves a DMA channel for an engine which uses the memory `mem` (NULL for
+// pwm.c's channels), and returns its registers (NULL if it is in use)
+volatile uint32_t *
+dma_claim(int channel, struct dma_mem *mem)
+{
+    volatile uint32_t *reg;
+
+    if (channel < 0 || channel > DMA_CHANNELS-1) {
+        pwm_fatal("Error: maximum channel is %d (requested channel %d)\n", DMA_CHANNELS-1, channel);
+        return NULL;
+    }
+    pthread_mutex_lock(&dma_lock);
+    if (claimed & (1 << channel)) {
+        pthread_mutex_unlock(&dma_lock);
+        pwm_fatal("Error: DMA channel %d is already in use\n", channel);
+        return NULL;
+    }
+    channel_mem[channel] = mem;
+    __atomic_fetch_or(&claimed, 1 << channel, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&dma_lock);
+
+    reg = dma_reg + (DMA_CHANNEL_INC / 4) * channel;
+    reg[DMA_CS] = DMA_RESET;
+    sleep_us(10);
+    return reg;
+}
+
+// Stops a claimed channel and returns it
+void
+dma_release(int channel)
+{
+    dma_reset(channel);
+    pthread_mutex_lock(&dma_lock);
+    __atomic_fetch_and(&claimed, ~(1 << channel), __ATOMIC_RELEASE);
+    channel_mem[channel] = NULL;
+    pthread_mutex_unlock(&dma_lock);
+}
+
+int
+dma_claimed(int channel)
+{
+    return __atomic_load_n(&claimed, __ATOMIC_ACQUIRE) & (1 << channel) ? 1 : 0;
+}
+
+// Memory of a simulated bus address
+static void *
+sim_virt(uint32_t phys)
+{
+    int c;
+    uint32_t offset;
+
+    for (c = 0; c < DMA_CHANNELS; c++) {
+        if (!channel_mem[c])
+            continue;
+        offset = phys - (SIM_BUS_BASE | (c << 26));
+        if (offset < channel_mem[c]->num_pages * PAGE_SIZE)
+            return channel_mem[c]->virtbase + offset;
+    }
+    return NULL;
+}
+
+static void
+sim_event(uint32_t set_mask, uint32_t clear_mask)
+{
+    struct dma_sim_event *events;
+
+    if (sim_count == sim_size) {
+        sim_size = sim_size ? sim_size * 2 : 4096;
+        if ((events = realloc(sim_events, sim_size * sizeof(*events))) == NULL) {
+            sim_size = sim_count;
+            return;
+        }
+        sim_events = events;
+    }
+    sim_events[sim_count].time_ns = sim_time_ns;
+    sim_events[sim_count].set_mask = set_mask;
+    sim_events[sim_count].clear_mask = clear_mask;
+    sim_count++;
+}
+
+// Executes a chain of control blocks on simulated hardware
+static void
+sim_run(uint32_t cb_phys)
+{
+    dma_cb_t *cb;
+    uint32_t *src;
+    void *dst;
+    uint64_t start_ns = sim_time_ns;
+
+    while (cb_phys && (cb = sim_virt(cb_phys)) != NULL) {
+        src = sim_virt(cb->src);
+        if (cb->dst == BUS_PWM_FIFO || cb->dst == BUS_PCM_FIFO) {
+            sim_time_ns += (uint64_t)(cb->length / 4) * pacers[cb->dst == BUS_PCM_FIFO].period_ns;
+        } else if (cb->dst == BUS_GPSET0 || cb->dst == BUS_GPCLR0) {
+            if (src && sim_recording)
+                sim_event(cb->dst == BUS_GPSET0 ? *src : 0, cb->dst == BUS_GPCLR0 ? *src : 0);
+        } else if (src && (dst = sim_virt(cb->dst)) != NULL) {
+            memcpy(dst, src, cb->length);
+        }
+        cb_phys = cb->next;
+    }
+    systimer_advance_us((sim_time_ns - start_ns) / 1000);
+}
+
+// Starts a claimed, idle channel at the control block `cb_phys`
+void
+dma_start(int channel, uint32_t cb_phys)
+{
+    volatile uint32_t *reg = dma_reg + (DMA_CHANNEL_INC / 4) * channel;
+
+    if (simulation_enabled()) {
+        sim_run(cb_phys);
+        return;
+    }
+    reg[DMA_CS] = DMA_INT | DMA_END; // Interrupt status & DMA end flag
+    reg[DMA_CONBLK_AD] = cb_phys;
+    reg[DMA_DEBUG] = 7; // clear debug error flags
+    reg[DMA_CS] = 0x10880001;    // go, mid priority, wait for outstanding writes
+}
+
+int
+dma_active(int channel)
+{
+    return dma_reg[(DMA_CHANNEL_INC / 4) * channel + DMA_CS] & DMA_ACTIVE;
+}
+
+// Holds a claimed channel at its current control block (see dma_position)
+void
+dma_pause(int channel)
+{
+    dma_reg[(DMA_CHANNEL_INC / 4) * channel + DMA_CS] = 0;
+    sleep_us(10);
+}
+
+// Stops a claimed channel
+void
+dma_reset(int channel)
+{
+    dma_reg[(DMA_CHANNEL_INC / 4) * channel + DMA_CS] = DMA_RESET;
+    sleep_us(10);
+}
+
+// Returns the control block a running or paused channel is at (NULL once
+// its chain ended, or if it is not in `mem`)
+dma_cb_t *
+dma_position(int channel, const struct dma_mem *mem)
+{
+    uint32_t i, cb_phys = dma_reg[(DMA_CHANNEL_INC / 4) * channel + DMA_CONBLK_AD];
+
+    if (cb_phys == 0)
+        return NULL;
+    for (i = 0; i < mem->num_pages; i++) {
+        if (mem->page_map[i].physaddr == (cb_phys & ~(PAGE_SIZE - 1)))
+            return (dma_cb_t *)(mem->page_map[i].virtaddr + (cb_phys % PAGE_SIZE));
+    }
+    return NULL;
+}
+
+// Resets the channels of all engines. Does not take locks, since it also
+// runs from signal handlers (see pwm_shutdown).
+void
+dma_shutdown(void)
+{
+    int i;
+
+    for (i = 0; i < DMA_CHANNELS; i++) {
+        if (dma_claimed(i))
+            dma_reg[(DMA_CHANNEL_INC / 4) * i + DMA_CS] = DMA_RESET;
+    }
+}
+
+// Control block which copies `length` bytes
+void
+dma_cb_copy(dma_cb_t *cb, uint32_t src, uint32_t dst, uint32_t length, uint32_t next)
+{
+    cb->info = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP;
+    cb->src = src;
+    cb->dst = dst;
+    cb->length = length;
+    cb->stride = 0;
+    cb->next = next;
+}
+
+// Control block which waits for `periods` (1..DMA_DELAY_MAX) of the pacer
+// `hw`; src can be any word of DMA memory
+void
+dma_cb_delay(dma_cb_t *cb, int hw, uint32_t periods, uint32_t src, uint32_t next)
+{
+    if (hw == DELAY_VIA_PWM) {
+        cb->info = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP | DMA_D_DREQ | DMA_PER_MAP(5);
+        cb->dst = BUS_PWM_FIFO;
+    } else {
+        cb->info = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP | DMA_D_DREQ | DMA_PER_MAP(2);
+        cb->dst = BUS_PCM_FIFO;
+    }
+    cb->src = src;
+    cb->length = periods * 4;
+    cb->stride = 0;
+    cb->next = next;
+}
+
+// Sets up a ring of `segments` (up to DMA_RING_MAX) on a claimed, idle
+// channel. `words` are 1 + segments words of `mem` for the sequence numbers.
+void
+dma_ring_init(struct dma_ring *ring, int channel, const struct dma_mem *mem, int segments, uint32_t *words)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->channel = channel;
+    ring->mem = mem;
+    ring->segments = segments;
+    ring->status = words;
+    ring->seq = words + 1;
+    ring->tail = -1;
+    memset(words, 0, (1 + segments) * sizeof(*words));
+}
+
+// Writes the marker of a segment at `cb` and returns the control block
+// after it. The engine sets ring->last[segment] to the last one.
+dma_cb_t *
+dma_ring_marker(struct dma_ring *ring, int segment, dma_cb_t *cb)
+{
+    ring->first[segment] = cb;
+    dma_cb_copy(cb, dma_phys(ring->mem, &ring->seq[segment]), dma_phys(ring->mem, (void *)ring->status), 4, dma_phys(ring->mem, cb + 1));
+    return cb + 1;
+}
+
+// Returns 1 if the DMA is done with a segment
+int
+dma_ring_done(const struct dma_ring *ring, int segment)
+{
+    return ring->seq[segment] == 0 || !dma_active(ring->channel) ||
+        (int32_t)(*ring->status - ring->seq[segment]) > 0;
+}
+
+// Returns the segment after the last committed one once the DMA is done
+// with it (-1 if it is not and `wait` is 0)
+int
+dma_ring_next(struct dma_ring *ring, int wait)
+{
+    int segment = (ring->tail + 1) % ring->segments;
+
+    while (!dma_ring_done(ring, segment)) {
+        if (!wait)
+            return -1;
+        sleep_us(50);
+    }
+    return segment;
+}
+
+// Appends a segment to the output
+void
+dma_ring_commit(struct dma_ring *ring, int segment)
+{
+    volatile uint32_t *reg = dma_reg + (DMA_CHANNEL_INC / 4) * ring->channel;
+    uint32_t first = dma_phys(ring->mem, ring->first[segment]);
+    dma_cb_t *last;
+
+    ring->seq[segment] = ++ring->committed;
+    ring->last[segment]->next = 0;
+    __sync_synchronize();
+    if (ring->tail < 0 || !dma_active(ring->channel)) {
+        ring->tail = segment;
+        dma_start(ring->channel, first);
+        return;
+    }
+
+    // The DMA follows the link unless it already loaded the last control
+    // block of the tail; then it stops at its end.
+    last = ring->last[ring->tail];
+    ring->tail = segment;
+    last->next = first;
+    __sync_synchronize();
+    if (reg[DMA_CONBLK_AD] == dma_phys(ring->mem, last) && reg[DMA_NEXTCONBK] != first) {
+        while (dma_active(ring->channel))
+            sleep_us(20);
+    }
+    if (!dma_active(ring->channel) && (int32_t)(*ring->status - ring->seq[segment]) < 0)
+        dma_start(ring->channel, first);
+}
+
+// Engine of kind `kind` on `channel` (engine_lock locked), or NULL
+static struct dma_engine *
+find_engine(int channel, int kind)
+{
+    if (channel < 0 || channel > DMA_CHANNELS-1 || engines[channel] == NULL || engines[channel]->kind != kind)
+        return NULL;
+    return engines[channel];
+}
+
+// Sets up the common part of an engine once its open function can no
+// longer fail before dma_engine_register()
+void
+dma_engine_init(struct dma_engine *e, int kind, int channel, int hw)
+{
+    pthread_condattr_t attr;
+
+    e->kind = kind;
+    e->channel = channel;
+    e->hw = hw;
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&e->idle, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+void
+dma_engine_register(struct dma_engine *e)
+{
+    pthread_mutex_lock(&engine_lock);
+    engines[e->channel] = e;
+    pthread_mutex_unlock(&engine_lock);
+}
+
+// Returns the engine of kind `kind` on `channel`, locked
+struct dma_engine *
+dma_engine_lock(int channel, int kind)
+{
+    struct dma_engine *e;
+
+    pthread_mutex_lock(&engine_lock);
+    if ((e = find_engine(channel, kind)) != NULL)
+        pthread_mutex_lock(&e->lock);
+    pthread_mutex_unlock(&engine_lock);
+    if (e == NULL)
+        pwm_fatal("Error: no %s on channel %d\n", engine_names[kind], channel);
+    return e;
+}
+
+// Waits up to timeout_ms (forever if negative) while busy(e) (NULL: never
+// busy), signalled on e->idle, then until the channel stopped. Called with
+// e locked, which it unlocks while waiting and before it returns. Returns 1
+// once the engine is idle, 0 on timeout, -1 if it was closed.
+int
+dma_engine_wait(struct dma_engine *e, int (*busy)(const struct dma_engine *), int timeout_ms)
+{
+    struct timespec deadline;
+    uint64_t due = 0;
+    int kind = e->kind, channel = e->channel;
+    int result = 1;
+
+    if (timeout_ms >= 0) {
+        due = monotonic_ns() + (uint64_t)timeout_ms * 1000000;
+        deadline.tv_sec = due / 1000000000;
+        deadline.tv_nsec = due % 1000000000;
+    }
+
+    e->waiters++;
+    while (result && busy && busy(e) && !e->closing) {
+        if (timeout_ms < 0)
+            pthread_cond_wait(&e->idle, &e->lock);
+        else if (pthread_cond_timedwait(&e->idle, &e->lock, &deadline) == ETIMEDOUT)
+            result = 0;
+    }
+    while (result && dma_active(channel) && !e->closing) {
+        pthread_mutex_unlock(&e->lock);
+        sleep_us(100);
+        pthread_mutex_lock(&e->lock);
+        if (timeout_ms >= 0 && monotonic_ns() >= due)
+            result = 0;
+    }
+    e->waiters--;
+    if (e->closing) {
+        // dma_engine_close() frees e once the last waiter left
+        pthread_cond_broadcast(&e->idle);
+        pthread_mutex_unlock(&e->lock);
+        pwm_fatal("Error: the %s on channel %d were closed\n", engine_names[kind], channel);
+        return -1;
+    }
+    pthread_mutex_unlock(&e->lock);
+    return result;
+}
+
+// Unregisters the engine of kind `kind` on `channel`, wakes the callers
+// which wait on it (`wake` those waiting on the engine's own conditions)
+// and waits until they returned. Returns the engine, unlocked, for its close
+// function to free (see dma_engine_release).
+struct dma_engine *
+dma_engine_close(int channel, int kind, void (*wake)(struct dma_engine *))
+{
+    struct dma_engine *e;
+
+    pthread_mutex_lock(&engine_lock);
+    if ((e = find_engine(channel, kind)) == NULL) {
+        pthread_mutex_unlock(&engine_lock);
+        pwm_fatal("Error: no %s on channel %d\n", engine_names[kind], channel);
+        return NULL;
+    }
+    // Wait for a running call
+    pthread_mutex_lock(&e->lock);
+    engines[channel] = NULL;
+    pthread_mutex_unlock(&engine_lock);
+
+    e->closing = 1;
+    if (wake)
+        wake(e);
+    pthread_cond_broadcast(&e->idle);
+    while (e->waiters)
+        pthread_cond_wait(&e->idle, &e->lock);
+    pthread_mutex_unlock(&e->lock);
+    return e;
+}
+
+// Stops the output of a closed engine, sets its gpios low and frees its
+// channel, pacer, memory and lock (but not the engine itself)
+void
+dma_engine_release(struct dma_engine *e)
+{
+    dma_release(e->channel);
+    pwm_gpio_clear(e->gpio_mask);
+    dma_pacer_release(e->hw);
+    dma_mem_free(&e->mem);
+    pthread_mutex_destroy(&e->lock);
+    pthread_cond_destroy(&e->idle);
+}
+
+// Number of frames the DMA has started (engines which output frames)
+int
+dma_engine_frames(int channel, int kind, uint32_t *frames)
+{
+    struct dma_engine *e;
+
+    if ((e = dma_engine_lock(channel, kind)) == NULL)
+        return EXIT_FAILURE;
+    *frames = *e->ring.status;
+    pthread_mutex_unlock(&e->lock);
+    return EXIT_SUCCESS;
+}
+
+// e->size of the engine on `channel` (0 if there is none)
+int
+dma_engine_size(int channel, int kind)
+{
+    struct dma_engine *e;
+    int size = 0;
+
+    pthread_mutex_lock(&engine_lock);
+    if ((e = find_engine(channel, kind)) != NULL)
+        size = e->size;
+    pthread_mutex_unlock(&engine_lock);
+    return size;
+}
+
+// Fills the tables which map a byte of dma_transpose8() (a bit of each of 8
+// outputs) to the gpios of the outputs: table[g] for outputs 8g..8g+7
+void
+dma_bit_tables(uint32_t (*table)[256], const int *gpios, int count)
+{
+    int i, s;
+
+    memset(table, 0, (count + 7) / 8 * sizeof(*table));
+    for (s = 0; s < count; s++) {
+        for (i = 0; i < 256; i++) {
+            if (i & (1 << (s % 8)))
+                table[s / 8][i] |= 1 << gpios[s];
+        }
+    }
+}
+
+// Starts the PWM or PCM pacer with a period of `range` cycles of PLLD/divisor
+void
+dma_pacer_program(int hw, uint32_t divisor, uint32_t range)
+{
+    if (hw == DELAY_VIA_PWM) {
+        // Initialise PWM
+        pwm_reg[PWM_CTL] = 0;
+        sleep_us(10);
+        clk_reg[PWMCLK_CNTL] = 0x5A000006;        // Source=PLLD (500MHz)
+        sleep_us(100);
+        clk_reg[PWMCLK_DIV] = 0x5A000000 | (divisor<<12);
+        sleep_us(100);
+        clk_reg[PWMCLK_CNTL] = 0x5A000016;        // Source=PLLD and enable
+        sleep_us(100);
+        pwm_reg[PWM_RNG1] = range;
+        sleep_us(10);
+        pwm_reg[PWM_DMAC] = PWMDMAC_ENAB | PWMDMAC_THRSHLD;
+        sleep_us(10);
+        pwm_reg[PWM_CTL] = PWMCTL_CLRF;
+        sleep_us(10);
+        pwm_reg[PWM_CTL] = PWMCTL_USEF1 | PWMCTL_PWEN1;
+        sleep_us(10);
+    } else {
+        // Initialise PCM
+        pcm_reg[PCM_CS_A] = 1;                // Disable Rx+Tx, Enable PCM block
+        sleep_us(100);
+        clk_reg[PCMCLK_CNTL] = 0x5A000006;        // Source=PLLD (500MHz)
+        sleep_us(100);
+        clk_reg[PCMCLK_DIV] = 0x5A000000 | (divisor<<12);
+        sleep_us(100);
+        clk_reg[PCMCLK_CNTL] = 0x5A000016;        // Source=PLLD and enable
+        sleep_us(100);
+        pcm_reg[PCM_TXC_A] = 0<<31 | 1<<30 | 0<<20 | 0<<16; // 1 channel, 8 bits
+        sleep_us(100);
+        pcm_reg[PCM_MODE_A] = (range - 1) << 10;
+        sleep_us(100);
+        pcm_reg[PCM_CS_A] |= 1<<4 | 1<<3;        // Clear FIFOs
+        sleep_us(100);
+        pcm_reg[PCM_DREQ_A] = 64<<24 | 64<<8;        // DMA Req when one slot is free?
+        sleep_us(100);
+        pcm_reg[PCM_CS_A] |= 1<<9;            // Enable DMA
+        sleep_us(100);
+        pcm_reg[PCM_CS_A] |= 1<<2;            // Enable Tx
+    }
+}
+
+// Finds the divisor and range (at least 10 cycles; the PCM frame length has
+// 10 bits) which come closest to period_ns. Returns the achieved period.
+static uint32_t
+pacer_timing(int hw, uint32_t period_ns, uint32_t *divisor, uint32_t *range)
+{
+    uint32_t r, d, r_max = hw == DELAY_VIA_PCM ? 1024 : 100000;
+    uint32_t best = 0, err, best_err = UINT32_MAX;
+
+    for (r = 10; r <= r_max; r++) {
+        d = (period_ns + r) / (2 * r);
+        if (d < 2)
+            break;
+        if (d > 4095)
+            continue;
+        err = 2 * d * r > period_ns ? 2 * d * r - period_ns : period_ns - 2 * d * r;
+        if (err < best_err) {
+            best_err = err;
+            best = 2 * d * r;
+            *divisor = d;
+            *range = r;
+        }
+    }
+    return best;
+}
+
+// Acquires the pacer `hw` (DELAY_VIA_PWM or DELAY_VIA_PCM) with a period as
+// close to period_ns as possible, starting it if it is not running. Fails if
+// it runs at another period (for pwm.c or another engine).
+int
+dma_pacer_acquire(int hw, uint32_t period_ns)
+{
+    uint32_t divisor, range, actual;
+    int result = EXIT_SUCCESS;
+
+    if (hw != DELAY_VIA_PWM && hw != DELAY_VIA_PCM)
+        return pwm_fatal("Error: unknown delay hardware %d\n", hw);
+    if ((actual = pacer_timing(hw, period_ns, &divisor, &range)) == 0)
+        return pwm_fatal("Error: a pacer period of %uns is out of range\n", period_ns);
+
+    pthread_mutex_lock(&dma_lock);
+    if (pwm_pacer == hw && pwm_pacer_ns != actual) {
+        result = pwm_fatal("Error: the %s pacer runs at %uus for PWM channels\n", hw == DELAY_VIA_PWM ? "PWM" : "PCM", pwm_pacer_ns / 1000);
+    } else if (pacers[hw].users && pacers[hw].period_ns != actual) {
+        result = pwm_fatal("Error: the %s pacer runs at %uns for another engine\n", hw == DELAY_VIA_PWM ? "PWM" : "PCM", pacers[hw].period_ns);
+    } else {
+        if (!pacers[hw].users && pwm_pacer != hw)
+            dma_pacer_program(hw, divisor, range);
+        pacers[hw].period_ns = actual;
+        pacers[hw].users++;
+    }
+    pthread_mutex_unlock(&dma_lock);
+    return result;
+}
+
+// Releases a pacer; the last user stops it (unless pwm.c uses it)
+void
+dma_pacer_release(int hw)
+{
+    pthread_mutex_lock(&dma_lock);
+    if (--pacers[hw].users == 0 && pwm_pacer != hw) {
+        if (hw == DELAY_VIA_PWM)
+            pwm_reg[PWM_CTL] = 0;
+        else
+            pcm_reg[PCM_CS_A] = 0;
+    }
+    pthread_mutex_unlock(&dma_lock);
+}
+
+// Reserves the pacer `hw` for pwm.c's channels for good, and starts it with
+// a period of 2ns * divisor * range. Fails while an engine uses it.
+int
+dma_pacer_reserve(int hw, uint32_t divisor, uint32_t range)
+{
+    if (hw != DELAY_VIA_PWM && hw != DELAY_VIA_PCM)
+        return pwm_fatal("Error: unknown delay hardware %d\n", hw);
+
+    pthread_mutex_lock(&dma_lock);
+    if (pacers[hw].users) {
+        pthread_mutex_unlock(&dma_lock);
+        return pwm_fatal("Error: the %s is used by a DMA engine\n", hw == DELAY_VIA_PWM ? "PWM" : "PCM");
+    }
+    pwm_pacer = hw;
+    pwm_pacer_ns = 2 * divisor * range;
+    dma_pacer_program(hw, divisor, range);
+    pthread_mutex_unlock(&dma_lock);
+    return EXIT_SUCCESS;
+}
+
+uint32_t
+dma_pacer_period_ns(int hw)
+{
+    return pacers[hw].period_ns;
+}
+
+// Starts (and clears) or stops recording the GPIO writes of simulated DMA
+// transfers; the simulated time starts at 0
+void
+dma_sim_record(int enabled)
+{
+    pthread_mutex_lock(&dma_lock);
+    sim_recording = enabled;
+    sim_time_ns = 0;
+    sim_count = 0;
+    pthread_mutex_unlock(&dma_lock);
+}
+
+// Returns the number of recorded GPIO writes and sets *events to them
+size_t
+dma_sim_events(const struct dma_sim_event **events)
+{
+    *events = sim_events;
+    return sim_count;
+}
@@ -0,0 +1,256 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * dma.h describes the DMA, PWM, PCM, clock and GPIO registers used by pwm.c,
+ * and dma.c, which provides what DMA output engines (eg. led.c) share with
+ * pwm.c: physically addressed DMA memory, exclusive DMA channels, and the PWM
+ * and PCM pacers which time the control blocks (see PACING in dma.c), and
+ * what the engines share among themselves (see ENGINES in dma.c).
+ */
+#ifndef RPIO_DMA_H
+#define RPIO_DMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// 15 DMA channels are usable on the RPi (0..14)
+#define DMA_CHANNELS    15
+
+// Standard page sizes
+#define PAGE_SIZE       4096
+#define PAGE_SHIFT      12
+
+// Memory Addresses
+#define DMA_BASE        0x20007000
+#define DMA_CHANNEL_INC 0x100
+#define DMA_LEN         0x24
+#define PWM_BASE        0x2020C000
+#define PWM_LEN         0x28
+#define CLK_BASE        0x20101000
+#define CLK_LEN         0xA8
+#define GPIO_BASE       0x20200000
+#define GPIO_LEN        0x100
+#define PCM_BASE        0x20203000
+#define PCM_LEN         0x24
+
+// Bus addresses seen by the DMA controller
+#define BUS_GPSET0      (0x7e200000 + 0x1c)
+#define BUS_GPCLR0      (0x7e200000 + 0x28)
+#define BUS_PWM_FIFO    ((PWM_BASE | 0x7e000000) + 0x18)
+#define BUS_PCM_FIFO    ((PCM_BASE | 0x7e000000) + 0x04)
+
+// Datasheet p. 51:
+#define DMA_NO_WIDE_BURSTS  (1<<26)
+#define DMA_WAIT_RESP   (1<<3)
+#define DMA_D_DREQ      (1<<6)
+#define DMA_PER_MAP(x)  ((x)<<16)
+#define DMA_END         (1<<1)
+#define DMA_RESET       (1<<31)
+#define DMA_INT         (1<<2)
+#define DMA_ACTIVE      (1<<0)
+
+// Each DMA channel has 3 writeable registers:
+#define DMA_CS          (0x00/4)
+#define DMA_CONBLK_AD   (0x04/4)
+#define DMA_NEXTCONBK   (0x1c/4)
+#define DMA_DEBUG       (0x20/4)
+
+// GPIO Memory Addresses
+#define GPIO_FSEL0      (0x00/4)
+#define GPIO_SET0       (0x1c/4)
+#define GPIO_CLR0       (0x28/4)
+#define GPIO_LEV0       (0x34/4)
+#define GPIO_PULLEN     (0x94/4)
+#define GPIO_PULLCLK    (0x98/4)
+
+// GPIO Modes (IN=0, OUT=1)
+#define GPIO_MODE_IN    0
+#define GPIO_MODE_OUT   1
+
+// PWM Memory Addresses
+#define PWM_CTL         (0x00/4)
+#define PWM_DMAC        (0x08/4)
+#define PWM_RNG1        (0x10/4)
+#define PWM_FIFO        (0x18/4)
+
+#define PWMCLK_CNTL     40
+#define PWMCLK_DIV      41
+
+#define PWMCTL_MODE1    (1<<1)
+#define PWMCTL_PWEN1    (1<<0)
+#define PWMCTL_CLRF     (1<<6)
+#define PWMCTL_USEF1    (1<<5)
+
+#define PWMDMAC_ENAB    (1<<31)
+#define PWMDMAC_THRSHLD ((15<<8) | (15<<0))
+
+#define PCM_CS_A        (0x00/4)
+#define PCM_FIFO_A      (0x04/4)
+#define PCM_MODE_A      (0x08/4)
+#define PCM_RXC_A       (0x0c/4)
+#define PCM_TXC_A       (0x10/4)
+#define PCM_DREQ_A      (0x14/4)
+#define PCM_INTEN_A     (0x18/4)
+#define PCM_INT_STC_A   (0x1c/4)
+#define PCM_GRAY        (0x20/4)
+
+#define PCMCLK_CNTL     38
+#define PCMCLK_DIV      39
+
+// Most periods of one delay control block (lite channels 7..14 transfer at
+// most 64KB per control block)
+#define DMA_DELAY_MAX   16383
+
+// DMA Control Block Data Structure (p40): 8 words (256 bits)
+typedef struct {
+    uint32_t info;   // TI: transfer information
+    uint32_t src;    // SOURCE_AD
+    uint32_t dst;    // DEST_AD
+    uint32_t length; // TXFR_LEN: transfer length
+    uint32_t stride; // 2D stride mode
+    uint32_t next;   // NEXTCONBK
+    uint32_t pad[2]; // _reserved_
+} dma_cb_t;
+
+// Memory mapping
+typedef struct {
+    uint8_t *virtaddr;
+    uint32_t physaddr;
+} page_map_t;
+
+// Locked, zeroed DMA memory of an engine (see dma_mem_alloc)
+struct dma_mem {
+    uint8_t *virtbase;
+    page_map_t *page_map;
+    uint32_t num_pages;
+};
+
+// Segments of control blocks which a channel outputs one after the other
+// (see RINGS in dma.c)
+#define DMA_RING_MAX    16
+
+struct dma_ring {
+    int channel;
+    const struct dma_mem *mem;
+    int segments;
+    dma_cb_t *first[DMA_RING_MAX];  // the marker of each segment
+    dma_cb_t *last[DMA_RING_MAX];   // ends the chain unless linked on
+    volatile uint32_t *status;      // sequence number of the segment being output
+    uint32_t *seq;                  // [segments] sequence number of each segment
+    uint32_t committed;             // sequence number of the last commit
+    int tail;                       // segment last committed (-1: none)
+};
+
+// Kinds of engines
+enum {
+    DMA_ENGINE_LED,
+    DMA_ENGINE_SHIFT,
+    DMA_ENGINE_STEPPER,
+};
+
+// What all engines have in common; the first member of each engine (see
+// ENGINES in dma.c)
+struct dma_engine {
+    pthread_mutex_t lock;
+    pthread_cond_t idle;        // on CLOCK_MONOTONIC (see dma_engine_wait)
+    int kind, channel, hw;
+    int size;                   // bytes per frame (LEDs, shift), axes (steppers)
+    int closing, waiters;       // callers which wait without the lock
+    uint32_t gpio_mask;
+    struct dma_mem mem;
+    struct dma_ring ring;
+};
+
+// GPIO write of a simulated DMA transfer (see dma_sim_record)
+struct dma_sim_event {
+    uint64_t time_ns;
+    uint32_t set_mask;
+    uint32_t clear_mask;
+};
+
+void *dma_map_peripheral(uint32_t base, uint32_t len);
+int dma_setup(void);
+
+int dma_mem_alloc(struct dma_mem *mem, int channel, size_t bytes);
+void dma_mem_free(struct dma_mem *mem);
+uint32_t dma_phys(const struct dma_mem *mem, const void *virt);
+
+volatile uint32_t *dma_claim(int channel, struct dma_mem *mem);
+void dma_release(int channel);
+int dma_claimed(int channel);
+void dma_start(int channel, uint32_t cb_phys);
+int dma_active(int channel);
+void dma_pause(int channel);
+void dma_reset(int channel);
+dma_cb_t *dma_position(int channel, const struct dma_mem *mem);
+void dma_shutdown(void);
+
+void dma_cb_copy(dma_cb_t *cb, uint32_t src, uint32_t dst, uint32_t length, uint32_t next);
+void dma_cb_delay(dma_cb_t *cb, int hw, uint32_t periods, uint32_t src, uint32_t next);
+
+void dma_ring_init(struct dma_ring *ring, int channel, const struct dma_mem *mem, int segments, uint32_t *words);
+dma_cb_t *dma_ring_marker(struct dma_ring *ring, int segment, dma_cb_t *cb);
+int dma_ring_done(const struct dma_ring *ring, int segment);
+int dma_ring_next(struct dma_ring *ring, int wait);
+void dma_ring_commit(struct dma_ring *ring, int segment);
+
+void dma_engine_init(struct dma_engine *e, int kind, int channel, int hw);
+void dma_engine_register(struct dma_engine *e);
+struct dma_engine *dma_engine_lock(int channel, int kind);
+int dma_engine_wait(struct dma_engine *e, int (*busy)(const struct dma_engine *), int timeout_ms);
+struct dma_engine *dma_engine_close(int channel, int kind, void (*wake)(struct dma_engine *));
+void dma_engine_release(struct dma_engine *e);
+int dma_engine_frames(int channel, int kind, uint32_t *frames);
+int dma_engine_size(int channel, int kind);
+
+void dma_bit_tables(uint32_t (*table)[256], const int *gpios, int count);
+
+void dma_pacer_program(int hw, uint32_t divisor, uint32_t range);
+int dma_pacer_acquire(int hw, uint32_t period_ns);
+void dma_pacer_release(int hw);
+int dma_pacer_reserve(int hw, uint32_t divisor, uint32_t range);
+uint32_t dma_pacer_period_ns(int hw);
+
+void dma_sim_record(int enabled);
+size_t dma_sim_events(const struct dma_sim_event **events);
+
+// Transposes the 8x8 bit matrix x (bit c of byte r is row r, column c), so
+// byte b holds bit b of the 8 input bytes (see dma_bit_tables)
+static inline uint64_t
+dma_transpose8(uint64_t x)
+{
+    uint64_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
+
+#endif
@@ -0,0 +1,296 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * led.c outputs frames to WS2812 (NeoPixel) and SK6812 LED strips, one strip
+ * per gpio, all strips of an engine in parallel with one DMA channel.
+ *
+ *
+ * WAVEFORM
+ * --------
+ * A bit takes three pacer periods (416ns each by default, 1.25us per bit):
+ * the DMA sets the gpios of all strips, clears those which send a 0 after
+ * one period (T0H 416ns) and all others after two (T1H 832ns). Per bit the
+ * chain has 6 control blocks: SET all, delay, CLR zeros, delay, CLR all,
+ * delay. The CLR zeros word of every bit is all that changes between frames.
+ * A frame ends with LED_RESET_US of low level, which latches it.
+ *
+ *
+ * FRAMES
+ * ------
+ * An engine has two frames (chains with their bit words) in a ring of two
+ * segments (see RINGS in dma.c). led_show() encodes into the frame which
+ * is not being output and commits it behind the current one, so frames
+ * always change at a frame boundary.
+ *
+ *
+ * ENCODING
+ * --------
+ * Pixels are given strip by strip in RGB (or RGBW) order and sent in the
+ * wire order of the strips (eg. GRB). For each byte, the bytes of 8 strips
+ * are transposed as an 8x8 bit matrix in a 64-bit word, so each of the
+ * resulting bytes holds one bit of all 8 strips, which a table maps to
+ * their gpios.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "pwm.h"
+#include "dma.h"
+#include "led.h"
+#include "systimer.h"
+#include "stats.h"
+
+#define LED_CBS_PER_BIT 6
+
+struct led_engine {
+    struct dma_engine base;
+    int strips, leds;
+    int bytes_per_led;          // 3 (RGB) or 4 (RGBW)
+    int wire[4];                // pixel byte of each wire byte
+    uint32_t gpio_mask;
+    uint32_t (*table)[256];     // [group of 8 strips][strip bits] -> gpio mask
+    uint32_t bits;              // per frame
+    uint32_t *all_mask;
+    uint32_t *words[2];         // the CLR zeros words of each frame
+};
+
+// Writes the CLR zeros words of a frame
+static void
+encode(const struct led_engine *e, const uint8_t *pixels, uint32_t *words)
+{
+    int i, k, g, j, b, groups = (e->strips + 7) / 8;
+    size_t stride = (size_t)e->leds * e->bytes_per_led;
+    uint32_t ones[8];
+    uint64_t x;
+    const uint8_t *p;
+
+    for (i = 0; i < e->leds; i++) {
+        for (k = 0; k < e->bytes_per_led; k++) {
+            p = pixels + (size_t)i * e->bytes_per_led + e->wire[k];
+            memset(ones, 0, sizeof(ones));
+            for (g = 0; g < groups; g++, p += 8 * stride) {
+                x = 0;
+                for (j = 0; j < 8 && g * 8 + j < e->strips; j++)
+                    x |= (uint64_t)p[j * stride] << (8 * j);
+                x = dma_transpose8(x);
+                for (b = 0; b < 8; b++)
+                    ones[b] |= e->table[g][(x >> (8 * b)) & 0xff];
+            }
+            // MSB first
+            for (b = 7; b >= 0; b--)
+                *words++ = e->base.gpio_mask & ~ones[b];
+        }
+    }
+}
+
+// Writes the chain of frame f
+static void
+build_frame(struct led_engine *e, int f, dma_cb_t *cb)
+{
+    uint32_t all = dma_phys(&e->base.mem, e->all_mask);
+    uint32_t b, reset = (LED_RESET_US * 1000 + dma_pacer_period_ns(e->base.hw) - 1) / dma_pacer_period_ns(e->base.hw);
+
+    if (reset > DMA_DELAY_MAX)
+        reset = DMA_DELAY_MAX;
+
+#define NEXT dma_phys(&e->base.mem, cb + 1)
+    cb = dma_ring_marker(&e->base.ring, f, cb);
+    for (b = 0; b < e->bits; b++) {
+        e->words[f][b] = e->base.gpio_mask;
+        dma_cb_copy(cb, all, BUS_GPSET0, 4, NEXT);
+        cb++;
+        dma_cb_delay(cb, e->base.hw, 1, all, NEXT);
+        cb++;
+        dma_cb_copy(cb, dma_phys(&e->base.mem, &e->words[f][b]), BUS_GPCLR0, 4, NEXT);
+        cb++;
+        dma_cb_delay(cb, e->base.hw, 1, all, NEXT);
+        cb++;
+        dma_cb_copy(cb, all, BUS_GPCLR0, 4, NEXT);
+        cb++;
+        dma_cb_delay(cb, e->base.hw, 1, all, NEXT);
+        cb++;
+    }
+#undef NEXT
+    dma_cb_delay(cb, e->base.hw, reset, all, 0);
+    e->base.ring.last[f] = cb;
+}
+
+// Sets up an engine on the DMA channel `channel` for `strips` strips of
+// `leds` LEDs each. `order` is the wire order of the bytes of a LED ("GRB"
+// for WS2812, "GRBW" for SK6812 RGBW), `hw` the pacer (DELAY_VIA_PWM or
+// DELAY_VIA_PCM) and period_ns a third of a bit.
+int
+led_open(int channel, const int *gpios, int strips, int leds, const char *order, int hw, uint32_t period_ns)
+{
+    struct led_engine *e;
+    uint32_t cbs, words;
+    size_t cb_bytes;
+    int s, k;
+    const char *c;
+
+    if (channel < 0 || channel > DMA_CHANNELS-1)
+        return pwm_fatal("Error: maximum channel is %d (requested channel %d)\n", DMA_CHANNELS-1, channel);
+    if (strips < 1 || strips > LED_STRIPS_MAX)
+        return pwm_fatal("Error: %d strips (1..%d are supported)\n", strips, LED_STRIPS_MAX);
+    if (leds < 1)
+        return pwm_fatal("Error: strips need at least one LED\n");
+    if (strlen(order) < 3 || strlen(order) > 4)
+        return pwm_fatal("Error: invalid LED byte order '%s'\n", order);
+    if (dma_setup() == EXIT_FAILURE)
+        return EXIT_FAILURE;
+
+    if ((e = calloc(1, sizeof(*e))) == NULL)
+        return pwm_fatal("Error: Failed to allocate LED engine: %m\n");
+    e->strips = strips;
+    e->leds = leds;
+    e->bytes_per_led = strlen(order);
+    for (k = 0; k < e->bytes_per_led; k++) {
+        c = strchr("RGBW", order[k]);
+        if (order[k] == 0 || c == NULL || c - "RGBW" >= e->bytes_per_led || memchr(order, order[k], k)) {
+            free(e);
+            return pwm_fatal("Error: invalid LED byte order '%s'\n", order);
+        }
+        e->wire[k] = c - "RGBW";
+    }
+    for (s = 0; s < strips; s++) {
+        if (gpios[s] < 0 || gpios[s] > 31 || (e->base.gpio_mask & (1 << gpios[s]))) {
+            free(e);
+            return pwm_fatal("Error: invalid or repeated gpio %d\n", gpios[s]);
+        }
+        e->base.gpio_mask |= 1 << gpios[s];
+    }
+
+    // Strip bits -> gpio mask, per group of 8 strips
+    e->table = calloc((strips + 7) / 8, sizeof(*e->table));
+    if (e->table == NULL) {
+        free(e);
+        return pwm_fatal("Error: Failed to allocate LED engine: %m\n");
+    }
+    dma_bit_tables(e->table, gpios, strips);
+
+    // Control blocks of both frames, then the words
+    e->bits = (uint32_t)leds * e->bytes_per_led * 8;
+    cbs = 2 + e->bits * LED_CBS_PER_BIT;
+    cb_bytes = (size_t)cbs * sizeof(dma_cb_t);
+    words = 4 + 2 * e->bits;    // all_mask, the ring's status and seq[2]
+    if (dma_pacer_acquire(hw, period_ns) == EXIT_FAILURE)
+        goto fail_pacer;
+    if (dma_mem_alloc(&e->base.mem, channel, 2 * cb_bytes + words * 4) == EXIT_FAILURE)
+        goto fail_mem;
+    e->all_mask = (uint32_t *)(e->base.mem.virtbase + 2 * cb_bytes);
+    e->words[0] = e->all_mask + 4;
+    e->words[1] = e->words[0] + e->bits;
+    *e->all_mask = e->base.gpio_mask;
+
+    if (dma_claim(channel, &e->base.mem) == NULL)
+        goto fail_claim;
+    for (s = 0; s < strips; s++) {
+        if (pwm_gpio_output(gpios[s]) == EXIT_FAILURE)
+            goto fail_gpio;
+    }
+    dma_engine_init(&e->base, DMA_ENGINE_LED, channel, hw);
+    e->base.size = strips * leds * e->bytes_per_led;
+    dma_ring_init(&e->base.ring, channel, &e->base.mem, 2, e->all_mask + 1);
+    build_frame(e, 0, (dma_cb_t *)e->base.mem.virtbase);
+    build_frame(e, 1, (dma_cb_t *)(e->base.mem.virtbase + cb_bytes));
+    dma_engine_register(&e->base);
+    return EXIT_SUCCESS;
+
+fail_gpio:
+    dma_release(channel);
+fail_claim:
+    dma_mem_free(&e->base.mem);
+fail_mem:
+    dma_pacer_release(hw);
+fail_pacer:
+    free(e->table);
+    free(e);
+    return EXIT_FAILURE;
+}
+
+// Stops the output of an engine, sets its gpios low and frees it
+int
+led_close(int channel)
+{
+    struct led_engine *e;
+
+    if ((e = (struct led_engine *)dma_engine_close(channel, DMA_ENGINE_LED, NULL)) == NULL)
+        return EXIT_FAILURE;
+    dma_engine_release(&e->base);
+    free(e->table);
+    free(e);
+    return EXIT_SUCCESS;
+}
+
+// Encodes a frame and outputs it after the current one. `pixels` holds
+// led_frame_bytes(), the LEDs of the first strip, then those of the next,
+// each LED in RGB (RGBW) order. Waits until the frame before the current
+// one was output.
+int
+led_show(int channel, const uint8_t *pixels)
+{
+    struct led_engine *e;
+    int f;
+
+    if ((e = (struct led_engine *)dma_engine_lock(channel, DMA_ENGINE_LED)) == NULL)
+        return EXIT_FAILURE;
+
+    f = dma_ring_next(&e->base.ring, 1);
+
+    STATS_TIMER(t0);
+    encode(e, pixels, e->words[f]);
+    STATS_RECORD(STAT_LED_ENCODE, t0);
+
+    dma_ring_commit(&e->base.ring, f);
+    pthread_mutex_unlock(&e->base.lock);
+    return EXIT_SUCCESS;
+}
+
+// Waits up to timeout_ms (forever if negative) until all committed frames
+// were output. Returns 1 if they were, 0 on timeout, -1 on errors.
+int
+led_wait(int channel, int timeout_ms)
+{
+    struct dma_engine *e;
+
+    if ((e = dma_engine_lock(channel, DMA_ENGINE_LED)) == NULL)
+        return -1;
+    return dma_engine_wait(e, NULL, timeout_ms);
+}
+
+// Number of frames the DMA has started
+int
+led_frames(int channel, uint32_t *frames)
+{
+    return dma_engine_frames(channel, DMA_ENGINE_LED, frames);
+}
+
+// Size of the pixels of a frame (0 if there is no engine on the channel)
+int
+led_frame_bytes(int channel)
+{
+    return dma_engine_size(channel, DMA_ENGINE_LED);
+}
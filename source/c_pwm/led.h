@@ -0,0 +1,47 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * led.c drives WS2812 (NeoPixel) and SK6812 LED strips on up to 32 gpios in
+ * parallel with one DMA channel. The DMA writes every bit of all strips at
+ * once: it sets all gpios, clears those of the strips which send a 0 one
+ * period later, and the others after the second period (see led.c).
+ */
+#ifndef RPIO_LED_H
+#define RPIO_LED_H
+
+#include <stdint.h>
+
+#define LED_STRIPS_MAX  32
+#define LED_PERIOD_NS   416     // a third of a bit at 800kHz
+#define LED_RESET_US    300     // low time which latches a frame (WS2812B: 280us)
+
+int led_open(int channel, const int *gpios, int strips, int leds, const char *order, int hw, uint32_t period_ns);
+int led_close(int channel);
+int led_show(int channel, const uint8_t *pixels);
+int led_wait(int channel, int timeout_ms);
+int led_frames(int channel, uint32_t *frames);
+int led_frame_bytes(int channel);
+
+#endif
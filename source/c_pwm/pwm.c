@@ -60,6 +60,22 @@
  * To achieve shorter pulses than 10s, you simply need set a lower granularity.
  *
  *
+ * THREADS
+ * -------
+ * Each DMA channel has its own lock, so threads can edit different channels
+ * in parallel (the Python wrapper releases the GIL for all channel calls).
+ * The bookkeeping of set up gpios is atomic, and error messages are kept per
+ * thread (get_error_message() returns the calling thread's last error).
+ *
+ *
+ * SIMULATION
+ * ----------
+ * With RPIO_SIMULATE=1 the peripherals and the DMA memory are plain process
+ * memory, physical addresses are made up and the clock is virtual. Nothing is
+ * output, but all channel bookkeeping runs (eg. for tests and benchmarks
+ * without a Raspberry Pi).
+ *
+ *
  * WARNING
  * -------
  * pwm.c is in beta and currently not yet fully tested. Setting very long or very short
@@ -84,100 +100,12 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <pthread.h>
 #include "pwm.h"
-
-// 15 DMA channels are usable on the RPi (0..14)
-#define DMA_CHANNELS    15
-
-// Standard page sizes
-#define PAGE_SIZE       4096
-#define PAGE_SHIFT      12
-
-// Memory Addresses
-#define DMA_BASE        0x20007000
-#define DMA_CHANNEL_INC 0x100
-#define DMA_LEN         0x24
-#define PWM_BASE        0x2020C000
-#define PWM_LEN         0x28
-#define CLK_BASE        0x20101000
-#define CLK_LEN         0xA8
-#define GPIO_BASE       0x20200000
-#define GPIO_LEN        0x100
-#define PCM_BASE        0x20203000
-#define PCM_LEN         0x24
-
-// Datasheet p. 51:
-#define DMA_NO_WIDE_BURSTS  (1<<26)
-#define DMA_WAIT_RESP   (1<<3)
-#define DMA_D_DREQ      (1<<6)
-#define DMA_PER_MAP(x)  ((x)<<16)
-#define DMA_END         (1<<1)
-#define DMA_RESET       (1<<31)
-#define DMA_INT         (1<<2)
-
-// Each DMA channel has 3 writeable registers:
-#define DMA_CS          (0x00/4)
-#define DMA_CONBLK_AD   (0x04/4)
-#define DMA_DEBUG       (0x20/4)
-
-// GPIO Memory Addresses
-#define GPIO_FSEL0      (0x00/4)
-#define GPIO_SET0       (0x1c/4)
-#define GPIO_CLR0       (0x28/4)
-#define GPIO_LEV0       (0x34/4)
-#define GPIO_PULLEN     (0x94/4)
-#define GPIO_PULLCLK    (0x98/4)
-
-// GPIO Modes (IN=0, OUT=1)
-#define GPIO_MODE_IN    0
-#define GPIO_MODE_OUT   1
-
-// PWM Memory Addresses
-#define PWM_CTL         (0x00/4)
-#define PWM_DMAC        (0x08/4)
-#define PWM_RNG1        (0x10/4)
-#define PWM_FIFO        (0x18/4)
-
-#define PWMCLK_CNTL     40
-#define PWMCLK_DIV      41
-
-#define PWMCTL_MODE1    (1<<1)
-#define PWMCTL_PWEN1    (1<<0)
-#define PWMCTL_CLRF     (1<<6)
-#define PWMCTL_USEF1    (1<<5)
-
-#define PWMDMAC_ENAB    (1<<31)
-#define PWMDMAC_THRSHLD ((15<<8) | (15<<0))
-
-#define PCM_CS_A        (0x00/4)
-#define PCM_FIFO_A      (0x04/4)
-#define PCM_MODE_A      (0x08/4)
-#define PCM_RXC_A       (0x0c/4)
-#define PCM_TXC_A       (0x10/4)
-#define PCM_DREQ_A      (0x14/4)
-#define PCM_INTEN_A     (0x18/4)
-#define PCM_INT_STC_A   (0x1c/4)
-#define PCM_GRAY        (0x20/4)
-
-#define PCMCLK_CNTL     38
-#define PCMCLK_DIV      39
-
-// DMA Control Block Data Structure (p40): 8 words (256 bits)
-typedef struct {
-    uint32_t info;   // TI: transfer information
-    uint32_t src;    // SOURCE_AD
-    uint32_t dst;    // DEST_AD
-    uint32_t length; // TXFR_LEN: transfer length
-    uint32_t stride; // 2D stride mode
-    uint32_t next;   // NEXTCONBK
-    uint32_t pad[2]; // _reserved_
-} dma_cb_t;
-
-// Memory mapping
-typedef struct {
-    uint8_t *virtaddr;
-    uint32_t physaddr;
-} page_map_t;
+#include "dma.h"
+#include "systimer.h"
+#include "stats.h"
+#include "trace.h"
 
 // Main control structure per channel
 struct channel {
@@ -187,6 +115,12 @@ struct channel {
     page_map_t *page_map;
     volatile uint32_t *dma_reg;
 
+    // Second copy of the samples and control blocks, allocated by the first
+    // set_channel_pulses(..), which builds the next subcycle there and swaps
+    // the banks. bank is the one the DMA runs (0: virtbase, 1: spare).
+    struct dma_mem spare;
+    int bank;
+
     // Set by user
     uint32_t subcycle_time_us;
 
@@ -205,12 +139,17 @@ static struct channel channels[DMA_CHANNELS];
 // Pulse width increment granularity
 static uint16_t pulse_width_incr_us = -1;
 static uint8_t _is_setup = 0;
-static int gpio_setup = 0; // bitfield for setup gpios (setup = out/low)
+static int gpio_setup = 0; // bitfield for setup gpios (setup = out/low), accessed atomically
+
+// One lock per channel (guards the channel struct and its DMA memory), one for
+// gpio function select changes and one for pwm_setup(..)
+static pthread_mutex_t channel_locks[DMA_CHANNELS] = {
+    [0 ... DMA_CHANNELS-1] = PTHREAD_MUTEX_INITIALIZER
+};
+static pthread_mutex_t gpio_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t setup_lock = PTHREAD_MUTEX_INITIALIZER;
 
-// Common registers
-static volatile uint32_t *pwm_reg;
-static volatile uint32_t *pcm_reg;
-static volatile uint32_t *clk_reg;
+// GPIO registers (DMA, PWM, PCM and clock registers are in dma.c)
 static volatile uint32_t *gpio_reg;
 
 // Defaults
@@ -222,8 +161,11 @@ static int log_level = LOG_LEVEL_DEFAULT;
 // python wrapper, in order to convert calls to fatal(..) to exceptions.
 static int soft_fatal = 0;
 
-// cache for a error message
-static char error_message[256];
+// Simulated backend (see SIMULATION above)
+static int simulated = 0;
+
+// cache for a error message (per thread)
+static __thread char error_message[256];
 
 // Debug logging
 void
@@ -265,47 +207,85 @@ gpio_set(int pin, int level)
         gpio_reg[GPIO_CLR0] = 1 << pin;
 }
 
-// Set GPIO to OUTPUT, Low
+static int
+is_gpio_setup(int gpio)
+{
+    return __atomic_load_n(&gpio_setup, __ATOMIC_ACQUIRE) & (1 << gpio);
+}
+
+// Set GPIO to OUTPUT, Low (once; function select is shared by all channels)
 static void
 init_gpio(int gpio)
 {
-    log_debug("init_gpio %d\n", gpio);
-    gpio_set(gpio, 0);
-    gpio_set_mode(gpio, GPIO_MODE_OUT);
-    gpio_setup |= 1 << gpio;
+    pthread_mutex_lock(&gpio_lock);
+    if (!is_gpio_setup(gpio)) {
+        log_debug("init_gpio %d\n", gpio);
+        gpio_set(gpio, 0);
+        gpio_set_mode(gpio, GPIO_MODE_OUT);
+        __atomic_fetch_or(&gpio_setup, 1 << gpio, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&gpio_lock);
+}
+
+// Sets a gpio of a DMA engine (see dma.c) to output, low
+int
+pwm_gpio_output(int gpio)
+{
+    if (gpio_reg == NULL) {
+        pthread_mutex_lock(&gpio_lock);
+        if (gpio_reg == NULL)
+            gpio_reg = dma_map_peripheral(GPIO_BASE, GPIO_LEN);
+        pthread_mutex_unlock(&gpio_lock);
+        if (gpio_reg == NULL)
+            return EXIT_FAILURE;
+    }
+    init_gpio(gpio);
+    return EXIT_SUCCESS;
+}
+
+// Sets the gpios of `mask` (which are set up) to low
+void
+pwm_gpio_clear(uint32_t mask)
+{
+    if (gpio_reg)
+        gpio_reg[GPIO_CLR0] = mask;
 }
 
-// Very short delay as demanded per datasheet
+// Very short delay as demanded per datasheet. Short delays spin on the
+// system timer, longer ones (eg. a full subcycle) sleep first.
 static void
 udelay(int us)
 {
-    struct timespec ts = { 0, us * 1000 };
-
-    nanosleep(&ts, NULL);
+    sleep_us(us);
 }
 
-// Shutdown -- its important to reset the DMA before quitting
+static int _clear_channel(int channel);
+static void init_bank(int channel, int bank);
+
+// Shutdown -- its important to reset the DMA before quitting. Does not take
+// the channel locks, since it also runs from signal handlers.
 void
-shutdown(void)
+pwm_shutdown(void)
 {
     int i;
 
     for (i = 0; i < DMA_CHANNELS; i++) {
         if (channels[i].dma_reg && channels[i].virtbase) {
             log_debug("shutting down dma channel %d\n", i);
-            clear_channel(i);
+            _clear_channel(i);
             udelay(channels[i].subcycle_time_us);
             channels[i].dma_reg[DMA_CS] = DMA_RESET;
             udelay(10);
         }
     }
+    dma_shutdown();
 }
 
 // Terminate is triggered by signals
 static void
 terminate(void)
 {
-    shutdown();
+    pwm_shutdown();
     if (soft_fatal) {
         return;
     }
@@ -314,26 +294,30 @@ terminate(void)
 
 // Shutdown with an error message. Returns EXIT_FAILURE for convenience.
 // if soft_fatal is set to 1, a call to `fatal(..)` will not shut down
-// PWM/DMA activity (used in the Python wrapper).
-static int
-fatal(char *fmt, ...)
+// PWM/DMA activity (used in the Python wrapper). Also used by the DMA
+// engines (see dma.c).
+int
+pwm_fatal(const char *fmt, ...)
 {
     va_list ap;
 
-    // Handle error
     va_start(ap, fmt);
+    // Handle error
     if (soft_fatal) {
-        vsprintf (error_message, fmt, ap);
+        vsnprintf(error_message, sizeof(error_message), fmt, ap);
+        va_end(ap);
         return EXIT_FAILURE;
     }
     vfprintf(stderr, fmt, ap);
     va_end(ap);
 
     // Shutdown all DMA and PWM activity
-    shutdown();
+    pwm_shutdown();
     exit(EXIT_FAILURE);
 }
 
+#define fatal(...) pwm_fatal(__VA_ARGS__)
+
 // Catch all signals possible - it is vital we kill the DMA engine
 // on process exit!
 static void
@@ -361,6 +345,13 @@ setup_sighandlers(void)
     }
 }
 
+// Catches the signals for DMA engines which run without pwm_setup(..)
+void
+pwm_catch_signals(void)
+{
+    setup_sighandlers();
+}
+
 // Memory mapping
 static uint32_t
 mem_virt_to_phys(int channel, void *virt)
@@ -369,46 +360,77 @@ mem_virt_to_phys(int channel, void *virt)
     return channels[channel].page_map[offset >> PAGE_SHIFT].physaddr + (offset % PAGE_SIZE);
 }
 
-// Peripherals memory mapping
-static void *
-map_peripheral(uint32_t base, uint32_t len)
+static uint8_t *
+bank_base(int channel, int bank)
 {
-    int fd = open("/dev/mem", O_RDWR);
-    void * vaddr;
+    return bank ? channels[channel].spare.virtbase : channels[channel].virtbase;
+}
 
-    if (fd < 0) {
-        fatal("rpio-pwm: Failed to open /dev/mem: %m\n");
-        return NULL;
-    }
-    vaddr = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, base);
-    if (vaddr == MAP_FAILED) {
-        fatal("rpio-pwm: Failed to map peripheral at 0x%08x: %m\n", base);
-        return NULL;
-    }
-    close(fd);
+static uint32_t
+bank_phys(int channel, int bank, void *virt)
+{
+    return bank ? dma_phys(&channels[channel].spare, virt) : mem_virt_to_phys(channel, virt);
+}
 
-    return vaddr;
+// Returns 1 if the bus address `phys` lies in a bank of this channel
+static int
+bank_has_phys(int channel, int bank, uint32_t phys)
+{
+    page_map_t *map = bank ? channels[channel].spare.page_map : channels[channel].page_map;
+    uint32_t i;
+
+    for (i = 0; i < channels[channel].num_pages; i++) {
+        if ((phys & ~(PAGE_SIZE - 1)) == map[i].physaddr)
+            return 1;
+    }
+    return 0;
 }
 
 // Returns a pointer to the control block of this channel in DMA memory
 uint8_t*
 get_cb(int channel)
 {
-    return channels[channel].virtbase + (sizeof(uint32_t) * channels[channel].num_samples);
+    return bank_base(channel, channels[channel].bank) + (sizeof(uint32_t) * channels[channel].num_samples);
+}
+
+// Returns the samples (gpio masks) of this channel in DMA memory
+static uint32_t *
+get_samples(int channel)
+{
+    return (uint32_t *) bank_base(channel, channels[channel].bank);
+}
+
+// Checks the channel number, and returns with the channel locked
+static int
+lock_channel(int channel)
+{
+    if (channel < 0 || channel > DMA_CHANNELS-1)
+        return fatal("Error: maximum channel is %d (requested channel %d)\n", DMA_CHANNELS-1, channel);
+    pthread_mutex_lock(&channel_locks[channel]);
+    return EXIT_SUCCESS;
+}
+
+static int
+unlock_channel(int channel, int result)
+{
+    pthread_mutex_unlock(&channel_locks[channel]);
+    return result;
 }
 
 // Reset this channel to original state (all samples=0, all cbs=clr0)
-int
-clear_channel(int channel)
+static int
+_clear_channel(int channel)
 {
     int i;
     uint32_t phys_gpclr0 = 0x7e200000 + 0x28;
-    dma_cb_t *cbp = (dma_cb_t *) get_cb(channel);
-    uint32_t *dp = (uint32_t *) channels[channel].virtbase;
+    dma_cb_t *cbp;
+    uint32_t *dp;
 
     log_debug("clear_channel: channel=%d\n", channel);
     if (!channels[channel].virtbase)
         return fatal("Error: channel %d has not been initialized with 'init_channel(..)'\n", channel);
+    cbp = (dma_cb_t *) get_cb(channel);
+    dp = get_samples(channel);
 
     // First we have to stop all currently enabled pulses
     for (i = 0; i < channels[channel].num_samples; i++) {
@@ -428,18 +450,35 @@ clear_channel(int channel)
 }
 
 
-// Clears all pulses for a specific gpio on this channel. Also sets the GPIO to Low.
 int
-clear_channel_gpio(int channel, int gpio)
+clear_channel(int channel)
+{
+    int result;
+    STATS_TIMER(t0);
+
+    if (lock_channel(channel) == EXIT_FAILURE)
+        return EXIT_FAILURE;
+    result = unlock_channel(channel, _clear_channel(channel));
+    STATS_RECORD(STAT_CLEAR_CHANNEL, t0);
+    if (result == EXIT_SUCCESS)
+        TRACE(TRACE_PWM_CLEAR_CHANNEL, channel, 0, 0, 0);
+    return result;
+}
+
+
+// Clears all pulses for a specific gpio on this channel. Also sets the GPIO to Low.
+static int
+_clear_channel_gpio(int channel, int gpio)
 {
     int i;
-    uint32_t *dp = (uint32_t *) channels[channel].virtbase;
+    uint32_t *dp;
 
     log_debug("clear_channel_gpio: channel=%d, gpio=%d\n", channel, gpio);
     if (!channels[channel].virtbase)
         return fatal("Error: channel %d has not been initialized with 'init_channel(..)'\n", channel);
-    if ((gpio_setup & 1<<gpio) == 0)
+    if (gpio < 0 || gpio > 31 || !is_gpio_setup(gpio))
         return fatal("Error: cannot clear gpio %d; not yet been set up\n", gpio);
+    dp = get_samples(channel);
 
     // Remove this gpio from all samples:
     for (i = 0; i < channels[channel].num_samples; i++) {
@@ -453,6 +492,21 @@ clear_channel_gpio(int channel, int gpio)
     return EXIT_SUCCESS;
 }
 
+int
+clear_channel_gpio(int channel, int gpio)
+{
+    int result;
+    STATS_TIMER(t0);
+
+    if (lock_channel(channel) == EXIT_FAILURE)
+        return EXIT_FAILURE;
+    result = unlock_channel(channel, _clear_channel_gpio(channel, gpio));
+    STATS_RECORD(STAT_CLEAR_CHANNEL_GPIO, t0);
+    if (result == EXIT_SUCCESS)
+        TRACE(TRACE_PWM_CLEAR_GPIO, channel, gpio, 0, 0);
+    return result;
+}
+
 
 // Update the channel with another pulse within one full cycle. Its possible to
 // add more gpios to the same timeslots (width_start). width_start and width are
@@ -462,41 +516,177 @@ clear_channel_gpio(int channel, int gpio)
 // point in time, only the last added action (eg. set-to-low) will be executed on all pins.
 // To create these kinds of inverted signals on two GPIOs, either offset them by 1 step, or
 // use multiple DMA channels.
-int
-add_channel_pulse(int channel, int gpio, int width_start, int width)
+static int
+check_pulse(int channel, int gpio, int width_start, int width)
 {
-    int i;
-    uint32_t phys_gpclr0 = 0x7e200000 + 0x28;
-    uint32_t phys_gpset0 = 0x7e200000 + 0x1c;
-    dma_cb_t *cbp = (dma_cb_t *) get_cb(channel) + (width_start * 2);
-    uint32_t *dp = (uint32_t *) channels[channel].virtbase;
-
-    log_debug("add_channel_pulse: channel=%d, gpio=%d, start=%d, width=%d\n", channel, gpio, width_start, width);
     if (!channels[channel].virtbase)
         return fatal("Error: channel %d has not been initialized with 'init_channel(..)'\n", channel);
     if (width_start + width > channels[channel].width_max + 1 || width_start < 0)
         return fatal("Error: cannot add pulse to channel %d: width_start+width exceed max_width of %d\n", channel, channels[channel].width_max);
+    if (gpio < 0 || gpio > 31)
+        return fatal("Error: gpio %d cannot be used for pwm (max gpio is 31)\n", gpio);
+    return EXIT_SUCCESS;
+}
 
-    if ((gpio_setup & 1<<gpio) == 0)
-        init_gpio(gpio);
+// Step from the destination of one sample's control block to the next
+#define CB_DST_STEP (2 * sizeof(dma_cb_t) / sizeof(uint32_t))
+
+// Writes a pulse into the samples `dp` (of a subcycle of `n`) and the
+// control block destinations `dst` (the one of sample i is
+// dst[i * CB_DST_STEP])
+static void
+put_pulse(uint32_t *dp, uint32_t *dst, uint32_t n, int gpio, int width_start, int width)
+{
+    uint32_t phys_gpclr0 = 0x7e200000 + 0x28;
+    uint32_t phys_gpset0 = 0x7e200000 + 0x1c;
+    int i, cb = width_start;
 
     // enable or disable gpio at this point in the cycle
     *(dp + width_start) |= 1 << gpio;
-    cbp->dst = phys_gpset0;
+    dst[cb * CB_DST_STEP] = phys_gpset0;
 
     // Do nothing for the specified width
     for (i = 1; i < width - 1; i++) {
         *(dp + width_start + i) &= ~(1 << gpio);  // set just this gpio's bit to 0
-        cbp += 2;
+        cb++;
     }
 
-    // Clear GPIO at end
-    *(dp + width_start + width) |= 1 << gpio;
-    cbp->dst = phys_gpclr0;
+    // Clear GPIO at end (a pulse up to the end of the subcycle has no sample
+    // for it, the control blocks follow the samples)
+    if (width_start + width < (int) n)
+        *(dp + width_start + width) |= 1 << gpio;
+    dst[cb * CB_DST_STEP] = phys_gpclr0;
+}
+
+static int
+_add_channel_pulse(int channel, int gpio, int width_start, int width)
+{
+    dma_cb_t *cbp;
+
+    log_debug("add_channel_pulse: channel=%d, gpio=%d, start=%d, width=%d\n", channel, gpio, width_start, width);
+    if (check_pulse(channel, gpio, width_start, width) == EXIT_FAILURE)
+        return EXIT_FAILURE;
+
+    if (!is_gpio_setup(gpio))
+        init_gpio(gpio);
+
+    cbp = (dma_cb_t *) get_cb(channel);
+    put_pulse(get_samples(channel), &cbp->dst, channels[channel].num_samples, gpio, width_start, width);
     return EXIT_SUCCESS;
 }
 
+int
+add_channel_pulse(int channel, int gpio, int width_start, int width)
+{
+    int result;
+    STATS_TIMER(t0);
+
+    if (lock_channel(channel) == EXIT_FAILURE)
+        return EXIT_FAILURE;
+    result = unlock_channel(channel, _add_channel_pulse(channel, gpio, width_start, width));
+    STATS_RECORD(STAT_ADD_CHANNEL_PULSE, t0);
+    if (result == EXIT_SUCCESS)
+        TRACE(TRACE_PWM_ADD_PULSE, channel, gpio, width_start, width);
+    return result;
+}
+
+// Replaces all pulses of a gpio on this channel by one pulse of `width`
+// from the start of the subcycle (width 0 just clears the gpio), under one
+// lock of the channel
+int
+set_channel_gpio_width(int channel, int gpio, int width)
+{
+    int result = EXIT_SUCCESS;
+
+    if (lock_channel(channel) == EXIT_FAILURE)
+        return EXIT_FAILURE;
+    if (gpio >= 0 && gpio <= 31 && is_gpio_setup(gpio))
+        result = _clear_channel_gpio(channel, gpio);
+    if (result == EXIT_SUCCESS && width > 0)
+        result = _add_channel_pulse(channel, gpio, 0, width);
+    unlock_channel(channel, result);
+    if (result == EXIT_SUCCESS)
+        TRACE(TRACE_PWM_ADD_PULSE, channel, gpio, 0, width);
+    return result;
+}
+
+
+
+// Replaces the pulses of the gpios in `mask` on this channel by `pulses`
+// (gpios of the pulses which are not in `mask` keep their other pulses) in
+// one step: the new subcycle is built in the spare bank, which the running
+// bank then links to, so the DMA switches over at the end of a subcycle.
+// Unlike clear_channel_gpio + add_channel_pulse, no subcycle is output with
+// these gpios cleared in between. Waits for the switch (one or two
+// subcycles); if the DMA does not switch, nothing is changed and it fails.
+// Gpios of `mask` without a new pulse are set to low.
+int
+set_channel_pulses(int channel, uint32_t mask, const struct pwm_pulse *pulses, int count)
+{
+    uint32_t *dp, *next_dp, n, left = mask;
+    dma_cb_t *cbp, *next_cbp;
+    int i, next, switched, waited = 0, result = EXIT_SUCCESS;
+
+    if (lock_channel(channel) == EXIT_FAILURE)
+        return EXIT_FAILURE;
+    if (!channels[channel].virtbase)
+        return unlock_channel(channel, fatal("Error: channel %d has not been initialized with 'init_channel(..)'\n", channel));
+    for (i = 0; i < count && result == EXIT_SUCCESS; i++)
+        result = check_pulse(channel, pulses[i].gpio, pulses[i].width_start, pulses[i].width);
+    if (result == EXIT_FAILURE)
+        return unlock_channel(channel, EXIT_FAILURE);
+    if (!channels[channel].spare.virtbase) {
+        if (dma_mem_alloc(&channels[channel].spare, channel, channels[channel].num_pages * PAGE_SIZE) == EXIT_FAILURE)
+            return unlock_channel(channel, EXIT_FAILURE);
+        init_bank(channel, 1);
+    }
+
+    // Build the next subcycle from the running one in the other bank
+    n = channels[channel].num_samples;
+    next = !channels[channel].bank;
+    dp = get_samples(channel);
+    cbp = (dma_cb_t *) get_cb(channel);
+    next_dp = (uint32_t *) bank_base(channel, next);
+    next_cbp = (dma_cb_t *) (bank_base(channel, next) + sizeof(uint32_t) * n);
+    for (i = 0; i < (int) n; i++) {
+        next_dp[i] = dp[i] & ~mask;
+        next_cbp[2 * i].dst = cbp[2 * i].dst;
+    }
+    for (i = 0; i < count; i++) {
+        if (!is_gpio_setup(pulses[i].gpio))
+            init_gpio(pulses[i].gpio);
+        put_pulse(next_dp, &next_cbp->dst, n, pulses[i].gpio, pulses[i].width_start, pulses[i].width);
+        left &= ~(1 << pulses[i].gpio);
+    }
+
+    // Link the end of the running subcycle to the new one. If the DMA had
+    // loaded the last control block already, it runs the old one once more.
+    __sync_synchronize();
+    cbp[2 * n - 1].next = bank_phys(channel, next, next_cbp);
+    __sync_synchronize();
+    do {
+        udelay(channels[channel].subcycle_time_us);
+        switched = simulated || bank_has_phys(channel, next, channels[channel].dma_reg[DMA_CONBLK_AD]);
+    } while (!switched && ++waited < 3);
+    cbp[2 * n - 1].next = bank_phys(channel, channels[channel].bank, cbp);
+    if (!switched) {
+        // The DMA may have loaded the link before it was restored
+        __sync_synchronize();
+        udelay(channels[channel].subcycle_time_us);
+        switched = bank_has_phys(channel, next, channels[channel].dma_reg[DMA_CONBLK_AD]);
+    }
+    if (!switched)
+        return unlock_channel(channel, fatal("Error: the DMA of channel %d did not switch to the new pulses\n", channel));
+    channels[channel].bank = next;
 
+    for (i = 0; i < 32; i++) {
+        if ((left & (1 << i)) && is_gpio_setup(i))
+            gpio_set(i, 0);
+    }
+    unlock_channel(channel, EXIT_SUCCESS);
+    TRACE(TRACE_PWM_SET_PULSES, channel, mask, count, 0);
+    return EXIT_SUCCESS;
+}
 
 // Get a channel's pagemap
 static int
@@ -509,6 +699,14 @@ make_pagemap(int channel)
 
     if (channels[channel].page_map == 0)
         return fatal("rpio-pwm: Failed to malloc page_map: %m\n");
+    if (simulated) {
+        // Contiguous bus addresses, one 64MB window per channel
+        for (i = 0; i < channels[channel].num_pages; i++) {
+            channels[channel].page_map[i].virtaddr = channels[channel].virtbase + i * PAGE_SIZE;
+            channels[channel].page_map[i].physaddr = 0x40000000 | (channel << 26) | (i << PAGE_SHIFT);
+        }
+        return EXIT_SUCCESS;
+    }
     memfd = open("/dev/mem", O_RDWR);
     if (memfd < 0)
         return fatal("rpio-pwm: Failed to open /dev/mem: %m\n");
@@ -540,8 +738,12 @@ make_pagemap(int channel)
 static int
 init_virtbase(int channel)
 {
+    int flags = MAP_SHARED|MAP_ANONYMOUS|MAP_NORESERVE|MAP_LOCKED;
+
+    if (simulated)
+        flags &= ~MAP_LOCKED;
     channels[channel].virtbase = mmap(NULL, channels[channel].num_pages * PAGE_SIZE, PROT_READ|PROT_WRITE,
-            MAP_SHARED|MAP_ANONYMOUS|MAP_NORESERVE|MAP_LOCKED, -1, 0);
+            flags, -1, 0);
     if (channels[channel].virtbase == MAP_FAILED)
         return fatal("rpio-pwm: Failed to mmap physical pages: %m\n");
     if ((unsigned long)channels[channel].virtbase & (PAGE_SIZE-1))
@@ -549,39 +751,36 @@ init_virtbase(int channel)
     return EXIT_SUCCESS;
 }
 
-// Initialize control block for this channel
-static int
-init_ctrl_data(int channel)
+// Builds the samples and control blocks of a bank of this channel
+static void
+init_bank(int channel, int bank)
 {
-    dma_cb_t *cbp = (dma_cb_t *) get_cb(channel);
-    uint32_t *sample = (uint32_t *) channels[channel].virtbase;
+    uint32_t *sample = (uint32_t *) bank_base(channel, bank);
+    dma_cb_t *first = (dma_cb_t *) (sample + channels[channel].num_samples);
+    dma_cb_t *cbp = first;
 
     uint32_t phys_fifo_addr;
     uint32_t phys_gpclr0 = 0x7e200000 + 0x28;
     int i;
 
-    channels[channel].dma_reg = map_peripheral(DMA_BASE, DMA_LEN) + (DMA_CHANNEL_INC * channel);
-    if (channels[channel].dma_reg == NULL)
-        return EXIT_FAILURE;
-
     if (delay_hw == DELAY_VIA_PWM)
         phys_fifo_addr = (PWM_BASE | 0x7e000000) + 0x18;
     else
         phys_fifo_addr = (PCM_BASE | 0x7e000000) + 0x04;
 
     // Reset complete per-sample gpio mask to 0
-    memset(sample, 0, sizeof(channels[channel].num_samples * sizeof(uint32_t)));
+    memset(sample, 0, channels[channel].num_samples * sizeof(uint32_t));
 
     // For each sample we add 2 control blocks:
     // - first: clear gpio and jump to second
     // - second: jump to next CB
     for (i = 0; i < channels[channel].num_samples; i++) {
         cbp->info = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP;
-        cbp->src = mem_virt_to_phys(channel, sample + i);  // src contains mask of which gpios need change at this sample
+        cbp->src = bank_phys(channel, bank, sample + i);  // src contains mask of which gpios need change at this sample
         cbp->dst = phys_gpclr0;  // set each sample to clear set gpios by default
         cbp->length = 4;
         cbp->stride = 0;
-        cbp->next = mem_virt_to_phys(channel, cbp + 1);
+        cbp->next = bank_phys(channel, bank, cbp + 1);
         cbp++;
 
         // Delay
@@ -589,17 +788,28 @@ init_ctrl_data(int channel)
             cbp->info = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP | DMA_D_DREQ | DMA_PER_MAP(5);
         else
             cbp->info = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP | DMA_D_DREQ | DMA_PER_MAP(2);
-        cbp->src = mem_virt_to_phys(channel, sample); // Any data will do
+        cbp->src = bank_phys(channel, bank, sample); // Any data will do
         cbp->dst = phys_fifo_addr;
         cbp->length = 4;
         cbp->stride = 0;
-        cbp->next = mem_virt_to_phys(channel, cbp + 1);
+        cbp->next = bank_phys(channel, bank, cbp + 1);
         cbp++;
     }
 
     // The last control block links back to the first (= endless loop)
     cbp--;
-    cbp->next = mem_virt_to_phys(channel, get_cb(channel));
+    cbp->next = bank_phys(channel, bank, first);
+}
+
+// Initialize control block for this channel
+static int
+init_ctrl_data(int channel)
+{
+    channels[channel].dma_reg = dma_map_peripheral(DMA_BASE, DMA_LEN) + (DMA_CHANNEL_INC * channel);
+    if (channels[channel].dma_reg == NULL)
+        return EXIT_FAILURE;
+    channels[channel].bank = 0;
+    init_bank(channel, 0);
 
     // Initialize the DMA channel 0 (p46, 47)
     channels[channel].dma_reg[DMA_CS] = DMA_RESET; // DMA channel reset
@@ -608,64 +818,19 @@ init_ctrl_data(int channel)
     channels[channel].dma_reg[DMA_CONBLK_AD] = mem_virt_to_phys(channel, get_cb(channel));  // initial CB
     channels[channel].dma_reg[DMA_DEBUG] = 7; // clear debug error flags
     channels[channel].dma_reg[DMA_CS] = 0x10880001;    // go, mid priority, wait for outstanding writes
+    TRACE(TRACE_DMA_START, channel, 0, 0, 0);
 
     return EXIT_SUCCESS;
 }
 
-// Initialize PWM or PCM hardware once for all channels (10MHz)
-static void
-init_hardware(void)
-{
-    if (delay_hw == DELAY_VIA_PWM) {
-        // Initialise PWM
-        pwm_reg[PWM_CTL] = 0;
-        udelay(10);
-        clk_reg[PWMCLK_CNTL] = 0x5A000006;        // Source=PLLD (500MHz)
-        udelay(100);
-        clk_reg[PWMCLK_DIV] = 0x5A000000 | (50<<12);    // set pwm div to 50, giving 10MHz
-        udelay(100);
-        clk_reg[PWMCLK_CNTL] = 0x5A000016;        // Source=PLLD and enable
-        udelay(100);
-        pwm_reg[PWM_RNG1] = pulse_width_incr_us * 10;
-        udelay(10);
-        pwm_reg[PWM_DMAC] = PWMDMAC_ENAB | PWMDMAC_THRSHLD;
-        udelay(10);
-        pwm_reg[PWM_CTL] = PWMCTL_CLRF;
-        udelay(10);
-        pwm_reg[PWM_CTL] = PWMCTL_USEF1 | PWMCTL_PWEN1;
-        udelay(10);
-    } else {
-        // Initialise PCM
-        pcm_reg[PCM_CS_A] = 1;                // Disable Rx+Tx, Enable PCM block
-        udelay(100);
-        clk_reg[PCMCLK_CNTL] = 0x5A000006;        // Source=PLLD (500MHz)
-        udelay(100);
-        clk_reg[PCMCLK_DIV] = 0x5A000000 | (50<<12);    // Set pcm div to 50, giving 10MHz
-        udelay(100);
-        clk_reg[PCMCLK_CNTL] = 0x5A000016;        // Source=PLLD and enable
-        udelay(100);
-        pcm_reg[PCM_TXC_A] = 0<<31 | 1<<30 | 0<<20 | 0<<16; // 1 channel, 8 bits
-        udelay(100);
-        pcm_reg[PCM_MODE_A] = (pulse_width_incr_us * 10 - 1) << 10;
-        udelay(100);
-        pcm_reg[PCM_CS_A] |= 1<<4 | 1<<3;        // Clear FIFOs
-        udelay(100);
-        pcm_reg[PCM_DREQ_A] = 64<<24 | 64<<8;        // DMA Req when one slot is free?
-        udelay(100);
-        pcm_reg[PCM_CS_A] |= 1<<9;            // Enable DMA
-        udelay(100);
-        pcm_reg[PCM_CS_A] |= 1<<2;            // Enable Tx
-    }
-}
-
 // Setup a channel with a specific subcycle time. After that pulse-widths can be
 // added at any time.
-int
-init_channel(int channel, int subcycle_time_us)
+static int
+_init_channel(int channel, int subcycle_time_us)
 {
     log_debug("Initializing channel %d...\n", channel);
     if (_is_setup == 0)
-        return fatal("Error: you need to call `setup(..)` before initializing channels\n");
+        return fatal("Error: you need to call `pwm_setup(..)` before initializing channels\n");
     if (channel > DMA_CHANNELS-1)
         return fatal("Error: maximum channel is %d (requested channel %d)\n", DMA_CHANNELS-1, channel);
     if (channels[channel].virtbase)
@@ -673,6 +838,10 @@ init_channel(int channel, int subcycle_time_us)
     if (subcycle_time_us < SUBCYCLE_TIME_US_MIN)
         return fatal("Error: subcycle time %dus is too small (min=%dus)\n", subcycle_time_us, SUBCYCLE_TIME_US_MIN);
 
+    // Reserve the DMA channel (until free_channel), unless an engine uses it
+    if (dma_claim(channel, NULL) == NULL)
+        return EXIT_FAILURE;
+
     // Setup Data
     channels[channel].subcycle_time_us = subcycle_time_us;
     channels[channel].num_samples = channels[channel].subcycle_time_us / pulse_width_incr_us;
@@ -691,6 +860,21 @@ init_channel(int channel, int subcycle_time_us)
     return EXIT_SUCCESS;
 }
 
+int
+init_channel(int channel, int subcycle_time_us)
+{
+    int result;
+    STATS_TIMER(t0);
+
+    if (lock_channel(channel) == EXIT_FAILURE)
+        return EXIT_FAILURE;
+    result = unlock_channel(channel, _init_channel(channel, subcycle_time_us));
+    STATS_RECORD(STAT_INIT_CHANNEL, t0);
+    if (result == EXIT_SUCCESS)
+        TRACE(TRACE_PWM_INIT_CHANNEL, channel, subcycle_time_us, 0, 0);
+    return result;
+}
+
 // Print some info about a channel
 int
 print_channel(int channel)
@@ -705,6 +889,44 @@ print_channel(int channel)
     return EXIT_SUCCESS;
 }
 
+// Stops a channel and releases its DMA memory. The channel can be initialized
+// again afterwards (with any subcycle time).
+static int
+_free_channel(int channel)
+{
+    log_debug("free_channel: channel=%d\n", channel);
+    if (!channels[channel].virtbase)
+        return fatal("Error: channel %d has not been initialized with 'init_channel(..)'\n", channel);
+
+    if (channels[channel].dma_reg) {
+        _clear_channel(channel);
+        channels[channel].dma_reg[DMA_CS] = DMA_RESET;
+        TRACE(TRACE_DMA_RESET, channel, 0, 0, 0);
+        udelay(10);
+        munmap((uint8_t *)channels[channel].dma_reg - DMA_CHANNEL_INC * channel, DMA_LEN);
+    }
+    munmap(channels[channel].virtbase, channels[channel].num_pages * PAGE_SIZE);
+    free(channels[channel].page_map);
+    if (channels[channel].spare.virtbase)
+        dma_mem_free(&channels[channel].spare);
+    memset(&channels[channel], 0, sizeof(channels[channel]));
+    dma_release(channel);
+    return EXIT_SUCCESS;
+}
+
+int
+free_channel(int channel)
+{
+    int result;
+
+    if (lock_channel(channel) == EXIT_FAILURE)
+        return EXIT_FAILURE;
+    result = unlock_channel(channel, _free_channel(channel));
+    if (result == EXIT_SUCCESS)
+        TRACE(TRACE_PWM_FREE_CHANNEL, channel, 0, 0, 0);
+    return result;
+}
+
 void
 set_softfatal(int enabled)
 {
@@ -717,39 +939,52 @@ get_error_message(void)
     return error_message;
 }
 
-// setup(..) needs to be called once and starts the PWM timer. delay hardware
+// pwm_setup(..) needs to be called once and starts the PWM timer. delay hardware
 // and pulse-width-increment-granularity is set for all DMA channels and cannot
 // be changed during runtime due to hardware mechanics (specific PWM timing).
-int
-setup(int pw_incr_us, int hw)
+static int
+_pwm_setup(int pw_incr_us, int hw)
 {
-    delay_hw = hw;
-    pulse_width_incr_us = pw_incr_us;
-
     if (_is_setup == 1)
-        return fatal("Error: setup(..) has already been called before\n");
+        return fatal("Error: pwm_setup(..) has already been called before\n");
 
-    log_debug("Using hardware: %s\n", delay_hw == DELAY_VIA_PWM ? "PWM" : "PCM");
-    log_debug("PW increments:  %dus\n", pulse_width_incr_us);
+    log_debug("Using hardware: %s\n", hw == DELAY_VIA_PWM ? "PWM" : "PCM");
+    log_debug("PW increments:  %dus\n", pw_incr_us);
 
-    // Catch all kind of kill signals
-    setup_sighandlers();
+    // Catch all kind of kill signals, system timer for calibrated delays
+    // and the DMA, PWM, PCM and clock registers
+    if (dma_setup() == EXIT_FAILURE)
+        return EXIT_FAILURE;
+    simulated = simulation_enabled();
 
     // Initialize common stuff
-    pwm_reg = map_peripheral(PWM_BASE, PWM_LEN);
-    pcm_reg = map_peripheral(PCM_BASE, PCM_LEN);
-    clk_reg = map_peripheral(CLK_BASE, CLK_LEN);
-    gpio_reg = map_peripheral(GPIO_BASE, GPIO_LEN);
-    if (pwm_reg == NULL || pcm_reg == NULL || clk_reg == NULL || gpio_reg == NULL)
+    if (gpio_reg == NULL)
+        gpio_reg = dma_map_peripheral(GPIO_BASE, GPIO_LEN);
+    if (gpio_reg == NULL)
         return EXIT_FAILURE;
 
-    // Start PWM/PCM timing activity
-    init_hardware();
+    // Start PWM/PCM timing activity (10MHz) for all channels, unless a DMA
+    // engine uses the pacer
+    if (dma_pacer_reserve(hw, 50, pw_incr_us * 10) == EXIT_FAILURE)
+        return EXIT_FAILURE;
 
+    delay_hw = hw;
+    pulse_width_incr_us = pw_incr_us;
     _is_setup = 1;
     return EXIT_SUCCESS;
 }
 
+int
+pwm_setup(int pw_incr_us, int hw)
+{
+    int result;
+
+    pthread_mutex_lock(&setup_lock);
+    result = _pwm_setup(pw_incr_us, hw);
+    pthread_mutex_unlock(&setup_lock);
+    return result;
+}
+
 int
 is_setup(void)
 {
@@ -768,20 +1003,28 @@ get_pulse_incr_us(void)
     return pulse_width_incr_us;
 }
 
+int
+get_delay_hw(void)
+{
+    return delay_hw;
+}
+
 int
 get_channel_subcycle_time_us(int channel)
 {
     return channels[channel].subcycle_time_us;
 }
 
+// Demo program, only built with -DPWM_STANDALONE (see Makefile)
+#ifdef PWM_STANDALONE
 int
 main(int argc, char **argv)
 {
     // Very crude...
     if (argc == 2 && !strcmp(argv[1], "--pcm"))
-        setup(PULSE_WIDTH_INCREMENT_GRANULARITY_US_DEFAULT, DELAY_VIA_PCM);
+        pwm_setup(PULSE_WIDTH_INCREMENT_GRANULARITY_US_DEFAULT, DELAY_VIA_PCM);
     else
-        setup(PULSE_WIDTH_INCREMENT_GRANULARITY_US_DEFAULT, DELAY_VIA_PWM);
+        pwm_setup(PULSE_WIDTH_INCREMENT_GRANULARITY_US_DEFAULT, DELAY_VIA_PWM);
 
     // Setup demo parameters
     int demo_timeout = 10 * 1000000;
@@ -806,6 +1049,7 @@ main(int argc, char **argv)
     usleep(demo_timeout);
 
     // All done
-    shutdown();
+    pwm_shutdown();
     exit(0);
 }
+#endif
@@ -22,16 +22,28 @@
  *
  *     http://pythonhosted.org/RPIO
  */
-int setup(int pw_incr_us, int hw);
-void shutdown(void);
+#include <stdint.h>
+
+// A pulse of set_channel_pulses(..)
+struct pwm_pulse {
+    int gpio;
+    int width_start;
+    int width;
+};
+
+int pwm_setup(int pw_incr_us, int hw);
+void pwm_shutdown(void);
 void set_loglevel(int level);
 
 int init_channel(int channel, int subcycle_time_us);
 int clear_channel(int channel);
 int clear_channel_gpio(int channel, int gpio);
+int free_channel(int channel);
 int print_channel(int channel);
 
 int add_channel_pulse(int channel, int gpio, int width_start, int width);
+int set_channel_gpio_width(int channel, int gpio, int width);
+int set_channel_pulses(int channel, uint32_t mask, const struct pwm_pulse *pulses, int count);
 char* get_error_message(void);
 void set_softfatal(int enabled);
 
@@ -39,6 +51,13 @@ int is_setup(void);
 int is_channel_initialized(int channel);
 int get_pulse_incr_us(void);
 int get_channel_subcycle_time_us(int channel);
+int get_delay_hw(void);
+
+// Shared with the DMA engines (see dma.c)
+int pwm_fatal(const char *fmt, ...);
+void pwm_catch_signals(void);
+int pwm_gpio_output(int gpio);
+void pwm_gpio_clear(uint32_t mask);
 
 #define DELAY_VIA_PWM   0
 #define DELAY_VIA_PCM   1
@@ -25,6 +25,12 @@
 #include "Python.h"
 #include <stdlib.h>
 #include "pwm.h"
+#include "dma.h"
+#include "led.h"
+#include "shift.h"
+#include "stepper.h"
+#include "py_stats.h"
+#include "py_trace.h"
 
 static void *
 raise_error(void)
@@ -37,7 +43,7 @@ raise_error(void)
 static PyObject*
 py_setup(PyObject *self, PyObject *args)
 {
-    int delay_hw=-1, pw_incr_us=-1;
+    int delay_hw=-1, pw_incr_us=-1, result;
 
     if (!PyArg_ParseTuple(args, "|ii", &pw_incr_us, &delay_hw))
         return NULL;
@@ -47,7 +53,10 @@ py_setup(PyObject *self, PyObject *args)
     if (delay_hw == -1)
         delay_hw = DELAY_VIA_PWM;
 
-    if (setup(pw_incr_us, delay_hw) == EXIT_FAILURE)
+    Py_BEGIN_ALLOW_THREADS
+    result = pwm_setup(pw_incr_us, delay_hw);
+    Py_END_ALLOW_THREADS
+    if (result == EXIT_FAILURE)
         return raise_error();
 
     Py_INCREF(Py_None);
@@ -58,7 +67,7 @@ py_setup(PyObject *self, PyObject *args)
 static PyObject*
 py_cleanup(PyObject *self, PyObject *args)
 {
-    shutdown();
+    pwm_shutdown();
 
     Py_INCREF(Py_None);
     return Py_None;
@@ -68,7 +77,7 @@ py_cleanup(PyObject *self, PyObject *args)
 static PyObject*
 py_init_channel(PyObject *self, PyObject *args)
 {
-    int channel, subcycle_time_us=-1;
+    int channel, subcycle_time_us=-1, result;
 
     if (!PyArg_ParseTuple(args, "i|i", &channel, &subcycle_time_us))
         return NULL;
@@ -76,7 +85,10 @@ py_init_channel(PyObject *self, PyObject *args)
     if (subcycle_time_us == -1)
         subcycle_time_us = SUBCYCLE_TIME_US_DEFAULT;
 
-    if (init_channel(channel, subcycle_time_us) == EXIT_FAILURE)
+    Py_BEGIN_ALLOW_THREADS
+    result = init_channel(channel, subcycle_time_us);
+    Py_END_ALLOW_THREADS
+    if (result == EXIT_FAILURE)
         return raise_error();
 
     Py_INCREF(Py_None);
@@ -87,12 +99,15 @@ py_init_channel(PyObject *self, PyObject *args)
 static PyObject*
 py_clear_channel(PyObject *self, PyObject *args)
 {
-    int channel;
+    int channel, result;
 
     if (!PyArg_ParseTuple(args, "i", &channel))
         return NULL;
 
-    if (clear_channel(channel) == EXIT_FAILURE)
+    Py_BEGIN_ALLOW_THREADS
+    result = clear_channel(channel);
+    Py_END_ALLOW_THREADS
+    if (result == EXIT_FAILURE)
         return raise_error();
 
     Py_INCREF(Py_None);
@@ -103,12 +118,49 @@ py_clear_channel(PyObject *self, PyObject *args)
 static PyObject*
 py_clear_channel_gpio(PyObject *self, PyObject *args)
 {
-    int channel, gpio;
+    int channel, gpio, result;
 
     if (!PyArg_ParseTuple(args, "ii", &channel, &gpio))
         return NULL;
 
-    if (clear_channel_gpio(channel, gpio) == EXIT_FAILURE)
+    Py_BEGIN_ALLOW_THREADS
+    result = clear_channel_gpio(channel, gpio);
+    Py_END_ALLOW_THREADS
+    if (result == EXIT_FAILURE)
+        return raise_error();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// Executes the PWM commands of RPIO's binary protocol (see
+// _GPIO.proto_set_pwm_handler)
+static int
+proto_pwm_handler(int channel, int gpio, int width)
+{
+    return set_channel_gpio_width(channel, gpio, width) == EXIT_SUCCESS ? 0 : -1;
+}
+
+// python function address = proto_pwm_handler()
+static PyObject*
+py_proto_pwm_handler(PyObject *self, PyObject *args)
+{
+    return PyLong_FromVoidPtr((void *)proto_pwm_handler);
+}
+
+// python function free_channel(int channel)
+static PyObject*
+py_free_channel(PyObject *self, PyObject *args)
+{
+    int channel, result;
+
+    if (!PyArg_ParseTuple(args, "i", &channel))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = free_channel(channel);
+    Py_END_ALLOW_THREADS
+    if (result == EXIT_FAILURE)
         return raise_error();
 
     Py_INCREF(Py_None);
@@ -119,12 +171,15 @@ py_clear_channel_gpio(PyObject *self, PyObject *args)
 static PyObject*
 py_add_channel_pulse(PyObject *self, PyObject *args)
 {
-    int channel, gpio, width_start, width;
+    int channel, gpio, width_start, width, result;
 
     if (!PyArg_ParseTuple(args, "iiii", &channel, &gpio, &width_start, &width))
         return NULL;
 
-    if (add_channel_pulse(channel, gpio, width_start, width) == EXIT_FAILURE)
+    Py_BEGIN_ALLOW_THREADS
+    result = add_channel_pulse(channel, gpio, width_start, width);
+    Py_END_ALLOW_THREADS
+    if (result == EXIT_FAILURE)
         return raise_error();
 
     Py_INCREF(Py_None);
@@ -199,19 +254,490 @@ py_get_channel_subcycle_time_us(PyObject *self, PyObject *args)
     return Py_BuildValue("i", get_channel_subcycle_time_us(channel));
 }
 
+// python function led_open(int channel, gpios, int leds, order="GRB", int hw=DELAY_VIA_PCM, int period_ns=LED_PERIOD_NS)
+static PyObject*
+py_led_open(PyObject *self, PyObject *args)
+{
+    int channel, leds, hw=DELAY_VIA_PCM, period_ns=LED_PERIOD_NS, strips, i, result;
+    int gpios[LED_STRIPS_MAX];
+    const char *order = "GRB";
+    PyObject *list, *seq;
+
+    if (!PyArg_ParseTuple(args, "iOi|sii", &channel, &list, &leds, &order, &hw, &period_ns))
+        return NULL;
+    if ((seq = PySequence_Fast(list, "gpios must be a sequence")) == NULL)
+        return NULL;
+    strips = PySequence_Fast_GET_SIZE(seq);
+    if (strips < 1 || strips > LED_STRIPS_MAX) {
+        Py_DECREF(seq);
+        PyErr_Format(PyExc_ValueError, "1 to %d gpios are supported", LED_STRIPS_MAX);
+        return NULL;
+    }
+    for (i = 0; i < strips; i++) {
+        gpios[i] = (int)PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+        if (gpios[i] == -1 && PyErr_Occurred()) {
+            Py_DECREF(seq);
+            return NULL;
+        }
+    }
+    Py_DECREF(seq);
+    if (period_ns <= 0) {
+        PyErr_SetString(PyExc_ValueError, "period_ns must be positive");
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    result = led_open(channel, gpios, strips, leds, order, hw, period_ns);
+    Py_END_ALLOW_THREADS
+    if (result == EXIT_FAILURE)
+        return raise_error();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function led_show(int channel, pixels)
+static PyObject*
+py_led_show(PyObject *self, PyObject *args)
+{
+    int channel, result;
+    Py_buffer pixels;
+
+    if (!PyArg_ParseTuple(args, "is*", &channel, &pixels))
+        return NULL;
+    if (pixels.len != led_frame_bytes(channel)) {
+        PyBuffer_Release(&pixels);
+        if (led_frame_bytes(channel) == 0)
+            PyErr_Format(PyExc_RuntimeError, "no LED strips on channel %d", channel);
+        else
+            PyErr_Format(PyExc_ValueError, "a frame has %d bytes (got %d)", led_frame_bytes(channel), (int)pixels.len);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    result = led_show(channel, pixels.buf);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&pixels);
+    if (result == EXIT_FAILURE)
+        return raise_error();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function bool led_wait(int channel, int timeout_ms=-1)
+static PyObject*
+py_led_wait(PyObject *self, PyObject *args)
+{
+    int channel, timeout_ms=-1, result;
+
+    if (!PyArg_ParseTuple(args, "i|i", &channel, &timeout_ms))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = led_wait(channel, timeout_ms);
+    Py_END_ALLOW_THREADS
+    if (result == -1)
+        return raise_error();
+    return PyBool_FromLong(result);
+}
+
+// python function int led_frames(int channel)
+static PyObject*
+py_led_frames(PyObject *self, PyObject *args)
+{
+    int channel;
+    uint32_t frames;
+
+    if (!PyArg_ParseTuple(args, "i", &channel))
+        return NULL;
+    if (led_frames(channel, &frames) == EXIT_FAILURE)
+        return raise_error();
+    return Py_BuildValue("I", frames);
+}
+
+// python function led_close(int channel)
+static PyObject*
+py_led_close(PyObject *self, PyObject *args)
+{
+    int channel, result;
+
+    if (!PyArg_ParseTuple(args, "i", &channel))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = led_close(channel);
+    Py_END_ALLOW_THREADS
+    if (result == EXIT_FAILURE)
+        return raise_error();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function shift_open(int channel, int clock, int latch, data, int bytes, int flags=0, int hw=DELAY_VIA_PCM, int period_ns=SHIFT_PERIOD_NS)
+static PyObject*
+py_shift_open(PyObject *self, PyObject *args)
+{
+    int channel, clock, latch, bytes, flags=0, hw=DELAY_VIA_PCM, period_ns=SHIFT_PERIOD_NS, lines, i, result;
+    int data[SHIFT_LINES_MAX];
+    PyObject *list, *seq;
+
+    if (!PyArg_ParseTuple(args, "iiiOi|iii", &channel, &clock, &latch, &list, &bytes, &flags, &hw, &period_ns))
+        return NULL;
+    if ((seq = PySequence_Fast(list, "data gpios must be a sequence")) == NULL)
+        return NULL;
+    lines = PySequence_Fast_GET_SIZE(seq);
+    if (lines < 1 || lines > SHIFT_LINES_MAX) {
+        Py_DECREF(seq);
+        PyErr_Format(PyExc_ValueError, "1 to %d data gpios are supported", SHIFT_LINES_MAX);
+        return NULL;
+    }
+    for (i = 0; i < lines; i++) {
+        data[i] = (int)PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+        if (data[i] == -1 && PyErr_Occurred()) {
+            Py_DECREF(seq);
+            return NULL;
+        }
+    }
+    Py_DECREF(seq);
+    if (period_ns <= 0) {
+        PyErr_SetString(PyExc_ValueError, "period_ns must be positive");
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    result = shift_open(channel, clock, latch, data, lines, bytes, flags, hw, period_ns);
+    Py_END_ALLOW_THREADS
+    if (result == EXIT_FAILURE)
+        return raise_error();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function shift_write(int channel, data)
+static PyObject*
+py_shift_write(PyObject *self, PyObject *args)
+{
+    int channel, result;
+    Py_buffer data;
+
+    if (!PyArg_ParseTuple(args, "is*", &channel, &data))
+        return NULL;
+    if (data.len != shift_frame_bytes(channel)) {
+        PyBuffer_Release(&data);
+        if (shift_frame_bytes(channel) == 0)
+            PyErr_Format(PyExc_RuntimeError, "no shift output on channel %d", channel);
+        else
+            PyErr_Format(PyExc_ValueError, "a frame has %d bytes (got %d)", shift_frame_bytes(channel), (int)data.len);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    result = shift_write(channel, data.buf);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&data);
+    if (result == EXIT_FAILURE)
+        return raise_error();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function bool shift_wait(int channel, int timeout_ms=-1)
+static PyObject*
+py_shift_wait(PyObject *self, PyObject *args)
+{
+    int channel, timeout_ms=-1, result;
+
+    if (!PyArg_ParseTuple(args, "i|i", &channel, &timeout_ms))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = shift_wait(channel, timeout_ms);
+    Py_END_ALLOW_THREADS
+    if (result == -1)
+        return raise_error();
+    return PyBool_FromLong(result);
+}
+
+// python function int shift_frames(int channel)
+static PyObject*
+py_shift_frames(PyObject *self, PyObject *args)
+{
+    int channel;
+    uint32_t frames;
+
+    if (!PyArg_ParseTuple(args, "i", &channel))
+        return NULL;
+    if (shift_frames(channel, &frames) == EXIT_FAILURE)
+        return raise_error();
+    return Py_BuildValue("I", frames);
+}
+
+// python function shift_close(int channel)
+static PyObject*
+py_shift_close(PyObject *self, PyObject *args)
+{
+    int channel, result;
+
+    if (!PyArg_ParseTuple(args, "i", &channel))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = shift_close(channel);
+    Py_END_ALLOW_THREADS
+    if (result == EXIT_FAILURE)
+        return raise_error();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// Reads a sequence of at most STEPPER_AXES_MAX ints; returns the count or -1
+static int
+int_list(PyObject *list, int *values, const char *what)
+{
+    PyObject *seq;
+    int count, i;
+
+    if ((seq = PySequence_Fast(list, what)) == NULL)
+        return -1;
+    count = PySequence_Fast_GET_SIZE(seq);
+    if (count < 1 || count > STEPPER_AXES_MAX) {
+        Py_DECREF(seq);
+        PyErr_Format(PyExc_ValueError, "1 to %d axes are supported", STEPPER_AXES_MAX);
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        values[i] = (int)PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+        if (values[i] == -1 && PyErr_Occurred()) {
+            Py_DECREF(seq);
+            return -1;
+        }
+    }
+    Py_DECREF(seq);
+    return count;
+}
+
+// python function stepper_open(int channel, step_gpios, dir_gpios, int hw=DELAY_VIA_PWM, int tick_ns=STEPPER_TICK_NS)
+static PyObject*
+py_stepper_open(PyObject *self, PyObject *args)
+{
+    int channel, hw=DELAY_VIA_PWM, tick_ns=STEPPER_TICK_NS, axes, result;
+    int steps[STEPPER_AXES_MAX], dirs[STEPPER_AXES_MAX];
+    PyObject *step_list, *dir_list;
+
+    if (!PyArg_ParseTuple(args, "iOO|ii", &channel, &step_list, &dir_list, &hw, &tick_ns))
+        return NULL;
+    if ((axes = int_list(step_list, steps, "step gpios must be a sequence")) == -1)
+        return NULL;
+    if (int_list(dir_list, dirs, "direction gpios must be a sequence") != axes) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_ValueError, "one direction gpio (or -1) per step gpio is needed");
+        return NULL;
+    }
+    if (tick_ns <= 0) {
+        PyErr_SetString(PyExc_ValueError, "tick_ns must be positive");
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    result = stepper_open(channel, steps, dirs, axes, hw, tick_ns);
+    Py_END_ALLOW_THREADS
+    if (result == EXIT_FAILURE)
+        return raise_error();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function stepper_move(int channel, [(steps, velocity, accel, jerk), ...])
+static PyObject*
+py_stepper_move(PyObject *self, PyObject *args)
+{
+    struct stepper_axis_move moves[STEPPER_AXES_MAX];
+    int channel, axes, i, result;
+    PyObject *list, *seq;
+
+    if (!PyArg_ParseTuple(args, "iO", &channel, &list))
+        return NULL;
+    if ((seq = PySequence_Fast(list, "moves must be a sequence")) == NULL)
+        return NULL;
+    axes = stepper_axes(channel);
+    if (axes == 0 || PySequence_Fast_GET_SIZE(seq) != axes) {
+        Py_DECREF(seq);
+        if (axes == 0)
+            PyErr_Format(PyExc_RuntimeError, "no steppers on channel %d", channel);
+        else
+            PyErr_Format(PyExc_ValueError, "one move per axis is needed (%d axes)", axes);
+        return NULL;
+    }
+    for (i = 0; i < axes; i++) {
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, i), "iddd", &moves[i].steps,
+                &moves[i].velocity, &moves[i].accel, &moves[i].jerk)) {
+            Py_DECREF(seq);
+            return NULL;
+        }
+    }
+    Py_DECREF(seq);
+
+    Py_BEGIN_ALLOW_THREADS
+    result = stepper_move(channel, moves);
+    Py_END_ALLOW_THREADS
+    if (result == EXIT_FAILURE)
+        return raise_error();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function bool stepper_wait(int channel, int timeout_ms=-1)
+static PyObject*
+py_stepper_wait(PyObject *self, PyObject *args)
+{
+    int channel, timeout_ms=-1, result;
+
+    if (!PyArg_ParseTuple(args, "i|i", &channel, &timeout_ms))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = stepper_wait(channel, timeout_ms);
+    Py_END_ALLOW_THREADS
+    if (result == -1)
+        return raise_error();
+    return PyBool_FromLong(result);
+}
+
+// python function list stepper_position(int channel)
+static PyObject*
+py_stepper_position(PyObject *self, PyObject *args)
+{
+    int32_t positions[STEPPER_AXES_MAX];
+    int channel, axes, i;
+    PyObject *list;
+
+    if (!PyArg_ParseTuple(args, "i", &channel))
+        return NULL;
+    axes = stepper_axes(channel);
+    if (stepper_position(channel, positions) == EXIT_FAILURE)
+        return raise_error();
+    if ((list = PyList_New(axes)) == NULL)
+        return NULL;
+    for (i = 0; i < axes; i++)
+        PyList_SET_ITEM(list, i, PyLong_FromLong(positions[i]));
+    return list;
+}
+
+// python function stepper_stop(int channel)
+static PyObject*
+py_stepper_stop(PyObject *self, PyObject *args)
+{
+    int channel, result;
+
+    if (!PyArg_ParseTuple(args, "i", &channel))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = stepper_stop(channel);
+    Py_END_ALLOW_THREADS
+    if (result == EXIT_FAILURE)
+        return raise_error();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function stepper_close(int channel)
+static PyObject*
+py_stepper_close(PyObject *self, PyObject *args)
+{
+    int channel, result;
+
+    if (!PyArg_ParseTuple(args, "i", &channel))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = stepper_close(channel);
+    Py_END_ALLOW_THREADS
+    if (result == EXIT_FAILURE)
+        return raise_error();
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function dma_sim_record(bool enabled)
+static PyObject*
+py_dma_sim_record(PyObject *self, PyObject *args)
+{
+    int enabled;
+
+    if (!PyArg_ParseTuple(args, "i", &enabled))
+        return NULL;
+    dma_sim_record(enabled);
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// python function dma_sim_events() -> [(time_ns, set_mask, clear_mask), ...]
+static PyObject*
+py_dma_sim_events(PyObject *self, PyObject *args)
+{
+    const struct dma_sim_event *events;
+    size_t i, count = dma_sim_events(&events);
+    PyObject *list, *item;
+
+    if ((list = PyList_New(count)) == NULL)
+        return NULL;
+    for (i = 0; i < count; i++) {
+        item = Py_BuildValue("(KII)", (unsigned long long)events[i].time_ns, events[i].set_mask, events[i].clear_mask);
+        if (item == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    return list;
+}
+
 static PyMethodDef pwm_methods[] = {
     {"setup", py_setup, METH_VARARGS, "Setup the DMA-PWM system"},
     {"cleanup", py_cleanup, METH_VARARGS, "Stop all pwms and clean up DMA engine"},
     {"init_channel", py_init_channel, METH_VARARGS, "Setup a channel with a specific period time and hardware"},
     {"clear_channel", py_clear_channel, METH_VARARGS, "Clear all pulses on this channel"},
     {"clear_channel_gpio", py_clear_channel_gpio, METH_VARARGS, "Clear one specific GPIO from this channel"},
+    {"free_channel", py_free_channel, METH_VARARGS, "Stop a channel and release its DMA memory"},
     {"add_channel_pulse", py_add_channel_pulse, METH_VARARGS, "Add a specific pulse to a channel"},
+    {"proto_pwm_handler", py_proto_pwm_handler, METH_NOARGS, "Returns the address of the handler for PWM commands of the binary protocol"},
     {"print_channel", py_print_channel, METH_VARARGS, "Print info about a specific channel"},
     {"set_loglevel", py_set_loglevel, METH_VARARGS, "Set the loglevel to either 0 (debug) or 1 (errors)"},
     {"is_setup", py_is_setup, METH_VARARGS, "Returns 1 is setup(..) has been called, else 0"},
     {"get_pulse_incr_us", py_get_pulse_incr_us, METH_VARARGS, "Gets the pulse width increment granularity in us"},
     {"is_channel_initialized", py_is_channel_initialized, METH_VARARGS, "Returns 1 if channel has been initialized, else 0"},
     {"get_channel_subcycle_time_us", py_get_channel_subcycle_time_us, METH_VARARGS, "Gets the subcycle time in us of the specified channel"},
+    {"led_open", py_led_open, METH_VARARGS, "Set up LED strips on gpios, driven by a DMA channel"},
+    {"led_show", py_led_show, METH_VARARGS, "Encode a frame of pixels and output it after the current one"},
+    {"led_wait", py_led_wait, METH_VARARGS, "Wait until all frames were output (False on timeout)"},
+    {"led_frames", py_led_frames, METH_VARARGS, "Returns the number of frames the DMA has started"},
+    {"led_close", py_led_close, METH_VARARGS, "Stop the LED strips and release their DMA channel"},
+    {"shift_open", py_shift_open, METH_VARARGS, "Set up a clocked serial output of data gpios, driven by a DMA channel"},
+    {"shift_write", py_shift_write, METH_VARARGS, "Encode a frame of bytes and output it after the current one"},
+    {"shift_wait", py_shift_wait, METH_VARARGS, "Wait until all frames were output (False on timeout)"},
+    {"shift_frames", py_shift_frames, METH_VARARGS, "Returns the number of frames the DMA has started"},
+    {"shift_close", py_shift_close, METH_VARARGS, "Stop the serial output and release its DMA channel"},
+    {"stepper_open", py_stepper_open, METH_VARARGS, "Set up step/direction stepper drivers, driven by a DMA channel"},
+    {"stepper_move", py_stepper_move, METH_VARARGS, "Queue a move of all axes"},
+    {"stepper_wait", py_stepper_wait, METH_VARARGS, "Wait until all moves were output (False on timeout)"},
+    {"stepper_position", py_stepper_position, METH_VARARGS, "Returns the positions of the axes, from the progress of the DMA"},
+    {"stepper_stop", py_stepper_stop, METH_VARARGS, "Stop all axes at once and drop the queued moves"},
+    {"stepper_close", py_stepper_close, METH_VARARGS, "Stop the steppers and release their DMA channel"},
+    {"dma_sim_record", py_dma_sim_record, METH_VARARGS, "Start (and clear) or stop recording the gpio writes of simulated DMA"},
+    {"dma_sim_events", py_dma_sim_events, METH_NOARGS, "Returns the recorded gpio writes as (time_ns, set_mask, clear_mask)"},
+    PY_STATS_METHODS,
+    PY_TRACE_METHODS,
     {NULL, NULL, 0, NULL}
 };
 
@@ -253,13 +779,23 @@ PyMODINIT_FUNC init_PWM(void)
     PyModule_AddObject(module, "LOG_LEVEL_DEFAULT", Py_BuildValue("i", LOG_LEVEL_DEFAULT));
     PyModule_AddObject(module, "SUBCYCLE_TIME_US_DEFAULT", Py_BuildValue("i", SUBCYCLE_TIME_US_DEFAULT));
     PyModule_AddObject(module, "PULSE_WIDTH_INCREMENT_GRANULARITY_US_DEFAULT", Py_BuildValue("i", PULSE_WIDTH_INCREMENT_GRANULARITY_US_DEFAULT));
+    PyModule_AddObject(module, "LED_PERIOD_NS", Py_BuildValue("i", LED_PERIOD_NS));
+    PyModule_AddObject(module, "LED_STRIPS_MAX", Py_BuildValue("i", LED_STRIPS_MAX));
+    PyModule_AddObject(module, "SHIFT_PERIOD_NS", Py_BuildValue("i", SHIFT_PERIOD_NS));
+    PyModule_AddObject(module, "SHIFT_LINES_MAX", Py_BuildValue("i", SHIFT_LINES_MAX));
+    PyModule_AddObject(module, "SHIFT_LSB_FIRST", Py_BuildValue("i", SHIFT_LSB_FIRST));
+    PyModule_AddObject(module, "STEPPER_TICK_NS", Py_BuildValue("i", STEPPER_TICK_NS));
+    PyModule_AddObject(module, "STEPPER_AXES_MAX", Py_BuildValue("i", STEPPER_AXES_MAX));
+    py_stats_add_constants(module);
+    py_trace_add_constants(module);
+    py_trace_share_state();
 
     // Enable PWM.C soft-fatal mode in order to convert them to python exceptions
     set_softfatal(1);
 
     // Add shutdown handler to be executed when python script stops
-    if (Py_AtExit(shutdown) != 0) {
-      shutdown();
+    if (Py_AtExit(pwm_shutdown) != 0) {
+      pwm_shutdown();
     }
 
 #if PY_MAJOR_VERSION > 2
@@ -57,6 +57,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sched.h>
+#include "systimer.h"
+#include "rt.h"
 
 // 8 GPIOs to use for driving servos
 static uint8_t gpio_list[] = {
@@ -228,13 +231,11 @@ gpio_set(int pin, int level)
         gpio_reg[GPIO_CLR0] = 1 << pin;
 }
 
-// Very short delay
+// Very short delay (spins on the system timer, sleeps first if longer)
 static void
 udelay(int us)
 {
-    struct timespec ts = { 0, us * 1000 };
-
-    nanosleep(&ts, NULL);
+    sleep_us(us);
 }
 
 // Shutdown -- its super important to reset the DMA before quitting
@@ -520,11 +521,25 @@ go_go_go(void)
 int
 main(int argc, char **argv)
 {
+    struct rt_profile rt = {SCHED_OTHER, 0, -1, 0, RT_STACK_BYTES};
     int i;
 
-    // Very crude...
-    if (argc == 2 && !strcmp(argv[1], "--pcm"))
-        delay_hw = DELAY_VIA_PCM;
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--pcm")) {
+            delay_hw = DELAY_VIA_PCM;
+        } else if (!strncmp(argv[i], "--rt-priority=", 14)) {
+            // Real-time profile: SCHED_FIFO, locked memory, pre-faulted stack
+            rt.policy = SCHED_FIFO;
+            rt.priority = atoi(argv[i] + 14);
+            rt.lock_memory = 1;
+        } else if (!strncmp(argv[i], "--rt-cpu=", 9)) {
+            rt.cpu = atoi(argv[i] + 9);
+            rt.lock_memory = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--pcm] [--rt-priority=1..99] [--rt-cpu=N]\n", argv[0]);
+            return 1;
+        }
+    }
 
     printf("Using hardware:       %s\n", delay_hw == DELAY_VIA_PWM ? "PWM" : "PCM");
     printf("Number of servos:     %d\n", NUM_GPIOS);
@@ -534,6 +549,7 @@ main(int argc, char **argv)
                         CHANNEL_WIDTH_MAX * PULSE_WIDTH_INCR_US);
 
     setup_sighandlers();
+    systimer_setup();
 
     dma_reg = map_peripheral(DMA_BASE, DMA_LEN);
     pwm_reg = map_peripheral(PWM_BASE, PWM_LEN);
@@ -573,6 +589,16 @@ main(int argc, char **argv)
     if (daemon(0,1) < 0)
         fatal("rpio-pwm: Failed to daemonize process: %m\n");
 
+    // After daemon(): memory locks are not inherited by the child
+    if (rt.lock_memory) {
+        if (rt_configure(&rt) < 0 || rt_apply() < 0)
+            fprintf(stderr, "rpio-pwm: Failed to apply real-time profile: %m\n");
+        else
+            printf("Real-time profile:    %s %d, cpu %d, memory locked\n",
+                    rt.policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_OTHER",
+                    rt.priority, rt.cpu);
+    }
+
     go_go_go();
 
     return 0;
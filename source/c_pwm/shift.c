@@ -0,0 +1,288 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * shift.c outputs byte buffers as clocked serial waveforms: the bits of up
+ * to SHIFT_LINES_MAX data lines change while their shared clock is low and
+ * are sampled on its rising edge (SPI mode 0), like the inputs of 74HC595
+ * shift registers. All lines are written by one DMA channel.
+ *
+ *
+ * WAVEFORM
+ * --------
+ * A bit takes two pacer periods (416ns each by default, 1.2MHz): the DMA
+ * clears the clock together with the data lines which send a 0, sets those
+ * which send a 1, waits a period, sets the clock and waits another period.
+ * After the last bit the clock and data lines go low, and a pulse on the
+ * latch gpio (if any) moves the bits to the outputs of the registers.
+ *
+ *
+ * FRAMES
+ * ------
+ * A frame is one buffer per data line (of `bytes` each, the first byte is
+ * shifted out first). As the LED strips (led.c) an engine has two frames
+ * in a ring (see RINGS in dma.c); shift_write() encodes into the frame the
+ * DMA is done with and queues it behind the current one. The CPU only
+ * encodes: the bits of 8 lines at a time are transposed in a 64-bit word
+ * and mapped to their gpios with a table.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "pwm.h"
+#include "dma.h"
+#include "shift.h"
+#include "systimer.h"
+#include "stats.h"
+
+#define SHIFT_CBS_PER_BIT 5
+
+struct shift_engine {
+    struct dma_engine base;
+    int flags;
+    int lines, bytes;
+    uint32_t clock_mask, data_mask, latch_mask;
+    uint32_t (*table)[256];     // [group of 8 lines][line bits] -> gpio mask
+    uint32_t bits;              // per line and frame
+    uint32_t *consts;           // clock, clock | data, latch
+    uint32_t *clr[2], *set[2];  // the words of each bit of a frame
+};
+
+// Writes the clear and set words of the bits of a frame
+static void
+encode(const struct shift_engine *e, const uint8_t *data, uint32_t *clr, uint32_t *set)
+{
+    int i, g, j, b, groups = (e->lines + 7) / 8;
+    uint32_t ones[8];
+    uint64_t x;
+    const uint8_t *p;
+
+    for (i = 0; i < e->bytes; i++) {
+        p = data + i;
+        memset(ones, 0, sizeof(ones));
+        for (g = 0; g < groups; g++, p += 8 * e->bytes) {
+            x = 0;
+            for (j = 0; j < 8 && g * 8 + j < e->lines; j++)
+                x |= (uint64_t)p[j * e->bytes] << (8 * j);
+            x = dma_transpose8(x);
+            for (b = 0; b < 8; b++)
+                ones[b] |= e->table[g][(x >> (8 * b)) & 0xff];
+        }
+        for (j = 0; j < 8; j++) {
+            b = e->flags & SHIFT_LSB_FIRST ? j : 7 - j;
+            *clr++ = e->clock_mask | (e->data_mask & ~ones[b]);
+            *set++ = ones[b];
+        }
+    }
+}
+
+// Writes the chain of frame f
+static void
+build_frame(struct shift_engine *e, int f, dma_cb_t *cb)
+{
+    uint32_t b, clock = dma_phys(&e->base.mem, &e->consts[0]);
+
+#define NEXT dma_phys(&e->base.mem, cb + 1)
+    cb = dma_ring_marker(&e->base.ring, f, cb);
+    for (b = 0; b < e->bits; b++) {
+        e->clr[f][b] = e->clock_mask | e->data_mask;
+        dma_cb_copy(cb, dma_phys(&e->base.mem, &e->clr[f][b]), BUS_GPCLR0, 4, NEXT);
+        cb++;
+        dma_cb_copy(cb, dma_phys(&e->base.mem, &e->set[f][b]), BUS_GPSET0, 4, NEXT);
+        cb++;
+        dma_cb_delay(cb, e->base.hw, 1, clock, NEXT);
+        cb++;
+        dma_cb_copy(cb, clock, BUS_GPSET0, 4, NEXT);
+        cb++;
+        dma_cb_delay(cb, e->base.hw, 1, clock, NEXT);
+        cb++;
+    }
+    dma_cb_copy(cb, dma_phys(&e->base.mem, &e->consts[1]), BUS_GPCLR0, 4, NEXT);
+    cb++;
+    if (e->latch_mask) {
+        dma_cb_delay(cb, e->base.hw, 1, clock, NEXT);
+        cb++;
+        dma_cb_copy(cb, dma_phys(&e->base.mem, &e->consts[2]), BUS_GPSET0, 4, NEXT);
+        cb++;
+        dma_cb_delay(cb, e->base.hw, 1, clock, NEXT);
+        cb++;
+        dma_cb_copy(cb, dma_phys(&e->base.mem, &e->consts[2]), BUS_GPCLR0, 4, NEXT);
+        cb++;
+    }
+#undef NEXT
+    dma_cb_delay(cb, e->base.hw, 1, clock, 0);
+    e->base.ring.last[f] = cb;
+}
+
+// Sets up an engine on the DMA channel `channel` which shifts `bytes` per
+// frame out of each of the `lines` gpios `data`, clocked by the gpio
+// `clock`, and pulses `latch` (-1: none) after each frame. `hw` is the pacer
+// (DELAY_VIA_PWM or DELAY_VIA_PCM), period_ns half a clock period.
+int
+shift_open(int channel, int clock, int latch, const int *data, int lines, int bytes, int flags, int hw, uint32_t period_ns)
+{
+    struct shift_engine *e;
+    uint32_t cbs, words, used;
+    size_t cb_bytes;
+    int s;
+
+    if (channel < 0 || channel > DMA_CHANNELS-1)
+        return pwm_fatal("Error: maximum channel is %d (requested channel %d)\n", DMA_CHANNELS-1, channel);
+    if (lines < 1 || lines > SHIFT_LINES_MAX)
+        return pwm_fatal("Error: %d data lines (1..%d are supported)\n", lines, SHIFT_LINES_MAX);
+    if (bytes < 1)
+        return pwm_fatal("Error: frames need at least one byte\n");
+    if (clock < 0 || clock > 31 || latch < -1 || latch > 31 || latch == clock)
+        return pwm_fatal("Error: invalid clock or latch gpio\n");
+    used = 1 << clock | (latch >= 0 ? 1 << latch : 0);
+    for (s = 0; s < lines; s++) {
+        if (data[s] < 0 || data[s] > 31 || (used & (1 << data[s])))
+            return pwm_fatal("Error: invalid or repeated gpio %d\n", data[s]);
+        used |= 1 << data[s];
+    }
+    if (dma_setup() == EXIT_FAILURE)
+        return EXIT_FAILURE;
+
+    if ((e = calloc(1, sizeof(*e))) == NULL)
+        return pwm_fatal("Error: Failed to allocate shift output: %m\n");
+    e->flags = flags;
+    e->lines = lines;
+    e->bytes = bytes;
+    e->clock_mask = 1 << clock;
+    e->latch_mask = latch >= 0 ? 1 << latch : 0;
+    e->data_mask = used & ~(e->clock_mask | e->latch_mask);
+    e->base.gpio_mask = used;
+    if ((e->table = calloc((lines + 7) / 8, sizeof(*e->table))) == NULL) {
+        free(e);
+        return pwm_fatal("Error: Failed to allocate shift output: %m\n");
+    }
+    dma_bit_tables(e->table, data, lines);
+
+    // Control blocks of both frames, then the words
+    e->bits = (uint32_t)bytes * 8;
+    cbs = 1 + e->bits * SHIFT_CBS_PER_BIT + (e->latch_mask ? 6 : 2);
+    cb_bytes = (size_t)cbs * sizeof(dma_cb_t);
+    words = 6 + 4 * e->bits;    // consts, the ring's status and seq[2]
+    if (dma_pacer_acquire(hw, period_ns) == EXIT_FAILURE)
+        goto fail_pacer;
+    if (dma_mem_alloc(&e->base.mem, channel, 2 * cb_bytes + words * 4) == EXIT_FAILURE)
+        goto fail_mem;
+    e->consts = (uint32_t *)(e->base.mem.virtbase + 2 * cb_bytes);
+    e->consts[0] = e->clock_mask;
+    e->consts[1] = e->clock_mask | e->data_mask;
+    e->consts[2] = e->latch_mask;
+    e->clr[0] = e->consts + 6;
+    e->set[0] = e->clr[0] + e->bits;
+    e->clr[1] = e->set[0] + e->bits;
+    e->set[1] = e->clr[1] + e->bits;
+
+    if (dma_claim(channel, &e->base.mem) == NULL)
+        goto fail_claim;
+    for (s = 0; s < 32; s++) {
+        if ((used & (1 << s)) && pwm_gpio_output(s) == EXIT_FAILURE)
+            goto fail_gpio;
+    }
+    dma_engine_init(&e->base, DMA_ENGINE_SHIFT, channel, hw);
+    e->base.size = lines * bytes;
+    dma_ring_init(&e->base.ring, channel, &e->base.mem, 2, e->consts + 3);
+    build_frame(e, 0, (dma_cb_t *)e->base.mem.virtbase);
+    build_frame(e, 1, (dma_cb_t *)(e->base.mem.virtbase + cb_bytes));
+    dma_engine_register(&e->base);
+    return EXIT_SUCCESS;
+
+fail_gpio:
+    dma_release(channel);
+fail_claim:
+    dma_mem_free(&e->base.mem);
+fail_mem:
+    dma_pacer_release(hw);
+fail_pacer:
+    free(e->table);
+    free(e);
+    return EXIT_FAILURE;
+}
+
+// Stops the output of an engine, sets its gpios low and frees it
+int
+shift_close(int channel)
+{
+    struct shift_engine *e;
+
+    if ((e = (struct shift_engine *)dma_engine_close(channel, DMA_ENGINE_SHIFT, NULL)) == NULL)
+        return EXIT_FAILURE;
+    dma_engine_release(&e->base);
+    free(e->table);
+    free(e);
+    return EXIT_SUCCESS;
+}
+
+// Encodes a frame and outputs it after the current one. `data` holds
+// shift_frame_bytes(): the bytes of the first data line, then those of the
+// next. Waits until the frame before the current one was output.
+int
+shift_write(int channel, const uint8_t *data)
+{
+    struct shift_engine *e;
+    int f;
+
+    if ((e = (struct shift_engine *)dma_engine_lock(channel, DMA_ENGINE_SHIFT)) == NULL)
+        return EXIT_FAILURE;
+
+    f = dma_ring_next(&e->base.ring, 1);
+
+    STATS_TIMER(t0);
+    encode(e, data, e->clr[f], e->set[f]);
+    STATS_RECORD(STAT_SHIFT_ENCODE, t0);
+
+    dma_ring_commit(&e->base.ring, f);
+    pthread_mutex_unlock(&e->base.lock);
+    return EXIT_SUCCESS;
+}
+
+// Waits up to timeout_ms (forever if negative) until all frames were
+// output. Returns 1 if they were, 0 on timeout, -1 on errors.
+int
+shift_wait(int channel, int timeout_ms)
+{
+    struct dma_engine *e;
+
+    if ((e = dma_engine_lock(channel, DMA_ENGINE_SHIFT)) == NULL)
+        return -1;
+    return dma_engine_wait(e, NULL, timeout_ms);
+}
+
+// Number of frames the DMA has started
+int
+shift_frames(int channel, uint32_t *frames)
+{
+    return dma_engine_frames(channel, DMA_ENGINE_SHIFT, frames);
+}
+
+// Size of the data of a frame (0 if there is no engine on the channel)
+int
+shift_frame_bytes(int channel)
+{
+    return dma_engine_size(channel, DMA_ENGINE_SHIFT);
+}
@@ -0,0 +1,48 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * shift.c clocks byte buffers out of up to SHIFT_LINES_MAX data gpios which
+ * share one clock (and optionally a latch gpio), eg. into chains of 74HC595
+ * shift registers or SPI-like displays, driven by a DMA channel.
+ */
+#ifndef RPIO_SHIFT_H
+#define RPIO_SHIFT_H
+
+#include <stdint.h>
+
+#define SHIFT_LINES_MAX 30
+#define SHIFT_PERIOD_NS 416     // half a clock period (1.2MHz), as LED_PERIOD_NS
+
+// shift_open() flags
+#define SHIFT_LSB_FIRST 1
+
+int shift_open(int channel, int clock, int latch, const int *data, int lines, int bytes, int flags, int hw, uint32_t period_ns);
+int shift_close(int channel);
+int shift_write(int channel, const uint8_t *data);
+int shift_wait(int channel, int timeout_ms);
+int shift_frames(int channel, uint32_t *frames);
+int shift_frame_bytes(int channel);
+
+#endif
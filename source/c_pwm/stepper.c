@@ -0,0 +1,747 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * stepper.c is a motion engine for step/direction stepper drivers. A move
+ * gives each axis a number of steps (signed), a maximum velocity and
+ * acceleration, and optionally a maximum jerk; all axes of a move start
+ * together, and the next move starts when all have stopped.
+ *
+ *
+ * PROFILES
+ * --------
+ * Each axis accelerates from 0 to its peak velocity, cruises and mirrors
+ * the acceleration to stop. Without jerk the acceleration is constant
+ * (trapezoidal velocity); with jerk it ramps up and down (S-curve). Moves
+ * too short to reach the maximum velocity peak where acceleration and
+ * deceleration meet. Step n is output when the profile reaches position n:
+ * its time is the inverse of the position of the profile (closed form, but
+ * for the last phase of an S-curve acceleration: Newton's method).
+ *
+ *
+ * SEGMENTS
+ * --------
+ * A feeder thread compiles the moves into control blocks on a timeline of
+ * pacer ticks: a step sets the step gpio for one tick, a move first sets
+ * the direction gpios STEPPER_DIR_SETUP ticks before its first step, and
+ * delays fill the gaps. The control blocks are written into a ring of
+ * STEPPER_SEGMENTS segments (see RINGS in dma.c) and committed segment by
+ * segment, so moves of any length use bounded memory. A move is output
+ * once compiled, or when a segment is full.
+ *
+ *
+ * POSITION
+ * --------
+ * The engine remembers the control block and axes of every step write per
+ * segment. The position is that at the start of the segment the DMA is in,
+ * plus the steps of the control blocks before the one it is at; once the
+ * DMA is idle, the position at the end of the last segment.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include "pwm.h"
+#include "dma.h"
+#include "stepper.h"
+#include "systimer.h"
+#include "stats.h"
+
+// Velocity profile of an axis. The acceleration has three phases: jerk up
+// to the peak acceleration a (tj), constant acceleration (tc) and jerk down
+// (tj); trapezoidal profiles have tj = 0.
+struct profile {
+    uint32_t steps;
+    double j, a, v;
+    double tj, tc;
+    double t1, v1, s1;      // at the end of the first phase
+    double t2, v2, s2;      // at the end of the second phase
+    double t_acc, s_acc;    // duration and distance of the acceleration
+    double total;
+};
+
+struct axis_state {
+    struct profile p;
+    uint32_t next;          // next step (1-based)
+    uint64_t tick;          // of the next step
+};
+
+struct stepper_move {
+    struct stepper_axis_move axis[STEPPER_AXES_MAX];
+};
+
+// Step write of a segment: its control block and the axes it moves
+struct stepper_mark {
+    uint32_t cb;
+    uint8_t up, down;
+};
+
+struct stepper_segment {
+    int32_t start[STEPPER_AXES_MAX];    // positions when the segment starts
+    int32_t end[STEPPER_AXES_MAX];
+    uint32_t count;
+    struct stepper_mark *marks;         // [STEPPER_SEGMENT_CBS]
+};
+
+struct stepper_engine {
+    struct dma_engine base;
+    pthread_cond_t wake, space;
+    pthread_t thread;
+    int abort, busy;
+    int axes;
+    uint32_t tick_ns;
+    uint32_t step_mask[STEPPER_AXES_MAX], dir_mask[STEPPER_AXES_MAX];
+    dma_cb_t *cbs;                      // [STEPPER_SEGMENTS * STEPPER_SEGMENT_CBS]
+    uint32_t *words;                    // one per control block
+    uint32_t zero_phys;                 // source of the delays
+    uint32_t *ring_words;
+    struct stepper_segment segments[STEPPER_SEGMENTS];
+    int32_t origin[STEPPER_AXES_MAX];   // positions when the ring started
+    int tail_moving;                    // the last segment ends within a move
+
+    struct stepper_move queue[STEPPER_QUEUE];
+    int head, count;
+
+    // Compiler state (feeder thread, or while it is idle)
+    int32_t planned[STEPPER_AXES_MAX];  // after the steps compiled so far
+    int moving;                         // within the steps of a move
+    int open, segment;                  // segment being written
+    dma_cb_t *cb, *cb_end;
+    uint32_t *word;
+    uint64_t now;                       // tick of the next control block
+    uint64_t compile_t0;
+};
+
+// Durations of the phases of an acceleration from 0 to v
+static void
+accel_phases(double v, double a, double j, double *tj, double *tc)
+{
+    if (j == 0) {
+        *tj = 0;
+        *tc = v / a;
+    } else if (v * j >= a * a) {
+        *tj = a / j;
+        *tc = v / a - a / j;
+    } else {
+        *tj = sqrt(v / j);
+        *tc = 0;
+    }
+}
+
+// Distance of an acceleration from 0 to v (the mean velocity is v/2)
+static double
+accel_distance(double v, double a, double j)
+{
+    double tj, tc;
+
+    accel_phases(v, a, j, &tj, &tc);
+    return v * (2 * tj + tc) / 2;
+}
+
+static void
+profile_init(struct profile *p, uint32_t steps, double v, double a, double j)
+{
+    double lo, hi;
+    int i;
+
+    memset(p, 0, sizeof(*p));
+    p->steps = steps;
+    p->j = j;
+    if (steps == 0)
+        return;
+    if (2 * accel_distance(v, a, j) > steps) {
+        // Peak velocity where acceleration and deceleration meet
+        for (lo = 0, hi = v, i = 0; i < 64; i++) {
+            v = (lo + hi) / 2;
+            if (2 * accel_distance(v, a, j) > steps)
+                hi = v;
+            else
+                lo = v;
+        }
+        v = lo;
+    }
+    accel_phases(v, a, j, &p->tj, &p->tc);
+    p->v = v;
+    p->a = j == 0 || p->tc > 0 ? a : j * p->tj;
+    p->t1 = p->tj;
+    p->v1 = j * p->tj * p->tj / 2;
+    p->s1 = j * p->tj * p->tj * p->tj / 6;
+    p->t2 = p->t1 + p->tc;
+    p->v2 = p->v1 + p->a * p->tc;
+    p->s2 = p->s1 + p->v1 * p->tc + p->a * p->tc * p->tc / 2;
+    p->t_acc = 2 * p->tj + p->tc;
+    p->s_acc = v * p->t_acc / 2;
+    p->total = 2 * p->t_acc + (steps - 2 * p->s_acc) / v;
+}
+
+// Time at which the acceleration has covered x (0 <= x <= s_acc)
+static double
+accel_time(const struct profile *p, double x)
+{
+    double t, lo, hi, f, df;
+    int i;
+
+    if (x <= 0)
+        return 0;
+    if (x <= p->s1)
+        return cbrt(6 * x / p->j);
+    if (x <= p->s2) {
+        x -= p->s1;
+        return p->t1 + 2 * x / (p->v1 + sqrt(p->v1 * p->v1 + 2 * p->a * x));
+    }
+
+    // Jerk down: Newton's method, bisection where it leaves the phase
+    x -= p->s2;
+    lo = 0;
+    hi = p->tj;
+    t = p->v2 > 0 ? x / p->v2 : hi / 2;
+    for (i = 0; i < 64; i++) {
+        if (!(t > lo && t < hi))
+            t = (lo + hi) / 2;
+        f = p->v2 * t + p->a * t * t / 2 - p->j * t * t * t / 6 - x;
+        if (fabs(f) < 1e-9)
+            break;
+        if (f > 0)
+            hi = t;
+        else
+            lo = t;
+        df = p->v2 + p->a * t - p->j * t * t / 2;
+        t = df > 0 ? t - f / df : (lo + hi) / 2;
+    }
+    return p->t2 + t;
+}
+
+// Time of step n (1..steps) after the start of the move, in seconds
+static double
+step_time(const struct profile *p, uint32_t n)
+{
+    double x = n;
+
+    if (x <= p->s_acc)
+        return accel_time(p, x);
+    if (x < p->steps - p->s_acc)
+        return p->t_acc + (x - p->s_acc) / p->v;
+    return p->total - accel_time(p, p->steps - x);
+}
+
+static uint64_t
+step_tick(const struct stepper_engine *e, const struct axis_state *st, uint64_t base)
+{
+    return base + (uint64_t)llround(step_time(&st->p, st->next) * 1e9 / e->tick_ns);
+}
+
+static void
+start_segment(struct stepper_engine *e)
+{
+    int s = dma_ring_next(&e->base.ring, 1);
+
+    e->segment = s;
+    e->cb = dma_ring_marker(&e->base.ring, s, e->cbs + (size_t)s * STEPPER_SEGMENT_CBS);
+    e->cb_end = e->cbs + (size_t)(s + 1) * STEPPER_SEGMENT_CBS;
+    e->word = e->words + (size_t)s * STEPPER_SEGMENT_CBS;
+    memcpy(e->segments[s].start, e->planned, sizeof(e->planned));
+    e->segments[s].count = 0;
+    e->open = 1;
+    e->compile_t0 = STATS_ENABLED ? stats_clock_ns() : 0;
+}
+
+// Commits the segment being written, unless it is empty
+static void
+finish_segment(struct stepper_engine *e)
+{
+    if (!e->open)
+        return;
+    e->open = 0;
+    if (e->cb == e->base.ring.first[e->segment] + 1)
+        return;
+    memcpy(e->segments[e->segment].end, e->planned, sizeof(e->planned));
+    e->base.ring.last[e->segment] = e->cb - 1;
+    STATS_RECORD(STAT_STEPPER_COMPILE, e->compile_t0);
+
+    pthread_mutex_lock(&e->base.lock);
+    if (!e->abort) {
+        // The DMA ran out of segments within a move
+        if (e->base.ring.tail >= 0 && e->tail_moving && !dma_active(e->base.channel) && !simulation_enabled())
+            STATS_INC(STAT_STEPPER_UNDERRUNS);
+        dma_ring_commit(&e->base.ring, e->segment);
+        e->tail_moving = e->moving;
+    }
+    pthread_mutex_unlock(&e->base.lock);
+}
+
+// Makes room for n control blocks in the segment being written
+static void
+ensure_room(struct stepper_engine *e, int n)
+{
+    if (e->open && e->cb_end - e->cb >= n)
+        return;
+    finish_segment(e);
+    start_segment(e);
+}
+
+static void
+emit_write(struct stepper_engine *e, uint32_t dst, uint32_t mask)
+{
+    *e->word = mask;
+    dma_cb_copy(e->cb, dma_phys(&e->base.mem, e->word), dst, 4, dma_phys(&e->base.mem, e->cb + 1));
+    e->cb++;
+    e->word++;
+}
+
+// Delays until tick t
+static void
+emit_delay(struct stepper_engine *e, uint64_t t)
+{
+    uint32_t n;
+
+    while (e->now < t) {
+        ensure_room(e, 1);
+        n = t - e->now > DMA_DELAY_MAX ? DMA_DELAY_MAX : t - e->now;
+        dma_cb_delay(e->cb, e->base.hw, n, e->zero_phys, dma_phys(&e->base.mem, e->cb + 1));
+        e->cb++;
+        e->now += n;
+    }
+}
+
+// Writes `set` and `clr` at tick t; `up` and `down` are the axes stepped
+// by `set`
+static void
+emit_event(struct stepper_engine *e, uint64_t t, uint32_t set, uint32_t clr, int up, int down)
+{
+    struct stepper_segment *seg;
+    struct stepper_mark *mark;
+    int a;
+
+    emit_delay(e, t);
+    if (set == 0 && clr == 0)
+        return;
+    ensure_room(e, 2);
+    if (clr)
+        emit_write(e, BUS_GPCLR0, clr);
+    if (set == 0)
+        return;
+    if (up | down) {
+        seg = &e->segments[e->segment];
+        mark = &seg->marks[seg->count++];
+        mark->cb = e->cb - e->base.ring.first[e->segment];
+        mark->up = up;
+        mark->down = down;
+        for (a = 0; a < e->axes; a++) {
+            if (up & (1 << a))
+                e->planned[a]++;
+            else if (down & (1 << a))
+                e->planned[a]--;
+        }
+    }
+    emit_write(e, BUS_GPSET0, set);
+}
+
+// Compiles a move into segments; stops early if the engine is stopped
+static void
+compile_move(struct stepper_engine *e, const struct stepper_move *m)
+{
+    struct axis_state st[STEPPER_AXES_MAX];
+    uint32_t set = 0, clr = 0, pending = 0;
+    uint64_t base, t, pending_tick = 0;
+    int a, up, down, forward = 0;
+
+    for (a = 0; a < e->axes; a++) {
+        profile_init(&st[a].p, m->axis[a].steps < 0 ? -(int64_t)m->axis[a].steps : m->axis[a].steps,
+                m->axis[a].velocity, m->axis[a].accel, m->axis[a].jerk);
+        st[a].next = 1;
+        if (m->axis[a].steps > 0) {
+            set |= e->dir_mask[a];
+            forward |= 1 << a;
+        } else if (m->axis[a].steps < 0) {
+            clr |= e->dir_mask[a];
+        }
+    }
+    emit_event(e, e->now, set, clr, 0, 0);
+    base = e->now + STEPPER_DIR_SETUP;
+    for (a = 0; a < e->axes; a++) {
+        if (st[a].p.steps)
+            st[a].tick = step_tick(e, &st[a], base);
+    }
+
+    // Merge the steps of all axes; a pulse ends one tick after it started
+    e->moving = 1;
+    while (!__atomic_load_n(&e->abort, __ATOMIC_ACQUIRE)) {
+        t = UINT64_MAX;
+        for (a = 0; a < e->axes; a++) {
+            if (st[a].next <= st[a].p.steps && st[a].tick < t)
+                t = st[a].tick;
+        }
+        if (pending && pending_tick < t)
+            t = pending_tick;
+        if (t == UINT64_MAX)
+            break;
+
+        set = up = down = 0;
+        clr = pending && pending_tick == t ? pending : 0;
+        if (clr)
+            pending = 0;
+        for (a = 0; a < e->axes; a++) {
+            if (st[a].next > st[a].p.steps || st[a].tick != t)
+                continue;
+            set |= e->step_mask[a];
+            if (forward & (1 << a))
+                up |= 1 << a;
+            else
+                down |= 1 << a;
+            if (++st[a].next <= st[a].p.steps) {
+                st[a].tick = step_tick(e, &st[a], base);
+                if (st[a].tick < t + 2)
+                    st[a].tick = t + 2;
+            }
+        }
+        emit_event(e, t, set, clr, up, down);
+        if (set) {
+            pending = set;
+            pending_tick = t + 1;
+        }
+    }
+    e->moving = 0;
+}
+
+// Feeder thread: compiles the queued moves
+static void *
+feeder(void *arg)
+{
+    struct stepper_engine *e = arg;
+    struct stepper_move move;
+
+    pthread_mutex_lock(&e->base.lock);
+    while (!e->base.closing) {
+        if (e->count == 0) {
+            e->busy = 0;
+            pthread_cond_broadcast(&e->base.idle);
+            pthread_cond_wait(&e->wake, &e->base.lock);
+            continue;
+        }
+        move = e->queue[e->head];
+        e->head = (e->head + 1) % STEPPER_QUEUE;
+        e->count--;
+        e->busy = 1;
+        pthread_cond_broadcast(&e->space);
+        pthread_mutex_unlock(&e->base.lock);
+
+        compile_move(e, &move);
+
+        // Output what is compiled unless more moves follow
+        pthread_mutex_lock(&e->base.lock);
+        if (e->abort) {
+            e->open = 0;
+        } else if (e->count == 0) {
+            pthread_mutex_unlock(&e->base.lock);
+            finish_segment(e);
+            pthread_mutex_lock(&e->base.lock);
+        }
+    }
+    e->busy = 0;
+    pthread_cond_broadcast(&e->base.idle);
+    pthread_mutex_unlock(&e->base.lock);
+    return NULL;
+}
+
+// Positions from the progress of the DMA (engine locked)
+static void
+derive_positions(struct stepper_engine *e, int32_t *pos)
+{
+    struct stepper_segment *seg;
+    dma_cb_t *cb;
+    uint32_t i, k;
+    int a, s;
+
+    if (e->base.ring.tail < 0) {
+        memcpy(pos, e->origin, sizeof(e->origin));
+        return;
+    }
+    cb = dma_position(e->base.channel, &e->base.mem);
+    if (cb == NULL || cb < e->cbs || cb >= e->cbs + STEPPER_SEGMENTS * STEPPER_SEGMENT_CBS) {
+        memcpy(pos, e->segments[e->base.ring.tail].end, sizeof(e->origin));
+        return;
+    }
+    s = (cb - e->cbs) / STEPPER_SEGMENT_CBS;
+    seg = &e->segments[s];
+    i = cb - e->base.ring.first[s];
+    memcpy(pos, seg->start, sizeof(e->origin));
+    for (k = 0; k < seg->count && seg->marks[k].cb < i; k++) {
+        for (a = 0; a < e->axes; a++) {
+            if (seg->marks[k].up & (1 << a))
+                pos[a]++;
+            else if (seg->marks[k].down & (1 << a))
+                pos[a]--;
+        }
+    }
+}
+
+static void
+free_engine(struct stepper_engine *e)
+{
+    int s;
+
+    for (s = 0; s < STEPPER_SEGMENTS; s++)
+        free(e->segments[s].marks);
+    free(e);
+}
+
+// Sets up an engine on the DMA channel `channel` for `axes` axes with the
+// gpios step_gpios and dir_gpios (-1: none). `hw` is the pacer
+// (DELAY_VIA_PWM or DELAY_VIA_PCM) and tick_ns its period, the resolution
+// of the step timing.
+int
+stepper_open(int channel, const int *step_gpios, const int *dir_gpios, int axes, int hw, uint32_t tick_ns)
+{
+    struct stepper_engine *e;
+    size_t cb_bytes = (size_t)STEPPER_SEGMENTS * STEPPER_SEGMENT_CBS * sizeof(dma_cb_t);
+    uint32_t words = STEPPER_SEGMENTS * STEPPER_SEGMENT_CBS + 2 + STEPPER_SEGMENTS;
+    uint32_t used = 0;
+    sigset_t all, old;
+    int a, s, err;
+
+    if (channel < 0 || channel > DMA_CHANNELS-1)
+        return pwm_fatal("Error: maximum channel is %d (requested channel %d)\n", DMA_CHANNELS-1, channel);
+    if (axes < 1 || axes > STEPPER_AXES_MAX)
+        return pwm_fatal("Error: %d axes (1..%d are supported)\n", axes, STEPPER_AXES_MAX);
+    for (a = 0; a < 2 * axes; a++) {
+        s = a < axes ? step_gpios[a] : dir_gpios[a - axes];
+        if (s == -1 && a >= axes)
+            continue;
+        if (s < 0 || s > 31 || (used & (1 << s)))
+            return pwm_fatal("Error: invalid or repeated gpio %d\n", s);
+        used |= 1 << s;
+    }
+    if (dma_setup() == EXIT_FAILURE)
+        return EXIT_FAILURE;
+
+    if ((e = calloc(1, sizeof(*e))) == NULL)
+        return pwm_fatal("Error: Failed to allocate steppers: %m\n");
+    e->axes = axes;
+    e->base.gpio_mask = used;
+    for (a = 0; a < axes; a++) {
+        e->step_mask[a] = 1 << step_gpios[a];
+        e->dir_mask[a] = dir_gpios[a] >= 0 ? 1 << dir_gpios[a] : 0;
+    }
+    for (s = 0; s < STEPPER_SEGMENTS; s++) {
+        if ((e->segments[s].marks = malloc(STEPPER_SEGMENT_CBS * sizeof(struct stepper_mark))) == NULL) {
+            free_engine(e);
+            return pwm_fatal("Error: Failed to allocate steppers: %m\n");
+        }
+    }
+
+    if (dma_pacer_acquire(hw, tick_ns) == EXIT_FAILURE) {
+        free_engine(e);
+        return EXIT_FAILURE;
+    }
+    e->tick_ns = dma_pacer_period_ns(hw);
+    if (dma_mem_alloc(&e->base.mem, channel, cb_bytes + words * 4) == EXIT_FAILURE)
+        goto fail_mem;
+    e->cbs = (dma_cb_t *)e->base.mem.virtbase;
+    e->words = (uint32_t *)(e->base.mem.virtbase + cb_bytes);
+    e->zero_phys = dma_phys(&e->base.mem, e->words + STEPPER_SEGMENTS * STEPPER_SEGMENT_CBS);
+    if (dma_claim(channel, &e->base.mem) == NULL)
+        goto fail_mem;
+    for (s = 0; s < 32; s++) {
+        if ((used & (1 << s)) && pwm_gpio_output(s) == EXIT_FAILURE)
+            goto fail_gpio;
+    }
+    e->ring_words = e->words + STEPPER_SEGMENTS * STEPPER_SEGMENT_CBS + 1;
+    dma_ring_init(&e->base.ring, channel, &e->base.mem, STEPPER_SEGMENTS, e->ring_words);
+
+    dma_engine_init(&e->base, DMA_ENGINE_STEPPER, channel, hw);
+    e->base.size = axes;
+    pthread_cond_init(&e->wake, NULL);
+    pthread_cond_init(&e->space, NULL);
+    // The feeder must not catch signals meant for the main thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    err = pthread_create(&e->thread, NULL, feeder, e);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err) {
+        errno = err;
+        pwm_fatal("Error: Failed to start the stepper thread: %m\n");
+        pthread_mutex_destroy(&e->base.lock);
+        pthread_cond_destroy(&e->wake);
+        pthread_cond_destroy(&e->space);
+        pthread_cond_destroy(&e->base.idle);
+        goto fail_gpio;
+    }
+
+    dma_engine_register(&e->base);
+    return EXIT_SUCCESS;
+
+fail_gpio:
+    dma_release(channel);
+fail_mem:
+    dma_mem_free(&e->base.mem);
+    dma_pacer_release(hw);
+    free_engine(e);
+    return EXIT_FAILURE;
+}
+
+// Stops the feeder and the callers waiting for it (see stepper_close)
+static void
+wake_feeder(struct dma_engine *base)
+{
+    struct stepper_engine *e = (struct stepper_engine *)base;
+
+    __atomic_store_n(&e->abort, 1, __ATOMIC_RELEASE);
+    e->count = 0;
+    dma_reset(base->channel);
+    pthread_cond_broadcast(&e->wake);
+    pthread_cond_broadcast(&e->space);
+}
+
+// Stops the motion and the feeder thread, sets the gpios low and frees the
+// engine
+int
+stepper_close(int channel)
+{
+    struct stepper_engine *e;
+
+    if ((e = (struct stepper_engine *)dma_engine_close(channel, DMA_ENGINE_STEPPER, wake_feeder)) == NULL)
+        return EXIT_FAILURE;
+    pthread_join(e->thread, NULL);
+    pthread_cond_destroy(&e->wake);
+    pthread_cond_destroy(&e->space);
+    dma_engine_release(&e->base);
+    free_engine(e);
+    return EXIT_SUCCESS;
+}
+
+// Queues a move (one stepper_axis_move per axis), waiting while the queue
+// is full
+int
+stepper_move(int channel, const struct stepper_axis_move *moves)
+{
+    struct stepper_engine *e;
+    double max_velocity;
+    int a;
+
+    if ((e = (struct stepper_engine *)dma_engine_lock(channel, DMA_ENGINE_STEPPER)) == NULL)
+        return EXIT_FAILURE;
+    max_velocity = 1e9 / (2.0 * e->tick_ns);
+    for (a = 0; a < e->axes; a++) {
+        if (moves[a].steps == 0)
+            continue;
+        if (!(moves[a].velocity > 0 && moves[a].velocity <= max_velocity) || !(moves[a].accel > 0) || !(moves[a].jerk >= 0)) {
+            pthread_mutex_unlock(&e->base.lock);
+            return pwm_fatal("Error: axis %d: invalid velocity, acceleration or jerk (at most %.0f steps/s)\n", a, max_velocity);
+        }
+    }
+
+    e->base.waiters++;
+    while (e->count == STEPPER_QUEUE && !e->base.closing)
+        pthread_cond_wait(&e->space, &e->base.lock);
+    e->base.waiters--;
+    if (e->base.closing) {
+        pthread_cond_broadcast(&e->base.idle);
+        pthread_mutex_unlock(&e->base.lock);
+        return pwm_fatal("Error: the steppers on channel %d were closed\n", channel);
+    }
+    memset(&e->queue[(e->head + e->count) % STEPPER_QUEUE], 0, sizeof(struct stepper_move));
+    memcpy(e->queue[(e->head + e->count) % STEPPER_QUEUE].axis, moves, e->axes * sizeof(*moves));
+    e->count++;
+    e->busy = 1;
+    pthread_cond_signal(&e->wake);
+    pthread_mutex_unlock(&e->base.lock);
+    return EXIT_SUCCESS;
+}
+
+// Whether the feeder has moves to compile (see stepper_wait)
+static int
+feeding(const struct dma_engine *base)
+{
+    const struct stepper_engine *e = (const struct stepper_engine *)base;
+
+    return e->count || e->busy;
+}
+
+// Waits up to timeout_ms (forever if negative) until all moves were output.
+// Returns 1 if they were, 0 on timeout, -1 on errors.
+int
+stepper_wait(int channel, int timeout_ms)
+{
+    struct dma_engine *e;
+
+    if ((e = dma_engine_lock(channel, DMA_ENGINE_STEPPER)) == NULL)
+        return -1;
+    // The feeder compiles the queue, then the DMA outputs it
+    return dma_engine_wait(e, feeding, timeout_ms);
+}
+
+// Current positions (in steps from where the engine started) of all axes
+int
+stepper_position(int channel, int32_t *positions)
+{
+    struct stepper_engine *e;
+
+    if ((e = (struct stepper_engine *)dma_engine_lock(channel, DMA_ENGINE_STEPPER)) == NULL)
+        return EXIT_FAILURE;
+    derive_positions(e, positions);
+    pthread_mutex_unlock(&e->base.lock);
+    return EXIT_SUCCESS;
+}
+
+// Stops all axes at once (without deceleration) and drops the queued
+// moves. The positions stay where the DMA stopped.
+int
+stepper_stop(int channel)
+{
+    struct stepper_engine *e;
+    int32_t pos[STEPPER_AXES_MAX];
+
+    if ((e = (struct stepper_engine *)dma_engine_lock(channel, DMA_ENGINE_STEPPER)) == NULL)
+        return EXIT_FAILURE;
+    __atomic_store_n(&e->abort, 1, __ATOMIC_RELEASE);
+    e->count = 0;
+    dma_pause(channel);
+    derive_positions(e, pos);
+    dma_reset(channel);
+    pwm_gpio_clear(e->base.gpio_mask);
+
+    // Restart the ring once the feeder dropped what it compiled
+    while (e->busy)
+        pthread_cond_wait(&e->base.idle, &e->base.lock);
+    dma_ring_init(&e->base.ring, channel, &e->base.mem, STEPPER_SEGMENTS, e->ring_words);
+    memcpy(e->origin, pos, sizeof(pos));
+    memcpy(e->planned, pos, sizeof(pos));
+    e->open = 0;
+    e->tail_moving = 0;
+    __atomic_store_n(&e->abort, 0, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&e->space);
+    pthread_mutex_unlock(&e->base.lock);
+    return EXIT_SUCCESS;
+}
+
+// Number of axes of the engine on `channel` (0 if there is none)
+int
+stepper_axes(int channel)
+{
+    return dma_engine_size(channel, DMA_ENGINE_STEPPER);
+}
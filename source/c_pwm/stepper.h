@@ -0,0 +1,59 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * stepper.c drives step/direction stepper drivers (A4988, DRV8825, ...) on
+ * up to STEPPER_AXES_MAX axes with a DMA channel. Moves are compiled into
+ * trapezoidal or S-curve (jerk limited) step timing by a feeder thread,
+ * and streamed through a ring of control block segments.
+ */
+#ifndef RPIO_STEPPER_H
+#define RPIO_STEPPER_H
+
+#include <stdint.h>
+
+#define STEPPER_AXES_MAX    8
+#define STEPPER_TICK_NS     2000    // pacer period; a step pulse is one tick high
+#define STEPPER_DIR_SETUP   2       // ticks from a direction change to the first step
+#define STEPPER_SEGMENTS    8
+#define STEPPER_SEGMENT_CBS 2048    // control blocks per segment
+#define STEPPER_QUEUE       64      // queued moves
+
+// Move of one axis
+struct stepper_axis_move {
+    int32_t steps;      // the sign gives the direction
+    double velocity;    // maximum, in steps/s
+    double accel;       // maximum acceleration, in steps/s^2
+    double jerk;        // maximum jerk in steps/s^3 (0: trapezoidal profile)
+};
+
+int stepper_open(int channel, const int *step_gpios, const int *dir_gpios, int axes, int hw, uint32_t tick_ns);
+int stepper_close(int channel);
+int stepper_move(int channel, const struct stepper_axis_move *moves);
+int stepper_wait(int channel, int timeout_ms);
+int stepper_position(int channel, int32_t *positions);
+int stepper_stop(int channel);
+int stepper_axes(int channel);
+
+#endif
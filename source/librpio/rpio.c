@@ -0,0 +1,1039 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * rpio.c implements the librpio handle API (see rpio.h) on top of the same
+ * GPIO, PWM, timer and event sources that the Python extensions are built of.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "rpio.h"
+#include "c_gpio.h"
+#include "c_events.h"
+#include "counter.h"
+#include "capture.h"
+#include "protocol.h"
+#include "record.h"
+#include "rt.h"
+#include "timed.h"
+#include "systimer.h"
+#include "pwm.h"
+#include "dma.h"
+#include "led.h"
+#include "shift.h"
+#include "stepper.h"
+#include "stats.h"
+#include "trace.h"
+
+#define RPIO_ERROR_LEN 256
+
+// The public structs are cast to the internal ones below, so both must share
+// the same layout: the same size, and each field at the same offset and of
+// the same size
+#define SAME_SIZE(pub, priv) \
+    _Static_assert(sizeof(pub) == sizeof(struct priv), #pub " and struct " #priv " differ in size")
+#define SAME_FIELD(pub, priv, field) \
+    _Static_assert(offsetof(pub, field) == offsetof(struct priv, field) && \
+            sizeof(((pub *)0)->field) == sizeof(((struct priv *)0)->field), \
+            #pub "." #field " and struct " #priv "." #field " differ")
+
+SAME_SIZE(rpio_event_t, gpio_event);
+SAME_FIELD(rpio_event_t, gpio_event, timestamp_ns);
+SAME_FIELD(rpio_event_t, gpio_event, seqno);
+SAME_FIELD(rpio_event_t, gpio_event, gpio);
+SAME_FIELD(rpio_event_t, gpio_event, level);
+SAME_FIELD(rpio_event_t, gpio_event, edge);
+SAME_FIELD(rpio_event_t, gpio_event, listener);
+
+SAME_SIZE(rpio_edge_count_t, edge_count);
+SAME_FIELD(rpio_edge_count_t, edge_count, rising);
+SAME_FIELD(rpio_edge_count_t, edge_count, falling);
+SAME_FIELD(rpio_edge_count_t, edge_count, last_ns);
+SAME_FIELD(rpio_edge_count_t, edge_count, period_ns);
+SAME_FIELD(rpio_edge_count_t, edge_count, frequency_hz);
+
+SAME_SIZE(rpio_rt_profile_t, rt_profile);
+SAME_FIELD(rpio_rt_profile_t, rt_profile, policy);
+SAME_FIELD(rpio_rt_profile_t, rt_profile, priority);
+SAME_FIELD(rpio_rt_profile_t, rt_profile, cpu);
+SAME_FIELD(rpio_rt_profile_t, rt_profile, lock_memory);
+SAME_FIELD(rpio_rt_profile_t, rt_profile, stack_bytes);
+
+SAME_SIZE(rpio_timed_op_t, timed_op);
+SAME_FIELD(rpio_timed_op_t, timed_op, time_us);
+SAME_FIELD(rpio_timed_op_t, timed_op, type);
+SAME_FIELD(rpio_timed_op_t, timed_op, set_mask);
+SAME_FIELD(rpio_timed_op_t, timed_op, clear_mask);
+
+SAME_SIZE(rpio_timed_result_t, timed_result);
+SAME_FIELD(rpio_timed_result_t, timed_result, id);
+SAME_FIELD(rpio_timed_result_t, timed_result, status);
+SAME_FIELD(rpio_timed_result_t, timed_result, start_us);
+SAME_FIELD(rpio_timed_result_t, timed_result, count);
+SAME_FIELD(rpio_timed_result_t, timed_result, late_us);
+SAME_FIELD(rpio_timed_result_t, timed_result, read_count);
+SAME_FIELD(rpio_timed_result_t, timed_result, reads);
+
+SAME_SIZE(rpio_stats_t, stats_entry);
+SAME_FIELD(rpio_stats_t, stats_entry, calls);
+SAME_FIELD(rpio_stats_t, stats_entry, total_ns);
+SAME_FIELD(rpio_stats_t, stats_entry, max_ns);
+SAME_FIELD(rpio_stats_t, stats_entry, buckets);
+
+SAME_SIZE(rpio_pwm_pulse_t, pwm_pulse);
+SAME_FIELD(rpio_pwm_pulse_t, pwm_pulse, gpio);
+SAME_FIELD(rpio_pwm_pulse_t, pwm_pulse, width_start);
+SAME_FIELD(rpio_pwm_pulse_t, pwm_pulse, width);
+
+struct rpio_handle {
+    char error[RPIO_ERROR_LEN];
+};
+
+struct rpio_pwm_channel {
+    rpio_t *rpio;
+    int channel;
+};
+
+struct rpio_led_strips {
+    rpio_t *rpio;
+    int channel;
+};
+
+struct rpio_shift {
+    rpio_t *rpio;
+    int channel;
+};
+
+struct rpio_steppers {
+    rpio_t *rpio;
+    int channel;
+    int axes;
+};
+
+struct rpio_events {
+    rpio_t *rpio;
+};
+
+// Number of open handles sharing the hardware mappings. handles_lock is held
+// while the first handle sets the hardware up and the last tears it down.
+static int open_handles = 0;
+static pthread_mutex_t handles_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+set_error(rpio_t *rpio, const char *msg)
+{
+    snprintf(rpio->error, RPIO_ERROR_LEN, "%s", msg);
+    return -1;
+}
+
+static int
+set_errno_error(rpio_t *rpio, const char *what)
+{
+    snprintf(rpio->error, RPIO_ERROR_LEN, "%s: %s", what, strerror(errno));
+    return -1;
+}
+
+// pwm.c runs in soft-fatal mode and keeps the message of the last error
+static int
+set_pwm_error(rpio_t *rpio)
+{
+    return set_error(rpio, get_error_message());
+}
+
+static int
+check_gpio(rpio_t *rpio, int gpio)
+{
+    if (gpio < 0 || gpio >= GPIO_COUNT)
+        return set_error(rpio, "Invalid gpio (must be between 0 and 53)");
+    return 0;
+}
+
+const char *
+rpio_version(void)
+{
+    return "0.10.1";
+}
+
+int
+rpio_is_simulated(void)
+{
+    return simulation_enabled();
+}
+
+// Opens a library handle. The first handle maps the GPIO registers and the
+// system timer. Returns NULL if the hardware cannot be accessed (errno is
+// EACCES if /dev/mem could not be opened).
+rpio_t *
+rpio_open(void)
+{
+    rpio_t *rpio;
+    int result;
+
+    if ((rpio = calloc(1, sizeof(*rpio))) == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&handles_lock);
+    if (open_handles == 0) {
+        result = setup();
+        if (result != SETUP_OK) {
+            pthread_mutex_unlock(&handles_lock);
+            free(rpio);
+            errno = result == SETUP_DEVMEM_FAIL ? EACCES : ENOMEM;
+            return NULL;
+        }
+        // Never exit() the host program from within pwm.c
+        set_softfatal(1);
+        set_loglevel(LOG_LEVEL_ERRORS);
+    }
+    open_handles++;
+    pthread_mutex_unlock(&handles_lock);
+    return rpio;
+}
+
+// Closes a handle. Closing the last handle stops all PWM and event activity
+// and unmaps the hardware.
+void
+rpio_close(rpio_t *rpio)
+{
+    if (rpio == NULL)
+        return;
+    free(rpio);
+    pthread_mutex_lock(&handles_lock);
+    if (--open_handles > 0) {
+        pthread_mutex_unlock(&handles_lock);
+        return;
+    }
+
+    if (is_setup())
+        pwm_shutdown();
+    else
+        dma_shutdown();
+    timed_stop();
+    replay_stop();
+    if (record_active())
+        record_stop();
+    events_cleanup();
+    counter_cleanup();
+    proto_cleanup();
+    cleanup();
+    pthread_mutex_unlock(&handles_lock);
+}
+
+const char *
+rpio_last_error(const rpio_t *rpio)
+{
+    return rpio->error;
+}
+
+int
+rpio_gpio_setup(rpio_t *rpio, int gpio, int direction, int pud)
+{
+    if (check_gpio(rpio, gpio) < 0)
+        return -1;
+    if (direction != RPIO_INPUT && direction != RPIO_OUTPUT)
+        return set_error(rpio, "Invalid direction");
+    if (pud != RPIO_PUD_OFF && pud != RPIO_PUD_DOWN && pud != RPIO_PUD_UP)
+        return set_error(rpio, "Invalid pull_up_down");
+    setup_gpio(gpio, direction, direction == RPIO_OUTPUT ? PUD_OFF : pud);
+    return 0;
+}
+
+int
+rpio_gpio_setup_pins(rpio_t *rpio, const rpio_pin_setup_t *pins, int count)
+{
+    struct pin_setup setup[GPIO_COUNT];
+    int i;
+
+    if (count < 0 || count > GPIO_COUNT)
+        return set_error(rpio, "Invalid number of pins");
+    for (i=0; i<count; i++) {
+        if (check_gpio(rpio, pins[i].gpio) < 0)
+            return -1;
+        if (pins[i].direction != RPIO_INPUT && pins[i].direction != RPIO_OUTPUT)
+            return set_error(rpio, "Invalid direction");
+        if (pins[i].pud != RPIO_PUD_OFF && pins[i].pud != RPIO_PUD_DOWN && pins[i].pud != RPIO_PUD_UP)
+            return set_error(rpio, "Invalid pull_up_down");
+        setup[i].gpio = pins[i].gpio;
+        setup[i].direction = pins[i].direction;
+        setup[i].pud = pins[i].direction == RPIO_OUTPUT ? PUD_OFF : pins[i].pud;
+    }
+    if (setup_pins(setup, count) < 0)
+        return set_error(rpio, "Invalid gpio (listed more than once)");
+    return 0;
+}
+
+int
+rpio_gpio_set_pull(rpio_t *rpio, int gpio, int pud)
+{
+    if (check_gpio(rpio, gpio) < 0)
+        return -1;
+    if (pud != RPIO_PUD_OFF && pud != RPIO_PUD_DOWN && pud != RPIO_PUD_UP)
+        return set_error(rpio, "Invalid pull_up_down");
+    set_pullupdn(gpio, pud);
+    return 0;
+}
+
+// Returns the raw function select value (0=input, 1=output, 4=alt0, ...)
+int
+rpio_gpio_function(rpio_t *rpio, int gpio)
+{
+    if (check_gpio(rpio, gpio) < 0)
+        return -1;
+    return gpio_function(gpio);
+}
+
+int
+rpio_gpio_write(rpio_t *rpio, int gpio, int value)
+{
+    if (check_gpio(rpio, gpio) < 0)
+        return -1;
+    output_gpio(gpio, value);
+    return 0;
+}
+
+int
+rpio_gpio_read(rpio_t *rpio, int gpio)
+{
+    if (check_gpio(rpio, gpio) < 0)
+        return -1;
+    return input_gpio(gpio) ? 1 : 0;
+}
+
+int
+rpio_gpio_write_mask(rpio_t *rpio, int bank, uint32_t set_mask, uint32_t clear_mask)
+{
+    if (bank != 0 && bank != 1)
+        return set_error(rpio, "Invalid bank (must be 0 or 1)");
+    output_gpio_mask(bank, set_mask, clear_mask);
+    return 0;
+}
+
+uint32_t
+rpio_gpio_read_bank(rpio_t *rpio, int bank)
+{
+    if (bank != 0 && bank != 1) {
+        set_error(rpio, "Invalid bank (must be 0 or 1)");
+        return 0;
+    }
+    return input_gpio_bank(bank);
+}
+
+volatile uint32_t *
+rpio_gpio_registers(rpio_t *rpio)
+{
+    return gpio_registers();
+}
+
+uint64_t
+rpio_now_us(void)
+{
+    return now_us();
+}
+
+void
+rpio_delay_us(uint32_t us)
+{
+    delay_us(us);
+}
+
+void
+rpio_delay_ns(uint32_t ns)
+{
+    delay_ns(ns);
+}
+
+void
+rpio_sleep_us(uint32_t us)
+{
+    sleep_us(us);
+}
+
+// Sets up PWM timing once per process. Calling it again with the same
+// granularity is a no-op.
+int
+rpio_pwm_setup(rpio_t *rpio, int pulse_incr_us, int delay_hw)
+{
+    if (is_setup()) {
+        if (get_pulse_incr_us() != pulse_incr_us)
+            return set_error(rpio, "PWM is already set up with a different pulse width increment");
+        return 0;
+    }
+    if (pwm_setup(pulse_incr_us, delay_hw) == EXIT_FAILURE)
+        return set_pwm_error(rpio);
+    return 0;
+}
+
+rpio_pwm_channel_t *
+rpio_pwm_channel_open(rpio_t *rpio, int dma_channel, int subcycle_time_us)
+{
+    rpio_pwm_channel_t *channel;
+
+    if ((channel = calloc(1, sizeof(*channel))) == NULL) {
+        set_errno_error(rpio, "Failed to allocate channel");
+        return NULL;
+    }
+    if (init_channel(dma_channel, subcycle_time_us) == EXIT_FAILURE) {
+        set_pwm_error(rpio);
+        free(channel);
+        return NULL;
+    }
+    channel->rpio = rpio;
+    channel->channel = dma_channel;
+    return channel;
+}
+
+// Stops the channel and releases its DMA memory
+void
+rpio_pwm_channel_close(rpio_pwm_channel_t *channel)
+{
+    if (channel == NULL)
+        return;
+    free_channel(channel->channel);
+    free(channel);
+}
+
+int
+rpio_pwm_add_pulse(rpio_pwm_channel_t *channel, int gpio, int width_start, int width)
+{
+    if (add_channel_pulse(channel->channel, gpio, width_start, width) == EXIT_FAILURE)
+        return set_pwm_error(channel->rpio);
+    return 0;
+}
+
+int
+rpio_pwm_clear_gpio(rpio_pwm_channel_t *channel, int gpio)
+{
+    if (clear_channel_gpio(channel->channel, gpio) == EXIT_FAILURE)
+        return set_pwm_error(channel->rpio);
+    return 0;
+}
+
+int
+rpio_pwm_clear(rpio_pwm_channel_t *channel)
+{
+    if (clear_channel(channel->channel) == EXIT_FAILURE)
+        return set_pwm_error(channel->rpio);
+    return 0;
+}
+
+int
+rpio_pwm_set_pulses(rpio_pwm_channel_t *channel, uint32_t gpio_mask, const rpio_pwm_pulse_t *pulses, int count)
+{
+    if (set_channel_pulses(channel->channel, gpio_mask, (const struct pwm_pulse *) pulses, count) == EXIT_FAILURE)
+        return set_pwm_error(channel->rpio);
+    return 0;
+}
+
+rpio_led_strips_t *
+rpio_led_open(rpio_t *rpio, int dma_channel, const int *gpios, int count, int leds, const char *order, int delay_hw, uint32_t period_ns)
+{
+    rpio_led_strips_t *strips;
+
+    if ((strips = calloc(1, sizeof(*strips))) == NULL) {
+        set_errno_error(rpio, "Failed to allocate LED strips");
+        return NULL;
+    }
+    if (led_open(dma_channel, gpios, count, leds, order ? order : "GRB", delay_hw, period_ns ? period_ns : LED_PERIOD_NS) == EXIT_FAILURE) {
+        set_pwm_error(rpio);
+        free(strips);
+        return NULL;
+    }
+    strips->rpio = rpio;
+    strips->channel = dma_channel;
+    return strips;
+}
+
+// Stops the strips, sets their gpios low and releases the DMA channel
+void
+rpio_led_close(rpio_led_strips_t *strips)
+{
+    if (strips == NULL)
+        return;
+    led_close(strips->channel);
+    free(strips);
+}
+
+int
+rpio_led_show(rpio_led_strips_t *strips, const uint8_t *pixels)
+{
+    if (led_show(strips->channel, pixels) == EXIT_FAILURE)
+        return set_pwm_error(strips->rpio);
+    return 0;
+}
+
+int
+rpio_led_wait(rpio_led_strips_t *strips, int timeout_ms)
+{
+    int result = led_wait(strips->channel, timeout_ms);
+
+    if (result < 0)
+        return set_pwm_error(strips->rpio);
+    return result;
+}
+
+int64_t
+rpio_led_frames(rpio_led_strips_t *strips)
+{
+    uint32_t frames;
+
+    if (led_frames(strips->channel, &frames) == EXIT_FAILURE)
+        return set_pwm_error(strips->rpio);
+    return frames;
+}
+
+rpio_shift_t *
+rpio_shift_open(rpio_t *rpio, int dma_channel, int clock, int latch, const int *data, int lines, int bytes, int flags, int delay_hw, uint32_t period_ns)
+{
+    rpio_shift_t *shift;
+
+    if ((shift = calloc(1, sizeof(*shift))) == NULL) {
+        set_errno_error(rpio, "Failed to allocate shift output");
+        return NULL;
+    }
+    if (shift_open(dma_channel, clock, latch, data, lines, bytes, flags, delay_hw, period_ns ? period_ns : SHIFT_PERIOD_NS) == EXIT_FAILURE) {
+        set_pwm_error(rpio);
+        free(shift);
+        return NULL;
+    }
+    shift->rpio = rpio;
+    shift->channel = dma_channel;
+    return shift;
+}
+
+// Stops the output, sets its gpios low and releases the DMA channel
+void
+rpio_shift_close(rpio_shift_t *shift)
+{
+    if (shift == NULL)
+        return;
+    shift_close(shift->channel);
+    free(shift);
+}
+
+int
+rpio_shift_write(rpio_shift_t *shift, const uint8_t *data)
+{
+    if (shift_write(shift->channel, data) == EXIT_FAILURE)
+        return set_pwm_error(shift->rpio);
+    return 0;
+}
+
+int
+rpio_shift_wait(rpio_shift_t *shift, int timeout_ms)
+{
+    int result = shift_wait(shift->channel, timeout_ms);
+
+    if (result < 0)
+        return set_pwm_error(shift->rpio);
+    return result;
+}
+
+int64_t
+rpio_shift_frames(rpio_shift_t *shift)
+{
+    uint32_t frames;
+
+    if (shift_frames(shift->channel, &frames) == EXIT_FAILURE)
+        return set_pwm_error(shift->rpio);
+    return frames;
+}
+
+rpio_steppers_t *
+rpio_stepper_open(rpio_t *rpio, int dma_channel, const int *step_gpios, const int *dir_gpios, int axes, int delay_hw, uint32_t tick_ns)
+{
+    rpio_steppers_t *steppers;
+    int dirs[STEPPER_AXES_MAX], i;
+
+    if (axes < 1 || axes > STEPPER_AXES_MAX) {
+        set_error(rpio, "1 to 8 axes are supported");
+        return NULL;
+    }
+    for (i = 0; i < axes; i++)
+        dirs[i] = dir_gpios ? dir_gpios[i] : -1;
+    if ((steppers = calloc(1, sizeof(*steppers))) == NULL) {
+        set_errno_error(rpio, "Failed to allocate steppers");
+        return NULL;
+    }
+    if (stepper_open(dma_channel, step_gpios, dirs, axes, delay_hw, tick_ns ? tick_ns : STEPPER_TICK_NS) == EXIT_FAILURE) {
+        set_pwm_error(rpio);
+        free(steppers);
+        return NULL;
+    }
+    steppers->rpio = rpio;
+    steppers->channel = dma_channel;
+    steppers->axes = axes;
+    return steppers;
+}
+
+// Stops the axes, sets their gpios low and releases the DMA channel
+void
+rpio_stepper_close(rpio_steppers_t *steppers)
+{
+    if (steppers == NULL)
+        return;
+    stepper_close(steppers->channel);
+    free(steppers);
+}
+
+int
+rpio_stepper_move(rpio_steppers_t *steppers, const rpio_stepper_move_t *moves)
+{
+    struct stepper_axis_move axis[STEPPER_AXES_MAX];
+    int i;
+
+    for (i = 0; i < steppers->axes; i++) {
+        axis[i].steps = moves[i].steps;
+        axis[i].velocity = moves[i].velocity;
+        axis[i].accel = moves[i].accel;
+        axis[i].jerk = moves[i].jerk;
+    }
+    if (stepper_move(steppers->channel, axis) == EXIT_FAILURE)
+        return set_pwm_error(steppers->rpio);
+    return 0;
+}
+
+int
+rpio_stepper_wait(rpio_steppers_t *steppers, int timeout_ms)
+{
+    int result = stepper_wait(steppers->channel, timeout_ms);
+
+    if (result < 0)
+        return set_pwm_error(steppers->rpio);
+    return result;
+}
+
+int
+rpio_stepper_position(rpio_steppers_t *steppers, int32_t *positions)
+{
+    if (stepper_position(steppers->channel, positions) == EXIT_FAILURE)
+        return set_pwm_error(steppers->rpio);
+    return 0;
+}
+
+int
+rpio_stepper_stop(rpio_steppers_t *steppers)
+{
+    if (stepper_stop(steppers->channel) == EXIT_FAILURE)
+        return set_pwm_error(steppers->rpio);
+    return 0;
+}
+
+rpio_events_t *
+rpio_events_open(rpio_t *rpio)
+{
+    rpio_events_t *events;
+
+    if ((events = calloc(1, sizeof(*events))) == NULL) {
+        set_errno_error(rpio, "Failed to allocate event engine");
+        return NULL;
+    }
+    if (events_setup() < 0) {
+        set_errno_error(rpio, "Failed to set up event engine");
+        free(events);
+        return NULL;
+    }
+    events->rpio = rpio;
+    return events;
+}
+
+// Stops edge detection on all gpios and unexports the ones the engine exported
+void
+rpio_events_close(rpio_events_t *events)
+{
+    if (events == NULL)
+        return;
+    events_cleanup();
+    free(events);
+}
+
+int
+rpio_events_set_backend(rpio_events_t *events, int backend, const char *chip)
+{
+    if (events_set_backend(backend, chip) < 0)
+        return set_errno_error(events->rpio, "Failed to set event backend");
+    return 0;
+}
+
+int
+rpio_events_fd(rpio_events_t *events)
+{
+    return events_fileno();
+}
+
+int
+rpio_events_add(rpio_events_t *events, int gpio, int edge)
+{
+    if (events_add_gpio(gpio, edge) < 0)
+        return set_errno_error(events->rpio, "Failed to add gpio to event engine");
+    return 0;
+}
+
+int
+rpio_events_remove(rpio_events_t *events, int gpio)
+{
+    if (events_del_gpio(gpio) < 0)
+        return set_errno_error(events->rpio, "Failed to remove gpio from event engine");
+    return 0;
+}
+
+int
+rpio_events_set_filter(rpio_events_t *events, int gpio, int filter, uint32_t width_us)
+{
+    if (events_set_filter(gpio, filter, width_us) < 0)
+        return set_errno_error(events->rpio, "Failed to set event filter");
+    return 0;
+}
+
+// Returns the listener id, or -1
+int
+rpio_events_listen(rpio_events_t *events, int gpio, int edge, int filter, uint32_t width_us)
+{
+    int id;
+
+    if ((id = events_listen(gpio, edge, filter, width_us)) < 0)
+        return set_errno_error(events->rpio, "Failed to add event listener");
+    return id;
+}
+
+int
+rpio_events_unlisten(rpio_events_t *events, int id)
+{
+    if (events_unlisten(id) < 0)
+        return set_errno_error(events->rpio, "Failed to remove event listener");
+    return 0;
+}
+
+int
+rpio_events_publish(rpio_events_t *events, int id)
+{
+    if (events_set_sink(id, proto_publish) < 0)
+        return set_errno_error(events->rpio, "Failed to publish listener");
+    return 0;
+}
+
+// Waits up to timeout_ms (-1 = forever) and returns the number of events
+// written to `out`
+int
+rpio_events_wait(rpio_events_t *events, rpio_event_t *out, int max_events, int timeout_ms)
+{
+    int n;
+
+    // rpio_event_t and struct gpio_event share the same layout
+    n = events_read((struct gpio_event *)out, max_events, timeout_ms);
+    if (n < 0)
+        return set_errno_error(events->rpio, "Failed to read events");
+    return n;
+}
+
+int
+rpio_wait_for_edge(rpio_t *rpio, const int *gpios, int count, int edge, int timeout_ms, rpio_event_t *out)
+{
+    int n;
+
+    do {
+        n = events_wait_edge(gpios, count, edge, timeout_ms, (struct gpio_event *)out);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        return set_errno_error(rpio, "Failed to wait for edge");
+    return n;
+}
+
+int
+rpio_counter_start(rpio_t *rpio, int gpio, int edge, uint32_t window_ms)
+{
+    if (counter_start(gpio, edge, window_ms) < 0)
+        return set_errno_error(rpio, "Failed to start edge counter");
+    return 0;
+}
+
+int
+rpio_counter_stop(rpio_t *rpio, int gpio)
+{
+    if (counter_stop(gpio) < 0)
+        return set_errno_error(rpio, "Failed to stop edge counter");
+    return 0;
+}
+
+int
+rpio_counter_read(rpio_t *rpio, int gpio, rpio_edge_count_t *out, int reset)
+{
+    // rpio_edge_count_t and struct edge_count share the same layout
+    if (counter_read(gpio, (struct edge_count *)out, reset) < 0)
+        return set_errno_error(rpio, "Failed to read edge counter");
+    return 0;
+}
+
+int
+rpio_rt_configure(rpio_t *rpio, const rpio_rt_profile_t *profile)
+{
+    // rpio_rt_profile_t and struct rt_profile share the same layout
+    if (rt_configure((const struct rt_profile *)profile) < 0)
+        return set_errno_error(rpio, "Failed to configure real-time profile");
+    return 0;
+}
+
+int
+rpio_rt_apply(rpio_t *rpio)
+{
+    if (rt_apply() < 0)
+        return set_errno_error(rpio, "Failed to apply real-time profile");
+    return 0;
+}
+
+int
+rpio_capture(rpio_t *rpio, void *out, size_t n, const int *gpios, int count, uint32_t interval_ns, int format, int cpu, uint64_t *elapsed_ns)
+{
+    if (capture_levels(out, n, gpios, count, interval_ns, format, cpu, elapsed_ns) < 0)
+        return set_errno_error(rpio, "Failed to capture levels");
+    return 0;
+}
+
+size_t
+rpio_capture_edges(const uint32_t *words, size_t n, int gpio, int edge, uint32_t *indices, size_t max)
+{
+    return capture_edges(words, n, gpio, edge, indices, max);
+}
+
+double
+rpio_capture_duty(const uint32_t *words, size_t n, int gpio)
+{
+    struct capture_stats stats;
+
+    capture_stats(words, n, gpio, &stats);
+    return n ? (double)stats.high / n : 0.0;
+}
+
+double
+rpio_capture_frequency(const uint32_t *words, size_t n, int gpio, double rate)
+{
+    struct capture_stats stats;
+
+    capture_stats(words, n, gpio, &stats);
+    if (stats.rising < 2)
+        return 0.0;
+    return (stats.rising - 1) * rate / (stats.last_rising - stats.first_rising);
+}
+
+int
+rpio_record_start(rpio_t *rpio, const char *path)
+{
+    if (record_start(path) < 0)
+        return set_errno_error(rpio, "Failed to start recording");
+    return 0;
+}
+
+int
+rpio_record_stop(rpio_t *rpio)
+{
+    if (record_stop() < 0)
+        return set_errno_error(rpio, "Failed to write recording");
+    return 0;
+}
+
+void
+rpio_record_events(rpio_t *rpio, const rpio_event_t *events, int count)
+{
+    // rpio_event_t and struct gpio_event share the same layout
+    record_events((const struct gpio_event *)events, count);
+}
+
+int
+rpio_replay_start(rpio_t *rpio, const char *path, double speed, uint64_t start_ns, int flags)
+{
+    if (replay_start(path, speed, start_ns, flags) < 0)
+        return set_errno_error(rpio, "Failed to start replay");
+    return 0;
+}
+
+void
+rpio_replay_stop(rpio_t *rpio)
+{
+    replay_stop();
+}
+
+int
+rpio_timed_start(rpio_t *rpio, int cpu)
+{
+    if (timed_start(cpu) < 0)
+        return set_errno_error(rpio, "Failed to start timed executor");
+    return 0;
+}
+
+void
+rpio_timed_stop(rpio_t *rpio)
+{
+    timed_stop();
+}
+
+int
+rpio_timed_submit(rpio_t *rpio, const rpio_timed_op_t *ops, uint32_t count, uint64_t start_us)
+{
+    int id;
+
+    // rpio_timed_op_t and struct timed_op share the same layout
+    if ((id = timed_submit((const struct timed_op *)ops, count, start_us)) < 0)
+        return set_errno_error(rpio, "Failed to submit timed schedule");
+    return id;
+}
+
+int
+rpio_timed_fileno(rpio_t *rpio)
+{
+    return timed_fileno();
+}
+
+int
+rpio_timed_collect(rpio_t *rpio, rpio_timed_result_t *result)
+{
+    return timed_collect((struct timed_result *)result);
+}
+
+void
+rpio_timed_result_free(rpio_timed_result_t *result)
+{
+    timed_result_free((struct timed_result *)result);
+}
+
+// Executes the PWM commands of the binary protocol
+static int
+protocol_pwm_handler(int channel, int gpio, int width)
+{
+    return set_channel_gpio_width(channel, gpio, width) == EXIT_SUCCESS ? 0 : -1;
+}
+
+int
+rpio_protocol_open(rpio_t *rpio, int fd)
+{
+    proto_set_pwm_handler(protocol_pwm_handler);
+    if (proto_open(fd) < 0)
+        return set_errno_error(rpio, "Failed to open protocol connection");
+    return 0;
+}
+
+int
+rpio_protocol_close(rpio_t *rpio, int fd)
+{
+    if (proto_close(fd) < 0)
+        return set_errno_error(rpio, "Failed to close protocol connection");
+    return 0;
+}
+
+int
+rpio_protocol_input(rpio_t *rpio, int fd)
+{
+    int flags;
+
+    if ((flags = proto_input(fd)) < 0)
+        return set_errno_error(rpio, "Protocol connection failed");
+    return flags;
+}
+
+int
+rpio_protocol_flush(rpio_t *rpio, int fd)
+{
+    int flags;
+
+    if ((flags = proto_flush(fd)) < 0)
+        return set_errno_error(rpio, "Protocol connection failed");
+    return flags;
+}
+
+int
+rpio_protocol_datagrams(rpio_t *rpio, int fd)
+{
+    int count;
+
+    proto_set_pwm_handler(protocol_pwm_handler);
+    if ((count = proto_datagrams(fd)) < 0)
+        return set_errno_error(rpio, "Failed to receive datagrams");
+    return count;
+}
+
+int
+rpio_protocol_pending(rpio_t *rpio, int *fds, int max)
+{
+    return proto_pending(fds, max);
+}
+
+int
+rpio_protocol_publish(rpio_t *rpio, const rpio_event_t *events, int count)
+{
+    // rpio_event_t and struct gpio_event share the same layout
+    return proto_publish((const struct gpio_event *)events, count);
+}
+
+int
+rpio_stats_count(void)
+{
+    return STATS_COUNT;
+}
+
+const char *
+rpio_stats_name(int id)
+{
+    return stats_name(id);
+}
+
+int
+rpio_stats_get(int id, rpio_stats_t *stats)
+{
+    if (id == STAT_PAGE_FAULTS)
+        rt_update_stats();
+    // rpio_stats_t and struct stats_entry share the same layout
+    return stats_get(id, (struct stats_entry *)stats);
+}
+
+void
+rpio_stats_reset(void)
+{
+    stats_reset();
+}
+
+void
+rpio_trace_enable(int enabled)
+{
+    trace_enable(enabled);
+}
+
+void
+rpio_trace_clear(void)
+{
+    trace_clear();
+}
+
+int
+rpio_trace_dump(const char *path)
+{
+    return trace_dump(path) < 0 ? -1 : 0;
+}
+
+int
+rpio_trace_dump_on_signal(int signum, const char *path)
+{
+    return trace_dump_on_signal(signum, path) < 0 ? -1 : 0;
+}
@@ -0,0 +1,403 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * rpio.h is the public C API of librpio, the standalone RPIO library. It
+ * exposes GPIO input and output (single pins and whole banks), the system
+ * timer, DMA PWM channels and the GPIO event engine, without requiring Python.
+ *
+ * All functions operate on opaque handles. The hardware itself is a process
+ * wide resource: every rpio_t shares the same register mappings (they are
+ * reference counted and released when the last handle is closed).
+ *
+ * Functions returning int return 0 (or a count) on success and -1 on error;
+ * rpio_last_error(handle) then describes the problem. librpio never exits
+ * the process on errors.
+ *
+ * Build with `make -C source/librpio` and link with `pkg-config --libs librpio`.
+ */
+#ifndef RPIO_H
+#define RPIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RPIO_VERSION_MAJOR 0
+#define RPIO_VERSION_MINOR 10
+#define RPIO_VERSION_PATCH 1
+
+#if defined(RPIO_BUILDING_LIBRARY)
+#define RPIO_API __attribute__((visibility("default")))
+#else
+#define RPIO_API
+#endif
+
+// GPIO directions and pull-up/down modes
+#define RPIO_INPUT    1
+#define RPIO_OUTPUT   0
+#define RPIO_PUD_OFF  0
+#define RPIO_PUD_DOWN 1
+#define RPIO_PUD_UP   2
+
+// Edge detection modes for the event engine
+#define RPIO_EDGE_NONE    0
+#define RPIO_EDGE_RISING  1
+#define RPIO_EDGE_FALLING 2
+#define RPIO_EDGE_BOTH    3
+
+// Event engine backends (see rpio_events_set_backend)
+#define RPIO_EVENTS_SYSFS    0
+#define RPIO_EVENTS_GPIOCHIP 1
+
+// Input filters of the event engine (see rpio_events_set_filter)
+#define RPIO_FILTER_NONE       0
+#define RPIO_FILTER_STABLE     1
+#define RPIO_FILTER_HOLDOFF    2
+#define RPIO_FILTER_INTEGRATOR 3
+
+// Listener id of events which belong to the gpio itself
+#define RPIO_LISTENER_NONE 0xffffffff
+
+// Flags of rpio_protocol_input() and rpio_protocol_flush()
+#define RPIO_PROTOCOL_WANT_READ  1  // the connection accepts input
+#define RPIO_PROTOCOL_WANT_WRITE 2  // responses are pending (wait until writable)
+#define RPIO_PROTOCOL_SUBSCRIBED 4  // the connection changed its subscriptions
+
+// rpio_capture() formats
+#define RPIO_CAPTURE_WORDS 0
+#define RPIO_CAPTURE_BITS  1
+
+// rpio_replay_start() flags
+#define RPIO_REPLAY_INJECT 1  // feed the edges into the event engine
+#define RPIO_REPLAY_OUTPUT 2  // drive the recorded levels on the pins
+
+// Operations of timed schedules (see rpio_timed_submit)
+#define RPIO_TIMED_WRITE 1  // set set_mask, then clear clear_mask
+#define RPIO_TIMED_WAIT  2  // only wait for time_us
+#define RPIO_TIMED_READ  3  // read the levels of gpio 0..31
+
+// rpio_shift_open() flags
+#define RPIO_SHIFT_LSB_FIRST 1
+
+// Timing hardware for DMA PWM
+#define RPIO_PWM_DELAY_VIA_PWM 0
+#define RPIO_PWM_DELAY_VIA_PCM 1
+
+typedef struct rpio_handle rpio_t;
+typedef struct rpio_pwm_channel rpio_pwm_channel_t;
+typedef struct rpio_led_strips rpio_led_strips_t;
+typedef struct rpio_shift rpio_shift_t;
+typedef struct rpio_steppers rpio_steppers_t;
+typedef struct rpio_events rpio_events_t;
+
+typedef struct {
+    int gpio;
+    int width_start;
+    int width;
+} rpio_pwm_pulse_t;
+
+typedef struct {
+    int gpio;
+    int direction;  // RPIO_INPUT or RPIO_OUTPUT
+    int pud;        // RPIO_PUD_*
+} rpio_pin_setup_t;
+
+typedef struct {
+    uint64_t timestamp_ns;  // CLOCK_MONOTONIC
+    uint32_t seqno;
+    uint16_t gpio;
+    uint8_t level;
+    uint8_t edge;           // RPIO_EDGE_RISING or RPIO_EDGE_FALLING
+    uint32_t listener;      // rpio_events_listen() id, or RPIO_LISTENER_NONE
+} rpio_event_t;
+
+typedef struct {
+    uint64_t rising;        // counted rising edges
+    uint64_t falling;       // counted falling edges
+    uint64_t last_ns;       // CLOCK_MONOTONIC time of the last counted edge
+    uint64_t period_ns;     // time between the last two edges of one kind
+    double frequency_hz;    // signal periods per second over the window
+} rpio_edge_count_t;
+
+// Real-time profile of librpio's threads (see rpio_rt_configure)
+typedef struct {
+    int policy;             // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+    int priority;           // 1..99 with SCHED_FIFO and SCHED_RR
+    int cpu;                // CPU to pin the threads to, -1: any
+    int lock_memory;        // mlockall() current and future mappings
+    size_t stack_bytes;     // stack pre-faulted by each thread
+} rpio_rt_profile_t;
+
+// Timed operation on gpio 0..31, at time_us after the start of its schedule
+typedef struct {
+    uint64_t time_us;
+    uint32_t type;          // RPIO_TIMED_*
+    uint32_t set_mask;      // RPIO_TIMED_WRITE
+    uint32_t clear_mask;
+} rpio_timed_op_t;
+
+// Result of a timed schedule; free it with rpio_timed_result_free()
+typedef struct {
+    uint32_t id;            // of rpio_timed_submit()
+    int status;             // 0, or ECANCELED if it was stopped
+    uint64_t start_us;      // system timer time the schedule started at
+    uint32_t count;         // executed operations
+    int32_t *late_us;       // per executed operation: actual - requested time
+    uint32_t read_count;
+    uint32_t *reads;        // levels of the RPIO_TIMED_READ operations
+} rpio_timed_result_t;
+
+// Move of one stepper axis (see rpio_stepper_move)
+typedef struct {
+    int32_t steps;          // the sign gives the direction
+    double velocity;        // maximum, in steps/s
+    double accel;           // maximum acceleration, in steps/s^2
+    double jerk;            // maximum jerk in steps/s^3 (0: trapezoidal)
+} rpio_stepper_move_t;
+
+// Runtime statistics of one instrumented function (or counter, which only
+// uses `calls`). buckets[i] counts calls which took [2^i, 2^(i+1)) ns.
+#define RPIO_STATS_BUCKETS 32
+
+typedef struct {
+    uint64_t calls;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[RPIO_STATS_BUCKETS];
+} rpio_stats_t;
+
+// Library handle. Handles may be opened and closed from any thread.
+RPIO_API rpio_t *rpio_open(void);
+RPIO_API void rpio_close(rpio_t *rpio);
+RPIO_API const char *rpio_last_error(const rpio_t *rpio);
+RPIO_API const char *rpio_version(void);
+RPIO_API int rpio_is_simulated(void);
+
+// GPIO (BCM numbering)
+RPIO_API int rpio_gpio_setup(rpio_t *rpio, int gpio, int direction, int pud);
+RPIO_API int rpio_gpio_setup_pins(rpio_t *rpio, const rpio_pin_setup_t *pins, int count);
+RPIO_API int rpio_gpio_set_pull(rpio_t *rpio, int gpio, int pud);
+RPIO_API int rpio_gpio_function(rpio_t *rpio, int gpio);
+RPIO_API int rpio_gpio_write(rpio_t *rpio, int gpio, int value);
+RPIO_API int rpio_gpio_read(rpio_t *rpio, int gpio);
+
+// Bulk I/O on a whole bank (0: gpio 0..31, 1: gpio 32..53)
+RPIO_API int rpio_gpio_write_mask(rpio_t *rpio, int bank, uint32_t set_mask, uint32_t clear_mask);
+RPIO_API uint32_t rpio_gpio_read_bank(rpio_t *rpio, int bank);
+
+// The mapped GPIO register block, for direct access (see rpio.hpp). Word
+// offsets: GPSET0 = 7, GPCLR0 = 10, GPLEV0 = 13 (+1 for bank 1).
+RPIO_API volatile uint32_t *rpio_gpio_registers(rpio_t *rpio);
+
+// System timer
+RPIO_API uint64_t rpio_now_us(void);
+RPIO_API void rpio_delay_us(uint32_t us);
+RPIO_API void rpio_delay_ns(uint32_t ns);
+RPIO_API void rpio_sleep_us(uint32_t us);
+
+// DMA PWM. rpio_pwm_setup() must be called once before opening channels; it
+// also installs signal handlers which stop all DMA activity on termination.
+RPIO_API int rpio_pwm_setup(rpio_t *rpio, int pulse_incr_us, int delay_hw);
+RPIO_API rpio_pwm_channel_t *rpio_pwm_channel_open(rpio_t *rpio, int dma_channel, int subcycle_time_us);
+RPIO_API void rpio_pwm_channel_close(rpio_pwm_channel_t *channel);
+RPIO_API int rpio_pwm_add_pulse(rpio_pwm_channel_t *channel, int gpio, int width_start, int width);
+RPIO_API int rpio_pwm_clear_gpio(rpio_pwm_channel_t *channel, int gpio);
+RPIO_API int rpio_pwm_clear(rpio_pwm_channel_t *channel);
+// Replaces the pulses of the gpios in `gpio_mask` by `pulses` in one step
+// (no subcycle is output with them cleared in between); waits for the DMA
+// to switch over, one or two subcycles, and fails without a change if it
+// does not.
+RPIO_API int rpio_pwm_set_pulses(rpio_pwm_channel_t *channel, uint32_t gpio_mask, const rpio_pwm_pulse_t *pulses, int count);
+
+// WS2812 / SK6812 LED strips (see led.h), one per gpio, output in parallel
+// by the DMA channel `dma_channel`. `order` is the wire order of the bytes
+// of a LED (NULL: "GRB"; "GRBW" for RGBW strips), period_ns a third of a
+// bit (0: 416ns) of the pacer `delay_hw`. rpio_led_show() takes the pixels
+// strip by strip, each LED in RGB(W) order, and outputs them after the
+// current frame. rpio_led_wait() returns 1 once all frames were output, 0
+// on timeout (timeout_ms < 0: none); rpio_led_frames() counts the frames
+// the DMA has started.
+RPIO_API rpio_led_strips_t *rpio_led_open(rpio_t *rpio, int dma_channel, const int *gpios, int count, int leds, const char *order, int delay_hw, uint32_t period_ns);
+RPIO_API void rpio_led_close(rpio_led_strips_t *strips);
+RPIO_API int rpio_led_show(rpio_led_strips_t *strips, const uint8_t *pixels);
+RPIO_API int rpio_led_wait(rpio_led_strips_t *strips, int timeout_ms);
+RPIO_API int64_t rpio_led_frames(rpio_led_strips_t *strips);
+
+// Clocked serial output (see shift.h), eg. into 74HC595 chains: `lines` data
+// gpios share the `clock` gpio (SPI mode 0) and `latch` (-1: none) is
+// pulsed after each frame. A frame is `bytes` per data line, line after
+// line; period_ns is half a clock period (0: 416ns). Frames are queued as
+// with the LED strips.
+RPIO_API rpio_shift_t *rpio_shift_open(rpio_t *rpio, int dma_channel, int clock, int latch, const int *data, int lines, int bytes, int flags, int delay_hw, uint32_t period_ns);
+RPIO_API void rpio_shift_close(rpio_shift_t *shift);
+RPIO_API int rpio_shift_write(rpio_shift_t *shift, const uint8_t *data);
+RPIO_API int rpio_shift_wait(rpio_shift_t *shift, int timeout_ms);
+RPIO_API int64_t rpio_shift_frames(rpio_shift_t *shift);
+
+// Step/direction stepper drivers (see stepper.h) on `axes` axes, driven by
+// the DMA channel `dma_channel`; dir_gpios may be NULL or hold -1 for axes
+// without direction gpio. tick_ns is the resolution of the step timing and
+// the period of the pacer `delay_hw` (0: 2us). rpio_stepper_move() queues a
+// move with one rpio_stepper_move_t per axis; all axes start together and
+// come to rest. rpio_stepper_wait() returns 1 once all moves were output, 0
+// on timeout (timeout_ms < 0: none). rpio_stepper_position() reads the
+// positions from the progress of the DMA; rpio_stepper_stop() stops at once
+// and drops the queued moves.
+RPIO_API rpio_steppers_t *rpio_stepper_open(rpio_t *rpio, int dma_channel, const int *step_gpios, const int *dir_gpios, int axes, int delay_hw, uint32_t tick_ns);
+RPIO_API void rpio_stepper_close(rpio_steppers_t *steppers);
+RPIO_API int rpio_stepper_move(rpio_steppers_t *steppers, const rpio_stepper_move_t *moves);
+RPIO_API int rpio_stepper_wait(rpio_steppers_t *steppers, int timeout_ms);
+RPIO_API int rpio_stepper_position(rpio_steppers_t *steppers, int32_t *positions);
+RPIO_API int rpio_stepper_stop(rpio_steppers_t *steppers);
+
+// Event engine (one per process). rpio_events_fd() is pollable and becomes
+// readable when events are pending.
+RPIO_API rpio_events_t *rpio_events_open(rpio_t *rpio);
+// Selects sysfs (default) or the GPIO character device `chip` (NULL:
+// /dev/gpiochip0; kernel timestamps, one line request for all gpios).
+// Only possible while no gpio is added.
+RPIO_API int rpio_events_set_backend(rpio_events_t *events, int backend, const char *chip);
+RPIO_API void rpio_events_close(rpio_events_t *events);
+RPIO_API int rpio_events_fd(rpio_events_t *events);
+RPIO_API int rpio_events_add(rpio_events_t *events, int gpio, int edge);
+RPIO_API int rpio_events_remove(rpio_events_t *events, int gpio);
+// Filters the edges of a gpio inside the engine: RPIO_FILTER_STABLE reports
+// a level once it was stable for width_us (shorter pulses are dropped),
+// RPIO_FILTER_HOLDOFF reports an edge at once and the settled level after
+// width_us, RPIO_FILTER_INTEGRATOR integrates the level over width_us.
+RPIO_API int rpio_events_set_filter(rpio_events_t *events, int gpio, int filter, uint32_t width_us);
+// Adds a listener with its own edge and filter to a gpio and returns its id
+// (events for it carry the id). All listeners of a gpio share its single fd;
+// rpio_events_wait() then needs room for one event per listener.
+RPIO_API int rpio_events_listen(rpio_events_t *events, int gpio, int edge, int filter, uint32_t width_us);
+RPIO_API int rpio_events_unlisten(rpio_events_t *events, int id);
+// Streams the events of a listener to the protocol connections subscribed
+// to its gpio (see rpio_protocol_pending) instead of returning them
+RPIO_API int rpio_events_publish(rpio_events_t *events, int id);
+RPIO_API int rpio_events_wait(rpio_events_t *events, rpio_event_t *out, int max_events, int timeout_ms);
+
+// Blocks until one of `gpios` sees an edge, without the event engine. Returns
+// 1 and fills `out`, 0 on timeout (timeout_ms -1 = forever) or -1 on error.
+RPIO_API int rpio_wait_for_edge(rpio_t *rpio, const int *gpios, int count, int edge, int timeout_ms, rpio_event_t *out);
+
+// Edge counters: a background thread counts the `edge` edges of a gpio
+// (input) without waking the caller. The frequency is measured over the
+// last window_ms. rpio_counter_read() with `reset` restarts counting
+// without losing edges in between.
+RPIO_API int rpio_counter_start(rpio_t *rpio, int gpio, int edge, uint32_t window_ms);
+RPIO_API int rpio_counter_stop(rpio_t *rpio, int gpio);
+RPIO_API int rpio_counter_read(rpio_t *rpio, int gpio, rpio_edge_count_t *out, int reset);
+
+// Real-time profile: rpio_rt_configure() locks the memory (if requested)
+// and sets the profile which librpio's threads (edge counters, replay)
+// apply when they start; rpio_rt_apply() applies it to the calling thread,
+// eg. the one calling rpio_events_wait(). Threads which failed to apply it
+// are counted in the `rt_errors` statistic, page faults in `page_faults`.
+RPIO_API int rpio_rt_configure(rpio_t *rpio, const rpio_rt_profile_t *profile);
+RPIO_API int rpio_rt_apply(rpio_t *rpio);
+
+// Bulk capture: samples `count` gpios (0..31) n times, every interval_ns (0:
+// as fast as possible) into `out`, optionally pinned to `cpu` (-1: not).
+// RPIO_CAPTURE_WORDS stores n uint32_t level words (GPLEV0 masked to the
+// gpios), RPIO_CAPTURE_BITS one row of (n + 7) / 8 bytes per gpio. The
+// decoders work on level words.
+RPIO_API int rpio_capture(rpio_t *rpio, void *out, size_t n, const int *gpios, int count, uint32_t interval_ns, int format, int cpu, uint64_t *elapsed_ns);
+RPIO_API size_t rpio_capture_edges(const uint32_t *words, size_t n, int gpio, int edge, uint32_t *indices, size_t max);
+RPIO_API double rpio_capture_duty(const uint32_t *words, size_t n, int gpio);
+RPIO_API double rpio_capture_frequency(const uint32_t *words, size_t n, int gpio, double rate);
+
+// Timed schedules (see timed.h): rpio_timed_submit() queues `count`
+// operations for the executor thread (started by rpio_timed_start() pinned
+// to `cpu`, -1: as the real-time profile says, or by the first submit) and
+// returns the schedule's id. The schedule starts at the system timer time
+// start_us (0: when the executor takes it); the executor sleeps until
+// shortly before each operation and spins for the rest. rpio_timed_fileno()
+// is readable while results are pending, rpio_timed_collect() takes the
+// oldest (1) or returns 0. The lateness is also kept in the
+// `timed_lateness` statistics. rpio_timed_stop() cancels the running and
+// pending schedules.
+RPIO_API int rpio_timed_start(rpio_t *rpio, int cpu);
+RPIO_API void rpio_timed_stop(rpio_t *rpio);
+RPIO_API int rpio_timed_submit(rpio_t *rpio, const rpio_timed_op_t *ops, uint32_t count, uint64_t start_us);
+RPIO_API int rpio_timed_fileno(rpio_t *rpio);
+RPIO_API int rpio_timed_collect(rpio_t *rpio, rpio_timed_result_t *result);
+RPIO_API void rpio_timed_result_free(rpio_timed_result_t *result);
+
+// Recordings (see record.h): rpio_record_start() appends the raw edges of
+// the event engine to a new file until rpio_record_stop(); edges the caller
+// handled itself can be added with rpio_record_events(). rpio_replay_start()
+// replays a recording in a background thread from its first edge at or
+// after start_ns, at `speed` times the recorded pace (0: as fast as
+// possible); injected edges reach the listeners as if they had happened.
+RPIO_API int rpio_record_start(rpio_t *rpio, const char *path);
+RPIO_API int rpio_record_stop(rpio_t *rpio);
+RPIO_API void rpio_record_events(rpio_t *rpio, const rpio_event_t *events, int count);
+RPIO_API int rpio_replay_start(rpio_t *rpio, const char *path, double speed, uint64_t start_ns, int flags);
+RPIO_API void rpio_replay_stop(rpio_t *rpio);
+
+// RPIO's framed binary protocol (see protocol.h) on connected, non-blocking
+// stream sockets which the caller accepts: rpio_protocol_input() reads and
+// executes all pending requests of a readable socket, rpio_protocol_flush()
+// sends pending responses once it is writable. Both return
+// RPIO_PROTOCOL_* flags, or -1 (also when the peer closed the connection).
+// PWM commands use the DMA channels opened with rpio_pwm_channel_open().
+// rpio_protocol_publish() queues edges for the subscribed connections (at
+// most 4096 per connection, more are dropped and counted in the event
+// frames) and returns the number of connections with output left;
+// rpio_protocol_pending() writes the fds of those not reported by
+// rpio_protocol_input/flush() yet, which wait until writable.
+// rpio_protocol_datagrams() executes a batch of pending datagrams of a
+// non-blocking datagram socket (eg. UDP), answers them, and returns their
+// number (0: none pending).
+RPIO_API int rpio_protocol_open(rpio_t *rpio, int fd);
+RPIO_API int rpio_protocol_close(rpio_t *rpio, int fd);
+RPIO_API int rpio_protocol_input(rpio_t *rpio, int fd);
+RPIO_API int rpio_protocol_flush(rpio_t *rpio, int fd);
+RPIO_API int rpio_protocol_datagrams(rpio_t *rpio, int fd);
+RPIO_API int rpio_protocol_pending(rpio_t *rpio, int *fds, int max);
+RPIO_API int rpio_protocol_publish(rpio_t *rpio, const rpio_event_t *events, int count);
+
+// Runtime statistics (ids 0..rpio_stats_count()-1; all zero if librpio was
+// built with -DRPIO_NO_STATS)
+RPIO_API int rpio_stats_count(void);
+RPIO_API const char *rpio_stats_name(int id);
+RPIO_API int rpio_stats_get(int id, rpio_stats_t *stats);
+RPIO_API void rpio_stats_reset(void);
+
+// Binary trace recorder (PWM edits, DMA starts/resets, interrupts). Dumps can
+// be converted to Chrome/Perfetto JSON with `python -m RPIO.tracing`.
+RPIO_API void rpio_trace_enable(int enabled);
+RPIO_API void rpio_trace_clear(void);
+RPIO_API int rpio_trace_dump(const char *path);
+RPIO_API int rpio_trace_dump_on_signal(int signum, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
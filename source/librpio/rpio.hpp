@@ -0,0 +1,295 @@
+/*
+ * This file is part of RPIO.
+ *
+ * Copyright
+ *
+ *     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+ *
+ * License
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU Lesser General Public License as published
+ *     by the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU Lesser General Public License for more details at
+ *     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+ *
+ * Documentation
+ *
+ *     http://pythonhosted.org/RPIO
+ *
+ *
+ * rpio.hpp is a header-only C++17 wrapper around librpio (rpio.h):
+ *
+ * - rpio::Gpio owns a library handle and the mapped GPIO registers.
+ * - rpio::Pin<N> and rpio::PinGroup<N...> compute bank offsets and masks at
+ *   compile time; set() and clear() compile down to a single volatile store.
+ * - rpio::PwmChannel owns a DMA channel and releases its DMA memory when it
+ *   goes out of scope.
+ * - rpio::PulseSet collects pulse edits and applies them to a channel in one
+ *   step, without a glitch on the outputs.
+ *
+ * Errors are reported as exceptions (std::system_error for rpio_open(),
+ * rpio::Error otherwise).
+ *
+ *     rpio::Gpio gpio;
+ *     rpio::Pin<17> led(gpio);
+ *     led.set();
+ *
+ *     rpio::PwmChannel pwm(gpio, 0, 20000);
+ *     rpio::PulseSet().add(18, 0, 100).add(23, 50, 100).apply(pwm);
+ */
+#ifndef RPIO_HPP
+#define RPIO_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "rpio.h"
+
+namespace rpio {
+
+// GPIO register word offsets
+namespace reg {
+constexpr unsigned kSet = 7;    // GPSET0
+constexpr unsigned kClear = 10; // GPCLR0
+constexpr unsigned kLevel = 13; // GPLEV0
+}
+
+constexpr unsigned kGpioCount = 54;
+
+// DMA PWM drives the gpios of the first bank (its masks are 32 bits wide)
+constexpr unsigned kPwmGpioCount = 32;
+
+class Error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+namespace detail {
+template <unsigned First, unsigned... Rest>
+struct first_of {
+    static constexpr unsigned value = First;
+};
+
+inline uint32_t pwm_mask(int gpio)
+{
+    if (gpio < 0 || gpio >= static_cast<int>(kPwmGpioCount))
+        throw Error("DMA PWM cannot drive gpio " + std::to_string(gpio));
+    return uint32_t(1) << gpio;
+}
+}
+
+// Owns a librpio handle
+class Gpio {
+public:
+    Gpio() : handle_(rpio_open())
+    {
+        if (handle_ == nullptr)
+            throw std::system_error(errno, std::generic_category(), "rpio_open");
+        regs_ = rpio_gpio_registers(handle_);
+    }
+    ~Gpio() { rpio_close(handle_); }
+
+    Gpio(const Gpio &) = delete;
+    Gpio &operator=(const Gpio &) = delete;
+
+    rpio_t *handle() const { return handle_; }
+    volatile uint32_t *registers() const { return regs_; }
+
+    void check(int result) const
+    {
+        if (result < 0)
+            throw Error(rpio_last_error(handle_));
+    }
+
+    void setup(int gpio, int direction, int pud = RPIO_PUD_OFF)
+    {
+        check(rpio_gpio_setup(handle_, gpio, direction, pud));
+    }
+
+    void setup_pins(const std::vector<rpio_pin_setup_t> &pins)
+    {
+        check(rpio_gpio_setup_pins(handle_, pins.data(), static_cast<int>(pins.size())));
+    }
+
+private:
+    rpio_t *handle_;
+    volatile uint32_t *regs_;
+};
+
+// A single GPIO with its bank and mask known at compile time
+template <unsigned N>
+class Pin {
+    static_assert(N < kGpioCount, "BCM GPIO number out of range");
+
+public:
+    static constexpr unsigned gpio = N;
+    static constexpr unsigned bank = N / 32;
+    static constexpr uint32_t mask = uint32_t(1) << (N % 32);
+
+    explicit Pin(const Gpio &gpio) : regs_(gpio.registers()) {}
+
+    void set() const { regs_[reg::kSet + bank] = mask; }
+    void clear() const { regs_[reg::kClear + bank] = mask; }
+    void write(bool value) const { regs_[(value ? reg::kSet : reg::kClear) + bank] = mask; }
+    bool read() const { return (regs_[reg::kLevel + bank] & mask) != 0; }
+
+private:
+    volatile uint32_t *regs_;
+};
+
+// Several GPIOs of the same bank, written together with one store
+template <unsigned... N>
+class PinGroup {
+    static_assert(sizeof...(N) > 0, "PinGroup needs at least one GPIO");
+    static_assert(((N < kGpioCount) && ...), "BCM GPIO number out of range");
+
+public:
+    static constexpr unsigned bank = detail::first_of<N...>::value / 32;
+    static constexpr uint32_t mask = (Pin<N>::mask | ...);
+    static_assert(((N / 32 == bank) && ...), "All GPIOs of a PinGroup must be in the same bank");
+
+    explicit PinGroup(const Gpio &gpio) : regs_(gpio.registers()) {}
+
+    void set() const { regs_[reg::kSet + bank] = mask; }
+    void clear() const { regs_[reg::kClear + bank] = mask; }
+
+    // Drives the group to `levels` (a bank-wide bitmask; bits outside the
+    // group are ignored). Two stores: one set, one clear.
+    void write(uint32_t levels) const
+    {
+        regs_[reg::kSet + bank] = levels & mask;
+        regs_[reg::kClear + bank] = ~levels & mask;
+    }
+
+    // Returns the levels of the group's pins as a bank-wide bitmask
+    uint32_t read() const { return regs_[reg::kLevel + bank] & mask; }
+
+private:
+    volatile uint32_t *regs_;
+};
+
+// Owns a DMA PWM channel; the DMA memory is released on destruction.
+// Requires rpio_pwm_setup() (or PwmChannel::setup()) beforehand.
+class PwmChannel {
+public:
+    static void setup(const Gpio &gpio, int pulse_incr_us = 10, int delay_hw = RPIO_PWM_DELAY_VIA_PWM)
+    {
+        gpio.check(rpio_pwm_setup(gpio.handle(), pulse_incr_us, delay_hw));
+    }
+
+    PwmChannel(const Gpio &gpio, int dma_channel, int subcycle_time_us = 20000)
+        : gpio_(&gpio), channel_(rpio_pwm_channel_open(gpio.handle(), dma_channel, subcycle_time_us))
+    {
+        if (channel_ == nullptr)
+            throw Error(rpio_last_error(gpio.handle()));
+    }
+    ~PwmChannel() { rpio_pwm_channel_close(channel_); }
+
+    PwmChannel(const PwmChannel &) = delete;
+    PwmChannel &operator=(const PwmChannel &) = delete;
+    PwmChannel(PwmChannel &&other) noexcept
+        : gpio_(other.gpio_), channel_(std::exchange(other.channel_, nullptr)), used_(other.used_) {}
+    PwmChannel &operator=(PwmChannel &&other) noexcept
+    {
+        if (this != &other) {
+            rpio_pwm_channel_close(channel_);
+            gpio_ = other.gpio_;
+            channel_ = std::exchange(other.channel_, nullptr);
+            used_ = other.used_;
+        }
+        return *this;
+    }
+
+    void add_pulse(int gpio, int width_start, int width)
+    {
+        uint32_t mask = detail::pwm_mask(gpio);
+        gpio_->check(rpio_pwm_add_pulse(channel(), gpio, width_start, width));
+        used_ |= mask;
+    }
+
+    void clear_gpio(int gpio)
+    {
+        uint32_t mask = detail::pwm_mask(gpio);
+        gpio_->check(rpio_pwm_clear_gpio(channel(), gpio));
+        used_ &= ~mask;
+    }
+
+    void clear()
+    {
+        gpio_->check(rpio_pwm_clear(channel()));
+        used_ = 0;
+    }
+
+    // Replaces the pulses of the gpios in `gpio_mask` by `pulses` in one step
+    void set_pulses(uint32_t gpio_mask, const std::vector<rpio_pwm_pulse_t> &pulses)
+    {
+        uint32_t added = 0;
+        for (const auto &p : pulses)
+            added |= detail::pwm_mask(p.gpio);
+        gpio_->check(rpio_pwm_set_pulses(channel(), gpio_mask, pulses.data(), static_cast<int>(pulses.size())));
+        used_ = (used_ & ~gpio_mask) | added;
+    }
+
+    // Whether this channel currently has pulses for a gpio
+    bool has_pulses(int gpio) const
+    {
+        return gpio >= 0 && gpio < static_cast<int>(kPwmGpioCount) && (used_ & (uint32_t(1) << gpio));
+    }
+
+private:
+    // The C channel; a moved-from PwmChannel has none
+    rpio_pwm_channel_t *channel() const
+    {
+        if (channel_ == nullptr)
+            throw Error("PwmChannel has been moved from");
+        return channel_;
+    }
+
+    const Gpio *gpio_;
+    rpio_pwm_channel_t *channel_;
+    uint32_t used_ = 0;
+};
+
+// Collects pulse edits for a channel. apply() replaces the pulses of every
+// gpio mentioned in the set at once (see PwmChannel::set_pulses): the new
+// subcycle is built aside and swapped in, the outputs never see the gpios
+// cleared in between.
+class PulseSet {
+public:
+    PulseSet &add(int gpio, int width_start, int width)
+    {
+        touched_ |= detail::pwm_mask(gpio);
+        pulses_.push_back({gpio, width_start, width});
+        return *this;
+    }
+
+    // Removes all pulses of a gpio (without adding new ones)
+    PulseSet &clear(int gpio)
+    {
+        touched_ |= detail::pwm_mask(gpio);
+        return *this;
+    }
+
+    void apply(PwmChannel &channel) const { channel.set_pulses(touched_, pulses_); }
+
+    bool empty() const { return pulses_.empty() && touched_ == 0; }
+
+private:
+    std::vector<rpio_pwm_pulse_t> pulses_;
+    uint32_t touched_ = 0;
+};
+
+} // namespace rpio
+
+#endif
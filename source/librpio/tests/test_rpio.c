@@ -0,0 +1,191 @@
+/*
+ * Tests of librpio's handles against the simulated register backend (run by
+ * `make check`, with RPIO_SIMULATE=1).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "rpio.h"
+
+// rpio_gpio_function() returns the FSEL value
+#define FSEL_INPUT 0
+#define FSEL_OUTPUT 1
+
+#define THREADS 8
+#define ROUNDS 500
+#define PULSE_ROUNDS 20
+
+static int failures = 0;
+static pthread_mutex_t failures_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        pthread_mutex_lock(&failures_lock); \
+        failures++; \
+        pthread_mutex_unlock(&failures_lock); \
+    } \
+} while (0)
+
+// The hardware is set up by the first handle and stays until the last one
+// is closed
+static void
+test_shared_mappings(void)
+{
+    rpio_t *a, *b;
+    rpio_pin_setup_t pins[] = {
+        { 18, RPIO_OUTPUT, RPIO_PUD_OFF },
+        { 17, RPIO_INPUT, RPIO_PUD_UP },
+        { 18, RPIO_INPUT, RPIO_PUD_OFF },
+    };
+
+    rpio_close(NULL);
+    a = rpio_open();
+    b = rpio_open();
+    CHECK(a != NULL && b != NULL && a != b);
+    CHECK(rpio_gpio_setup(a, 17, RPIO_OUTPUT, RPIO_PUD_OFF) == 0);
+    CHECK(rpio_gpio_function(b, 17) == FSEL_OUTPUT);
+
+    rpio_close(a);
+    CHECK(rpio_gpio_setup(b, 18, RPIO_OUTPUT, RPIO_PUD_OFF) == 0);
+    CHECK(rpio_gpio_function(b, 17) == FSEL_OUTPUT);
+    CHECK(rpio_gpio_function(b, 18) == FSEL_OUTPUT);
+    rpio_close(b);
+
+    // Opened again after the last handle was closed: fresh registers
+    a = rpio_open();
+    CHECK(a != NULL);
+    CHECK(rpio_gpio_function(a, 17) == FSEL_INPUT);
+    CHECK(rpio_gpio_write_mask(a, 2, 0, 0) < 0);
+    CHECK(rpio_last_error(a)[0] != '\0');
+    CHECK(rpio_gpio_setup_pins(a, pins, 3) < 0);
+    CHECK(rpio_gpio_function(a, 18) == FSEL_INPUT);
+    rpio_close(a);
+}
+
+static void *
+open_close(void *arg)
+{
+    int gpio = (int) (uintptr_t) arg;
+    rpio_t *rpio;
+    int i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        if ((rpio = rpio_open()) == NULL) {
+            CHECK(rpio != NULL);
+            break;
+        }
+        CHECK(rpio_gpio_setup(rpio, gpio, RPIO_OUTPUT, RPIO_PUD_OFF) == 0);
+        CHECK(rpio_gpio_function(rpio, gpio) == FSEL_OUTPUT);
+        rpio_close(rpio);
+    }
+    return NULL;
+}
+
+// Handles opened and closed by several threads at once: every open/close
+// may be the first or the last one
+static void
+test_concurrent_open_close(void)
+{
+    pthread_t threads[THREADS];
+    rpio_t *rpio;
+    uintptr_t i;
+
+    for (i = 0; i < THREADS; i++)
+        CHECK(pthread_create(&threads[i], NULL, open_close, (void *) (i + 2)) == 0);
+    for (i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    // All handles are closed: the next one sets up fresh registers
+    rpio = rpio_open();
+    CHECK(rpio != NULL);
+    CHECK(rpio_gpio_function(rpio, 2) == FSEL_INPUT);
+    rpio_close(rpio);
+}
+
+struct pulse_editor {
+    rpio_pwm_channel_t *channel;
+    int gpio;
+};
+
+static void *
+edit_pulses(void *arg)
+{
+    struct pulse_editor *editor = arg;
+    rpio_pwm_pulse_t pulse = { editor->gpio, 0, 0 };
+    uint32_t mask = 1u << editor->gpio;
+    int i;
+
+    for (i = 0; i < PULSE_ROUNDS; i++) {
+        pulse.width_start = (editor->gpio * 10 + i) % 200;
+        pulse.width = 1 + i % 50;
+        CHECK(rpio_pwm_set_pulses(editor->channel, mask, &pulse, 1) == 0);
+        if (i % 5 == 4)
+            CHECK(rpio_pwm_set_pulses(editor->channel, mask, NULL, 0) == 0);
+    }
+    return NULL;
+}
+
+// Several threads swap their own gpio's pulses on one channel at once
+static void
+test_concurrent_pulse_edits(void)
+{
+    pthread_t threads[THREADS];
+    struct pulse_editor editors[THREADS];
+    rpio_pwm_pulse_t pulses[THREADS];
+    uint32_t mask = 0;
+    rpio_pwm_channel_t *channel;
+    rpio_t *rpio;
+    int i;
+
+    rpio = rpio_open();
+    CHECK(rpio != NULL);
+    CHECK(rpio_pwm_setup(rpio, 10, RPIO_PWM_DELAY_VIA_PWM) == 0);
+    channel = rpio_pwm_channel_open(rpio, 0, 3000);
+    CHECK(channel != NULL);
+    if (!channel) {
+        rpio_close(rpio);
+        return;
+    }
+
+    for (i = 0; i < THREADS; i++) {
+        editors[i].channel = channel;
+        editors[i].gpio = i + 2;
+        CHECK(pthread_create(&threads[i], NULL, edit_pulses, &editors[i]) == 0);
+    }
+    for (i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    // The channel is still consistent: one swap of all gpios
+    for (i = 0; i < THREADS; i++) {
+        pulses[i].gpio = i + 2;
+        pulses[i].width_start = i * 20;
+        pulses[i].width = 10;
+        mask |= 1u << pulses[i].gpio;
+    }
+    CHECK(rpio_pwm_set_pulses(channel, mask, pulses, THREADS) == 0);
+    CHECK(rpio_pwm_clear(channel) == 0);
+    rpio_pwm_channel_close(channel);
+    rpio_close(rpio);
+}
+
+int
+main(void)
+{
+    if (!rpio_is_simulated()) {
+        fprintf(stderr, "test_rpio: set RPIO_SIMULATE=1\n");
+        return 2;
+    }
+
+    test_shared_mappings();
+    test_concurrent_open_close();
+    test_concurrent_pulse_edits();
+
+    if (failures)
+        fprintf(stderr, "test_rpio: %d failures\n", failures);
+    else
+        printf("test_rpio: OK\n");
+    return failures ? 1 : 0;
+}
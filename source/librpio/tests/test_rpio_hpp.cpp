@@ -0,0 +1,127 @@
+/*
+ * Tests of the C++ wrapper rpio.hpp against the simulated register backend
+ * (run by `make check`, with RPIO_SIMULATE=1).
+ */
+#include <cstdio>
+#include <cstdlib>
+
+#include "rpio.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+// Compile-time bank offsets and masks
+static_assert(rpio::Pin<17>::bank == 0 && rpio::Pin<17>::mask == (1u << 17), "Pin<17>");
+static_assert(rpio::Pin<40>::bank == 1 && rpio::Pin<40>::mask == (1u << 8), "Pin<40>");
+static_assert(rpio::PinGroup<4, 17, 27>::mask == ((1u << 4) | (1u << 17) | (1u << 27)), "PinGroup mask");
+
+static void
+test_pins(rpio::Gpio &gpio)
+{
+    volatile uint32_t *regs = gpio.registers();
+    rpio::Pin<40> pin(gpio);
+    rpio::PinGroup<4, 17> group(gpio);
+
+    // The simulated registers are plain memory: check the stores
+    pin.set();
+    CHECK(regs[rpio::reg::kSet + 1] == (1u << 8));
+    pin.clear();
+    CHECK(regs[rpio::reg::kClear + 1] == (1u << 8));
+    group.write(1u << 17);
+    CHECK(regs[rpio::reg::kSet] == (1u << 17));
+    CHECK(regs[rpio::reg::kClear] == (1u << 4));
+}
+
+// Whether f() throws rpio::Error
+template <typename F>
+static bool
+throws_error(F f)
+{
+    try {
+        f();
+    } catch (const rpio::Error &) {
+        return true;
+    }
+    return false;
+}
+
+static void
+test_pulse_set(rpio::Gpio &gpio)
+{
+    rpio::PwmChannel pwm(gpio, 0, 10000);
+
+    pwm.add_pulse(18, 0, 100);
+    pwm.add_pulse(23, 0, 50);
+    CHECK(pwm.has_pulses(18) && pwm.has_pulses(23));
+
+    // Replaces 18 and removes 23, 24 is new
+    rpio::PulseSet().add(18, 10, 200).clear(23).add(24, 300, 100).apply(pwm);
+    CHECK(pwm.has_pulses(18));
+    CHECK(!pwm.has_pulses(23));
+    CHECK(pwm.has_pulses(24));
+
+    // Repeated swaps alternate between both banks
+    for (int width = 10; width < 400; width += 10)
+        rpio::PulseSet().add(18, 0, width).apply(pwm);
+    CHECK(pwm.has_pulses(18) && pwm.has_pulses(24));
+
+    // A pulse beyond the subcycle is rejected, nothing is changed
+    bool thrown = false;
+    try {
+        rpio::PulseSet().add(18, 0, 100).add(24, 900, 200).apply(pwm);
+    } catch (const rpio::Error &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(pwm.has_pulses(18) && pwm.has_pulses(24));
+
+    // Moving hands the channel over
+    rpio::PwmChannel moved(std::move(pwm));
+    CHECK(moved.has_pulses(18));
+    moved.add_pulse(24, 0, 10);
+    moved.clear();
+    CHECK(!moved.has_pulses(18) && !moved.has_pulses(24));
+
+    // Gpios beyond the 32-bit masks are refused before anything is changed
+    CHECK(throws_error([] { rpio::PulseSet().add(32, 0, 10); }));
+    CHECK(throws_error([] { rpio::PulseSet().clear(-1); }));
+    CHECK(throws_error([&] { moved.add_pulse(40, 0, 10); }));
+    CHECK(throws_error([&] { moved.clear_gpio(54); }));
+    CHECK(throws_error([&] { moved.set_pulses(0, {{53, 0, 10}}); }));
+    CHECK(!moved.has_pulses(53));
+
+    // The moved-from channel has no DMA channel left
+    CHECK(throws_error([&] { pwm.add_pulse(18, 0, 10); }));
+    CHECK(throws_error([&] { pwm.clear_gpio(18); }));
+    CHECK(throws_error([&] { pwm.clear(); }));
+    CHECK(throws_error([&] { rpio::PulseSet().add(18, 0, 10).apply(pwm); }));
+}
+
+int
+main()
+{
+    if (!rpio_is_simulated()) {
+        std::fprintf(stderr, "test_rpio_hpp: set RPIO_SIMULATE=1\n");
+        return 2;
+    }
+
+    rpio::Gpio gpio;
+    test_pins(gpio);
+    CHECK(rpio::PulseSet().empty());
+    CHECK(!rpio::PulseSet().clear(18).empty());
+
+    rpio::PwmChannel::setup(gpio);
+    test_pulse_set(gpio);
+
+    if (failures)
+        std::fprintf(stderr, "test_rpio_hpp: %d failures\n", failures);
+    else
+        std::printf("test_rpio_hpp: OK\n");
+    return failures ? 1 : 0;
+}
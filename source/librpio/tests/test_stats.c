@@ -0,0 +1,214 @@
+/*
+ * Tests of the runtime statistics (stats.c): counters, histogram buckets and
+ * reset (run by `make check`).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "stats.h"
+
+#define THREADS 4
+#define ROUNDS 100000
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+static struct stats_entry
+get(int id)
+{
+    struct stats_entry e;
+
+    memset(&e, 0xff, sizeof(e));
+    CHECK(stats_get(id, &e) == 0);
+    return e;
+}
+
+static uint64_t
+bucket_sum(const struct stats_entry *e)
+{
+    uint64_t sum = 0;
+    int i;
+
+    for (i = 0; i < STATS_BUCKETS; i++)
+        sum += e->buckets[i];
+    return sum;
+}
+
+static void
+test_names(void)
+{
+    int i, j;
+
+    for (i = 0; i < STATS_COUNT; i++) {
+        CHECK(stats_name(i) != NULL);
+        for (j = 0; j < i; j++)
+            CHECK(strcmp(stats_name(i), stats_name(j)) != 0);
+    }
+    CHECK(stats_name(-1) == NULL);
+    CHECK(stats_name(STATS_COUNT) == NULL);
+    CHECK(strcmp(stats_name(STAT_HANDLE_INTERRUPT), "handle_interrupt") == 0);
+}
+
+// Bucket i counts [2^i, 2^(i+1)) ns, bucket 0 also 0ns, the last one all
+// above
+static void
+test_buckets(void)
+{
+    static const struct {
+        uint64_t ns;
+        int bucket;
+    } cases[] = {
+        {0, 0}, {1, 0}, {2, 1}, {3, 1}, {4, 2}, {1023, 9}, {1024, 10},
+        {(1ULL << 31) - 1, 30}, {1ULL << 31, 31}, {1ULL << 40, 31}, {UINT64_MAX / 2, 31},
+    };
+    struct stats_entry e;
+    unsigned i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        stats_reset();
+        stats_record(STAT_PY_OUTPUT_GPIO, cases[i].ns);
+        e = get(STAT_PY_OUTPUT_GPIO);
+        CHECK(e.buckets[cases[i].bucket] == 1);
+        CHECK(bucket_sum(&e) == 1);
+        if (e.buckets[cases[i].bucket] != 1)
+            fprintf(stderr, "  %llu ns: expected bucket %d\n",
+                    (unsigned long long) cases[i].ns, cases[i].bucket);
+    }
+}
+
+static void
+test_record(void)
+{
+    struct stats_entry e;
+
+    stats_reset();
+    stats_record(STAT_ADD_CHANNEL_PULSE, 100);
+    stats_record(STAT_ADD_CHANNEL_PULSE, 5000);
+    stats_record(STAT_ADD_CHANNEL_PULSE, 300);
+    e = get(STAT_ADD_CHANNEL_PULSE);
+    CHECK(e.calls == 3);
+    CHECK(e.total_ns == 5400);
+    CHECK(e.max_ns == 5000);
+    CHECK(e.buckets[6] == 1 && e.buckets[8] == 1 && e.buckets[12] == 1);
+
+    // Other entries are untouched
+    e = get(STAT_CLEAR_CHANNEL);
+    CHECK(e.calls == 0 && e.total_ns == 0 && e.max_ns == 0 && bucket_sum(&e) == 0);
+}
+
+// Counters only count calls, no times and no buckets
+static void
+test_counters(void)
+{
+    struct stats_entry e;
+
+    stats_reset();
+    stats_count(STAT_EVENTS_DROPPED);
+    stats_count(STAT_EVENTS_DROPPED);
+    stats_add(STAT_EVENTS_DROPPED, 40);
+    stats_add(STAT_EVENTS_DROPPED, 0);
+    e = get(STAT_EVENTS_DROPPED);
+    CHECK(e.calls == 42);
+    CHECK(e.total_ns == 0 && e.max_ns == 0 && bucket_sum(&e) == 0);
+
+    // Invalid ids are ignored
+    stats_count(-1);
+    stats_count(STATS_COUNT);
+    stats_add(STATS_COUNT, 5);
+    stats_record(-1, 10);
+    stats_record(STATS_COUNT, 10);
+    CHECK(stats_get(-1, &e) == -1);
+    CHECK(stats_get(STATS_COUNT, &e) == -1);
+    e = get(STATS_COUNT - 1);
+    CHECK(e.calls == 0);
+    e = get(0);
+    CHECK(e.calls == 0);
+}
+
+static void
+test_reset(void)
+{
+    struct stats_entry e;
+    int i;
+
+    for (i = 0; i < STATS_COUNT; i++)
+        stats_record(i, 1000 + i);
+    stats_reset();
+    for (i = 0; i < STATS_COUNT; i++) {
+        e = get(i);
+        CHECK(e.calls == 0 && e.total_ns == 0 && e.max_ns == 0 && bucket_sum(&e) == 0);
+    }
+}
+
+static void *
+record_many(void *arg)
+{
+    uint64_t i, base = (uintptr_t) arg;
+
+    for (i = 0; i < ROUNDS; i++) {
+        stats_record(STAT_HANDLE_INTERRUPT, base + i);
+        stats_count(STAT_DEBOUNCE_SUPPRESSED);
+    }
+    return NULL;
+}
+
+// Updates are lock-free; none may get lost
+static void
+test_concurrent(void)
+{
+    pthread_t threads[THREADS];
+    struct stats_entry e;
+    uint64_t total = 0;
+    uintptr_t i;
+
+    stats_reset();
+    for (i = 0; i < THREADS; i++) {
+        total += i * 1000 * ROUNDS + (uint64_t) ROUNDS * (ROUNDS - 1) / 2;
+        CHECK(pthread_create(&threads[i], NULL, record_many, (void *) (i * 1000)) == 0);
+    }
+    for (i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    e = get(STAT_HANDLE_INTERRUPT);
+    CHECK(e.calls == (uint64_t) THREADS * ROUNDS);
+    CHECK(e.total_ns == total);
+    CHECK(e.max_ns == (THREADS - 1) * 1000 + ROUNDS - 1);
+    CHECK(bucket_sum(&e) == e.calls);
+    CHECK(get(STAT_DEBOUNCE_SUPPRESSED).calls == (uint64_t) THREADS * ROUNDS);
+}
+
+static void
+test_clock(void)
+{
+    uint64_t t0 = stats_clock_ns();
+
+    CHECK(t0 > 0);
+    CHECK(stats_clock_ns() >= t0);
+}
+
+int
+main(void)
+{
+    test_names();
+    test_buckets();
+    test_record();
+    test_counters();
+    test_reset();
+    test_concurrent();
+    test_clock();
+
+    if (failures)
+        fprintf(stderr, "test_stats: %d failures\n", failures);
+    else
+        printf("test_stats: OK\n");
+    return failures ? 1 : 0;
+}
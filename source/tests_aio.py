@@ -0,0 +1,222 @@
+#!/usr/bin/env python
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Tests RPIO.aio in simulation, against a fake /sys/class/gpio tree of
+exported gpios. Runs anywhere, no Raspberry Pi or root needed.
+
+epoll cannot watch regular files, so the fake epoll returns the events
+which the tests fire after writing a value file; its fileno() is readable
+while events are pending, like the real one.
+"""
+import os
+import sys
+import time
+import fcntl
+import select
+import shutil
+import asyncio
+import tempfile
+import unittest
+import logging
+log_format = '%(levelname)s | %(asctime)-15s | %(message)s'
+logging.basicConfig(format=log_format, level=logging.INFO)
+
+os.environ["RPIO_SIMULATE"] = "1"
+import RPIO
+from RPIO import aio
+RPIO.setwarnings(False)
+
+
+class FakeEpoll(object):
+    def __init__(self):
+        self.registered = set()
+        self.events = []
+        self._r, self._w = os.pipe()
+        fcntl.fcntl(self._r, fcntl.F_SETFL, os.O_NONBLOCK)
+
+    def register(self, fileno, eventmask):
+        self.registered.add(fileno)
+
+    def unregister(self, fileno):
+        self.registered.remove(fileno)
+
+    def fileno(self):
+        return self._r
+
+    def fire(self, fileno, event):
+        self.events.append((fileno, event))
+        os.write(self._w, b"x")
+
+    def poll(self, timeout=-1):
+        try:
+            os.read(self._r, 4096)
+        except OSError:
+            pass
+        events = [e for e in self.events if e[0] in self.registered]
+        self.events = []
+        return events
+
+    def close(self):
+        os.close(self._r)
+        os.close(self._w)
+
+
+class TestAsyncio(unittest.TestCase):
+    def setUp(self):
+        self.root = tempfile.mkdtemp(prefix="rpio-sysfs-")
+        for gpio in (17, 18):
+            os.mkdir(os.path.join(self.root, "gpio%s" % gpio))
+            for attr, content in (("direction", "in"), ("edge", "none"),
+                    ("value", "0")):
+                self.write(gpio, attr, content)
+        RPIO.set_sysfs_root(self.root)
+        self.epoll = RPIO._rpio._epoll = FakeEpoll()
+        self.loop = asyncio.new_event_loop()
+        asyncio.set_event_loop(self.loop)
+
+    def tearDown(self):
+        aio.detach()
+        RPIO.cleanup()
+        self.loop.close()
+        asyncio.set_event_loop(None)
+        shutil.rmtree(self.root)
+        self.epoll.close()
+
+    def write(self, gpio, attr, content):
+        with open(os.path.join(self.root, "gpio%s" % gpio, attr), "w") as f:
+            f.write(content + "\n")
+
+    def read(self, gpio, attr):
+        with open(os.path.join(self.root, "gpio%s" % gpio, attr)) as f:
+            return f.read().strip()
+
+    def edge(self, gpio, value):
+        """ Changes the value of a watched gpio like the kernel does """
+        self.write(gpio, "value", str(value))
+        self.epoll.fire(RPIO._rpio._map_gpioid_to_fileno[gpio],
+                select.EPOLLPRI)
+
+    def run_async(self, coro):
+        return self.loop.run_until_complete(asyncio.wait_for(coro, 2))
+
+    def test1_wait_for_edge(self):
+        async def waiter():
+            return await aio.wait_for_edge(17, 'rising', timeout=1)
+
+        async def main():
+            task = self.loop.create_task(waiter())
+            await asyncio.sleep(0.01)
+            self.assertEqual(self.read(17, "edge"), "rising")
+
+            # A falling edge does not end a wait for a rising one
+            self.edge(17, 0)
+            await asyncio.sleep(0.01)
+            self.assertFalse(task.done())
+            self.edge(17, 1)
+            return await task
+
+        t = time.monotonic()
+        edge = self.run_async(main())
+        self.assertEqual((edge.gpio, edge.value), (17, 1))
+        self.assertTrue(t <= edge.timestamp <= time.monotonic())
+
+        # The value file is closed once the edge arrived
+        self.assertNotIn(17, RPIO._rpio._map_gpioid_to_callbacks)
+        self.assertEqual(self.epoll.registered, set())
+
+    def test2_edge_stream(self):
+        async def main():
+            received = []
+            async with aio.edges(17, 'both') as stream:
+                for value in (1, 0, 1):
+                    self.edge(17, value)
+                    await asyncio.sleep(0.01)
+                received.append(await stream.get())
+                received.extend(stream.pending())
+                self.edge(17, 0)
+                async for edge in stream:
+                    received.append(edge)
+                    break
+            return received
+
+        edges = self.run_async(main())
+        self.assertEqual([(e.gpio, e.value) for e in edges],
+                [(17, 1), (17, 0), (17, 1), (17, 0)])
+        self.assertEqual(self.epoll.registered, set())
+
+    def test3_cancel(self):
+        async def main():
+            task = self.loop.create_task(aio.wait_for_edge(17))
+            await asyncio.sleep(0.01)
+            fileno = RPIO._rpio._map_gpioid_to_fileno[17]
+            task.cancel()
+            with self.assertRaises(asyncio.CancelledError):
+                await task
+
+            # An edge of the closed value file is not handled
+            self.epoll.fire(fileno, select.EPOLLPRI)
+            self.assertEqual(RPIO.poll_interrupts(0), 0)
+
+            with self.assertRaises(asyncio.TimeoutError):
+                await aio.wait_for_edge(18, timeout=0.02)
+
+        self.run_async(main())
+        for gpio in (17, 18):
+            self.assertNotIn(gpio, RPIO._rpio._map_gpioid_to_callbacks)
+        self.assertEqual(self.epoll.registered, set())
+
+    def test4_close_and_detach(self):
+        async def main():
+            stream = aio.edges(17, 'both')
+            waiter = self.loop.create_task(stream.get())
+            await asyncio.sleep(0.01)
+
+            # close() ends a waiting get() and the iteration
+            stream.close()
+            with self.assertRaises(StopAsyncIteration):
+                await waiter
+            with self.assertRaises(StopAsyncIteration):
+                await stream.__anext__()
+            stream.close()
+
+        self.run_async(main())
+        self.assertEqual(self.epoll.registered, set())
+
+        # The loop watches RPIO's fd until detach()
+        self.assertTrue(self.loop.remove_reader(self.epoll.fileno()))
+        aio.attach(self.loop)
+        aio.detach()
+        self.assertFalse(self.loop.remove_reader(self.epoll.fileno()))
+
+
+if __name__ == '__main__':
+    logging.info("==================================")
+    logging.info("= Test Suite Run with Python %s   =" % \
+            sys.version_info[0])
+    logging.info("==================================")
+    logging.info("")
+    logging.info("")
+    unittest.main()
@@ -0,0 +1,101 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Tests bulk capture of pin levels and the decoders of captured level words,
+against simulated registers (on any Linux box):
+
+    $ python tests_capture.py
+"""
+import os
+import sys
+import struct
+import unittest
+import logging
+log_format = '%(levelname)s | %(asctime)-15s | %(message)s'
+logging.basicConfig(format=log_format, level=logging.INFO)
+
+os.environ["RPIO_SIMULATE"] = "1"
+import RPIO
+RPIO.setwarnings(False)
+
+
+def words(levels, gpio=17):
+    """ Level words of one gpio from a list of levels """
+    return bytearray(struct.pack("<%dI" % len(levels),
+            *[level << gpio | 1 << 4 for level in levels]))
+
+
+class TestCapture(unittest.TestCase):
+    def test1_capture_words(self):
+        buf, rate = RPIO.capture([17, 18], 100000, 1000)
+        self.assertEqual(len(buf), 4000)
+        # Simulated clock: exactly the requested rate
+        self.assertAlmostEqual(rate, 100000, delta=1)
+        mask = ~(1 << 17 | 1 << 18) & 0xffffffff
+        self.assertTrue(all(not w & mask for w in
+                struct.unpack("<1000I", bytes(buf))))
+
+    def test2_preallocated(self):
+        buf = bytearray(256)
+        RPIO.capture([4], 0, 64, buf)
+        self.assertRaises(ValueError, RPIO.capture, [4], 0, 65, buf)
+        self.assertRaises(ValueError, RPIO.capture, [4], -1, 64, buf)
+        self.assertRaises((TypeError, BufferError), RPIO.capture, [4], 0, 1,
+                b"1234")
+
+    def test3_bits(self):
+        buf, rate = RPIO.capture([17, 22, 27], 50000, 100, bits=True)
+        self.assertEqual(len(buf), 3 * 13)
+
+    def test4_edges(self):
+        levels = [0, 0, 1, 1, 1, 0, 1, 0, 0, 1]
+        buf = words(levels)
+        self.assertEqual(RPIO.capture_edges(buf, 17), [2, 5, 6, 7, 9])
+        self.assertEqual(RPIO.capture_edges(buf, 17, 'rising'), [2, 6, 9])
+        self.assertEqual(RPIO.capture_edges(buf, 17, 'falling'), [5, 7])
+        self.assertEqual(RPIO.capture_edges(buf, 18), [])
+        self.assertEqual(RPIO.capture_edges(bytearray(), 17), [])
+
+    def test5_duty_frequency(self):
+        # 1 kHz, 25% duty cycle sampled at 100 kHz
+        period = [1] * 25 + [0] * 75
+        buf = words(period * 50)
+        self.assertAlmostEqual(RPIO.capture_duty(buf, 17), 0.25)
+        self.assertAlmostEqual(RPIO.capture_frequency(buf, 17, 100000),
+                1000.0)
+        self.assertEqual(RPIO.capture_frequency(words([0, 1, 1]), 17, 10),
+                0.0)
+        self.assertEqual(RPIO.capture_duty(buf, 18), 0.0)
+
+
+if __name__ == '__main__':
+    logging.info("==================================")
+    logging.info("= Test Suite Run with Python %s   =" % \
+            sys.version_info[0])
+    logging.info("==================================")
+    logging.info("")
+    logging.info("")
+    unittest.main()
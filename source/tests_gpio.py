@@ -224,6 +224,58 @@ class TestSequenceFunctions(unittest.TestCase):
 
         logging.info("ALL DONE :)")
 
+    def test7_setup_pins(self):
+        logging.info(" ")
+        logging.info(" ")
+        logging.info("=== SETUP_PINS TESTS ===")
+        RPIO.setmode(RPIO.BCM)
+        RPIO.setup(22, RPIO.IN)
+        RPIO.setup_pins([
+                (GPIO_IN, RPIO.IN, RPIO.PUD_UP),
+                (22, RPIO.IN, RPIO.PUD_DOWN),
+                (GPIO_OUT, RPIO.OUT, RPIO.PUD_OFF, RPIO.HIGH),
+                (23, RPIO.OUT, RPIO.PUD_UP, RPIO.LOW),
+                (24, RPIO.OUT)])
+        for gpio, direction in ((GPIO_IN, RPIO.IN), (22, RPIO.IN),
+                (GPIO_OUT, RPIO.OUT), (23, RPIO.OUT), (24, RPIO.OUT)):
+            self.assertEqual(RPIO.gpio_function(gpio), direction)
+
+        # The directions are known to output()
+        RPIO.output(24, RPIO.HIGH)
+        with self.assertRaises(RPIO._GPIO.WrongDirectionException):
+            RPIO.output(22, RPIO.HIGH)
+
+        # Levels of the pulls and initial values (of unconnected pins; the
+        # simulated registers keep no levels)
+        if not RPIO.SIMULATED:
+            self.assertEqual(RPIO.input(GPIO_IN), True)
+            self.assertEqual(RPIO.input(22), False)
+            self.assertEqual(RPIO.input(GPIO_OUT), True)
+            self.assertEqual(RPIO.input(23), False)
+
+        # Nothing is configured when any entry is invalid
+        with self.assertRaises(RPIO._GPIO.InvalidDirectionException):
+            RPIO.setup_pins([(22, RPIO.OUT), (27, 5)])
+        with self.assertRaises(RPIO._GPIO.InvalidPullException):
+            RPIO.setup_pins([(22, RPIO.OUT), (27, RPIO.IN, 7)])
+        with self.assertRaises(RPIO._GPIO.InvalidChannelException):
+            RPIO.setup_pins([(22, RPIO.OUT), (32, RPIO.IN)])
+        with self.assertRaises(RPIO._GPIO.InvalidChannelException):
+            RPIO.setup_pins([(22, RPIO.OUT)] * 55)
+        with self.assertRaises(RPIO._GPIO.InvalidChannelException):
+            RPIO.setup_pins([(22, RPIO.OUT), (27, RPIO.IN), (22, RPIO.IN)])
+        with self.assertRaises(TypeError):
+            RPIO.setup_pins([(22, RPIO.OUT), (27,)])
+        with self.assertRaises(TypeError):
+            RPIO.setup_pins(22)
+        self.assertEqual(RPIO.gpio_function(22), RPIO.IN)
+
+        # The pull of an output is ignored, not validated
+        RPIO.setup_pins([(22, RPIO.OUT, 7, RPIO.LOW)])
+        self.assertEqual(RPIO.gpio_function(22), RPIO.OUT)
+        RPIO.setup_pins([])
+        RPIO.cleanup()
+
 
 if __name__ == '__main__':
     logging.info("==================================")
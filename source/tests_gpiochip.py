@@ -0,0 +1,318 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Tests the gpiochip (GPIO character device) interrupt backend against a
+simulated gpiochip, on any Linux box (needs root):
+
+    $ sudo modprobe gpio-sim     (configfs, Linux 5.17+)
+    $ sudo python tests_gpiochip.py
+
+or with `sudo modprobe gpio-mockup gpio_mockup_ranges=-1,32` and debugfs.
+The tests are skipped if neither is available. The registers are simulated
+(RPIO_SIMULATE=1), so this does not touch real pins.
+"""
+import os
+import sys
+import time
+import unittest
+from threading import Timer
+import logging
+log_format = '%(levelname)s | %(asctime)-15s | %(message)s'
+logging.basicConfig(format=log_format, level=logging.INFO)
+
+os.environ["RPIO_SIMULATE"] = "1"
+import RPIO
+from RPIO import protocol
+RPIO.setwarnings(False)
+
+CONFIGFS_GPIO_SIM = "/sys/kernel/config/gpio-sim"
+DEBUGFS_GPIO_MOCKUP = "/sys/kernel/debug/gpio-mockup"
+NUM_LINES = 32
+PORT = 18734
+
+
+class GpioSim(object):
+    """ gpiochip created through the gpio-sim configfs interface """
+    def __init__(self):
+        self.path = os.path.join(CONFIGFS_GPIO_SIM, "rpio-test")
+        os.mkdir(self.path)
+        os.mkdir(os.path.join(self.path, "bank0"))
+        self._write("bank0/num_lines", NUM_LINES)
+        self._write("live", 1)
+        chip = self._read("bank0/chip_name")
+        self.dev = "/dev/" + chip
+        self.sysfs = "/sys/devices/platform/%s/%s" % \
+                (self._read("dev_name"), chip)
+
+    def _write(self, name, value):
+        with open(os.path.join(self.path, name), "w") as f:
+            f.write("%s\n" % value)
+
+    def _read(self, name):
+        with open(os.path.join(self.path, name)) as f:
+            return f.read().strip()
+
+    def set(self, line, value):
+        with open("%s/sim_gpio%s/pull" % (self.sysfs, line), "w") as f:
+            f.write("pull-up" if value else "pull-down")
+
+    def close(self):
+        self._write("live", 0)
+        os.rmdir(os.path.join(self.path, "bank0"))
+        os.rmdir(self.path)
+
+
+class GpioMockup(object):
+    """ gpiochip of an already loaded gpio-mockup module (via debugfs) """
+    def __init__(self):
+        chips = sorted(os.listdir(DEBUGFS_GPIO_MOCKUP))
+        if not chips:
+            raise OSError("no gpio-mockup chip")
+        self.dev = "/dev/" + chips[0]
+        self.path = os.path.join(DEBUGFS_GPIO_MOCKUP, chips[0])
+
+    def set(self, line, value):
+        with open(os.path.join(self.path, str(line)), "w") as f:
+            f.write("1" if value else "0")
+
+    def close(self):
+        pass
+
+
+def find_simulator():
+    for cls in (GpioSim, GpioMockup):
+        try:
+            return cls()
+        except (OSError, IOError):
+            pass
+    return None
+
+
+class Received(object):
+    """ Callback which records (gpio, value, timestamp_ns, seqno) """
+    def __init__(self):
+        self.events = []
+
+    def __call__(self, gpio_id, value):
+        event = RPIO.last_interrupt(gpio_id)
+        self.events.append((gpio_id, value, event[1], event[2]))
+
+    def wait(self, count, timeout=1):
+        t_end = time.time() + timeout
+        while len(self.events) < count and time.time() < t_end:
+            RPIO.poll_interrupts(0.05)
+        return self.events
+
+
+class TestGpiochip(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.sim = find_simulator()
+        if cls.sim is None:
+            raise unittest.SkipTest("neither gpio-sim nor gpio-mockup found")
+        logging.info("Testing against simulated %s", cls.sim.dev)
+        RPIO.set_interrupt_backend("gpiochip", cls.sim.dev)
+
+    @classmethod
+    def tearDownClass(cls):
+        RPIO.cleanup()
+        RPIO.set_interrupt_backend("sysfs")
+        cls.sim.close()
+
+    def setUp(self):
+        for line in (17, 18, 22, 23):
+            self.sim.set(line, 0)
+
+    def tearDown(self):
+        RPIO.cleanup_interrupts()
+
+    def test1_edges(self):
+        received = Received()
+        RPIO.add_interrupt_callbacks([(17, received, 'both'),
+                (18, received, 'rising'), (22, received, 'falling')])
+        for line, value in ((17, 1), (18, 1), (22, 1), (17, 0), (18, 0),
+                (22, 0)):
+            self.sim.set(line, value)
+        events = received.wait(4)
+
+        # 18 only reports rising and 22 only falling edges
+        self.assertEqual([e[:2] for e in events],
+                [(17, 1), (18, 1), (17, 0), (22, 0)])
+        timestamps = [e[2] for e in events]
+        seqnos = [e[3] for e in events]
+        self.assertEqual(timestamps, sorted(timestamps))
+        self.assertEqual(seqnos, sorted(seqnos))
+        self.assertTrue(all(timestamps))
+
+    def test2_batch(self):
+        received = Received()
+        RPIO.add_interrupt_callback(17, received)
+        for i in range(40):
+            self.sim.set(17, (i + 1) & 1)
+
+        # The kernel buffered all edges, which are read in one go
+        events = received.wait(40)
+        self.assertEqual(len(events), 40)
+        self.assertEqual([e[1] for e in events], [(i + 1) & 1 for i in
+                range(40)])
+
+    def test3_wait_for_edge(self):
+        Timer(0.05, self.sim.set, (23, 1)).start()
+        t = time.time()
+        result = RPIO.wait_for_edge(23, edge='rising', timeout=2)
+        self.assertTrue(time.time() - t < 1)
+        self.assertEqual(result[:2], (23, 1))
+        self.assertEqual(RPIO.wait_for_edge(23, timeout=0.05), None)
+
+    def test4_remove(self):
+        received = Received()
+        RPIO.add_interrupt_callbacks([(17, received), (18, received)])
+        RPIO.del_interrupt_callback(17)
+        self.sim.set(17, 1)
+        self.sim.set(18, 1)
+        self.assertEqual([e[:2] for e in received.wait(1)], [(18, 1)])
+
+    def test5_filters(self):
+        received = Received()
+        RPIO.add_interrupt_callbacks([
+                (17, received, 'both', RPIO.PUD_OFF, False, None, 50000),
+                (18, received, 'both', RPIO.PUD_OFF, False, 50)])
+
+        # Bounces on 17 settle on 1 after 50ms; a glitch back to 0 is dropped
+        for value in (1, 0, 1, 0, 1):
+            self.sim.set(17, value)
+        events = received.wait(1, timeout=0.5)
+        self.assertEqual([e[:2] for e in events], [(17, 1)])
+        self.sim.set(17, 0)
+        self.sim.set(17, 1)
+        time.sleep(0.1)
+        self.assertEqual(len(received.wait(2, timeout=0.1)), 1)
+
+        # 18 reports the first edge at once, then the settled level
+        del received.events[:]
+        for value in (1, 0, 1, 0):
+            self.sim.set(18, value)
+        events = received.wait(2, timeout=0.5)
+        self.assertEqual([e[:2] for e in events], [(18, 1), (18, 0)])
+
+    def test6_multiplexed(self):
+        rising, falling, both = Received(), Received(), Received()
+        RPIO.add_interrupt_callbacks([(17, rising, 'rising'),
+                (17, falling, 'falling'),
+                (17, both, 'both', RPIO.PUD_OFF, False, 50)])
+        for value in (1, 0, 1, 0):
+            self.sim.set(17, value)
+
+        # One armed line, demultiplexed per callback; `both` is held off
+        # after the first edge and then reports the settled level
+        both.wait(2, timeout=0.5)
+        self.assertEqual([e[1] for e in rising.events], [1, 1])
+        self.assertEqual([e[1] for e in falling.events], [0, 0])
+        self.assertEqual([e[1] for e in both.events], [1, 0])
+
+        RPIO.remove_interrupt_callback(17, falling)
+        del rising.events[:]
+        self.sim.set(17, 1)
+        self.sim.set(17, 0)
+        self.assertEqual([e[1] for e in rising.wait(1)], [1])
+        self.assertEqual(len(falling.events), 2)
+
+    def test7_counter(self):
+        RPIO.counter_start(22, edge='rising', window_ms=500)
+        for i in range(200):
+            self.sim.set(22, (i + 1) & 1)
+        time.sleep(0.05)
+        rising, falling, frequency, period = RPIO.counter_read(22, reset=True)
+        self.assertEqual((rising, falling), (100, 0))
+        self.assertTrue(frequency > 0 and period > 0)
+        self.assertEqual(RPIO.counter_read(22)[:2], (0, 0))
+        RPIO.counter_stop(22)
+        self.assertRaises(IOError, RPIO.counter_read, 22)
+
+        # With both edges, a period spans a rising and a falling edge
+        RPIO.counter_start(22, edge='both', window_ms=500)
+        for i in range(200):
+            self.sim.set(22, (i + 1) & 1)
+            time.sleep(0.001)
+        time.sleep(0.05)
+        rising, falling, frequency, period = RPIO.counter_read(22)
+        self.assertEqual((rising, falling), (100, 100))
+        self.assertAlmostEqual(frequency * period, 1, delta=0.5)
+        RPIO.counter_stop(22)
+
+        # Lines of the event engine cannot be counted
+        RPIO.add_interrupt_callback(23, lambda gpio, value: None,
+                'both', RPIO.PUD_OFF, False, None, 50000)
+        self.assertRaises(IOError, RPIO.counter_start, 23)
+
+    def test8_subscription(self):
+        RPIO.add_tcp_callback(PORT)
+        RPIO.wait_for_interrupts(threaded=True, epoll_timeout=0.05)
+        client = protocol.Client("127.0.0.1", PORT)
+        try:
+            client.request(protocol.subscribe(1 << 17))
+            for i in range(100):
+                self.sim.set(17, (i + 1) & 1)
+
+            # Edges are streamed by the engine; an empty request collects them
+            t_end = time.time() + 2
+            while len(client.events) < 100 and time.time() < t_end:
+                client.request()
+        finally:
+            client.close()
+            RPIO.stop_waiting_for_interrupts()
+            time.sleep(0.1)
+        self.assertEqual([e[:2] for e in client.events],
+                [(17, (i + 1) & 1) for i in range(100)])
+        seqnos = [e[3] for e in client.events]
+        self.assertEqual(seqnos, sorted(seqnos))
+        self.assertEqual(client.dropped, 0)
+
+    def test9_wait_for_engine_line(self):
+        received = Received()
+        RPIO.add_interrupt_callback(23, received)
+        RPIO.add_interrupt_callback(22, received, edge='rising')
+
+        # 23 is a line of the engine's request: the wait is served from it and
+        # the engine still sees the edge
+        Timer(0.05, self.sim.set, (23, 1)).start()
+        result = RPIO.wait_for_edge([23, 18], edge='rising', timeout=2)
+        self.assertEqual(result[:2], (23, 1))
+        self.assertEqual([e[:2] for e in received.wait(1)], [(23, 1)])
+
+        # 22 is not armed for falling edges
+        self.assertRaises(IOError, RPIO.wait_for_edge, 22, edge='falling',
+                timeout=0.05)
+
+
+if __name__ == '__main__':
+    logging.info("==================================")
+    logging.info("= Test Suite Run with Python %s   =" % \
+            sys.version_info[0])
+    logging.info("==================================")
+    logging.info("")
+    logging.info("")
+    unittest.main()
@@ -0,0 +1,203 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Tests the DMA driven LED strips (RPIO.PWM.LedStrips) against simulated
+hardware (on any Linux box). The simulated DMA records its gpio writes with
+their times, which are decoded back into the bytes the strips receive:
+
+    $ python tests_led.py
+"""
+import os
+import sys
+import random
+import unittest
+import logging
+log_format = '%(levelname)s | %(asctime)-15s | %(message)s'
+logging.basicConfig(format=log_format, level=logging.INFO)
+
+os.environ["RPIO_SIMULATE"] = "1"
+import RPIO
+from RPIO import PWM
+RPIO.setwarnings(False)
+
+PERIOD = PWM.LED_PERIOD_NS
+
+
+def decode(events, gpios):
+    """
+    Returns (bytes received by each strip, start time of each frame). A bit
+    is high for one period if it is 0, for two if it is 1.
+    """
+    widths = dict((gpio, []) for gpio in gpios)
+    high = {}
+    frames = []
+    last = None
+    for t, set_mask, clear_mask in events:
+        if set_mask and (last is None or t - last > 100 * PERIOD):
+            frames.append(t)
+        for gpio in gpios:
+            if set_mask & (1 << gpio):
+                high[gpio] = t
+                last = t
+            elif clear_mask & (1 << gpio) and gpio in high:
+                widths[gpio].append(t - high.pop(gpio))
+    received = []
+    for gpio in gpios:
+        bits = [{PERIOD: 0, 2 * PERIOD: 1}[w] for w in widths[gpio]]
+        data = bytearray()
+        for i in range(0, len(bits), 8):
+            data.append(int("".join(str(b) for b in bits[i:i + 8]), 2))
+        received.append(data)
+    return received, frames
+
+
+def random_pixels(size):
+    return bytearray(random.randint(0, 255) for i in range(size))
+
+
+def wire_order(pixels, strips, leds, order):
+    """ The bytes each strip receives for `pixels` (RGB(W) per LED) """
+    n = len(order)
+    result = []
+    for s in range(strips):
+        data = bytearray()
+        for i in range(leds):
+            led = pixels[(s * leds + i) * n:(s * leds + i + 1) * n]
+            for c in order:
+                data.append(led["RGBW".index(c)])
+        result.append(data)
+    return result
+
+
+class TestLedStrips(unittest.TestCase):
+    def tearDown(self):
+        PWM._PWM.dma_sim_record(0)
+
+    def test1_waveform(self):
+        gpios = [17, 18, 22]
+        strips = PWM.LedStrips(gpios, 5)
+        try:
+            frame1 = random_pixels(strips.frame_bytes())
+            frame2 = random_pixels(strips.frame_bytes())
+            PWM._PWM.dma_sim_record(1)
+            strips.show(frame1)
+            strips.show(frame2)
+            self.assertTrue(strips.wait(1))
+            events = PWM._PWM.dma_sim_events()
+        finally:
+            strips.close()
+
+        received, frames = decode(events, gpios)
+        expected = [a + b for a, b in zip(wire_order(frame1, 3, 5, "GRB"),
+                wire_order(frame2, 3, 5, "GRB"))]
+        self.assertEqual(received, expected)
+
+        # 3 periods per bit, then the reset time which latches the frame
+        self.assertEqual(len(frames), 2)
+        self.assertTrue(frames[1] - frames[0] >= 5 * 24 * 3 * PERIOD + 300000)
+        sets = [e[0] for e in events if e[1]]
+        self.assertEqual(sets[1] - sets[0], 3 * PERIOD)
+
+    def test2_rgbw(self):
+        # 9 strips span two groups of 8
+        gpios = [2, 3, 4, 7, 8, 9, 10, 11, 14]
+        strips = PWM.LedStrips(gpios, 3, dma_channel=12, order="GRBW")
+        try:
+            pixels = random_pixels(strips.frame_bytes())
+            PWM._PWM.dma_sim_record(1)
+            strips.show(pixels)
+            events = PWM._PWM.dma_sim_events()
+        finally:
+            strips.close()
+        received = decode(events, gpios)[0]
+        self.assertEqual(received, wire_order(pixels, 9, 3, "GRBW"))
+
+    def test3_frames(self):
+        strips = PWM.LedStrips([18], 10)
+        try:
+            for i in range(3):
+                strips.show(bytes(bytearray(30)))
+            self.assertTrue(strips.wait())
+            self.assertEqual(strips.frames(), 3)
+        finally:
+            strips.close()
+        self.assertRaises(RuntimeError, strips.frames)
+
+    def test4_errors(self):
+        strips = PWM.LedStrips([18], 10)
+        try:
+            self.assertRaises(ValueError, strips.show, bytearray(29))
+            self.assertRaises(RuntimeError, PWM.LedStrips, [23], 10)
+            self.assertRaises(RuntimeError, PWM.LedStrips, [23], 10, 12,
+                    "GRX")
+            self.assertRaises(RuntimeError, PWM.LedStrips, [23, 23], 10, 12)
+
+            # The pacer runs at one period, which both engines must use
+            self.assertRaises(RuntimeError, PWM.LedStrips, [23], 10, 12,
+                    "GRB", PWM.DELAY_VIA_PCM, 1000)
+            other = PWM.LedStrips([23], 10, 12)
+            other.close()
+        finally:
+            strips.close()
+
+    def test5_encode(self):
+        # 8 strips of 1000 LEDs; the CPU only encodes
+        strips = PWM.LedStrips(range(4, 12), 1000)
+        try:
+            PWM._PWM.stats_reset()
+            strips.show(random_pixels(strips.frame_bytes()))
+            stats = PWM._PWM.stats()
+        finally:
+            strips.close()
+        if RPIO._GPIO.STATS_ENABLED:
+            self.assertEqual(stats["led_encode"]["calls"], 1)
+            self.assertTrue(stats["led_encode"]["max_ns"] < 10000000)
+
+    def test6_pwm_channels(self):
+        # PWM channels and the strips claim their DMA channel alike
+        PWM.setup()
+        PWM.init_channel(13)
+        try:
+            self.assertRaises(RuntimeError, PWM.LedStrips, [23], 10)
+        finally:
+            PWM.free_channel(13)
+        strips = PWM.LedStrips([23], 10)
+        try:
+            self.assertRaises(RuntimeError, PWM.init_channel, 13)
+        finally:
+            strips.close()
+        PWM.init_channel(13)
+        PWM.free_channel(13)
+
+
+if __name__ == '__main__':
+    logging.info("==================================")
+    logging.info("= Test Suite Run with Python %s   =" % \
+            sys.version_info[0])
+    logging.info("==================================")
+    logging.info("")
+    logging.info("")
+    unittest.main()
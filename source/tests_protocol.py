@@ -0,0 +1,163 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Tests the binary protocol servers (RPIO.add_tcp_callback, add_unix_callback
+and add_udp_callback without a callback) over loopback, against simulated
+registers (on any Linux box):
+
+    $ python tests_protocol.py
+"""
+import os
+import sys
+import socket
+import struct
+import tempfile
+import unittest
+import logging
+log_format = '%(levelname)s | %(asctime)-15s | %(message)s'
+logging.basicConfig(format=log_format, level=logging.INFO)
+
+os.environ["RPIO_SIMULATE"] = "1"
+import RPIO
+from RPIO import PWM
+from RPIO import protocol
+RPIO.setwarnings(False)
+
+PORT = 18733
+UNIX_PATH = os.path.join(tempfile.gettempdir(), "rpio-test-%s.sock" % \
+        os.getpid())
+
+
+class TestProtocol(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        PWM.set_loglevel(PWM.LOG_LEVEL_ERRORS)
+        PWM.setup()
+        PWM.init_channel(0)
+        RPIO.add_tcp_callback(PORT)
+        RPIO.add_unix_callback(UNIX_PATH)
+        RPIO.add_unix_callback(UNIX_PATH + "p", seqpacket=True)
+        RPIO.add_udp_callback(PORT)
+        RPIO.wait_for_interrupts(threaded=True, epoll_timeout=0.1)
+
+    @classmethod
+    def tearDownClass(cls):
+        RPIO.stop_waiting_for_interrupts()
+        RPIO.cleanup_interrupts()
+        PWM.cleanup()
+
+    def setUp(self):
+        self.client = protocol.Client("127.0.0.1", PORT)
+
+    def tearDown(self):
+        self.client.close()
+
+    def test1_batch(self):
+        RPIO.setup(17, RPIO.OUT)
+        results = self.client.request(protocol.write_mask(0, 1 << 17),
+                protocol.read_port(0), protocol.read_port(1),
+                protocol.write_mask(0, 0, 1 << 17))
+        self.assertEqual(len(results), 2)
+        self.assertEqual(self.client.request(), [])
+
+    def test2_pipelined(self):
+        seqnos = [self.client.send(protocol.read_port(0)) for i in
+                range(2000)]
+        responses = [self.client.receive() for i in range(2000)]
+        self.assertEqual([r[0] for r in responses], seqnos)
+        self.assertTrue(all(r[1] == protocol.OK and len(r[2]) == 1 for r in
+                responses))
+
+    def test3_split_frames(self):
+        # Frames arrive byte by byte and coalesced with the next one
+        body = struct.pack("<I", 7) + protocol.read_port(0)
+        frame = struct.pack("<I", len(body)) + body
+        for i in range(len(frame)):
+            self.client.socket.sendall(frame[i:i + 1])
+        self.client.socket.sendall(frame + frame)
+        self.assertEqual([self.client.receive()[0] for i in range(3)],
+                [7, 7, 7])
+
+    def test4_errors(self):
+        for command, status in ((protocol.read_port(2), protocol.EINVAL),
+                (b"\x7f", protocol.ECOMMAND),
+                (protocol.write_mask(0)[:5], protocol.ECOMMAND),
+                (protocol.pwm_width(1, 18, 100), protocol.EIO)):
+            try:
+                self.client.request(command)
+            except protocol.ProtocolError as e:
+                self.assertEqual(e.status, status)
+            else:
+                self.fail("no error for %r" % command)
+
+        # Commands before the failing one were executed
+        self.client.send(protocol.read_port(0), protocol.read_port(9),
+                protocol.read_port(0))
+        seqno, status, results = self.client.receive()
+        self.assertEqual((status, len(results)), (protocol.EINVAL, 1))
+
+    def test5_pwm(self):
+        self.client.request(protocol.pwm_width(0, 18, 100),
+                protocol.pwm_width(0, 18, 50), protocol.pwm_width(0, 18, 0))
+
+    def test6_malformed_frame(self):
+        self.client.socket.sendall(struct.pack("<I", protocol.FRAME_MAX + 1))
+        self.assertRaises((IOError, socket.error), self.client.receive)
+
+    def test7_unix(self):
+        for seqpacket, path in ((False, UNIX_PATH), (True, UNIX_PATH + "p")):
+            client = protocol.Client(path, seqpacket=seqpacket)
+            seqnos = [client.send(protocol.write_mask(0, 1 << 22),
+                    protocol.read_port(0)) for i in range(100)]
+            responses = [client.receive() for i in range(100)]
+            client.close()
+            self.assertEqual([r[0] for r in responses], seqnos)
+            self.assertEqual(set((r[1], len(r[2])) for r in responses),
+                    set([(protocol.OK, 1)]))
+
+    def test8_udp(self):
+        client = protocol.DatagramClient("127.0.0.1", PORT)
+        # Fire and forget, then a request which waits for its response
+        for i in range(50):
+            client.send(protocol.write_mask(0, 1 << 23))
+        self.assertEqual(len(client.request(protocol.read_port(0),
+                protocol.read_port(1))), 2)
+        try:
+            client.request(protocol.subscribe(1 << 23))
+            self.fail("datagram clients can't subscribe")
+        except protocol.ProtocolError as e:
+            self.assertEqual(e.status, protocol.EINVAL)
+        client.close()
+
+
+if __name__ == '__main__':
+    logging.info("==================================")
+    logging.info("= Test Suite Run with Python %s   =" % \
+            sys.version_info[0])
+    logging.info("==================================")
+    logging.info("")
+    logging.info("")
+    unittest.main()
@@ -0,0 +1,226 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Tests recording edges into files, reading them back with
+RPIO.recording and replaying them into the event engine, against simulated
+registers (on any Linux box):
+
+    $ python tests_recording.py
+"""
+import os
+import sys
+import time
+import select
+import struct
+import tempfile
+import threading
+import unittest
+import logging
+log_format = '%(levelname)s | %(asctime)-15s | %(message)s'
+logging.basicConfig(format=log_format, level=logging.INFO)
+
+os.environ["RPIO_SIMULATE"] = "1"
+import RPIO
+import RPIO._GPIO as _GPIO
+from RPIO.recording import Recording, RecordingFormatError
+RPIO.setwarnings(False)
+
+T0 = 10 ** 12
+
+
+def edges(count, step_ns=1000):
+    """ count edges on gpios 17, 18, 22 and 23, with a pause every 1500 """
+    result = []
+    t = T0
+    for i in range(count):
+        result.append(((17, 18, 22, 23)[i % 4], (i // 4) & 1, t))
+        t += step_ns + (2 * 10 ** 9 if i % 1500 == 1499 else i % 3)
+    return result
+
+
+def write(path, events):
+    RPIO.record_start(path)
+    for gpio, level, timestamp_ns in events:
+        _GPIO.record_event(gpio, level, timestamp_ns)
+    RPIO.record_stop()
+
+
+def read_engine(count, timeout=2):
+    """ Collects raw edges from the event engine """
+    result = []
+    fd = _GPIO.events_fileno()
+    t_end = time.time() + timeout
+    while len(result) < count and time.time() < t_end:
+        select.select([fd], [], [], 0.05)
+        result.extend(_GPIO.events_read())
+    return result
+
+
+class TestRecording(unittest.TestCase):
+    def setUp(self):
+        fd, self.path = tempfile.mkstemp(prefix="rpio-", suffix=".rec")
+        os.close(fd)
+
+    def tearDown(self):
+        RPIO.replay_stop()
+        os.unlink(self.path)
+
+    def test1_roundtrip(self):
+        events = edges(5000)
+        write(self.path, events)
+        rec = Recording(self.path)
+        self.assertEqual(len(rec), 5000)
+        self.assertTrue(len(rec.blocks) > 4)
+        self.assertEqual([e[:3] for e in rec.events()], events)
+        self.assertEqual([e[3] for e in rec.events()], list(range(5000)))
+        # Compact: a few bytes per edge
+        self.assertTrue(os.path.getsize(self.path) < 5000 * 4)
+        rec.close()
+
+    def test2_seek(self):
+        events = edges(5000)
+        write(self.path, events)
+        rec = Recording(self.path)
+        start, end = events[3210][2], events[4321][2]
+        found = list(rec.events(start, end))
+        self.assertEqual([e[:3] for e in found], events[3210:4321])
+        self.assertEqual(found[0][3], 3210)
+        self.assertEqual(list(rec.events(events[-1][2] + 1)), [])
+
+        # Iterators of one recording are independent
+        it1, it2 = rec.events(), rec.events(start)
+        self.assertEqual([next(it1)[3], next(it2)[3], next(it1)[3]],
+                [0, 3210, 1])
+        rec.close()
+        self.assertRaises(ValueError, list, rec.events())
+
+        with open(self.path, "wb") as f:
+            f.write(b"not a recording")
+        self.assertRaises(RecordingFormatError, Recording, self.path)
+
+    def test3_without_trailer(self):
+        # A recorder which crashed leaves no index and trailer
+        events = edges(3000)
+        write(self.path, events)
+        size = os.path.getsize(self.path)
+        with open(self.path, "r+b") as f:
+            f.truncate(size - 16)
+        rec = Recording(self.path)
+        self.assertEqual([e[:3] for e in rec.events()], events)
+        rec.close()
+
+    def test4_replay(self):
+        events = edges(3000)
+        write(self.path, events)
+        RPIO.replay(self.path, speed=0)
+        self.assertRaises(IOError, RPIO.replay, self.path)
+        received = read_engine(3000)
+        self.assertEqual([e[:2] for e in received], [e[:2] for e in events])
+        timestamps = [e[2] for e in received]
+        self.assertEqual(timestamps, sorted(timestamps))
+        RPIO.replay_stop()
+        self.assertFalse(RPIO.replay_running())
+
+    def test5_replay_pace(self):
+        events = edges(10, step_ns=20 * 10 ** 6)
+        write(self.path, events)
+
+        # From the 6th edge on at twice the speed: 4 * 20ms / 2
+        t = time.time()
+        RPIO.replay(self.path, speed=2, start_ns=events[5][2])
+        received = read_engine(5)
+        elapsed = time.time() - t
+        self.assertEqual([e[:2] for e in received], [e[:2] for e in \
+                events[5:]])
+        self.assertTrue(0.035 < elapsed < 0.5, elapsed)
+        self.assertTrue(received[-1][2] - received[0][2] > 35 * 10 ** 6)
+
+    def test6_flush(self):
+        # The last block is written a second after its first edge, also if
+        # no edge follows (and the recorder then crashes)
+        events = edges(10)
+        RPIO.record_start(self.path)
+        try:
+            for gpio, level, timestamp_ns in events:
+                _GPIO.record_event(gpio, level, timestamp_ns)
+            time.sleep(1.5)
+            rec = Recording(self.path)
+            self.assertEqual([e[:3] for e in rec.events()], events)
+            rec.close()
+        finally:
+            RPIO.record_stop()
+
+    def test7_index_cycle(self):
+        # A corrupt, empty index block pointing back at itself is not
+        # followed; the blocks are walked instead
+        events = edges(100)
+        write(self.path, events)
+        with open(self.path, "r+b") as f:
+            f.seek(-16, os.SEEK_END)
+            last_index = struct.unpack("<Q", f.read(8))[0]
+            f.seek(last_index + 8)
+            f.write(struct.pack("<IIQ", 0, 0, last_index))
+        RPIO.replay(self.path, speed=0)
+        received = read_engine(100)
+        self.assertEqual([e[:2] for e in received], [e[:2] for e in events])
+
+    def test8_replay_empty(self):
+        write(self.path, [])
+        RPIO.replay(self.path, speed=0)
+        t_end = time.time() + 2
+        while RPIO.replay_running() and time.time() < t_end:
+            time.sleep(0.01)
+        self.assertFalse(RPIO.replay_running())
+        self.assertEqual(read_engine(1, timeout=0.1), [])
+
+    def test9_replay_concurrent(self):
+        # Only one of several concurrent replay() calls starts
+        write(self.path, edges(10, step_ns=10 ** 9))
+        results = []
+
+        def start():
+            try:
+                RPIO.replay(self.path)
+                results.append(True)
+            except IOError:
+                results.append(False)
+        threads = [threading.Thread(target=start) for i in range(8)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(sorted(results), [False] * 7 + [True])
+        RPIO.replay_stop()
+
+
+if __name__ == '__main__':
+    logging.info("==================================")
+    logging.info("= Test Suite Run with Python %s   =" % \
+            sys.version_info[0])
+    logging.info("==================================")
+    logging.info("")
+    logging.info("")
+    unittest.main()
@@ -0,0 +1,86 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Tests the real-time profile of RPIO's threads against simulated registers
+(on any Linux box). Without root, applying SCHED_FIFO fails, which is
+counted as `rt_errors`:
+
+    $ python tests_rt.py
+"""
+import os
+import sys
+import time
+import unittest
+import logging
+log_format = '%(levelname)s | %(asctime)-15s | %(message)s'
+logging.basicConfig(format=log_format, level=logging.INFO)
+
+os.environ["RPIO_SIMULATE"] = "1"
+import RPIO
+RPIO.setwarnings(False)
+
+
+def rt_counts():
+    stats = RPIO.stats()
+    return stats["rt_threads"]["calls"], stats["rt_errors"]["calls"]
+
+
+class TestRtProfile(unittest.TestCase):
+    def tearDown(self):
+        RPIO.set_rt_profile('other', lock_memory=False)
+
+    def test1_configure(self):
+        self.assertEqual(RPIO.rt_profile(), None)
+        RPIO.set_rt_profile('rr', 10, cpu=0, lock_memory=False, stack_kb=16)
+        self.assertEqual(RPIO.rt_profile(), ('rr', 10, 0, 0, 16384))
+        self.assertRaises(ValueError, RPIO.set_rt_profile, 'idle')
+        self.assertRaises(IOError, RPIO.set_rt_profile, 'fifo', 100)
+        self.assertRaises(IOError, RPIO.set_rt_profile, cpu=4096)
+
+    def test2_interrupt_thread(self):
+        RPIO.set_rt_profile('fifo', 10, cpu=0, lock_memory=False)
+        threads, errors = rt_counts()
+        RPIO.wait_for_interrupts(threaded=True, epoll_timeout=0.05)
+        time.sleep(0.1)
+        RPIO.stop_waiting_for_interrupts()
+        time.sleep(0.1)
+        self.assertEqual(sum(rt_counts()), threads + errors + 1)
+
+    def test3_page_faults(self):
+        RPIO.stats()
+        buf = bytearray(1 << 22)
+        buf[::4096] = b"\1" * (len(buf) // 4096)
+        self.assertTrue(RPIO.stats()["page_faults"]["calls"] > 0)
+
+
+if __name__ == '__main__':
+    logging.info("==================================")
+    logging.info("= Test Suite Run with Python %s   =" % \
+            sys.version_info[0])
+    logging.info("==================================")
+    logging.info("")
+    logging.info("")
+    unittest.main()
@@ -0,0 +1,171 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Tests the DMA driven serial output (RPIO.PWM.ShiftOut) against simulated
+hardware (on any Linux box). The gpio writes of the simulated DMA are
+replayed, and the data lines sampled at each rising clock edge as a shift
+register would:
+
+    $ python tests_shift.py
+"""
+import os
+import sys
+import random
+import unittest
+import logging
+log_format = '%(levelname)s | %(asctime)-15s | %(message)s'
+logging.basicConfig(format=log_format, level=logging.INFO)
+
+os.environ["RPIO_SIMULATE"] = "1"
+import RPIO
+from RPIO import PWM
+RPIO.setwarnings(False)
+
+PERIOD = PWM.SHIFT_PERIOD_NS
+
+
+def to_bytes(bits, lsb_first=False):
+    data = bytearray()
+    for i in range(0, len(bits), 8):
+        byte = bits[i:i + 8]
+        if lsb_first:
+            byte.reverse()
+        data.append(int("".join(str(b) for b in byte), 2))
+    return data
+
+
+def decode(events, clock, data, latch=None, lsb_first=False):
+    """
+    Replays the recorded gpio writes. Returns the bytes received on each data
+    line per latch pulse (all bytes as one frame without latch), and the
+    times of the rising clock edges.
+    """
+    level = 0
+    bits = [[] for gpio in data]
+    frames = []
+    rising = []
+    for t, set_mask, clear_mask in events:
+        edges = (level | set_mask) & ~level
+        level = (level | set_mask) & ~clear_mask
+        if edges & (1 << clock):
+            rising.append(t)
+            for i, gpio in enumerate(data):
+                bits[i].append(level >> gpio & 1)
+        if latch is not None and edges & (1 << latch):
+            frames.append([to_bytes(b, lsb_first) for b in bits])
+            bits = [[] for gpio in data]
+    if latch is None:
+        frames.append([to_bytes(b, lsb_first) for b in bits])
+    return frames, rising
+
+
+def random_bytes(size):
+    return bytearray(random.randint(0, 255) for i in range(size))
+
+
+def per_line(data, lines, nbytes):
+    return [data[i * nbytes:(i + 1) * nbytes] for i in range(lines)]
+
+
+class TestShiftOut(unittest.TestCase):
+    def tearDown(self):
+        PWM._PWM.dma_sim_record(0)
+
+    def test1_shift_registers(self):
+        # Two chains of 3 registers, sharing clock and latch
+        shift = PWM.ShiftOut(11, [10, 9], 3, latch=8)
+        try:
+            frame1 = random_bytes(shift.frame_bytes())
+            frame2 = random_bytes(shift.frame_bytes())
+            PWM._PWM.dma_sim_record(1)
+            shift.write(frame1)
+            shift.write(frame2)
+            self.assertTrue(shift.wait(1))
+            self.assertEqual(shift.frames(), 2)
+            events = PWM._PWM.dma_sim_events()
+        finally:
+            shift.close()
+
+        frames, rising = decode(events, 11, [10, 9], 8)
+        self.assertEqual(frames, [per_line(frame1, 2, 3),
+                per_line(frame2, 2, 3)])
+
+        # Two periods per bit
+        self.assertEqual(len(rising), 2 * 3 * 8)
+        self.assertEqual(rising[1] - rising[0], 2 * PERIOD)
+
+    def test2_lsb_first(self):
+        shift = PWM.ShiftOut(17, 27, 4, lsb_first=True)
+        try:
+            data = random_bytes(4)
+            PWM._PWM.dma_sim_record(1)
+            shift.write(data)
+            events = PWM._PWM.dma_sim_events()
+        finally:
+            shift.close()
+        frames = decode(events, 17, [27], lsb_first=True)[0]
+        self.assertEqual(frames, [[data]])
+
+    def test3_many_lines(self):
+        # 12 data lines span two groups of 8
+        data_gpios = [2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 14, 15]
+        shift = PWM.ShiftOut(17, data_gpios, 5, latch=18)
+        try:
+            data = random_bytes(shift.frame_bytes())
+            PWM._PWM.dma_sim_record(1)
+            shift.write(data)
+            events = PWM._PWM.dma_sim_events()
+        finally:
+            shift.close()
+        frames = decode(events, 17, data_gpios, 18)[0]
+        self.assertEqual(frames, [per_line(data, 12, 5)])
+
+    def test4_errors(self):
+        self.assertRaises(RuntimeError, PWM.ShiftOut, 11, [10, 11], 1)
+        self.assertRaises(RuntimeError, PWM.ShiftOut, 11, [10], 1, 10)
+        shift = PWM.ShiftOut(11, [10], 2)
+        try:
+            self.assertRaises(ValueError, shift.write, bytearray(3))
+            self.assertRaises(RuntimeError, PWM.ShiftOut, 17, [27], 1)
+
+            # The pacer is shared with LED strips at the same period only
+            self.assertRaises(RuntimeError, PWM.LedStrips, [18], 1, 13,
+                    "GRB", PWM.DELAY_VIA_PCM, 500)
+            strips = PWM.LedStrips([18], 1, 13)
+            strips.close()
+        finally:
+            shift.close()
+        self.assertRaises(RuntimeError, shift.frames)
+
+
+if __name__ == '__main__':
+    logging.info("==================================")
+    logging.info("= Test Suite Run with Python %s   =" % \
+            sys.version_info[0])
+    logging.info("==================================")
+    logging.info("")
+    logging.info("")
+    unittest.main()
@@ -0,0 +1,188 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Tests the stepper motion engine (RPIO.PWM.Steppers) against simulated
+hardware (on any Linux box). The gpio writes of the simulated DMA are
+replayed into the step times and directions of each axis:
+
+    $ python tests_stepper.py
+"""
+import os
+import sys
+import math
+import unittest
+import logging
+log_format = '%(levelname)s | %(asctime)-15s | %(message)s'
+logging.basicConfig(format=log_format, level=logging.INFO)
+
+os.environ["RPIO_SIMULATE"] = "1"
+import RPIO
+from RPIO import PWM
+RPIO.setwarnings(False)
+
+TICK = PWM.STEPPER_TICK_NS
+STEP = [17, 27]
+DIR = [22, 23]
+
+
+def decode(events, step=STEP, dir=DIR):
+    """
+    Replays the recorded gpio writes. Returns the times of the rising step
+    edges per axis, with the level of the axis' direction gpio then.
+    """
+    level = 0
+    steps = [[] for gpio in step]
+    for t, set_mask, clear_mask in events:
+        edges = (level | set_mask) & ~level
+        level = (level | set_mask) & ~clear_mask
+        for axis, gpio in enumerate(step):
+            if edges & (1 << gpio):
+                steps[axis].append((t, level >> dir[axis] & 1))
+    return steps
+
+
+def intervals(times):
+    return [b - a for a, b in zip(times, times[1:])]
+
+
+class TestSteppers(unittest.TestCase):
+    def setUp(self):
+        self.steppers = PWM.Steppers(STEP, DIR)
+        PWM._PWM.dma_sim_record(1)
+
+    def tearDown(self):
+        PWM._PWM.dma_sim_record(0)
+        self.steppers.close()
+
+    def test1_trapezoid(self):
+        # 250 steps to accelerate to 10000 steps/s, 500 at that velocity
+        self.steppers.move([1000, 0], 10000, 200000)
+        self.assertTrue(self.steppers.wait())
+        steps = decode(PWM._PWM.dma_sim_events())
+        self.assertEqual(len(steps[0]), 1000)
+        self.assertEqual(steps[1], [])
+        self.assertTrue(all(level for t, level in steps[0]))
+
+        times = [t for t, level in steps[0]]
+        self.assertTrue(min(intervals(times)) >= 100000 - TICK)
+        cruise = intervals(times[300:700])
+        self.assertTrue(max(cruise) - min(cruise) <= TICK)
+        self.assertTrue(abs(times[-1] - times[0] -
+                (0.15 - math.sqrt(2 / 200000.)) * 1e9) < 2 * TICK)
+
+        # Accelerating at 200000 steps/s^2
+        self.assertTrue(abs(times[99] - times[0] -
+                (math.sqrt(2 * 100 / 200000.) - math.sqrt(2 / 200000.)) * 1e9)
+                < 2 * TICK)
+        self.assertEqual(self.steppers.position(), [1000, 0])
+
+    def test2_axes(self):
+        self.steppers.move([300, -200], [5000, 8000], 100000)
+        self.steppers.move([-300, 200], 5000, 100000)
+        self.assertTrue(self.steppers.wait())
+        steps = decode(PWM._PWM.dma_sim_events())
+        self.assertEqual([level for t, level in steps[0]],
+                [1] * 300 + [0] * 300)
+        self.assertEqual([level for t, level in steps[1]],
+                [0] * 200 + [1] * 200)
+
+        # Both axes start together; the next move waits for the slower one
+        self.assertTrue(abs(steps[0][0][0] - steps[1][0][0]) < 1e5)
+        self.assertTrue(steps[1][200][0] > steps[0][299][0])
+        self.assertEqual(self.steppers.position(), [0, 0])
+
+    def test3_s_curve(self):
+        self.steppers.move([2000, 2000], 20000, 200000, [0, 10000000])
+        self.assertTrue(self.steppers.wait())
+        steps = decode(PWM._PWM.dma_sim_events())
+        trapezoid, s_curve = [[t for t, level in s] for s in steps]
+        self.assertEqual(len(s_curve), 2000)
+
+        # The S-curve starts gentler and takes longer
+        self.assertTrue(s_curve[10] - s_curve[0] > trapezoid[10] - trapezoid[0])
+        self.assertTrue(s_curve[-1] > trapezoid[-1])
+        self.assertTrue(abs(s_curve[0] - trapezoid[0] -
+                (math.pow(6 / 10000000., 1 / 3.) - math.sqrt(2 / 200000.)) * 1e9)
+                < 2 * TICK)
+        accel = intervals(s_curve[:300])
+        self.assertTrue(all(b <= a + TICK for a, b in zip(accel, accel[1:])))
+        self.assertTrue(min(intervals(s_curve)) >= 50000 - TICK)
+
+    def test4_long_move(self):
+        # Far more control blocks than the segment ring holds
+        self.steppers.move([200000, -50000], 100000, 1000000)
+        self.assertTrue(self.steppers.wait())
+        steps = decode(PWM._PWM.dma_sim_events())
+        self.assertEqual([len(s) for s in steps], [200000, 50000])
+        self.assertTrue(min(intervals([t for t, level in steps[0]])) >=
+                10000 - TICK)
+        self.assertEqual(self.steppers.position(), [200000, -50000])
+
+    def test5_stop(self):
+        self.steppers.move([500, 500], 10000, 100000)
+        self.steppers.wait()
+        self.steppers.stop()
+        self.assertEqual(self.steppers.position(), [500, 500])
+
+        # Stopped within a move, the position is where the steps stopped
+        self.steppers.move([100000, 0], 100000, 1000000)
+        self.steppers.stop()
+        position = self.steppers.position()
+        self.assertTrue(500 <= position[0] <= 100500)
+        self.steppers.move([-100, 10], 10000, 100000)
+        self.assertTrue(self.steppers.wait())
+        self.assertEqual(self.steppers.position(),
+                [position[0] - 100, 510])
+        steps = decode(PWM._PWM.dma_sim_events())
+        self.assertEqual(len(steps[1]), 510)
+
+    def test6_errors(self):
+        self.assertRaises(RuntimeError, self.steppers.move, 10, 300000, 1000)
+        self.assertRaises(RuntimeError, self.steppers.move, 10, 1000, 0)
+        self.assertRaises(ValueError, self.steppers.move, [1, 2, 3], 1000, 100)
+        self.assertRaises(RuntimeError, PWM.Steppers, [4, 4], [5, 6], 10)
+        self.assertRaises(RuntimeError, PWM.Steppers, [4], [5], 11)
+        self.steppers.move(0, 0, 0)
+        self.assertTrue(self.steppers.wait(1))
+        self.assertEqual(self.steppers.position(), [0, 0])
+
+        # Without direction gpio
+        steppers = PWM.Steppers(4, dma_channel=10)
+        steppers.move(-5, 1000, 10000)
+        self.assertTrue(steppers.wait())
+        self.assertEqual(steppers.position(), [-5])
+        steppers.close()
+        self.assertRaises(RuntimeError, steppers.position)
+
+
+if __name__ == '__main__':
+    logging.info("==================================")
+    logging.info("= Test Suite Run with Python %s   =" % \
+            sys.version_info[0])
+    logging.info("==================================")
+    logging.info("")
+    logging.info("")
+    unittest.main()
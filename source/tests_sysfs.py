@@ -0,0 +1,258 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Tests RPIO's sysfs interrupt setup against a fake /sys/class/gpio tree. Runs
+anywhere (the registers are simulated), no Raspberry Pi or root needed.
+
+`export` and `unexport` are FIFOs served by a fake udev thread, which
+creates and removes the gpioN directories like the kernel does. Gpios with
+input filters are handled by the C event engine, whose epoll cannot watch
+the fake value files; tests_gpiochip.py covers them.
+"""
+import os
+import sys
+import time
+import errno
+import shutil
+import tempfile
+import unittest
+from threading import Thread
+import logging
+log_format = '%(levelname)s | %(asctime)-15s | %(message)s'
+logging.basicConfig(format=log_format, level=logging.INFO)
+
+os.environ["RPIO_SIMULATE"] = "1"
+import RPIO
+from RPIO.Exceptions import InvalidChannelException
+RPIO.setwarnings(False)
+
+GPIOS = (2, 3, 4, 7, 8, 9, 10, 11, 14, 15, 17, 18, 22, 23, 24, 25, 27)
+
+
+class FakeEpoll(object):
+    """ epoll cannot watch regular files, so only record registrations """
+    def __init__(self):
+        self.registered = set()
+
+    def register(self, fileno, eventmask):
+        self.registered.add(fileno)
+
+    def unregister(self, fileno):
+        self.registered.remove(fileno)
+
+
+class FakeSysfs(object):
+    def __init__(self):
+        self.root = tempfile.mkdtemp(prefix="rpio-sysfs-")
+        self.exports = []
+        self.unexports = []
+        self.delay = 0     # seconds the fake udev takes per export
+        self.threads = []
+        for name in ("export", "unexport"):
+            os.mkfifo(os.path.join(self.root, name))
+            t = Thread(target=self._serve, args=(name,))
+            t.daemon = True
+            t.start()
+            self.threads.append(t)
+
+    def path(self, gpio, attr):
+        return os.path.join(self.root, "gpio%s" % gpio, attr)
+
+    def create(self, gpio, direction="out", edge="none", value="0"):
+        # Build the directory aside and move it in place, so it appears
+        # complete like the kernel's
+        tmp = tempfile.mkdtemp(dir=self.root)
+        for attr, content in (("direction", direction), ("edge", edge),
+                ("value", value)):
+            with open(os.path.join(tmp, attr), "w") as f:
+                f.write(content + "\n")
+        os.rename(tmp, os.path.join(self.root, "gpio%s" % gpio))
+
+    def read(self, gpio, attr):
+        with open(self.path(gpio, attr)) as f:
+            return f.read().strip()
+
+    def _serve(self, name):
+        while True:
+            fd = os.open(os.path.join(self.root, name), os.O_RDONLY)
+            while True:
+                data = os.read(fd, 64)
+                if not data:
+                    break
+                for gpio in data.decode().split():
+                    if gpio == "stop":
+                        os.close(fd)
+                        return
+                    if name == "export":
+                        self.exports.append(int(gpio))
+                        time.sleep(self.delay)
+                        self.create(gpio)
+                    else:
+                        self.unexports.append(int(gpio))
+                        shutil.rmtree(os.path.join(self.root, "gpio" + gpio))
+            os.close(fd)
+
+    def close(self):
+        for name in ("export", "unexport"):
+            with open(os.path.join(self.root, name), "w") as f:
+                f.write("\nstop\n")
+        for t in self.threads:
+            t.join(1)
+        shutil.rmtree(self.root)
+
+    def wait_unexported(self, count, timeout=1):
+        """ unexport writes are not synchronous; wait for the fake udev """
+        t_end = time.time() + timeout
+        while len(self.unexports) < count and time.time() < t_end:
+            time.sleep(0.001)
+        return sorted(self.unexports)
+
+
+def callback(gpio_id, value):
+    pass
+
+
+class TestSysfsSetup(unittest.TestCase):
+    def setUp(self):
+        self.sysfs = FakeSysfs()
+        RPIO.set_sysfs_root(self.sysfs.root)
+        self.epoll = RPIO._rpio._epoll = FakeEpoll()
+
+    def tearDown(self):
+        RPIO.cleanup()
+        self.sysfs.close()
+
+    def test1_batch_export(self):
+        t = time.time()
+        RPIO.add_interrupt_callbacks([(gpio, callback, 'rising') for \
+                gpio in GPIOS])
+        logging.info("- %s gpios exported and configured in %.1f ms", \
+                len(GPIOS), (time.time() - t) * 1000)
+        self.assertEqual(sorted(self.sysfs.exports), sorted(GPIOS))
+        for gpio in GPIOS:
+            self.assertEqual(self.sysfs.read(gpio, "direction"), "in")
+            self.assertEqual(self.sysfs.read(gpio, "edge"), "rising")
+        self.assertEqual(len(self.epoll.registered), len(GPIOS))
+
+        # Only the interfaces exported by RPIO are removed again
+        RPIO.cleanup_interrupts()
+        self.assertEqual(self.sysfs.wait_unexported(len(GPIOS)), sorted(GPIOS))
+        self.assertEqual(len(self.epoll.registered), 0)
+
+    def test2_reuse_exported(self):
+        for gpio in GPIOS:
+            self.sysfs.create(gpio, "in", "both")
+            os.utime(self.sysfs.path(gpio, "edge"), (0, 0))
+
+        t = time.time()
+        RPIO.add_interrupt_callbacks([(gpio, callback) for gpio in GPIOS])
+        logging.info("- %s exported gpios reused in %.1f ms", len(GPIOS), \
+                (time.time() - t) * 1000)
+        self.assertEqual(self.sysfs.exports, [])
+        for gpio in GPIOS:
+            # Matching configuration is not written again
+            self.assertEqual(os.stat(self.sysfs.path(gpio, "edge")).st_mtime, 0)
+
+        RPIO.cleanup_interrupts()
+        self.assertEqual(self.sysfs.unexports, [])
+        self.assertEqual(len(self.epoll.registered), 0)
+
+    def test3_reconfigure_exported(self):
+        self.sysfs.create(17, "out", "none")
+        RPIO.add_interrupt_callback(17, callback, edge='falling')
+        self.assertEqual(self.sysfs.exports, [])
+        self.assertEqual(self.sysfs.read(17, "direction"), "in")
+        self.assertEqual(self.sysfs.read(17, "edge"), "falling")
+
+    def test4_callbacks(self):
+        RPIO.add_interrupt_callbacks([(17, callback), (17, callback),
+                (18, callback, 'falling', RPIO.PUD_UP, False)])
+        self.assertEqual(sorted(self.sysfs.exports), [17, 18])
+        self.assertEqual(len(RPIO._rpio._map_gpioid_to_callbacks[17]), 2)
+
+        # Callbacks for different edges go to the event engine (which cannot
+        # poll the fake tree, see tests_gpiochip.py); invalid ones raise
+        with self.assertRaises(AttributeError):
+            RPIO.add_interrupt_callbacks([(22, callback, 'rising'),
+                    (22, callback, 'up')])
+        self.assertEqual(sorted(self.sysfs.exports), [17, 18])
+
+    def test5_wait_for_edge_timeout(self):
+        self.assertEqual(RPIO.wait_for_edge([17, 18], timeout=0.05), None)
+        self.assertRaises(InvalidChannelException, RPIO.wait_for_edge,
+                list(range(55)), timeout=0.05)
+        self.assertEqual(sorted(self.sysfs.exports), [17, 18])
+        self.assertEqual(self.sysfs.read(18, "edge"), "both")
+
+    def test6_failed_setup_unexports(self):
+        # 18 is exported already but its edge cannot be configured
+        self.sysfs.create(18, "in")
+        os.remove(self.sysfs.path(18, "edge"))
+        os.mkdir(self.sysfs.path(18, "edge"))
+        with self.assertRaises(IOError):
+            RPIO.add_interrupt_callbacks([(17, callback), (18, callback)])
+
+        # Only the gpio exported by the failed call is unexported
+        self.assertEqual(self.sysfs.exports, [17])
+        self.assertEqual(self.sysfs.wait_unexported(1), [17])
+        self.assertEqual(len(self.epoll.registered), 0)
+
+    def test7_counter_setup(self):
+        errors = []
+
+        def start():
+            try:
+                RPIO.counter_start(17, edge='both')
+            except IOError as e:
+                errors.append(e.errno)
+
+        self.sysfs.delay = 0.3
+        thread = Thread(target=start)
+        thread.start()
+        time.sleep(0.05)
+
+        # Counters are not locked while the setup waits for udev
+        t = time.time()
+        self.assertRaises(IOError, RPIO.counter_read, 18)
+        self.assertTrue(time.time() - t < 0.1)
+        thread.join()
+
+        # The gpio was configured, but epoll cannot watch the fake value
+        # file: the counter does not start and 17 is unexported again
+        self.assertEqual(self.sysfs.exports, [17])
+        self.assertEqual(errors, [errno.EPERM])
+        self.assertEqual(self.sysfs.wait_unexported(1), [17])
+        self.assertRaises(IOError, RPIO.counter_read, 17)
+
+
+if __name__ == '__main__':
+    logging.info("==================================")
+    logging.info("= Test Suite Run with Python %s   =" % \
+            sys.version_info[0])
+    logging.info("==================================")
+    logging.info("")
+    logging.info("")
+    unittest.main()
@@ -0,0 +1,168 @@
+# -*- coding: utf-8 -*-
+#
+# This file is part of RPIO.
+#
+# Copyright
+#
+#     Copyright (C) 2013 Chris Hager <chris@linuxuser.at>
+#
+# License
+#
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU Lesser General Public License as published
+#     by the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+#
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU Lesser General Public License for more details at
+#     <http://www.gnu.org/licenses/lgpl-3.0-standalone.html>
+#
+# Documentation
+#
+#     http://pythonhosted.org/RPIO
+#
+"""
+Tests the executor of timed GPIO schedules against simulated registers (on
+any Linux box). The clock is virtual, so every operation runs exactly on
+time:
+
+    $ python tests_timed.py
+"""
+import os
+import sys
+import time
+import errno
+import unittest
+from threading import Thread
+import logging
+log_format = '%(levelname)s | %(asctime)-15s | %(message)s'
+logging.basicConfig(format=log_format, level=logging.INFO)
+
+os.environ["RPIO_SIMULATE"] = "1"
+import RPIO
+RPIO.setwarnings(False)
+
+
+def square_wave(gpio, period_us, cycles):
+    """ Schedule of `cycles` periods on `gpio`, reading the levels in each """
+    schedule = []
+    for i in range(cycles):
+        t = i * period_us
+        schedule.append((t, RPIO.TIMED_WRITE, 1 << gpio, 0))
+        schedule.append((t + period_us // 4, RPIO.TIMED_READ))
+        schedule.append((t + period_us // 2, RPIO.TIMED_WRITE, 0, 1 << gpio))
+    schedule.append((cycles * period_us, RPIO.TIMED_WAIT))
+    return schedule
+
+
+class TestTimed(unittest.TestCase):
+    def setUp(self):
+        RPIO.setup(17, RPIO.OUT)
+
+    def tearDown(self):
+        RPIO.cleanup()
+
+    def test1_callback(self):
+        results = []
+        schedule = square_wave(17, 1000, 50)
+        schedule_id = RPIO.timed_submit(schedule,
+                lambda *result: results.append(result))
+        for i in range(100):
+            if results:
+                break
+            RPIO.poll_interrupts(0.05)
+        self.assertEqual(len(results), 1)
+        result_id, status, start_us, late_us, reads = results[0]
+        self.assertEqual((result_id, status), (schedule_id, 0))
+        self.assertEqual(len(late_us), len(schedule))
+        self.assertEqual(len(reads), 50)
+        self.assertEqual(late_us, [0] * len(schedule))
+        self.assertTrue(RPIO.now_us() >= start_us + 50000)
+
+    def test2_wait(self):
+        start_us = RPIO.now_us() + 5000
+        first = RPIO.timed_submit([(0, RPIO.TIMED_READ)], start_us=start_us)
+        second = RPIO.timed_submit(square_wave(17, 100, 3))
+
+        # Results are kept per schedule until they are fetched
+        result = RPIO.timed_wait(second, timeout=5)
+        self.assertEqual((result[0], result[1]), (second, 0))
+        result = RPIO.timed_wait(first, timeout=5)
+        self.assertEqual(result[:3], (first, 0, start_us))
+        self.assertEqual(len(result[4]), 1)
+        self.assertEqual(RPIO.timed_wait(first, timeout=0.1), None)
+        self.assertTrue(RPIO.stats()["timed_lateness"]["calls"] >= 11)
+
+    def test3_invalid(self):
+        self.assertRaises(ValueError, RPIO.timed_submit, [])
+        self.assertRaises(ValueError, RPIO.timed_submit, [(0, 7)])
+        self.assertRaises(ValueError, RPIO.timed_submit, [(0, "write")])
+        self.assertRaises(ValueError, RPIO.timed_submit, [(-1, RPIO.TIMED_WAIT)])
+        schedule_id = RPIO.timed_submit([(0, RPIO.TIMED_WAIT)], lambda *r: 0)
+        self.assertRaises(ValueError, RPIO.timed_wait, schedule_id)
+
+    def test4_stop(self):
+        # A schedule waiting for a start far in the future is cancelled
+        RPIO.timed_start(cpu=0)
+        RPIO.timed_stop()
+        schedule_id = RPIO.timed_submit([(0, RPIO.TIMED_WAIT)],
+                start_us=RPIO.now_us() + 10 ** 6)
+        RPIO.timed_stop()
+        result = RPIO.timed_wait(schedule_id, timeout=1)
+        self.assertTrue(result[1] in (0, errno.ECANCELED))
+
+    def test5_stop_while_submitting(self):
+        fds = len(os.listdir("/proc/self/fd"))
+        ids = []
+
+        def submit():
+            for i in range(20):
+                ids.append(RPIO.timed_submit([(100, RPIO.TIMED_WAIT)]))
+
+        threads = [Thread(target=submit) for i in range(4)]
+        for t in threads:
+            t.start()
+        for i in range(10):
+            RPIO.timed_stop()
+        for t in threads:
+            t.join()
+        RPIO.timed_stop()
+
+        # Every schedule ran or was cancelled, and the eventfds are closed
+        for schedule_id in ids:
+            result = RPIO.timed_wait(schedule_id, timeout=1)
+            self.assertTrue(result[1] in (0, errno.ECANCELED))
+        self.assertEqual(len(os.listdir("/proc/self/fd")), fds)
+
+    def test6_virtual_clock(self):
+        # The clock only advances by the delays, also from several threads
+        t = RPIO.now_us()
+        time.sleep(0.01)
+        self.assertEqual(RPIO.now_us(), t)
+        RPIO.delay_us(10)
+        RPIO.delay_ns(600)
+        RPIO.delay_ns(400)
+        self.assertEqual(RPIO.now_us(), t + 11)
+
+        def sleep():
+            for i in range(1000):
+                RPIO.sleep_us(3)
+
+        threads = [Thread(target=sleep) for i in range(8)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(RPIO.now_us(), t + 11 + 8 * 1000 * 3)
+
+
+if __name__ == '__main__':
+    logging.info("==================================")
+    logging.info("= Test Suite Run with Python %s   =" % \
+            sys.version_info[0])
+    logging.info("==================================")
+    logging.info("")
+    logging.info("")
+    unittest.main()